@@ -31,7 +31,10 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #include "include/rectangle.h"
 #include "include/snr.h"
 #include "include/edge_model.h"
+#include "include/edge_store.h"
+#include "include/sampling_rate.h"
 #include <memory>
+#include <array>
 
 #include <map>
 using std::map;
@@ -42,18 +45,15 @@ class Block {
   public:
     typedef enum {TOP, LEFT, RIGHT, BOTTOM} edge_position;    
 
-    Block(void) : rect(Mrectangle()), mtf50(4,0.0), quality(4, 0.0), 
-        sfr(4), esf(4), centroid(0,0), area(0.0), valid(true), 
-        line_deviation(4, cv::Point3d(0,0,1)), snr(4), scansets(4), 
-        chromatic_aberration(4, cv::Point2d(Edge_info::nodata, Edge_info::nodata)), 
-        edge_model(4), valid_edge(4, false), edge_length(4, 0.0) {
+    Block(void) : rect(Mrectangle()), centroid(0,0), area(0.0), valid(true) {
+        init_edges();
     }
 
-    Block(const Mrectangle& in_rect) : rect(in_rect), mtf50(4,0.0), 
-        quality(4, 0.0), sfr(4), esf(4), centroid(0,0), area(0.0), valid(true), 
-        line_deviation(in_rect.line_deviation), snr(4), scansets(4), 
-        chromatic_aberration(4, cv::Point2d(Edge_info::nodata, Edge_info::nodata)),
-        edge_model(4), valid_edge(4, false), edge_length(4, 0.0) {
+    Block(const Mrectangle& in_rect) : rect(in_rect), centroid(0,0), area(0.0), valid(true) {
+        init_edges();
+        for (size_t k=0; k < 4 && k < in_rect.line_deviation.size(); k++) {
+            line_deviation[k] = in_rect.line_deviation[k];
+        }
     
         size_t top_edge_idx = 0;
         size_t bot_edge_idx = 0;
@@ -115,23 +115,32 @@ class Block {
     }
 
     void set_sfr(size_t edge_number, const vector<double>& in_sfr) {
-        sfr[edge_number] = std::shared_ptr<vector<double>>(new vector<double>(in_sfr));
+        sfr[edge_number] = edge_store()->add_array(in_sfr);
     }
     
-    const vector<double>& get_sfr(size_t edge_number) const {
-        return *sfr[edge_number];
+    // edges without a stored SFR (or ESF) read as all zeros
+    Edge_store::Span get_sfr(size_t edge_number) const {
+        return lookup(sfr[edge_number], NYQUIST_FREQ*2);
     }
     
     void set_esf(size_t edge_number, const vector<double>& in_esf) {
-        esf[edge_number] = std::shared_ptr<vector<double>>(new vector<double>(in_esf));
+        esf[edge_number] = edge_store()->add_array(in_esf);
     }
 
-    const vector<double>& get_esf(size_t edge_number) const {
-        return *esf[edge_number];
+    Edge_store::Span get_esf(size_t edge_number) const {
+        return lookup(esf[edge_number], FFT_SIZE/2);
     }
     
+    // empty unless the edge models were retained, see Mtf_core::set_retain_edge_geometry()
     const vector<Point2d>& get_ridge(size_t edge_number) const {
-        return edge_model[edge_number]->ridge;
+        static const vector<Point2d> no_ridge;
+        return edge_model[edge_number] ? edge_model[edge_number]->ridge : no_ridge;
+    }
+    
+    // results are stored in (and shared through) this arena; a block without
+    // one creates its own on first use
+    void attach_store(const std::shared_ptr<Edge_store>& s) {
+        store = s;
     }
 
     void set_normal(size_t edge_number, const Point2d& rgrad) {
@@ -163,8 +172,7 @@ class Block {
     }
     
     Point2d get_edge_centroid(edge_position ep) const {
-        map<edge_position, size_t>::const_iterator it = edge_lut.find(ep);
-        return rect.centroids[it->second];
+        return rect.centroids[edge_lut[ep]];
     }
     
     // quality of 1.0 means good quality, 0.0 means unusably poor
@@ -180,14 +188,27 @@ class Block {
     }
     
     double get_mtf50_value(edge_position ep) const {
-        map<edge_position, size_t>::const_iterator it = edge_lut.find(ep);
-        return get_mtf50_value(it->second);
+        return get_mtf50_value(edge_lut[ep]);
     }
     
     Point2d get_centroid(void) const {
         return centroid;
     }
     
+    // moves the block by offset, e.g., from a decoded region back into the input image;
+    // retained edge models (see Mtf_core::set_retain_edge_geometry()) are not moved
+    void translate(const Point2d& offset) {
+        for (auto& c: rect.centroids) {
+            c += offset;
+        }
+        for (auto& c: rect.corners) {
+            c += offset;
+        }
+        rect.tl += offset;
+        rect.br += offset;
+        centroid += offset;
+    }
+    
     double get_area(void) const {
         return area;
     }
@@ -197,13 +218,11 @@ class Block {
     }
     
     double get_quality(edge_position ep) const {
-        map<edge_position, size_t>::const_iterator it = edge_lut.find(ep);
-        return quality[it->second];
+        return quality[edge_lut[ep]];
     }
     
     int get_edge_index(edge_position ep) const {
-        map<edge_position, size_t>::const_iterator it = edge_lut.find(ep);
-        return it->second;
+        return int(edge_lut[ep]);
     }
     
     cv::Point3d get_line_deviation(size_t edge_number) const {
@@ -218,12 +237,13 @@ class Block {
     
     void set_scanset(size_t edge_number, const map<int, scanline>& scanset) {
         assert(edge_number < 4);
-        scansets[edge_number] = std::shared_ptr<map<int, scanline>>(new map<int, scanline>(scanset));
+        scansets[edge_number] = edge_store()->add_scanset(scanset);
     }
     
-    const map<int, scanline>& get_scanset(size_t edge_number) const {
+    // rebuilt from the compact copy in the store; empty if it was not retained
+    map<int, scanline> get_scanset(size_t edge_number) const {
         assert(edge_number < 4);
-        return *scansets[edge_number];
+        return store ? store->scanset(scansets[edge_number]) : map<int, scanline>();
     }
     
     void set_ca(size_t edge_number, Point2d ca) {
@@ -266,48 +286,163 @@ class Block {
         edge_length[edge_number] = length;
     }
 
+    // MTF values at the extra contrast levels, see Mtf_core::set_extra_mtf_contrasts()
+    void set_mtf_levels(size_t edge_number, const vector<double>& values) {
+        assert(edge_number < 4);
+        mtf_levels[edge_number] = values;
+    }
+    
+    double get_mtf_level(size_t edge_number, size_t level) const {
+        assert(edge_number < 4);
+        return level < mtf_levels[edge_number].size() ? mtf_levels[edge_number][level] : 1.0;
+    }
+    
+    // a copy of this block with the primary MTF values replaced by those 
+    // of the specified contrast level
+    Block level_view(size_t level) const {
+        Block view(*this);
+        for (size_t k=0; k < 4; k++) {
+            view.mtf50[k] = get_mtf_level(k, level);
+        }
+        return view;
+    }
+    
+    // results measured on the same edge for an additional Bayer subset, 
+    // see Mtf_core::set_extra_bayer_subsets()
+    void set_channel_result(size_t channel, size_t edge_number, double mtf50_value, double quality_value,
+        const vector<double>& in_sfr, const vector<double>& in_esf, const Snr& in_snr) {
+        
+        assert(edge_number < 4);
+        if (channels.size() <= channel) {
+            channels.resize(channel + 1);
+        }
+        Channel_result& cr = channels[channel];
+        cr.mtf50[edge_number] = mtf50_value;
+        cr.quality[edge_number] = quality_value;
+        cr.sfr[edge_number] = edge_store()->add_array(in_sfr);
+        cr.esf[edge_number] = edge_store()->add_array(in_esf);
+        cr.snr[edge_number] = in_snr;
+    }
+    
+    size_t num_channels(void) const {
+        return channels.size();
+    }
+    
+    // a copy of this block with the MTF50, quality, SFR, ESF and SNR values
+    // replaced by those of the specified channel; the geometry is shared
+    Block channel_view(size_t channel) const {
+        Block view(*this);
+        view.channels.clear();
+        if (channel < channels.size()) {
+            const Channel_result& cr = channels[channel];
+            view.mtf50 = cr.mtf50;
+            view.quality = cr.quality;
+            view.sfr = cr.sfr;
+            view.esf = cr.esf;
+            view.snr = cr.snr;
+        } else {
+            view.valid = false;
+        }
+        return view;
+    }
+
     bool serialize(FILE* fout) const {
         vector<Point2d> edge_centroids(4);
         vector<double> edge_angle(4);
         vector<Point2d> edge_snr(4);
+        vector<std::shared_ptr<vector<double>>> edge_sfr(4);
+        vector<std::shared_ptr<vector<double>>> edge_esf(4);
         
         for (size_t k=0; k < 4; k++) {
             edge_centroids[k] = rect.get_centroid(k);
             edge_angle[k] = atan2(-get_normal(k).x, get_normal(k).y);
             edge_snr[k] = cv::Point2d(snr[k].mean_cnr(), snr[k].oversampling());
+            edge_sfr[k] = std::make_shared<vector<double>>(get_sfr(k).to_vector());
+            edge_esf[k] = std::make_shared<vector<double>>(get_esf(k).to_vector());
         }
         
         return Edge_info::serialize(
             fout,
             edge_centroids,
             edge_angle,
-            mtf50,
-            quality,
-            sfr,
-            esf,
+            vector<double>(mtf50.begin(), mtf50.end()),
+            vector<double>(quality.begin(), quality.end()),
+            edge_sfr,
+            edge_esf,
             edge_snr,
-            chromatic_aberration,
-            valid_edge,
-            edge_length
+            vector<Point2d>(chromatic_aberration.begin(), chromatic_aberration.end()),
+            vector<bool>(valid_edge.begin(), valid_edge.end()),
+            vector<double>(edge_length.begin(), edge_length.end())
         );
     }
     
+    // Per-edge values are kept in fixed-size arrays, and the SFR/ESF curves and
+    // scansets live in the shared Edge_store, so copying a Block is cheap
     Mrectangle rect;
-    vector<double> mtf50;
-    vector<double> quality;
-    vector<std::shared_ptr<vector<double>>> sfr;
-    vector<std::shared_ptr<vector<double>>> esf;
-    map<edge_position, size_t> edge_lut;
+    std::array<double, 4> mtf50;
+    std::array<double, 4> quality;
+    std::array<Edge_store::id_t, 4> sfr;
+    std::array<Edge_store::id_t, 4> esf;
+    std::array<size_t, 4> edge_lut;
     Point2d centroid;
     double area;
     bool valid;
-    vector<cv::Point3d> line_deviation;
-    vector<Snr> snr;
-    vector<std::shared_ptr<map<int, scanline>>> scansets; 
-    vector<Point2d> chromatic_aberration;
-    vector<std::shared_ptr<Edge_model>> edge_model;
-    vector<bool> valid_edge;
-    vector<double> edge_length;
+    std::array<cv::Point3d, 4> line_deviation;
+    std::array<Snr, 4> snr;
+    std::array<Edge_store::id_t, 4> scansets; 
+    std::array<Point2d, 4> chromatic_aberration;
+    std::array<std::shared_ptr<Edge_model>, 4> edge_model;
+    std::array<bool, 4> valid_edge;
+    std::array<double, 4> edge_length;
+    std::array<vector<double>, 4> mtf_levels;
+    
+    class Channel_result {
+      public:
+        Channel_result(void) {
+            mtf50.fill(0.0);
+            quality.fill(0.0);
+            sfr.fill(Edge_store::none);
+            esf.fill(Edge_store::none);
+        }
+        
+        std::array<double, 4> mtf50;
+        std::array<double, 4> quality;
+        std::array<Edge_store::id_t, 4> sfr;
+        std::array<Edge_store::id_t, 4> esf;
+        std::array<Snr, 4> snr;
+    };
+    vector<Channel_result> channels;
+    
+  private:
+    void init_edges(void) {
+        mtf50.fill(0.0);
+        quality.fill(0.0);
+        sfr.fill(Edge_store::none);
+        esf.fill(Edge_store::none);
+        scansets.fill(Edge_store::none);
+        edge_lut.fill(0);
+        chromatic_aberration.fill(cv::Point2d(Edge_info::nodata, Edge_info::nodata));
+        valid_edge.fill(false);
+        edge_length.fill(0.0);
+        line_deviation.fill(cv::Point3d(0,0,1));
+    }
+    
+    Edge_store* edge_store(void) {
+        if (!store) {
+            store = std::make_shared<Edge_store>(4096);
+        }
+        return store.get();
+    }
+    
+    Edge_store::Span lookup(Edge_store::id_t id, size_t placeholder_length) const {
+        static const vector<double> zeros(FFT_SIZE, 0.0);
+        if (store && id != Edge_store::none) {
+            return store->array(id);
+        }
+        return Edge_store::Span(zeros.data(), std::min(placeholder_length, zeros.size()));
+    }
+    
+    std::shared_ptr<Edge_store> store;
 };
 
 #endif
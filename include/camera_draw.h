@@ -32,6 +32,7 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #include "include/common_types.h"
 #include "include/distance_scale.h"
 #include "include/srgb_render.h"
+#include "include/image_encoder.h"
 #include <opencv2/imgcodecs/imgcodecs.hpp>
 
 class Camera_draw {
@@ -268,7 +269,7 @@ class Camera_draw {
         sprintf(tbuffer, "%s", s.c_str());
         cv::putText(rimg, tbuffer, Point2d(50, initial_rows + (rimg.rows-initial_rows)/2), font, 1, cv::Scalar::all(0), 1, cv::LINE_AA);
         
-        imwrite(path, rimg);
+        Image_encoder::instance().submit(path, rimg);
     }
     
     void checkmark(const Point2d& pos, const cv::Scalar& colour) {
@@ -0,0 +1,79 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#ifndef CFA_PLANES_H
+#define CFA_PLANES_H
+
+#include "include/common_types.h"
+#include "include/bayer.h"
+
+#include <array>
+
+// Quarter-resolution copies of the four CFA subsets of a Bayer mosaic.
+// Subset s = ((row & 1) << 1) | (col & 1) holds pixel (row, col) of the mosaic
+// at position (row >> 1, col >> 1) of plane s, so that the samples of any one
+// subset along a mosaic row are contiguous in memory.
+class Cfa_planes {
+  public:
+    Cfa_planes(const cv::Mat& mosaic);
+    
+    const cv::Mat& plane(int subset) const {
+        return planes[subset];
+    }
+    
+    // true if the planes were extracted from this particular image buffer
+    bool matches(const cv::Mat& img) const {
+        return img.data == source_data && img.rows == rows && img.cols == cols;
+    }
+    
+    // Returns the only subset in cfa_mask that occurs on rows with the given
+    // parity, -1 if no subset in cfa_mask occurs on such rows, or -2 if both
+    // subsets on such rows are selected
+    static int row_subset(Bayer::cfa_mask_t cfa_mask, int row_parity) {
+        int first = row_parity << 1;
+        bool a = (cfa_mask & (1 << (first ^ 3))) != 0;
+        bool b = (cfa_mask & (1 << ((first | 1) ^ 3))) != 0;
+        if (a && b) {
+            return -2;
+        }
+        if (a) {
+            return first;
+        }
+        if (b) {
+            return first | 1;
+        }
+        return -1;
+    }
+    
+  private:
+    std::array<cv::Mat, 4> planes;
+    const uchar* source_data = nullptr;
+    int rows = 0;
+    int cols = 0;
+};
+
+#endif
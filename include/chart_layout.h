@@ -0,0 +1,84 @@
+/*
+Copyright 2026 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#ifndef CHART_LAYOUT_H
+#define CHART_LAYOUT_H
+
+#include "include/common_types.h"
+#include "include/block.h"
+#include "include/rectangle.h"
+
+#include <string>
+using std::string;
+
+// The block geometry detected on a reference frame. Later captures of the same chart from the
+// same position can rebuild their rectangles from the layout, rather than thresholding, labelling
+// and fitting them again; see Mtf_core::layout_aligned() and Mtf_core::measure_layout_block().
+class Chart_layout {
+  public:
+    class Entry {
+      public:
+        Point2d centroids[4];      // refined edge centroids
+        double angles[4];          // direction of the edge normals
+        double edge_angles[4];     // direction along the edges, to which quad_coeffs refer
+        double quad_coeffs[4][3];  // edge curvature, used to seed the edge models
+        size_t boundary_length = 0;
+    };
+    
+    Chart_layout(void) {}
+    
+    Chart_layout(const vector<Block>& blocks, const cv::Size& image_size);
+    
+    // returns false if fname does not exist, or is not a layout file
+    bool load(const string& fname);
+    bool save(const string& fname) const;
+    
+    // the layout is only meaningful for images with the same dimensions
+    bool matches(const cv::Size& size) const {
+        return size.width == image_size.width && size.height == image_size.height;
+    }
+    
+    size_t size(void) const {
+        return entries.size();
+    }
+    
+    const Entry& operator[](size_t i) const {
+        return entries[i];
+    }
+    
+    // the rectangle that the block extraction would have produced for entry i
+    Mrectangle rectangle(size_t i) const;
+    
+    // the bounding boxes of the blocks, grown by margin pixels and clipped to the image
+    vector<cv::Rect> regions(int margin) const;
+    
+  private:
+    vector<Entry> entries;
+    cv::Size image_size;
+};
+
+#endif
@@ -32,7 +32,8 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #include "include/common_types.h"
 #include "include/bayer.h"
 
-void simple_demosaic(cv::Mat& cvimg, cv::Mat& rawimg, Bayer::cfa_pattern_t cfa_pattern, Bayer::bayer_t bayer, bool unbalanced_scene);
+// returns false if bayer does not select a single Bayer subset
+bool simple_demosaic(cv::Mat& cvimg, cv::Mat& rawimg, Bayer::cfa_pattern_t cfa_pattern, Bayer::bayer_t bayer, bool unbalanced_scene);
 void geometric_demosaic(cv::Mat& cvimg, cv::Mat& rawimg, int target_subset=0);
 
 #endif
@@ -0,0 +1,109 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#ifndef EDGE_STORE_H
+#define EDGE_STORE_H
+
+#include "include/scanline.h"
+
+#include <cstdint>
+#include <vector>
+using std::vector;
+#include <map>
+using std::map;
+#include <mutex>
+#include <limits>
+
+// Append-only arena for the bulky per-edge results (SFR/ESF curves and,
+// optionally, scansets). Arrays are stored in large chunks and referenced by
+// a small integer id, so that Block stays a lightweight view. Values are kept
+// as doubles: the text outputs print SFRs and ESFs with more digits than a
+// float carries, and must not change with the storage format.
+// add_*() may be called concurrently; lookups must not race with additions,
+// which is the same contract as Mtf_core::get_blocks(). Spans remain valid
+// for the lifetime of the store.
+class Edge_store {
+  public:
+    typedef uint32_t id_t;
+    static constexpr id_t none = std::numeric_limits<id_t>::max();
+    
+    template <class T>
+    class Array_span {
+      public:
+        Array_span(const T* data=nullptr, size_t n=0) : data(data), n(n) {}
+        
+        size_t size(void) const { return n; }
+        bool empty(void) const { return n == 0; }
+        double operator[](size_t i) const { return data[i]; }
+        const T* begin(void) const { return data; }
+        const T* end(void) const { return data + n; }
+        
+        vector<double> to_vector(void) const {
+            return vector<double>(begin(), end());
+        }
+        
+      private:
+        const T* data;
+        size_t n;
+    };
+    typedef Array_span<double> Span;
+    
+    Edge_store(size_t chunk_size=1 << 18) : chunk_size(chunk_size) {}
+    
+    id_t add_array(const vector<double>& values);
+    Span array(id_t id) const;
+    
+    id_t add_scanset(const map<int, scanline>& scanset);
+    map<int, scanline> scanset(id_t id) const;
+    
+    // approximate heap usage, in bytes
+    size_t memory_usage(void) const;
+    
+  private:
+    class Entry {
+      public:
+        uint32_t chunk;
+        uint32_t offset;
+        uint32_t length;
+    };
+    
+    // returns a pointer to n free elements, starting a new chunk if required
+    template <class T>
+    T* allocate(vector<vector<T>>& chunks, size_t n, Entry& e);
+    
+    size_t chunk_size;
+    vector<vector<double>> chunks;
+    vector<Entry> arrays;
+    
+    // scanline rows are stored as consecutive (row, start, end) triples
+    vector<int32_t> scan_rows;
+    vector<Entry> scansets;
+    
+    mutable std::mutex mutex;
+};
+
+#endif
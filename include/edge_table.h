@@ -0,0 +1,640 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#ifndef EDGE_TABLE_H
+#define EDGE_TABLE_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+using std::string;
+using std::vector;
+
+#ifdef _WIN32
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+#include "include/edge_info.h"
+#include "include/job_metadata.h"
+#include "include/logger.h"
+
+// Columnar edge results file (output version 3 of "serialized_edges.bin").
+// 
+// Layout (all values in host byte order, as with the older record stream):
+//   Header                 (64 bytes, fixed)
+//   Record[edge_count]     (fixed-width edge table)
+//   float[edge_count*sfr_stride]  SFR block, one zero-padded row per edge
+//   float[edge_count*esf_stride]  ESF block, one zero-padded row per edge
+//   Grid index             (coarse spatial grid, CSR-style cell lists)
+//   Section[n], Footer     (footer index pointing at the sections above)
+//
+// Every section starts on an 8-byte boundary, so a memory-mapped file can
+// be accessed in place; the SFR of edge i is simply sfr_block + i*sfr_stride.
+class Edge_table {
+  public:
+    static constexpr uint32_t format_version = 1;
+    
+    typedef enum {
+        SECTION_EDGES = 1,
+        SECTION_SFR,
+        SECTION_ESF,
+        SECTION_GRID
+    } section_t;
+    
+    struct Header {
+        char     magic[8];
+        uint32_t version;
+        uint32_t edge_count;
+        double   pixel_pitch;
+        double   mtf_contrast;
+        uint32_t bayer;
+        uint32_t channels;
+        uint32_t sfr_stride;
+        uint32_t esf_stride;
+        uint64_t footer_offset;
+        uint64_t reserved;
+    };
+    
+    struct Record {
+        double   centroid_x;
+        double   centroid_y;
+        double   angle;         // whole angle, not relative
+        double   mtf50;         // MTF-XX, in c/p
+        double   cnr;           // mean CNR
+        double   oversampling;
+        double   ca_red;        // CA red-green
+        double   ca_blue;       // CA blue-green
+        double   edge_length;   // in pixels
+        uint32_t block_id;
+        uint16_t sfr_size;
+        uint16_t esf_size;
+    };
+    
+    struct Grid_header {
+        double   origin_x;
+        double   origin_y;
+        double   cell_size;
+        uint32_t cols;
+        uint32_t rows;
+        // followed by uint32_t cell_start[cols*rows + 1], uint32_t edge_index[edge_count]
+    };
+    
+    struct Section {
+        uint32_t id;
+        uint32_t reserved;
+        uint64_t offset;
+        uint64_t size;
+    };
+    
+    struct Footer {
+        uint32_t section_count;
+        uint32_t reserved;
+        char     magic[8];
+    };
+    
+    static_assert(sizeof(Header) == 64, "Edge_table::Header must be 64 bytes");
+    static_assert(sizeof(Record) == 80, "Edge_table::Record must be 80 bytes");
+    static_assert(sizeof(Grid_header) == 32, "Edge_table::Grid_header must be 32 bytes");
+    
+    static const char* header_magic(void) { return "MTFMEDGE"; }
+    static const char* footer_magic(void) { return "MTFMEIDX"; }
+    
+    // Accumulates edges, then encodes the whole table in one go
+    class Writer {
+      public:
+        void add(uint32_t block_id, const cv::Point2d& centroid, double angle, double mtf50,
+            const cv::Point2d& snr, const cv::Point2d& chromatic_aberration, double edge_length,
+            const vector<double>& sfr, const vector<double>& esf) {
+            
+            Record r;
+            memset(&r, 0, sizeof(r));
+            r.centroid_x = centroid.x;
+            r.centroid_y = centroid.y;
+            r.angle = angle;
+            r.mtf50 = mtf50;
+            r.cnr = snr.x;
+            r.oversampling = snr.y;
+            r.ca_red = chromatic_aberration.x;
+            r.ca_blue = chromatic_aberration.y;
+            r.edge_length = edge_length;
+            r.block_id = block_id;
+            r.sfr_size = uint16_t(std::min(sfr.size(), size_t(UINT16_MAX)));
+            r.esf_size = uint16_t(std::min(esf.size(), size_t(UINT16_MAX)));
+            records.push_back(r);
+            
+            sfr_rows.push_back(vector<float>(sfr.begin(), sfr.begin() + r.sfr_size));
+            esf_rows.push_back(vector<float>(esf.begin(), esf.begin() + r.esf_size));
+        }
+        
+        size_t size(void) const {
+            return records.size();
+        }
+        
+        vector<char> encode(const Job_metadata& metadata) const {
+            uint32_t sfr_stride = 0;
+            uint32_t esf_stride = 0;
+            for (const auto& r: records) {
+                sfr_stride = std::max(sfr_stride, uint32_t(r.sfr_size));
+                esf_stride = std::max(esf_stride, uint32_t(r.esf_size));
+            }
+            // keep every row 8-byte aligned
+            sfr_stride += sfr_stride & 1;
+            esf_stride += esf_stride & 1;
+            
+            const size_t n = records.size();
+            vector<Section> sections;
+            vector<char> out(sizeof(Header), 0);
+            
+            sections.push_back(append(out, SECTION_EDGES, records.data(), n*sizeof(Record)));
+            
+            vector<float> block(n*sfr_stride, 0.0f);
+            for (size_t i=0; i < n; i++) {
+                std::copy(sfr_rows[i].begin(), sfr_rows[i].end(), block.begin() + i*sfr_stride);
+            }
+            sections.push_back(append(out, SECTION_SFR, block.data(), block.size()*sizeof(float)));
+            
+            block.assign(n*esf_stride, 0.0f);
+            for (size_t i=0; i < n; i++) {
+                std::copy(esf_rows[i].begin(), esf_rows[i].end(), block.begin() + i*esf_stride);
+            }
+            sections.push_back(append(out, SECTION_ESF, block.data(), block.size()*sizeof(float)));
+            
+            vector<char> grid = build_grid();
+            sections.push_back(append(out, SECTION_GRID, grid.data(), grid.size()));
+            
+            Header h;
+            memset(&h, 0, sizeof(h));
+            memcpy(h.magic, header_magic(), sizeof(h.magic));
+            h.version = format_version;
+            h.edge_count = uint32_t(n);
+            h.pixel_pitch = metadata.pixel_pitch;
+            h.mtf_contrast = metadata.mtf_contrast;
+            h.bayer = uint32_t(metadata.bayer);
+            h.channels = uint32_t(metadata.channels);
+            h.sfr_stride = sfr_stride;
+            h.esf_stride = esf_stride;
+            h.footer_offset = out.size();
+            memcpy(out.data(), &h, sizeof(h));
+            
+            Footer f;
+            memset(&f, 0, sizeof(f));
+            f.section_count = uint32_t(sections.size());
+            memcpy(f.magic, footer_magic(), sizeof(f.magic));
+            
+            const char* sp = (const char*)sections.data();
+            out.insert(out.end(), sp, sp + sections.size()*sizeof(Section));
+            out.insert(out.end(), (const char*)&f, (const char*)&f + sizeof(f));
+            
+            return out;
+        }
+        
+        bool write(const string& fname, const Job_metadata& metadata) const {
+            vector<char> buffer = encode(metadata);
+            FILE* fout = fopen(fname.c_str(), "wb");
+            if (!fout) {
+                logger.error("Could not open edge table file [%s] for writing\n", fname.c_str());
+                return false;
+            }
+            size_t nwritten = fwrite(buffer.data(), 1, buffer.size(), fout);
+            fclose(fout);
+            if (nwritten != buffer.size()) {
+                logger.error("Could not write edge table, tried %lu bytes, only wrote %lu\n", (unsigned long)buffer.size(), (unsigned long)nwritten);
+                return false;
+            }
+            return true;
+        }
+        
+      private:
+        static Section append(vector<char>& out, uint32_t id, const void* data, size_t size) {
+            Section s;
+            memset(&s, 0, sizeof(s));
+            s.id = id;
+            s.offset = out.size();
+            s.size = size;
+            const char* p = (const char*)data;
+            out.insert(out.end(), p, p + size);
+            out.resize((out.size() + 7) & ~size_t(7), 0);
+            return s;
+        }
+        
+        vector<char> build_grid(void) const {
+            Grid_header g;
+            memset(&g, 0, sizeof(g));
+            g.cols = g.rows = 1;
+            g.cell_size = 1;
+            
+            if (!records.empty()) {
+                double min_x = records[0].centroid_x;
+                double max_x = min_x;
+                double min_y = records[0].centroid_y;
+                double max_y = min_y;
+                for (const auto& r: records) {
+                    min_x = std::min(min_x, r.centroid_x);
+                    max_x = std::max(max_x, r.centroid_x);
+                    min_y = std::min(min_y, r.centroid_y);
+                    max_y = std::max(max_y, r.centroid_y);
+                }
+                // aim for roughly four edges per cell
+                double extent = std::max(max_x - min_x, max_y - min_y) + 1;
+                double cells_per_side = std::max(1.0, std::min(256.0, std::ceil(std::sqrt(records.size()/4.0))));
+                g.cell_size = std::max(1.0, extent / cells_per_side);
+                g.origin_x = min_x;
+                g.origin_y = min_y;
+                g.cols = uint32_t(std::floor((max_x - min_x) / g.cell_size)) + 1;
+                g.rows = uint32_t(std::floor((max_y - min_y) / g.cell_size)) + 1;
+            }
+            
+            const size_t ncells = size_t(g.cols) * g.rows;
+            vector<uint32_t> cell_start(ncells + 1, 0);
+            vector<uint32_t> cell_of(records.size());
+            for (size_t i=0; i < records.size(); i++) {
+                uint32_t cx = uint32_t((records[i].centroid_x - g.origin_x) / g.cell_size);
+                uint32_t cy = uint32_t((records[i].centroid_y - g.origin_y) / g.cell_size);
+                cell_of[i] = std::min(cy, g.rows - 1)*g.cols + std::min(cx, g.cols - 1);
+                cell_start[cell_of[i] + 1]++;
+            }
+            for (size_t c=0; c < ncells; c++) {
+                cell_start[c+1] += cell_start[c];
+            }
+            vector<uint32_t> edge_index(records.size());
+            vector<uint32_t> fill(cell_start.begin(), cell_start.end() - 1);
+            for (size_t i=0; i < records.size(); i++) {
+                edge_index[fill[cell_of[i]]++] = uint32_t(i);
+            }
+            
+            vector<char> out(sizeof(Grid_header) + (cell_start.size() + edge_index.size())*sizeof(uint32_t));
+            char* p = out.data();
+            memcpy(p, &g, sizeof(g));
+            p += sizeof(g);
+            memcpy(p, cell_start.data(), cell_start.size()*sizeof(uint32_t));
+            p += cell_start.size()*sizeof(uint32_t);
+            memcpy(p, edge_index.data(), edge_index.size()*sizeof(uint32_t));
+            return out;
+        }
+        
+        vector<Record> records;
+        vector<vector<float>> sfr_rows;
+        vector<vector<float>> esf_rows;
+    };
+    
+    Edge_table(void) {}
+    
+    Edge_table(const Edge_table&) = delete;
+    Edge_table& operator=(const Edge_table&) = delete;
+    
+    ~Edge_table(void) {
+        close();
+    }
+    
+    // Opens either a columnar edge table (memory mapped) or a legacy
+    // "serialized_edges.bin" record stream (decoded into an in-memory table)
+    bool open(const string& fname) {
+        close();
+        
+        if (!map_file(fname)) {
+            return false;
+        }
+        
+        if (length >= sizeof(Header) && memcmp(base, header_magic(), 8) == 0) {
+            if (parse()) {
+                return true;
+            }
+            close();
+            return false;
+        }
+        
+        // not a columnar table, so try the older record stream
+        unmap_file();
+        return open_legacy(fname);
+    }
+    
+    void close(void) {
+        unmap_file();
+        owned.clear();
+        base = nullptr;
+        length = 0;
+        header = nullptr;
+        records = nullptr;
+        sfr_block = nullptr;
+        esf_block = nullptr;
+        grid = nullptr;
+        cell_start = nullptr;
+        edge_index = nullptr;
+    }
+    
+    bool is_open(void) const {
+        return header != nullptr;
+    }
+    
+    size_t size(void) const {
+        return header ? header->edge_count : 0;
+    }
+    
+    Job_metadata metadata(void) const {
+        Job_metadata md;
+        if (header) {
+            md.pixel_pitch = header->pixel_pitch;
+            md.mtf_contrast = header->mtf_contrast;
+            md.bayer = Bayer::bayer_t(header->bayer);
+            md.channels = int(header->channels);
+        }
+        return md;
+    }
+    
+    const Record& record(size_t i) const {
+        return records[i];
+    }
+    
+    const float* sfr(size_t i, size_t& n) const {
+        n = records[i].sfr_size;
+        return sfr_block + i*header->sfr_stride;
+    }
+    
+    const float* esf(size_t i, size_t& n) const {
+        n = records[i].esf_size;
+        return esf_block + i*header->esf_stride;
+    }
+    
+    Edge_info edge_info(size_t i) const {
+        const Record& r = records[i];
+        Edge_info b;
+        b.centroid = cv::Point2d(r.centroid_x, r.centroid_y);
+        b.angle = r.angle;
+        b.mtf50 = r.mtf50;
+        b.quality = 0;
+        b.snr = cv::Point2d(r.cnr, r.oversampling);
+        b.chromatic_aberration = cv::Point2d(r.ca_red, r.ca_blue);
+        b.edge_length = r.edge_length;
+        size_t n = 0;
+        const float* s = sfr(i, n);
+        b.sfr = std::make_shared<vector<double>>(s, s + n);
+        s = esf(i, n);
+        b.esf = std::make_shared<vector<double>>(s, s + n);
+        b.set_metadata(metadata());
+        return b;
+    }
+    
+    // Index of the edge closest to (x, y), or -1 if none lies within max_dist
+    int nearest(double x, double y, double max_dist) const {
+        if (!grid || size() == 0) {
+            return -1;
+        }
+        int c0 = int(std::floor((x - max_dist - grid->origin_x) / grid->cell_size));
+        int c1 = int(std::floor((x + max_dist - grid->origin_x) / grid->cell_size));
+        int r0 = int(std::floor((y - max_dist - grid->origin_y) / grid->cell_size));
+        int r1 = int(std::floor((y + max_dist - grid->origin_y) / grid->cell_size));
+        c0 = std::max(c0, 0);
+        r0 = std::max(r0, 0);
+        c1 = std::min(c1, int(grid->cols) - 1);
+        r1 = std::min(r1, int(grid->rows) - 1);
+        
+        int best = -1;
+        double best_dist = max_dist*max_dist;
+        for (int row=r0; row <= r1; row++) {
+            for (int col=c0; col <= c1; col++) {
+                size_t cell = size_t(row)*grid->cols + col;
+                for (uint32_t k=cell_start[cell]; k < cell_start[cell+1]; k++) {
+                    const Record& r = records[edge_index[k]];
+                    double d = (r.centroid_x - x)*(r.centroid_x - x) + (r.centroid_y - y)*(r.centroid_y - y);
+                    if (d < best_dist) {
+                        best_dist = d;
+                        best = int(edge_index[k]);
+                    }
+                }
+            }
+        }
+        return best;
+    }
+    
+    // Reads only the job metadata, without mapping the edge data
+    static bool peek_metadata(const string& fname, Job_metadata& md) {
+        FILE* fin = fopen(fname.c_str(), "rb");
+        if (!fin) {
+            return false;
+        }
+        Header h;
+        bool success = false;
+        if (fread(&h, 1, sizeof(h), fin) == sizeof(h) && memcmp(h.magic, header_magic(), 8) == 0) {
+            md.pixel_pitch = h.pixel_pitch;
+            md.mtf_contrast = h.mtf_contrast;
+            md.bayer = Bayer::bayer_t(h.bayer);
+            md.channels = int(h.channels);
+            success = true;
+        } else {
+            fseek(fin, 0, SEEK_SET);
+            size_t dummy_count = 0;
+            success = Edge_info::deserialize_header(fin, dummy_count, md);
+        }
+        fclose(fin);
+        return success;
+    }
+    
+  private:
+    bool parse(void) {
+        header = (const Header*)base;
+        if (header->version != format_version) {
+            logger.error("Unsupported edge table version %d\n", int(header->version));
+            return false;
+        }
+        if (header->footer_offset + sizeof(Footer) > length) {
+            logger.error("%s\n", "Edge table footer offset out of range");
+            return false;
+        }
+        const Footer* f = (const Footer*)(base + length - sizeof(Footer));
+        if (memcmp(f->magic, footer_magic(), 8) != 0 ||
+            header->footer_offset + f->section_count*sizeof(Section) + sizeof(Footer) != length) {
+            
+            logger.error("%s\n", "Edge table footer is corrupt (truncated file?)");
+            return false;
+        }
+        
+        const size_t n = header->edge_count;
+        const Section* sections = (const Section*)(base + header->footer_offset);
+        for (uint32_t s=0; s < f->section_count; s++) {
+            if (sections[s].offset + sections[s].size > header->footer_offset) {
+                logger.error("Edge table section %d out of range\n", int(sections[s].id));
+                return false;
+            }
+            const char* p = base + sections[s].offset;
+            switch (sections[s].id) {
+            case SECTION_EDGES:
+                if (sections[s].size != n*sizeof(Record)) return false;
+                records = (const Record*)p;
+                break;
+            case SECTION_SFR:
+                if (sections[s].size != n*header->sfr_stride*sizeof(float)) return false;
+                sfr_block = (const float*)p;
+                break;
+            case SECTION_ESF:
+                if (sections[s].size != n*header->esf_stride*sizeof(float)) return false;
+                esf_block = (const float*)p;
+                break;
+            case SECTION_GRID:
+                {
+                    if (sections[s].size < sizeof(Grid_header)) return false;
+                    grid = (const Grid_header*)p;
+                    size_t ncells = size_t(grid->cols)*grid->rows;
+                    if (sections[s].size != sizeof(Grid_header) + (ncells + 1 + n)*sizeof(uint32_t)) return false;
+                    cell_start = (const uint32_t*)(p + sizeof(Grid_header));
+                    edge_index = cell_start + ncells + 1;
+                }
+                break;
+            default:
+                break; // unknown sections from later versions are skipped
+            }
+        }
+        
+        return records && sfr_block && esf_block && grid;
+    }
+    
+    bool open_legacy(const string& fname) {
+        FILE* fin = fopen(fname.c_str(), "rb");
+        if (!fin) {
+            return false;
+        }
+        size_t edge_count = 0;
+        Job_metadata md;
+        bool success = Edge_info::deserialize_header(fin, edge_count, md);
+        Writer writer;
+        for (size_t i=0; success && i < edge_count; i++) {
+            Edge_info b = Edge_info::deserialize(fin, success);
+            if (success) {
+                writer.add(0, b.centroid, b.angle, b.mtf50, b.snr, b.chromatic_aberration, b.edge_length, *b.sfr, *b.esf);
+            }
+        }
+        fclose(fin);
+        
+        if (writer.size() == 0 && edge_count > 0) {
+            logger.error("Could not read serialized edge info file [%s]\n", fname.c_str());
+            return false;
+        }
+        
+        owned = writer.encode(md);
+        base = owned.data();
+        length = owned.size();
+        return parse();
+    }
+    
+    bool map_file(const string& fname) {
+        #ifdef _WIN32
+        file_handle = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file_handle == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER fsize;
+        if (!GetFileSizeEx(file_handle, &fsize) || fsize.QuadPart == 0) {
+            CloseHandle(file_handle);
+            file_handle = INVALID_HANDLE_VALUE;
+            return false;
+        }
+        map_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!map_handle) {
+            CloseHandle(file_handle);
+            file_handle = INVALID_HANDLE_VALUE;
+            return false;
+        }
+        mapped = MapViewOfFile(map_handle, FILE_MAP_READ, 0, 0, 0);
+        if (!mapped) {
+            CloseHandle(map_handle);
+            CloseHandle(file_handle);
+            map_handle = NULL;
+            file_handle = INVALID_HANDLE_VALUE;
+            return false;
+        }
+        length = size_t(fsize.QuadPart);
+        #else
+        int fd = ::open(fname.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+        mapped = p;
+        length = size_t(st.st_size);
+        #endif
+        base = (const char*)mapped;
+        return true;
+    }
+    
+    void unmap_file(void) {
+        if (!mapped) {
+            return;
+        }
+        #ifdef _WIN32
+        UnmapViewOfFile(mapped);
+        CloseHandle(map_handle);
+        CloseHandle(file_handle);
+        map_handle = NULL;
+        file_handle = INVALID_HANDLE_VALUE;
+        #else
+        munmap(mapped, length);
+        #endif
+        mapped = nullptr;
+        base = nullptr;
+        length = 0;
+    }
+    
+    void* mapped = nullptr;
+    #ifdef _WIN32
+    HANDLE file_handle = INVALID_HANDLE_VALUE;
+    HANDLE map_handle = NULL;
+    #endif
+    vector<char> owned;
+    const char* base = nullptr;
+    size_t length = 0;
+    
+    const Header* header = nullptr;
+    const Record* records = nullptr;
+    const float* sfr_block = nullptr;
+    const float* esf_block = nullptr;
+    const Grid_header* grid = nullptr;
+    const uint32_t* cell_start = nullptr;
+    const uint32_t* edge_index = nullptr;
+};
+
+#endif
@@ -34,6 +34,7 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include "include/bayer.h"
+#include "include/cfa_planes.h"
 #include "include/edge_model.h"
 #include <map>
 using std::map;
@@ -70,11 +71,57 @@ class Esf_sampler {
         const cv::Mat& geom_img, const cv::Mat& sampling_img, 
         Bayer::cfa_mask_t cfa_mask = Bayer::DEFAULT) = 0;
         
+    void set_cfa_planes(const Cfa_planes* planes) {
+        cfa_planes = planes;
+    }
+        
   protected:
+    // Calls f(x, y, value) for every pixel in scanset that lies inside the border of
+    // bounds_img and belongs to one of the CFA subsets in cfa_mask. If the CFA planes
+    // were extracted from sampling_img, the values are read from the planes with unit
+    // stride; otherwise sampling_img is scanned and the other subsets are skipped.
+    template<class F>
+    void for_each_pixel(const map<int, scanline>& scanset, const cv::Mat& bounds_img,
+        const cv::Mat& sampling_img, Bayer::cfa_mask_t cfa_mask, F&& f) const {
+        
+        bool use_planes = cfa_planes && cfa_mask != Bayer::ALL && cfa_planes->matches(sampling_img);
+        
+        int x_lower = int(ceil(border_width));
+        int x_upper = int(floor(bounds_img.cols - 1 - border_width));
+        
+        for (map<int, scanline>::const_iterator it=scanset.begin(); it != scanset.end(); ++it) {
+            int y = it->first;
+            if (y < border_width || y > bounds_img.rows-1-border_width) continue;
+            
+            int x_start = std::max(it->second.start, x_lower);
+            int x_end = std::min(it->second.end, x_upper);
+            
+            int subset = use_planes ? Cfa_planes::row_subset(cfa_mask, y & 1) : -2;
+            if (subset == -1) continue;
+            
+            if (subset >= 0) {
+                const uint16_t* prow = cfa_planes->plane(subset).ptr<uint16_t>(y >> 1);
+                for (int x = x_start + ((x_start & 1) != (subset & 1)); x <= x_end; x += 2) {
+                    f(x, y, prow[x >> 1]);
+                }
+            } else {
+                int rowcode = (y & 1) << 1;
+                const uint16_t* srow = sampling_img.ptr<uint16_t>(y);
+                for (int x=x_start; x <= x_end; ++x) {
+                    int code = 1 << ( (rowcode | (x & 1)) ^ 3 );
+                    if ((code & cfa_mask) == 0) continue;
+                    
+                    f(x, y, srow[x]);
+                }
+            }
+        }
+    }
+    
     double max_dot;
     Bayer::cfa_mask_t default_cfa_mask;
     double max_edge_length;
     double border_width;
+    const Cfa_planes* cfa_planes = nullptr;
 };
 
 #endif
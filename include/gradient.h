@@ -33,7 +33,12 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 
 class Gradient {
 public:
-    Gradient(const cv::Mat& in_img);
+    // If max_buffer_bytes is non-zero, the smoothed intermediate image is computed over
+    // horizontal strips that fit in max_buffer_bytes; the gradients are identical.
+    Gradient(const cv::Mat& in_img, size_t max_buffer_bytes=0);
+    // Only computes the gradients inside regions (as used by coarse-to-fine detection); they are
+    // zero elsewhere, and identical to those of the whole-image constructor inside the regions.
+    Gradient(const cv::Mat& in_img, const vector<cv::Rect>& regions);
     virtual ~Gradient(void);
 
     inline const cv::Mat& grad_x(void) const {
@@ -72,7 +77,10 @@ public:
     
 private:
 
+    static const int strip_halo = 3;
+
     void _compute_gradients(const cv::Mat& smoothed_im);
+    void _compute_gradients_strips(const cv::Mat& in_img, double max_val, int strip_rows);
 
 protected:
     int _width;
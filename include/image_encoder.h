@@ -0,0 +1,107 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#ifndef IMAGE_ENCODER_H
+#define IMAGE_ENCODER_H
+
+#include "include/common_types.h"
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Encodes output images (annotated image, diagnostic plots) off the render
+// threads. PNG files are compressed in horizontal bands on the ThreadPool,
+// with the bands joined into a single deflate stream, so that large
+// images do not serialize on a single core.
+// There is one encoder per process, shared by all concurrent Mtf_job instances;
+// the PNG level is a process-wide setting (see Mtf_job::apply_process_settings).
+class Image_encoder {
+  public:
+    static Image_encoder& instance(void) {
+        static Image_encoder singleton;
+        return singleton;
+    }
+    
+    ~Image_encoder(void);
+    
+    // zlib level (0-9) used for PNG outputs
+    void set_png_level(int level) {
+        png_level = std::max(0, std::min(9, level));
+    }
+    
+    int get_png_level(void) const {
+        return png_level;
+    }
+    
+    // queue an image for encoding; the pixel data is shared, not copied, so the
+    // caller must not modify img after submitting it
+    void submit(const string& fname, const cv::Mat& img, const vector<int>& params = vector<int>());
+    
+    // blocks until all submitted images whose file name starts with prefix
+    // have been written; the default empty prefix waits for every image
+    void wait(const string& prefix = string());
+    
+    // synchronous encode, using the parallel PNG path where possible
+    bool write(const string& fname, const cv::Mat& img, const vector<int>& params = vector<int>()) const;
+    
+  private:
+    Image_encoder(void) {}
+    
+    bool write_png(const string& fname, const cv::Mat& img) const;
+    
+    class Job {
+      public:
+        string fname;
+        cv::Mat img;
+        vector<int> params;
+    };
+    
+    void run(void);
+    
+    bool pending(const string& prefix) const;
+    
+    std::deque<Job> jobs;
+    string in_flight; // file name of the image being encoded, if busy
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable cv_work;
+    std::condition_variable cv_done;
+    size_t busy = 0;
+    bool stop = false;
+    int png_level = 1;
+};
+
+#endif
@@ -0,0 +1,97 @@
+/*
+Copyright 2021 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#ifndef IMAGE_METADATA_H
+#define IMAGE_METADATA_H
+
+#include <string>
+using std::string;
+
+// Camera and lens properties read from the EXIF (or TIFF/EP) tags of an image;
+// numeric fields are negative (or zero, for dimensions) if the tag was absent
+class Image_metadata {
+  public:
+    bool found(void) const {
+        return !make.empty() || focal_length > 0 || focal_length_35mm > 0;
+    }
+    
+    // in microns, derived from the focal plane resolution
+    double pixel_pitch(void) const {
+        double res = focal_plane_x_res > 0 ? focal_plane_x_res : focal_plane_y_res;
+        double unit = resolution_unit_mm();
+        if (res <= 0 || unit <= 0) {
+            return -1;
+        }
+        return 1000.0 * unit / res;
+    }
+    
+    // focal length divided by sensor width, as used by --focal-ratio; the width is
+    // taken from PixelXDimension, else image_width (the decoded image), else the
+    // full-resolution TIFF image, but never from IFD0, which is often a thumbnail
+    double focal_ratio(int image_width = 0) const {
+        // the 35 mm equivalent focal length is the most widely supported, and
+        // the full-frame sensor width is close enough to 36 mm for all cameras
+        if (focal_length_35mm > 0) {
+            return focal_length_35mm / 36.0;
+        }
+        
+        int w = pixel_x_dimension > 0 ? pixel_x_dimension : (image_width > 0 ? image_width : full_width);
+        double pitch = pixel_pitch();
+        if (focal_length > 0 && pitch > 0 && w > 0) {
+            return focal_length / (w * pitch / 1000.0);
+        }
+        return -1;
+    }
+    
+    string make;
+    string model;
+    string user_comment;
+    double focal_length = -1;       // mm
+    double focal_length_35mm = -1;  // mm
+    double f_number = -1;
+    double focal_plane_x_res = -1;  // pixels per focal_plane_res_unit
+    double focal_plane_y_res = -1;
+    int focal_plane_res_unit = 2;   // EXIF default is inches
+    int pixel_x_dimension = 0;      // EXIF (valid) image dimensions
+    int pixel_y_dimension = 0;
+    int full_width = 0;             // dimensions of the largest full-resolution TIFF image (IFD or SubIFD)
+    int full_height = 0;
+    
+  private:
+    double resolution_unit_mm(void) const {
+        switch (focal_plane_res_unit) {
+        case 1: // no unit, but in practice inches
+        case 2: return 25.4;
+        case 3: return 10.0;
+        case 4: return 1.0;
+        case 5: return 0.001;
+        default: return -1;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,93 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#ifndef MEMORY_TRACKER_H
+#define MEMORY_TRACKER_H
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+using std::vector;
+
+// Process memory accounting, based on the resident set size reported by the OS.
+// Stages (see Stage_trace) open a watermark on entry and close it on exit, which
+// yields the high-water mark of the process while the stage was active; on Linux
+// the kernel high-water mark is reset at each stage boundary, so these are exact.
+//
+// A memory budget, if set, is used by the memory-hungry stages (thresholding,
+// gradient computation) to size their scratch buffers; see scratch_allowance().
+// Both the budget and the watermarks are process-wide, so they cover all the
+// jobs running in the process; only Mtf_job::apply_process_settings() sets them.
+class Memory_tracker {
+  public:
+    static Memory_tracker& instance(void) {
+        static Memory_tracker singleton;
+        return singleton;
+    }
+    
+    // current resident set size, in bytes (0 if the platform does not report it)
+    static size_t resident(void);
+    
+    // returns a watermark handle; the mark starts at the current resident size
+    size_t open_watermark(void);
+    
+    // returns the high-water mark (in bytes) since the matching open_watermark()
+    size_t close_watermark(size_t handle);
+    
+    // high-water mark of the whole process, in bytes
+    size_t peak(void);
+    
+    void set_budget(size_t bytes) {
+        budget_bytes = bytes;
+    }
+    
+    size_t budget(void) const {
+        return budget_bytes;
+    }
+    
+    // Bytes that a stage may use for scratch buffers, given that it still has to allocate
+    // committed_bytes of output. Returns 0 (meaning "no limit") if no budget was set.
+    size_t scratch_allowance(size_t committed_bytes) const;
+    
+    // smallest scratch allowance that is ever returned, so that progress is always possible
+    static constexpr size_t min_scratch_bytes = size_t(16) << 20;
+    
+  private:
+    Memory_tracker(void);
+    
+    // reads the OS high-water mark, and resets it where the OS allows it
+    size_t sample_peak(bool reset);
+    
+    std::mutex mutex;
+    vector<size_t> marks;      // high-water mark of each open watermark, indexed by handle
+    vector<bool> open;
+    size_t process_peak = 0;
+    size_t budget_bytes = 0;
+    bool resettable = false;
+};
+
+#endif
@@ -50,9 +50,12 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 
 #include "include/esf_model.h"
 #include "include/snr.h"
+#include "include/chart_layout.h"
 
 #include <memory>
+#include <array>
 #include <map>
+#include <atomic>
 using std::map;
 
 #include <opencv2/imgproc/imgproc.hpp>
@@ -96,7 +99,7 @@ class Mtf_core {
         case Esf_sampler::DEFERRED:
             if (!undistort) { // hopefully we stop it before this point ...
                 logger.error("%s\n", "Fatal error: No undistortion model provided to Esf_sampler_deferred. Aborting");
-                exit(-1);
+                break; // see valid()
             }
             esf_sampler = new Esf_sampler_deferred(undistort, max_dot, Bayer::to_cfa_mask(bayer, cfa_pattern), border_width);
             break;
@@ -105,14 +108,10 @@ class Mtf_core {
         for (Boundarylist::const_iterator it=cl.get_boundaries().begin(); it != cl.get_boundaries().end(); ++it) {
             valid_obj.push_back(it->first);
         }
-        
-        cv::Mat temp;
-        in_img.convertTo(temp, CV_8U, 256.0/16384.0);
-        cv::cvtColor(temp, od_img, cv::COLOR_GRAY2RGB);
     }
     
     ~Mtf_core(void) {
-        //cv::imwrite(string("detections.png"), od_img);
+        //cv::imwrite(string("detections.png"), detection_overlay());
     }
     
     size_t num_objects(void) {
@@ -120,18 +119,29 @@ class Mtf_core {
     }
     
     void search_borders(const Point2d& cent, int label);
+    void measure_rectangle(Mrectangle& rrect, int label);
+    
+    // measures the edges of block i of a layout, instead of extracting its rectangle from a labelled object
+    void measure_layout_block(const Chart_layout& layout, size_t i);
+    
+    // sparse check, on a few edges spread over the layout, that the chart has not moved since the
+    // layout was recorded; the gradient must have been computed around the layout blocks
+    bool layout_aligned(const Chart_layout& layout) const;
     bool extract_rectangle(const Point2d& cent, int label, Mrectangle& rect);
     double compute_mtf(Edge_model& edge_model, const map<int, scanline>& scanset, 
                        double& poor, double& edge_length,
                        vector<double>& sfr, vector<double>& esf, 
-                       Snr& snr, bool allow_peak_shift = false);
+                       Snr& snr, bool allow_peak_shift = false,
+                       Bayer::cfa_mask_t cfa_mask = Bayer::DEFAULT,
+                       vector<double>* mtf_levels = nullptr);
                        
     vector<Block>& get_blocks(void) {
         if (detected_blocks.size() == 0) {
             // make a copy into an STL container if necessary
             detected_blocks.reserve(shared_blocks_map.size());
 
-            for (map<int, Block>::const_iterator it = shared_blocks_map.begin();
+            // the blocks are moved out, since nothing reads shared_blocks_map afterwards
+            for (map<int, Block>::iterator it = shared_blocks_map.begin();
                 it != shared_blocks_map.end(); ++it) {
 
                 bool allzero = true;
@@ -142,13 +152,29 @@ class Mtf_core {
                 }
 
                 if (it->second.valid && !allzero) {
-                    detected_blocks.push_back(it->second);
+                    detected_blocks.push_back(std::move(it->second));
                 }
             }
+            shared_blocks_map.clear();
         }
         return detected_blocks;
     }
     
+    // copies of the blocks returned by get_blocks(), carrying the results of
+    // the specified entry of the extra Bayer subset list; get_blocks() must have
+    // been called first, so that concurrent callers only read the blocks
+    vector<Block> get_channel_blocks(size_t channel) const {
+        assert(shared_blocks_map.empty());
+        vector<Block> channel_blocks;
+        for (const auto& b: detected_blocks) {
+            Block view = b.channel_view(channel);
+            if (view.valid) {
+                channel_blocks.push_back(view);
+            }
+        }
+        return channel_blocks;
+    }
+    
     vector<Mtf_profile_sample>& get_samples(void) {
         return samples;
     }
@@ -182,6 +208,16 @@ class Mtf_core {
     void set_ridges_only(bool b) {
         ridges_only = b;
     }
+    
+    // keep the scanset and edge model of every edge after it has been measured;
+    // these are only needed by Ca_core and Distortion_optimizer
+    void set_retain_edge_geometry(bool b) {
+        retain_edge_geometry = b;
+    }
+    
+    const std::shared_ptr<Edge_store>& get_edge_store(void) const {
+        return edge_store;
+    }
 
     void use_full_sfr(void) {
         mtf_width = 4 * NYQUIST_FREQ;
@@ -195,6 +231,40 @@ class Mtf_core {
         return mtf_contrast;
     }
     
+    // additional contrast levels, e.g., 0.1 -> MTF10, evaluated on the same SFR as the primary level
+    void set_extra_mtf_contrasts(const vector<double>& contrasts) {
+        extra_mtf_contrasts.clear();
+        for (double c: contrasts) {
+            extra_mtf_contrasts.push_back(std::max(0.01, std::min(c, 0.9)));
+        }
+    }
+    
+    const vector<double>& get_extra_mtf_contrasts(void) const {
+        return extra_mtf_contrasts;
+    }
+    
+    // copies of the blocks returned by get_blocks(), with the MTF values
+    // of the specified entry of the extra contrast level list; get_blocks() must
+    // have been called first, so that concurrent callers only read the blocks
+    vector<Block> get_level_blocks(size_t level) const {
+        assert(shared_blocks_map.empty());
+        vector<Block> level_blocks;
+        for (const auto& b: detected_blocks) {
+            level_blocks.push_back(b.level_view(level));
+        }
+        return level_blocks;
+    }
+    
+    // Bayer subsets to measure on every edge in addition to the primary subset;
+    // edge detection and the edge models are shared with the primary subset
+    void set_extra_bayer_subsets(const vector<Bayer::bayer_t>& subsets) {
+        extra_bayer_subsets = subsets;
+    }
+    
+    const vector<Bayer::bayer_t>& get_extra_bayer_subsets(void) const {
+        return extra_bayer_subsets;
+    }
+    
     void process_image_as_roi(
         const cv::Rect2i& bounds, 
         cv::Point2d handle_a = cv::Point2d(-1e11, -1e11),
@@ -203,6 +273,14 @@ class Mtf_core {
     
     void process_manual_rois(const string& roi_fname);
     
+    // reads the (handle_a, handle_b) pairs of an --roi-file, in input image coordinates
+    static bool read_manual_rois(const string& roi_fname, vector<std::pair<Point2d, Point2d>>& rois);
+    
+    // position of img within the input image, which is what the --roi-file coordinates refer to
+    void set_roi_origin(const Point2d& origin) {
+        roi_origin = origin;
+    }
+    
     void set_esf_model(std::unique_ptr<Esf_model>&& model) {
         esf_model = std::move(model);
     }
@@ -219,10 +297,20 @@ class Mtf_core {
         return sliding_edges;
     }
     
+    // false if the ESF sampler could not be constructed, i.e., the deferred
+    // sampler without an undistortion model; nothing may be processed then
+    bool valid(void) const {
+        return esf_sampler != nullptr;
+    }
+    
     Esf_sampler* get_esf_sampler(void) const {
         return esf_sampler;
     }
     
+    void set_cfa_planes(const Cfa_planes* planes) {
+        esf_sampler->set_cfa_planes(planes);
+    }
+    
     Bayer::cfa_pattern_t get_cfa_pattern(void) const {
         return cfa_pattern;
     }
@@ -231,6 +319,15 @@ class Mtf_core {
         return single_roi_mode;
     }
     
+    // the remaining objects are skipped once *flag is set
+    void set_abort_flag(const std::atomic<bool>* flag) {
+        abort_flag = flag;
+    }
+    
+    bool aborted(void) const {
+        return abort_flag && abort_flag->load(std::memory_order_relaxed);
+    }
+    
     const Component_labeller& cl;
     const Gradient&           g;
     const cv::Mat&            img;
@@ -248,7 +345,12 @@ class Mtf_core {
     
     vector<Mtf_profile_sample> samples;
     
-    cv::Mat od_img;
+    // Detection overlay primitives, recorded during search_borders(). The
+    // full-resolution overlay image is only rasterised by detection_overlay()
+    vector<cv::Point> od_points;
+    vector<std::array<cv::Point2d, 4>> od_quads;
+    
+    cv::Mat detection_overlay(void) const;
     
     #ifdef MDEBUG
     double noise_seed = 10;
@@ -265,12 +367,30 @@ class Mtf_core {
     bool find_fiducials;
     Undistort* undistort = nullptr;
     bool ridges_only;
+    bool retain_edge_geometry = false;
+    Point2d roi_origin = Point2d(0, 0);
+    const std::atomic<bool>* abort_flag = nullptr;
+    std::shared_ptr<Edge_store> edge_store = std::make_shared<Edge_store>();
     size_t mtf_width = 2 * NYQUIST_FREQ;
     Esf_sampler* esf_sampler = nullptr;
     double mtf_contrast = 0.5; // target MTF contrast, e.g., 0.5 -> MTF50
+    vector<double> extra_mtf_contrasts;
     std::unique_ptr<Esf_model> esf_model;
     vector<std::pair<Point2d, Point2d>> sliding_edges;
+    vector<Bayer::bayer_t> extra_bayer_subsets;
+    
+    class Subset_measurement {
+      public:
+        double mtf50 = 0;
+        double quality = 0;
+        vector<double> sfr;
+        vector<double> esf;
+        Snr snr;
+    };
     
+    double mtf_crossing(const vector<double>& magnitude, const vector<double>& base_mtf, 
+                        double n0, double contrast, double quad) const;
+    vector<Subset_measurement> measure_extra_subsets(Edge_model& edge_model, const map<int, scanline>& scanset, bool allow_peak_shift);
     void process_with_sliding_window(Mrectangle& rrect);
     bool homogenous(const Point2d& cent, int label, const Mrectangle& rrect) const;
     bool single_roi_mode = false;
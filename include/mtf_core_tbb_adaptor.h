@@ -38,7 +38,7 @@ class Mtf_core_tbb_adaptor {
     }
 
     void operator()(const Stride_range& r) const {
-        for (size_t i=r.begin(); i != r.end(); r.increment(i)) {
+        for (size_t i=r.begin(); i != r.end() && !mtf_core->aborted(); r.increment(i)) {
             Boundarylist::const_iterator it = mtf_core->cl.get_boundaries().find(mtf_core->valid_obj[i]);
             Point2d cent = centroid(it->second);
             mtf_core->search_borders(cent, mtf_core->valid_obj[i]);
@@ -48,4 +48,19 @@ class Mtf_core_tbb_adaptor {
     Mtf_core* mtf_core;  
 };
 
+class Mtf_core_layout_adaptor {
+  public:
+    Mtf_core_layout_adaptor(Mtf_core* core, const Chart_layout* layout) : mtf_core(core), layout(layout) {
+    }
+
+    void operator()(const Stride_range& r) const {
+        for (size_t i=r.begin(); i != r.end() && !mtf_core->aborted(); r.increment(i)) {
+            mtf_core->measure_layout_block(*layout, i);
+        }
+    }
+  
+    Mtf_core* mtf_core;
+    const Chart_layout* layout;
+};
+
 #endif
@@ -0,0 +1,191 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#ifndef MTF_ENGINE_H
+#define MTF_ENGINE_H
+
+#include "include/common_types.h"
+#include "include/block.h"
+#include "include/ellipse.h"
+#include "include/mtf_profile_sample.h"
+#include "include/bayer.h"
+#include "include/display_profile.h"
+#include "include/distance_scale.h"
+#include "include/job_metadata.h"
+
+#include <string>
+#include <atomic>
+using std::string;
+
+// Analysis settings; the defaults match those of the mtf_mapper command line tool.
+class Mtf_engine_options {
+  public:
+    // input interpretation
+    bool linear = false;                  // treat 8-bit input as linear, rather than sRGB
+    bool border = false;                  // add a white border around the image
+    bool autocrop = false;
+    bool imatest_chart = false;
+    string bayer = "none";
+    string cfa_pattern = "rggb";
+    vector<string> extra_bayer;
+    bool cfa_planes = false;
+    Display_profile display_profile;      // only used by process(const cv::Mat&, ...)
+    
+    // object detection
+    double threshold = 0.55;
+    double threshold_window = 0.33333;    // fraction of min(width, height)
+    int min_threshold_window = 500;       // lower bound on the window size, in pixels
+    bool checkerboard = false;
+    int checkerboard_radius = 2;
+    bool single_roi = false;
+    string roi_file;                      // only process the ROIs in this file, if not empty
+    int detection_downsample = 1;         // find candidate targets at 1/2 or 1/4 resolution, if > 1
+    string layout_file;                   // reuse the block layout in this file, or record it there, if not empty
+    
+    // geometric corrections
+    double equiangular = 0;               // focal length (mm) of an equi-angular lens, if > 0
+    double stereographic = 0;             // focal length (mm) of a stereographic lens, if > 0
+    double pixel_pitch = 0;               // in microns; required by the fisheye models
+    bool rectilinear_equivalent = false;
+    bool undistort_crop = true;
+    bool optimize_distortion = false;
+    
+    // ESF construction and SFR
+    string esf_sampler = "piecewise-quadratic";
+    string esf_model = "kernel";
+    double alpha = 0;                     // ESF model smoothing parameter, if > 0
+    bool monotonic_filter = false;
+    double snap_angle = -1;               // in degrees, if >= 0
+    bool absolute_sfr = false;
+    bool sfr_smoothing = true;
+    bool full_sfr = false;
+    double mtf_contrast = 50;             // percentage
+    vector<double> extra_mtf_contrasts;   // percentages
+    
+    // special charts, and chromatic aberration
+    bool focus = false;
+    bool mf_profile = false;
+    bool chart_orientation = false;
+    double focal_ratio = -2;
+    string fiducial_correspondence_file;  // written by the chart pose estimation, if not empty
+    bool ca = false;
+    bool ca_all_edges = false;
+    
+    #ifdef MDEBUG
+    bool bradley = false;
+    bool single_threaded = false;
+    double ridge = 5e-8;
+    double noise_seed = 10;
+    double noise_sd = 0;
+    #endif
+};
+
+// Everything the renderers need; the intermediate images are released before this is returned.
+class Mtf_engine_result {
+  public:
+    cv::Mat image;                        // luminance image on which the edges were measured
+    cv::Rect img_dimension_correction;    // offset of image relative to the input, after cropping
+    int input_channels = 1;
+    Job_metadata job_metadata;
+    Bayer::bayer_t bayer = Bayer::NONE;
+    double mtf_contrast = 0.5;
+    
+    vector<Block> blocks;
+    vector<double> extra_mtf_contrasts;
+    vector<vector<Block>> level_blocks;   // one per entry in extra_mtf_contrasts
+    vector<Bayer::bayer_t> extra_bayer_subsets;
+    vector<vector<Block>> channel_blocks; // one per entry in extra_bayer_subsets
+    
+    // only populated for the focus, mf-profile and chart orientation modes
+    vector<Mtf_profile_sample> samples;
+    vector<std::pair<Point2d, Point2d>> sliding_edges;
+    vector<Ellipse_detector> ellipses;
+    Distance_scale distance_scale;
+};
+
+// The MTF Mapper analysis pipeline, from a decoded image to the measured edges.
+// The embedding application must define the global Logger instance (see logger.h).
+class Mtf_engine {
+  public:
+    // exit codes of the mtf_mapper command line tool, returned by process()
+    enum status_t {
+        OK = 0,
+        INVALID_OPTIONS = 1,
+        UNREADABLE_INPUT = 2,
+        NO_TARGETS_FOUND = 4,
+        INVALID_IMAGE_TYPE = 5,
+        MEMORY_BUDGET_EXCEEDED = 6,
+        ABORTED = 7
+    };
+    
+    Mtf_engine(const Mtf_engine_options& options);
+    
+    // checks the consistency of the options, logging the reason if they are not
+    status_t validate(void) const;
+    
+    // decodes the image file, and picks up its embedded colour profile, if any
+    status_t process(const string& fname, Mtf_engine_result& result);
+    
+    // img must be 8-bit or 16-bit unsigned, with 1, 3 or 4 channels; it is not modified.
+    // An existing buffer can be passed without copying as cv::Mat(rows, cols, type, data, step)
+    status_t process(const cv::Mat& img, Mtf_engine_result& result);
+    
+    // process() returns ABORTED soon after *flag is set by another thread;
+    // the flag must outlive the call to process()
+    void set_abort_flag(const std::atomic<bool>* flag) {
+        abort_flag = flag;
+    }
+    
+  private:
+    bool aborted(void) const {
+        return abort_flag && abort_flag->load(std::memory_order_relaxed);
+    }
+    
+    // the Sauvola threshold window, in pixels, for the (luminance) image cvimg
+    int threshold_window_size(const cv::Mat& cvimg) const;
+    
+    // clamps a target contrast (in percent) given with --mtf or --extra-mtf to the supported range
+    static double clamp_mtf_contrast(double contrast);
+    
+    // decodes only the part of an uncompressed TIFF that is covered by the --roi-file ROIs
+    bool decode_roi_region(const string& fname, cv::Mat& img, cv::Rect& dimensions) const;
+    
+    // maps the results measured on a region decoded by decode_roi_region() back onto the
+    // whole input, so that the outputs do not depend on how the input was decoded
+    static void restore_input_frame(const cv::Rect& dimensions, Mtf_engine_result& result);
+    
+    // thresholds and labels a downsampled copy of cvimg to find candidate targets, then thresholds
+    // cvimg only inside the returned regions around them; returns no regions if none were found
+    vector<cv::Rect> coarse_detection(const cv::Mat& cvimg, int factor, double threshold, int S, cv::Mat& masked_img) const;
+    
+    Mtf_engine_options opts;
+    const std::atomic<bool>* abort_flag = nullptr;
+    cv::Rect input_dimensions; // offset of the image passed to process() within the input, and the input size
+    bool owns_input = false;   // set when process(const string&, ...) hands over its decoded image
+};
+
+#endif
@@ -0,0 +1,85 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#ifndef MTF_JOB_H
+#define MTF_JOB_H
+
+#include "include/mtf_engine.h"
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <memory>
+#include <atomic>
+
+// One invocation of mtf_mapper: parses the command line arguments, runs the
+// analysis engine, and renders the requested outputs to the working directory.
+// Several jobs may run concurrently in one process, e.g., in the GUI, provided
+// that only the command line tool calls apply_process_settings().
+class Mtf_job {
+  public:
+    Mtf_job(void);
+    ~Mtf_job(void);
+    
+    // returns false if the job should not be run, with the exit code in exit_code
+    bool parse(int argc, char** argv, int& exit_code);
+    bool parse(const vector<string>& argv, int& exit_code);
+    
+    // by default invalid arguments (and --help, --version) terminate the process
+    void set_exit_on_error(bool exit_on_error) {
+        exit_on_error_flag = exit_on_error;
+    }
+    
+    // process-wide settings: log file, log level, trace, memory budget, PNG level;
+    // these affect every job in the process, so embedded callers (the GUI) do not
+    // call this, and run() warns that the corresponding options are ignored
+    int apply_process_settings(void);
+    
+    // run() returns Mtf_engine::ABORTED soon after *flag is set by another thread
+    void set_abort_flag(const std::atomic<bool>* flag) {
+        abort_flag = flag;
+    }
+    
+    // returns the exit code of the mtf_mapper command line tool
+    int run(void);
+    
+    // peak memory use and the stage trace, if requested
+    void report_process_statistics(void);
+    
+  private:
+    struct Arguments;
+    std::unique_ptr<Arguments> args;
+    
+    const std::atomic<bool>* abort_flag = nullptr;
+    bool exit_on_error_flag = true;
+    bool process_settings_applied = false;
+};
+
+#endif
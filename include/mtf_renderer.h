@@ -38,7 +38,21 @@ class Mtf_renderer {
     
     virtual void render(const vector<Block>& blocks) = 0;
     
+    // draw plots directly with Plot_raster, rather than running gnuplot
+    void set_builtin_plots(bool builtin) {
+        builtin_plots = builtin;
+    }
+    
+    // gzip the bulk text outputs (print/sfr/esf/edges renderers)
+    void set_compressed_output(bool compress) {
+        compressed_output = compress;
+    }
+    
     string img_filename;
+    
+  protected:
+    bool builtin_plots = false;
+    bool compressed_output = false;
 };
 
 #endif
@@ -43,6 +43,12 @@ class Mtf_renderer_annotate : public Mtf_renderer {
     }
     
     void render(const vector<Block>& blocks);
+    
+    // downscale the annotated image by this factor before encoding it
+    void set_output_scale(double scale) {
+        output_scale = scale;
+    }
+    
     void write_number(cv::Mat& img, int px, int py, double val, double quality, double font_scale);
     
     const cv::Mat& img;
@@ -51,6 +57,7 @@ class Mtf_renderer_annotate : public Mtf_renderer {
     bool    lpmm_mode;
     double  pixel_size;
     bool jpeg_output = false;
+    double output_scale = 1.0;
 };
 
 #endif
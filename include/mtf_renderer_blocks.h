@@ -30,6 +30,7 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 
 #include "mtf_renderer.h"
 #include "common_types.h"
+#include "include/image_encoder.h"
 
 class Mtf_renderer_blocks : public Mtf_renderer {
   public:
@@ -51,7 +52,7 @@ class Mtf_renderer_blocks : public Mtf_renderer {
         }    
         delete [] pts;
         
-        imwrite(ofname, out_img);
+        Image_encoder::instance().submit(ofname, out_img);
     }
     
     const cv::Mat& img;
@@ -191,7 +191,7 @@ class Mtf_renderer_chart_orientation : public Mtf_renderer {
         }
         
         
-        imwrite(wdir + '/' + co_fname, draw.rimg);
+        Image_encoder::instance().submit(wdir + '/' + co_fname, draw.rimg);
     }
     
   private:
@@ -33,6 +33,8 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #include "include/ordered_point.h"
 #include "include/output_version.h"
 #include "include/job_metadata.h"
+#include "include/edge_table.h"
+#include "include/text_writer.h"
 
 class Mtf_renderer_edges : public Mtf_renderer {
   public:
@@ -61,12 +63,13 @@ class Mtf_renderer_edges : public Mtf_renderer {
         
     
     
-        FILE* fout = fopen(ofname.c_str(), "wt");
-        FILE* sfrout = fopen(sfrname.c_str(), "wt");
-        FILE* devout = fopen(devname.c_str(), "wt");
+        Text_writer fout(ofname, compressed_output);
+        Text_writer sfrout(sfrname, compressed_output);
+        Text_writer devout(devname, compressed_output);
         
         FILE* serout = NULL;
-        if (output_version >= Output_version::V2) {
+        Edge_table::Writer edge_table;
+        if (output_version == Output_version::V2) {
             serout = fopen(serialname.c_str(), "wb");
             
             if (serout) {
@@ -86,39 +89,39 @@ class Mtf_renderer_edges : public Mtf_renderer {
         }
         
         if (output_version >= Output_version::V2) {
-            fprintf(sfrout, "# MTF Mapper SFR, output format version %d \n", int(output_version));
-            fprintf(sfrout, "# column  1: block_id\n");
-            fprintf(sfrout, "# column  2: edge centroid x (pixels)\n");
-            fprintf(sfrout, "# column  3: edge centroid y (pixels)\n");
-            fprintf(sfrout, "# column  4: slanted edge orientation (degrees, modulo 45 degrees)\n");
-            fprintf(sfrout, "# column  5: edge orientation relative to radial line to centre (degrees)\n");
-            fprintf(sfrout, "# column  6: mean CNR (50%% weight to each of dark and bright sides)\n");
-            fprintf(sfrout, "# column  7: dark side CNR\n");
-            fprintf(sfrout, "# column  8: bright side CNR\n");
-            fprintf(sfrout, "# column  9: dark side SNR\n");
-            fprintf(sfrout, "# column 10: bright side SNR\n");
-            fprintf(sfrout, "# column 11: contrast\n");
-            fprintf(sfrout, "# column 12: effective oversampling factor (maximum is 8x, below 4x is considered poor)\n");
-            fprintf(sfrout, "# column 13: effective edge length (a value below 25 pixels is considered poor)\n");
+            sfrout.printf("# MTF Mapper SFR, output format version %d \n", int(output_version));
+            sfrout.put("# column  1: block_id\n");
+            sfrout.put("# column  2: edge centroid x (pixels)\n");
+            sfrout.put("# column  3: edge centroid y (pixels)\n");
+            sfrout.put("# column  4: slanted edge orientation (degrees, modulo 45 degrees)\n");
+            sfrout.put("# column  5: edge orientation relative to radial line to centre (degrees)\n");
+            sfrout.printf("# column  6: mean CNR (50%% weight to each of dark and bright sides)\n");
+            sfrout.put("# column  7: dark side CNR\n");
+            sfrout.put("# column  8: bright side CNR\n");
+            sfrout.put("# column  9: dark side SNR\n");
+            sfrout.put("# column 10: bright side SNR\n");
+            sfrout.put("# column 11: contrast\n");
+            sfrout.put("# column 12: effective oversampling factor (maximum is 8x, below 4x is considered poor)\n");
+            sfrout.put("# column 13: effective edge length (a value below 25 pixels is considered poor)\n");
             
-            fprintf(fout, "# MTF Mapper MTF summary, output format version %d \n", int(output_version));
-            fprintf(fout, "# column  1: block_id\n");
-            fprintf(fout, "# column  2: edge centroid x (pixels)\n");
-            fprintf(fout, "# column  3: edge centroid y (pixels)\n");
-            fprintf(fout, "# column  4: MTF-%d value (%s)\n", (int)lrint(metadata.mtf_contrast*100), lpmm_mode ? "lp/mm" : "c/p");
-            fprintf(fout, "# column  5: nearby corner x (pixels)\n");
-            fprintf(fout, "# column  6: nearby corner y (pixels)\n");
-            fprintf(fout, "# column  7: mean CNR (50%% weight to each of dark and bright sides)\n");
-            fprintf(fout, "# column  8: effective oversampling factor (maximum is 8x, below 4x is considered poor)\n");
-            fprintf(fout, "# column  9: effective edge length (a value below 25 pixels is considered poor)\n");
+            fout.printf("# MTF Mapper MTF summary, output format version %d \n", int(output_version));
+            fout.put("# column  1: block_id\n");
+            fout.put("# column  2: edge centroid x (pixels)\n");
+            fout.put("# column  3: edge centroid y (pixels)\n");
+            fout.printf("# column  4: MTF-%d value (%s)\n", (int)lrint(metadata.mtf_contrast*100), lpmm_mode ? "lp/mm" : "c/p");
+            fout.put("# column  5: nearby corner x (pixels)\n");
+            fout.put("# column  6: nearby corner y (pixels)\n");
+            fout.printf("# column  7: mean CNR (50%% weight to each of dark and bright sides)\n");
+            fout.put("# column  8: effective oversampling factor (maximum is 8x, below 4x is considered poor)\n");
+            fout.put("# column  9: effective edge length (a value below 25 pixels is considered poor)\n");
             
-            fprintf(devout, "# MTF Mapper line deviation, output format version %d \n", int(output_version));
-            fprintf(devout, "# column  1: block_id\n");
-            fprintf(devout, "# column  2: edge centroid x (pixels)\n");
-            fprintf(devout, "# column  3: edge centroid y (pixels)\n");
-            fprintf(devout, "# column  4: slope, i.e., rise/run\n");
-            fprintf(devout, "# column  5: rise\n");
-            fprintf(devout, "# column  6: run\n");
+            devout.printf("# MTF Mapper line deviation, output format version %d \n", int(output_version));
+            devout.put("# column  1: block_id\n");
+            devout.put("# column  2: edge centroid x (pixels)\n");
+            devout.put("# column  3: edge centroid y (pixels)\n");
+            devout.put("# column  4: slope, i.e., rise/run\n");
+            devout.put("# column  5: rise\n");
+            devout.put("# column  6: run\n");
         }
         
         vector<int> corder(4);
@@ -219,28 +222,23 @@ class Mtf_renderer_edges : public Mtf_renderer {
                 }
                 
                 if (output_version == Output_version::V1) {
-                    fprintf(fout, "%d %lf %lf %lf %lf %lf\n",
-                        int(i),
-                        ec.x, ec.y,
-                        lpmm_mode ? val*pixel_size : val,
-                        cr.x, cr.y
-                    );
+                    fout.integer(i).put(' ').fixed(ec.x).put(' ').fixed(ec.y).put(' ')
+                        .fixed(lpmm_mode ? val*pixel_size : val).put(' ')
+                        .fixed(cr.x).put(' ').fixed(cr.y).put('\n');
                 }
                 
                 if (output_version >= Output_version::V2) {
-                    fprintf(fout, "%d %lf %lf %lf %lf %lf %.3lf %.1lf %.1lf\n",
-                        int(i),
-                        ec.x, ec.y,
-                        lpmm_mode ? val*pixel_size : val,
-                        cr.x, cr.y, snr.mean_cnr(), snr.oversampling(),
-                        edge_length
-                    );
+                    fout.integer(i).put(' ').fixed(ec.x).put(' ').fixed(ec.y).put(' ')
+                        .fixed(lpmm_mode ? val*pixel_size : val).put(' ')
+                        .fixed(cr.x).put(' ').fixed(cr.y).put(' ')
+                        .fixed(snr.mean_cnr(), 3).put(' ').fixed(snr.oversampling(), 1).put(' ')
+                        .fixed(edge_length, 1).put('\n');
                 }
                 
-                fprintf(sfrout, "%d %lf %lf ", int(i), ec.x, ec.y);
+                sfrout.integer(i).put(' ').fixed(ec.x).put(' ').fixed(ec.y).put(' ');
                 
                 double edge_angle = atan2(-blocks[i].get_normal(l).x, blocks[i].get_normal(l).y);
-                fprintf(sfrout, "%lf ", angle_reduce(edge_angle));
+                sfrout.fixed(angle_reduce(edge_angle)).put(' ');
                 
                 Point2d cent = blocks[i].get_edge_centroid(l);
 
@@ -252,39 +250,60 @@ class Mtf_renderer_edges : public Mtf_renderer {
                 Point2d norm = blocks[i].get_normal(l);
 
                 double delta = dir.x*norm.x + dir.y*norm.y;
-                fprintf(sfrout, "%lf ", acos(fabs(delta))/M_PI*180.0);
+                sfrout.fixed(acos(fabs(delta))/M_PI*180.0).put(' ');
                 
                 if (output_version >= Output_version::V2) {
-                    fprintf(sfrout, "%.3lf %.3lf %.3lf %.3lf %.3lf %.1lf %.1lf %.1lf ",
-                        snr.mean_cnr(), snr.dark_cnr(), snr.bright_cnr(),
-                        snr.dark_snr(), snr.bright_snr(), snr.contrast(),
-                        snr.oversampling(), edge_length
-                    );
+                    sfrout.fixed(snr.mean_cnr(), 3).put(' ').fixed(snr.dark_cnr(), 3).put(' ').fixed(snr.bright_cnr(), 3).put(' ')
+                        .fixed(snr.dark_snr(), 3).put(' ').fixed(snr.bright_snr(), 3).put(' ').fixed(snr.contrast(), 1).put(' ')
+                        .fixed(snr.oversampling(), 1).put(' ').fixed(edge_length, 1).put(' ');
                 }
                 
-                const vector<double>& sfr = blocks[i].get_sfr(l);
+                const Edge_store::Span sfr = blocks[i].get_sfr(l);
                 for (size_t j=0; j < sfr.size(); j++) {
-                    fprintf(sfrout, "%lf ", sfr[j]);
+                    sfrout.fixed(sfr[j]).put(' ');
                 }
-                fprintf(sfrout, "\n");
+                sfrout.put('\n');
                 
                 cv::Point3d deviation = blocks[i].get_line_deviation(l);
-                fprintf(devout, "%d %lf %lf %.8lf %lf %lf\n", int(i), ec.x, ec.y, deviation.x, deviation.y, deviation.z);
+                devout.integer(i).put(' ').fixed(ec.x).put(' ').fixed(ec.y).put(' ')
+                    .fixed(deviation.x, 8).put(' ').fixed(deviation.y).put(' ').fixed(deviation.z).put('\n');
             }
             
-            if (output_version >= Output_version::V2) {
+            if (output_version == Output_version::V2) {
                 bool success = blocks[i].serialize(serout);
                 serialization_errors |= !success;
             }
+            
+            if (output_version >= Output_version::V3) {
+                for (size_t k=0; k < 4; k++) {
+                    if (!blocks[i].get_edge_valid(k)) continue;
+                    const Snr& snr = blocks[i].get_snr(k);
+                    edge_table.add(
+                        uint32_t(i),
+                        blocks[i].get_edge_centroid(k),
+                        atan2(-blocks[i].get_normal(k).x, blocks[i].get_normal(k).y),
+                        blocks[i].get_mtf50_value(k),
+                        Point2d(snr.mean_cnr(), snr.oversampling()),
+                        blocks[i].get_ca(k),
+                        blocks[i].get_edge_length(k),
+                        blocks[i].get_sfr(k).to_vector(),
+                        blocks[i].get_esf(k).to_vector()
+                    );
+                }
+            }
         }    
-        fclose(fout);
-        fclose(sfrout);
-        fclose(devout);
+        fout.close();
+        sfrout.close();
+        devout.close();
         
-        if (output_version >= Output_version::V2 && serout) {
+        if (output_version == Output_version::V2 && serout) {
             fclose(serout);
         }
         
+        if (output_version >= Output_version::V3) {
+            serialization_errors |= !edge_table.write(serialname, metadata);
+        }
+        
         if (serialization_errors) {
             logger.error("%s\n", "One or more errors during edge serialization");
         }
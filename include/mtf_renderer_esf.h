@@ -31,6 +31,7 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #include "mtf_renderer.h"
 #include "include/output_version.h"
 #include "common_types.h"
+#include "include/text_writer.h"
 
 class Mtf_renderer_esf : public Mtf_renderer {
   public:
@@ -40,41 +41,41 @@ class Mtf_renderer_esf : public Mtf_renderer {
     }
     
     void render(const vector<Block>& blocks) {
-        FILE* fout_esf = fopen(ofname_esf.c_str(), "wt");
-        FILE* fout_lsf = fopen(ofname_lsf.c_str(), "wt");
+        Text_writer fout_esf(ofname_esf, compressed_output);
+        Text_writer fout_lsf(ofname_lsf, compressed_output);
 
         printf("output version = %d", (int)output_version);
 
         if (output_version >= Output_version::V2) {
-            fprintf(fout_esf, "# MTF Mapper ESF, output format version %d \n", int(output_version));
-            fprintf(fout_esf, "# column  1: block_id\n");
-            fprintf(fout_esf, "# column  2: edge centroid x (pixels)\n");
-            fprintf(fout_esf, "# column  3: edge centroid y (pixels)\n");
-            fprintf(fout_esf, "# column  4: ESF sample spacing (pixels)\n");
-            fprintf(fout_esf, "# column  5: number of ESF samples, N\n");
-            fprintf(fout_esf, "# next N columns: ESF samples\n");
-
-            fprintf(fout_lsf, "# MTF Mapper LSF, output format version %d \n", int(output_version));
-            fprintf(fout_lsf, "# column  1: block_id\n");
-            fprintf(fout_lsf, "# column  2: edge centroid x (pixels)\n");
-            fprintf(fout_lsf, "# column  3: edge centroid y (pixels)\n");
-            fprintf(fout_lsf, "# column  4: LSF sample spacing (pixels)\n");
-            fprintf(fout_lsf, "# column  5: number of LSF samples, N\n");
-            fprintf(fout_lsf, "# next N columns: LSF samples\n");
+            fout_esf.printf("# MTF Mapper ESF, output format version %d \n", int(output_version));
+            fout_esf.put("# column  1: block_id\n");
+            fout_esf.put("# column  2: edge centroid x (pixels)\n");
+            fout_esf.put("# column  3: edge centroid y (pixels)\n");
+            fout_esf.put("# column  4: ESF sample spacing (pixels)\n");
+            fout_esf.put("# column  5: number of ESF samples, N\n");
+            fout_esf.put("# next N columns: ESF samples\n");
+
+            fout_lsf.printf("# MTF Mapper LSF, output format version %d \n", int(output_version));
+            fout_lsf.put("# column  1: block_id\n");
+            fout_lsf.put("# column  2: edge centroid x (pixels)\n");
+            fout_lsf.put("# column  3: edge centroid y (pixels)\n");
+            fout_lsf.put("# column  4: LSF sample spacing (pixels)\n");
+            fout_lsf.put("# column  5: number of LSF samples, N\n");
+            fout_lsf.put("# next N columns: LSF samples\n");
         }
 
         for (size_t i=0; i < blocks.size(); i++) {
             for (size_t k=0; k < 4; k++) {
-                const vector<double>& esf = blocks[i].get_esf(k);
+                const Edge_store::Span esf = blocks[i].get_esf(k);
 
                 if (output_version >= Output_version::V2) {
-                    fprintf(fout_esf, "%d %lf %lf 0.125 %d ", int(i), blocks[i].get_edge_centroid(k).x, blocks[i].get_edge_centroid(k).y, int(esf.size()));
+                    fout_esf.integer(i).put(' ').fixed(blocks[i].get_edge_centroid(k).x).put(' ').fixed(blocks[i].get_edge_centroid(k).y).put(" 0.125 ").integer(esf.size()).put(' ');
                 }
 
                 for (size_t j=0; j < esf.size(); j++) {
-                    fprintf(fout_esf, "%lf ", esf[j]);
+                    fout_esf.fixed(esf[j]).put(' ');
                 }
-                fprintf(fout_esf, "\n");
+                fout_esf.put('\n');
                 
                 double sum = 0;
                 for (size_t j=1; j < esf.size()-1; j++) {
@@ -82,19 +83,19 @@ class Mtf_renderer_esf : public Mtf_renderer {
                 }
 
                 if (output_version >= Output_version::V2) {
-                    fprintf(fout_lsf, "%d %lf %lf 0.125 %d ", int(i), blocks[i].get_edge_centroid(k).x, blocks[i].get_edge_centroid(k).y, int(esf.size()));
+                    fout_lsf.integer(i).put(' ').fixed(blocks[i].get_edge_centroid(k).x).put(' ').fixed(blocks[i].get_edge_centroid(k).y).put(" 0.125 ").integer(esf.size()).put(' ');
                 }
                 
                 double sign = sum < 0 ? -1 : 1;
-                fprintf(fout_lsf, "%lf ", 0.0);
+                fout_lsf.fixed(0.0).put(' ');
                 for (size_t j=1; j < esf.size()-1; j++) {
-                    fprintf(fout_lsf, "%lf ", sign*(esf[j+1] - esf[j-1])*0.5);
+                    fout_lsf.fixed(sign*(esf[j+1] - esf[j-1])*0.5).put(' ');
                 }
-                fprintf(fout_lsf, " %lf\n", 0.0);
+                fout_lsf.put(' ').fixed(0.0).put('\n');
             }
         }    
-        fclose(fout_esf);
-        fclose(fout_lsf);
+        fout_esf.close();
+        fout_lsf.close();
     }
     
     string ofname_esf;
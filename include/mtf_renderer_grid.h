@@ -105,6 +105,11 @@ class Mtf_renderer_grid : public Mtf_renderer {
         sparse_chart = s;
     }
     
+    // appended to the names of the gnuplot script and plot images
+    void set_output_suffix(const std::string& suffix) {
+        output_suffix = suffix;
+    }
+    
     bool gnuplot_failed(void) {
         return gnuplot_failure;
     }
@@ -126,6 +131,7 @@ class Mtf_renderer_grid : public Mtf_renderer {
     std::string wdir;
     std::string fname;
     std::string gnuplot_binary;
+    std::string output_suffix;
     
     // grid used to fit local polynomial
     size_t grid_x_coarse;
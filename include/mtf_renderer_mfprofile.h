@@ -43,6 +43,7 @@ using std::make_pair;
 #include "focus_surface.h"
 #include "distance_scale.h"
 #include "mtf50_edge_quality_rating.h"
+#include "include/image_encoder.h"
 
 class Mtf_renderer_mfprofile : public Mtf_renderer {
   public:
@@ -150,7 +151,7 @@ class Mtf_renderer_mfprofile : public Mtf_renderer {
         cv::putText(merged, tbuffer, Point2d(50, initial_rows + (merged.rows-initial_rows)/2), font, 1, cv::Scalar::all(0), 1, cv::LINE_AA);
         
         
-        imwrite(wdir + prname, merged);
+        Image_encoder::instance().submit(wdir + prname, merged);
         
     }
 
@@ -30,6 +30,7 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 
 #include "mtf_renderer.h"
 #include "common_types.h"
+#include "include/text_writer.h"
 
 class Mtf_renderer_print : public Mtf_renderer {
   public:
@@ -42,7 +43,7 @@ class Mtf_renderer_print : public Mtf_renderer {
     }
     
     void render(const vector<Block>& blocks) {
-        FILE* fout = fopen(ofname.c_str(), "wt");
+        Text_writer fout(ofname, compressed_output);
         for (size_t i=0; i < blocks.size(); i++) {
             if (!blocks[i].valid) continue;
             for (size_t k=0; k < 4; k++) {
@@ -51,15 +52,15 @@ class Mtf_renderer_print : public Mtf_renderer {
                     double ba = blocks[i].get_edge_angle(k);
                     double ad = acos(cos(angle)*cos(ba) + sin(angle)*sin(ba));
                     if (fabs(ad) < 5.0/180.0*M_PI || fabs(ad - M_PI) < 5.0/180.0*M_PI) {
-                        fprintf(fout, "%lf ", val);
+                        fout.fixed(val).put(' ');
                     }
                 } else {
-                    fprintf(fout, "%lf ", val);
+                    fout.fixed(val).put(' ');
                 }
             }
-            fprintf(fout, "\n");
+            fout.put('\n');
         }    
-        fclose(fout);
+        fout.close();
     }
     
     string ofname;
@@ -32,6 +32,7 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #include "mtf_renderer.h"
 #include "common_types.h"
 #include "loess_fit.h"
+#include "plot_raster.h"
 
 #include <stdlib.h>
 
@@ -236,8 +237,47 @@ class Mtf_renderer_profile : public Mtf_renderer {
             peak_mtf50*3*pixel_size
         );
         fclose(prfile);
+        
+        if (builtin_plots) {
+            Plot_raster::Series raw(Plot_raster::POINTS, cv::Scalar(32, 32, 255), 0.5*gnuplot_width/1024.0 + 1, "");
+            Plot_raster::Series smoothed(Plot_raster::LINES, cv::Scalar(32, 175, 32), 3*gnuplot_width/1024.0, "");
+            char label[128];
+            sprintf(label, "MTF%2d (%s) raw", mtf_contrast, lpmm_mode ? "lp/mm" : "c/p");
+            raw.label = label;
+            sprintf(label, "MTF%2d (%s) smoothed", mtf_contrast, lpmm_mode ? "lp/mm" : "c/p");
+            smoothed.label = label;
+            i = 0;
+            for (map<int, double>::const_iterator it = row_max.begin(); it != row_max.end(); ++it) {
+                raw.points.push_back(Point2d(it->first/pixel_size, it->second*pixel_size));
+                smoothed.points.push_back(Point2d(it->first/pixel_size, med_filt_mtf[i++]*pixel_size));
+            }
+            Plot_raster::Series focus(
+                Plot_raster::IMPULSES, 
+                peak_quality_good ? cv::Scalar(255, 114, 0) : cv::Scalar(211, 0, 148), 
+                3*gnuplot_width/1024.0, "Expected focus point"
+            );
+            focus.points.push_back(Point2d(
+                (transpose ? blocks[largest_block].get_edge_centroid(peak_idx).x : blocks[largest_block].get_edge_centroid(peak_idx).y)/pixel_size,
+                peak_mtf50*pixel_size
+            ));
+            
+            Plot_raster::Axes axes;
+            axes.xlabel = string("column (") + (lpmm_mode ? "mm" : "pixels") + ")";
+            sprintf(label, "MTF%2d (%s)", mtf_contrast, lpmm_mode ? "line pairs per mm" : "cycles/pixel");
+            axes.ylabel = label;
+            axes.ymin = 0;
+            axes.ymax = effective_max*pixel_size;
+            axes.legend_top = true;
+            
+            Plot_raster plot(gnuplot_width, int(gnuplot_width*768.0/1024.0), lrint(12.0*gnuplot_width/1024.0), img_filename);
+            plot.line_plot(Plot_raster::Panel(), {smoothed, raw, focus}, axes);
+            if (!plot.write(wdir + string("profile_image") + output_suffix + string(".png"))) {
+                logger.error("%s\n", "Failed to write profile image");
+            }
+            return;
+        }
 
-        FILE* gpf = fopen( (wdir + string("profile.gnuplot")).c_str(), "wt");
+        FILE* gpf = fopen( (wdir + string("profile") + output_suffix + string(".gnuplot")).c_str(), "wt");
         fprintf(gpf, "set xlab \"column (%s)\"\n", lpmm_mode ? "mm" : "pixels");
         fprintf(gpf, "set ylab \"MTF%2d (%s)\"\n", mtf_contrast, lpmm_mode ? "line pairs per mm" : "cycles/pixel");
         double ar = 768.0/1024.0;
@@ -258,7 +298,7 @@ class Mtf_renderer_profile : public Mtf_renderer {
         if (img_filename.length() > 0) {
             fprintf(gpf, "set title \"%s\" font \",%d\"\n", img_filename.c_str(), title_fontsize);
         }
-        fprintf(gpf, "set output \"%sprofile_image.png\"\n", wdir.c_str());
+        fprintf(gpf, "set output \"%sprofile_image%s.png\"\n", wdir.c_str(), output_suffix.c_str());
         fprintf(gpf, "plot [][0:%lf] \"%s\" i 0 u 1:3 t \"MTF%2d (%s) smoothed\" w l lw %d lc rgb \"#0020af20\", \"%s\" i 0 u 1:2 t \"MTF%2d (%s) raw\" w p ps %lf lc rgb \"#70ff2020\",  \"%s\" i 1 u 1:2 t \"Expected focus point\" w i lc %d lw %d\n",
             effective_max*pixel_size,
             (wdir+prname).c_str(), mtf_contrast, lpmm_mode ? "lp/mm" : "c/p", linewidth,
@@ -270,9 +310,9 @@ class Mtf_renderer_profile : public Mtf_renderer {
         
         char* buffer = new char[1024];
         #ifdef _WIN32
-        sprintf(buffer, "\"\"%s\" \"%sprofile.gnuplot\"\"", gnuplot_binary.c_str(), wdir.c_str());
+        sprintf(buffer, "\"\"%s\" \"%sprofile%s.gnuplot\"\"", gnuplot_binary.c_str(), wdir.c_str(), output_suffix.c_str());
         #else
-        sprintf(buffer, "\"%s\" \"%sprofile.gnuplot\"", gnuplot_binary.c_str(), wdir.c_str());
+        sprintf(buffer, "\"%s\" \"%sprofile%s.gnuplot\"", gnuplot_binary.c_str(), wdir.c_str(), output_suffix.c_str());
         #endif
         int rval = system(buffer);
         if (rval != 0) {
@@ -291,6 +331,11 @@ class Mtf_renderer_profile : public Mtf_renderer {
         gnuplot_warning = gnuplot;
     }
     
+    // appended to the names of the gnuplot script and plot image
+    void set_output_suffix(const std::string& suffix) {
+        output_suffix = suffix;
+    }
+    
     bool gnuplot_failed(void) {
         return gnuplot_failure;
     }
@@ -419,6 +464,7 @@ class Mtf_renderer_profile : public Mtf_renderer {
     int gnuplot_width;
     string img_filename;
     int mtf_contrast = 50;
+    std::string output_suffix;
 };
 
 #endif
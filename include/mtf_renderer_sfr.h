@@ -30,6 +30,7 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 
 #include "mtf_renderer.h"
 #include "common_types.h"
+#include "include/text_writer.h"
 
 class Mtf_renderer_sfr : public Mtf_renderer {
   public:
@@ -40,18 +41,18 @@ class Mtf_renderer_sfr : public Mtf_renderer {
     }
     
     void render(const vector<Block>& blocks) {
-        FILE* fout = fopen(ofname.c_str(), "wt");
+        Text_writer fout(ofname, compressed_output);
         for (size_t i=0; i < blocks.size(); i++) {
             for (size_t k=0; k < 4; k++) {
-                const vector<double>& sfr = blocks[i].get_sfr(k);
-                fprintf(fout, "%lf ", angle_reduce(atan2(-blocks[i].get_normal(k).x, blocks[i].get_normal(k).y)));
+                const Edge_store::Span sfr = blocks[i].get_sfr(k);
+                fout.fixed(angle_reduce(atan2(-blocks[i].get_normal(k).x, blocks[i].get_normal(k).y))).put(' ');
                 for (size_t j=0; j < sfr.size(); j++) {
-                    fprintf(fout, "%lf ", sfr[j]);
+                    fout.fixed(sfr[j]).put(' ');
                 }
-                fprintf(fout, "\n");
+                fout.put('\n');
             }
         }    
-        fclose(fout);
+        fout.close();
     }
     
     string ofname;
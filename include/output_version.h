@@ -42,6 +42,7 @@ class Output_version {
     typedef enum {
         V1=1,
         V2,
+        V3,  // columnar serialized_edges.bin (see edge_table.h)
         
         VLAST // not used
     } type;
@@ -51,7 +52,7 @@ class Output_version {
         return global_ov;
     }
     
-    vector<int>& get_versions(void) {
+    const vector<int>& get_versions(void) const {
         return version_vect;
     }
     
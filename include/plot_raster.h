@@ -0,0 +1,114 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#ifndef PLOT_RASTER_H
+#define PLOT_RASTER_H
+
+#include "include/common_types.h"
+
+#include <string>
+using std::string;
+
+// Minimal plotting backend that renders line plots, heat maps and surfaces
+// directly into an image, as an alternative to writing gnuplot scripts
+class Plot_raster {
+  public:
+    typedef enum {LINES, DASHED_LINES, POINTS, IMPULSES, FILLED_POLYGON} style_t;
+    
+    class Series {
+      public:
+        Series(style_t style, const cv::Scalar& colour, double line_width=1, const string& label="")
+        : style(style), colour(colour), line_width(line_width), label(label) {}
+      
+        vector<Point2d> points;
+        style_t style;
+        cv::Scalar colour;  // BGR
+        double line_width;
+        string label;
+        double opacity = 1.0;
+    };
+    
+    // axis limits; a limit equal to NaN is computed from the data
+    class Axes {
+      public:
+        string xlabel;
+        string ylabel;
+        string title;
+        double xmin = NAN;
+        double xmax = NAN;
+        double ymin = NAN;
+        double ymax = NAN;
+        double ytic = 0;           // 0 selects the tic spacing automatically
+        bool legend_top = false;   // legend at top right, otherwise bottom left
+    };
+    
+    // region of the canvas, as fractions of the canvas width and height
+    class Panel {
+      public:
+        Panel(double x=0, double y=0, double w=1, double h=1) : x(x), y(y), w(w), h(h) {}
+        double x;
+        double y;
+        double w;
+        double h;
+    };
+    
+    Plot_raster(int width, int height, int font_size, const string& title="");
+    
+    void line_plot(const Panel& panel, const vector<Series>& series, const Axes& axes);
+    
+    // 'values' is a CV_32FC1 grid covering [0, x_extent] x [0, y_extent], row 0 at the top
+    void heat_map(const Panel& panel, const cv::Mat& values, double x_extent, double y_extent,
+        double zmin, double zmax, const Axes& axes, int contour_levels=8);
+    
+    // oblique view of 'values' rendered as a shaded, filled mesh, similar to gnuplot's "view 25, 350"
+    void surface(const Panel& panel, const cv::Mat& values, double zmin, double zmax, 
+        const string& title, double elevation=25, double azimuth=350);
+    
+    bool write(const string& fname) const;
+    
+    const cv::Mat& image(void) const {
+        return canvas;
+    }
+    
+    // Moreland's diverging colour map, t in [0, 1]
+    static cv::Scalar palette(double t);
+    
+  private:
+    cv::Rect panel_rect(const Panel& panel) const;
+    void text(const string& s, cv::Point p, double scale, int halign=-1, bool vertical=false);
+    cv::Size text_size(const string& s, double scale) const;
+    static vector<double> tics(double lower, double upper, double step=0);
+    static string tic_label(double v, double step);
+    void colour_bar(const cv::Rect& r, double zmin, double zmax);
+    
+    cv::Mat canvas;
+    int font_size;
+    double font_scale;
+    int title_height;
+};
+
+#endif
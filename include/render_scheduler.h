@@ -0,0 +1,81 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#ifndef RENDER_SCHEDULER_H
+#define RENDER_SCHEDULER_H
+
+#include <vector>
+using std::vector;
+
+#include <string>
+using std::string;
+
+#include <functional>
+
+// Runs a set of render tasks concurrently, starting each task only once all
+// the tasks it depends on have completed. Tasks must only read shared state
+// (e.g., the blocks returned by Mtf_core::get_blocks()), or state owned by
+// the tasks they depend on. If a task fails (throws), the tasks that depend on
+// it, directly or indirectly, are skipped and reported as failed.
+class Render_scheduler {
+  public:
+    typedef size_t task_id;
+    
+    // max_concurrent == 0 selects the number of hardware threads
+    Render_scheduler(size_t max_concurrent = 0);
+    
+    task_id add(const string& name, std::function<void(void)> task, 
+        const vector<task_id>& dependencies = vector<task_id>());
+    
+    // blocks until all tasks have completed or have been skipped; returns
+    // the number of tasks that failed, including the skipped ones
+    size_t run(void);
+    
+    size_t size(void) const {
+        return tasks.size();
+    }
+    
+  private:
+    class Task {
+      public:
+        Task(const string& name, std::function<void(void)> func)
+        : name(name), func(func) {}
+        
+        string name;
+        std::function<void(void)> func;
+        vector<task_id> dependents;
+        size_t pending = 0;
+        bool started = false;
+        bool failed = false;
+        string failed_dependency; // non-empty if a dependency failed
+    };
+    
+    vector<Task> tasks;
+    size_t max_concurrent;
+};
+
+#endif
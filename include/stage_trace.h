@@ -0,0 +1,216 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#ifndef STAGE_TRACE_H
+#define STAGE_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+using std::string;
+
+#include "include/memory_tracker.h"
+using std::vector;
+
+// Lightweight instrumentation of the processing stages. Scopes and counters
+// are recorded into per-thread buffers only while tracing is enabled (--trace);
+// otherwise a Scope costs a single relaxed atomic load.
+// Names must outlive the trace, so pass string literals, or use intern().
+// Scopes in the "stage" category also record the memory high-water mark of the
+// process while they were active (see Memory_tracker); per-edge kernels should
+// use another category, e.g., "kernel", to keep their overhead low.
+// The trace is process-wide; it is only enabled by Mtf_job::apply_process_settings().
+class Stage_trace {
+  public:
+    typedef std::chrono::steady_clock clock;
+    
+    static Stage_trace& instance(void) {
+        static Stage_trace singleton;
+        return singleton;
+    }
+    
+    static bool enabled(void) {
+        return instance().active.load(std::memory_order_relaxed);
+    }
+    
+    void enable(bool b = true) {
+        if (b) {
+            origin = clock::now();
+        }
+        active.store(b, std::memory_order_relaxed);
+    }
+    
+    // returns a stable copy of a dynamically constructed name
+    static const char* intern(const string& name);
+    
+    // increments a counter, e.g., objects rejected for a particular reason
+    static void count(const char* name, int64_t delta = 1) {
+        if (enabled()) {
+            instance().buffer().add_count(name, delta);
+        }
+    }
+    
+    // records one observation of a distribution, e.g., samples per edge
+    static void sample(const char* name, double value) {
+        if (enabled()) {
+            instance().buffer().add_sample(name, value);
+        }
+    }
+    
+    // labels the calling thread in the trace
+    static void name_thread(const char* name) {
+        instance().buffer().name = name;
+    }
+    
+    class Scope {
+      public:
+        Scope(const char* name, const char* category = "stage") 
+        : name(name), category(category), recording(enabled()) {
+            if (recording) {
+                if (strcmp(category, "stage") == 0) {
+                    watermark = Memory_tracker::instance().open_watermark();
+                    tracks_memory = true;
+                }
+                start = clock::now();
+                instance().buffer().depth++;
+            }
+        }
+        
+        ~Scope(void) {
+            stop();
+        }
+        
+        // ends the scope early, for stages whose results must outlive the block
+        void stop(void) {
+            if (recording) {
+                recording = false;
+                auto end = clock::now();
+                size_t peak = tracks_memory ? Memory_tracker::instance().close_watermark(watermark) : 0;
+                instance().record(name, category, start, end, peak);
+            }
+        }
+        
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        
+      private:
+        const char* name;
+        const char* category;
+        bool recording;
+        bool tracks_memory = false;
+        size_t watermark = 0;
+        clock::time_point start;
+    };
+    
+    // Chrome/Perfetto trace event format (load in chrome://tracing or ui.perfetto.dev)
+    bool write_chrome_trace(const string& fname);
+    
+    // per-stage times, counters and per-thread busy time, through logger.info
+    void print_summary(void);
+    
+  private:
+    struct cstr_less {
+        bool operator()(const char* a, const char* b) const {
+            return strcmp(a, b) < 0;
+        }
+    };
+    
+    class Stat {
+      public:
+        void add(double value) {
+            if (count == 0 || value < min_value) min_value = value;
+            if (count == 0 || value > max_value) max_value = value;
+            count++;
+            sum += value;
+        }
+        
+        void merge(const Stat& b) {
+            if (b.count == 0) return;
+            if (count == 0 || b.min_value < min_value) min_value = b.min_value;
+            if (count == 0 || b.max_value > max_value) max_value = b.max_value;
+            count += b.count;
+            sum += b.sum;
+        }
+        
+        int64_t count = 0;
+        double sum = 0;
+        double min_value = 0;
+        double max_value = 0;
+    };
+    
+    class Event {
+      public:
+        const char* name;
+        const char* category;
+        double start_us;
+        double duration_us;
+        size_t peak_bytes; // zero if memory was not tracked
+        int depth;
+    };
+    
+    class Thread_buffer {
+      public:
+        void add_count(const char* name, int64_t delta) {
+            std::lock_guard<std::mutex> lock(mutex);
+            counters[name] += delta;
+        }
+        
+        void add_sample(const char* name, double value) {
+            std::lock_guard<std::mutex> lock(mutex);
+            samples[name].add(value);
+        }
+        
+        std::mutex mutex; // uncontended, except while a trace is being written
+        vector<Event> events;
+        std::map<const char*, int64_t, cstr_less> counters;
+        std::map<const char*, Stat, cstr_less> samples;
+        string name;
+        size_t tid = 0;
+        int depth = 0;
+    };
+    
+    Stage_trace(void) : origin(clock::now()) {}
+    
+    Thread_buffer& buffer(void);
+    
+    void record(const char* name, const char* category, clock::time_point start, clock::time_point end, size_t peak_bytes);
+    
+    std::atomic<bool> active{false};
+    clock::time_point origin;
+    std::mutex mutex;
+    vector<std::shared_ptr<Thread_buffer>> buffers;
+    std::set<string> interned;
+};
+
+#endif
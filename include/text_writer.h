@@ -0,0 +1,120 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#ifndef TEXT_WRITER_H
+#define TEXT_WRITER_H
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+
+// Buffered text output for the bulk renderers (print/sfr/esf/edges).
+// Numbers are formatted with std::to_chars (locale-independent, no printf
+// parsing), so fixed(v, 6) produces exactly the same bytes as "%lf".
+// Output is flushed in large blocks, optionally through zlib (the file
+// name then gets a ".gz" suffix).
+class Text_writer {
+  public:
+    Text_writer(const string& fname, bool compress=false, size_t buffer_size=1 << 20);
+    ~Text_writer(void);
+    
+    Text_writer(const Text_writer&) = delete;
+    Text_writer& operator=(const Text_writer&) = delete;
+    
+    bool is_open(void) const {
+        return fout != nullptr || gzout != nullptr;
+    }
+    
+    const string& filename(void) const {
+        return fname;
+    }
+    
+    // equivalent to printf("%.<precision>lf", val)
+    Text_writer& fixed(double val, int precision=6) {
+        reserve(max_number_length);
+        pos += format_fixed(buffer.data() + pos, val, precision);
+        return *this;
+    }
+    
+    // shortest representation that round-trips to the same double
+    Text_writer& shortest(double val) {
+        reserve(max_number_length);
+        pos += format_shortest(buffer.data() + pos, val);
+        return *this;
+    }
+    
+    // equivalent to printf("%d", val)
+    Text_writer& integer(int64_t val) {
+        reserve(max_number_length);
+        pos += format_integer(buffer.data() + pos, val);
+        return *this;
+    }
+    
+    Text_writer& put(char c) {
+        reserve(1);
+        buffer[pos++] = c;
+        return *this;
+    }
+    
+    Text_writer& put(const char* s);
+    
+    // for headers and other infrequent output
+    Text_writer& printf(const char* format, ...)
+    #if defined(__GNUC__)
+        __attribute__((format(printf, 2, 3)))
+    #endif
+    ;
+    
+    bool close(void);
+    
+  private:
+    static constexpr size_t max_number_length = 352; // enough for fixed-point DBL_MAX
+    
+    void reserve(size_t n) {
+        if (pos + n > buffer.size()) {
+            flush();
+        }
+    }
+    
+    void flush(void);
+    
+    static size_t format_fixed(char* out, double val, int precision);
+    static size_t format_shortest(char* out, double val);
+    static size_t format_integer(char* out, int64_t val);
+    
+    string fname;
+    FILE* fout = nullptr;
+    void* gzout = nullptr;
+    vector<char> buffer;
+    size_t pos = 0;
+    bool failed = false;
+};
+
+#endif
@@ -28,14 +28,30 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #ifndef THRESHOLDING_H
 #define THRESHOLDING_H
 
-namespace cv {
-   class Mat;
-}
+#include <opencv2/core/core.hpp>
 
 #include "include/threadpool.h"
+#include <cstddef>
+#include <vector>
 
 void bradley_adaptive_threshold(const cv::Mat& cvimg, cv::Mat& img, double threshold, int S);
-void sauvola_adaptive_threshold(const cv::Mat& cvimg, cv::Mat& img, double threshold, int S);
+
+// If max_buffer_bytes is non-zero, the integral images are computed over horizontal strips
+// that fit in max_buffer_bytes, rather than over the whole image; the result is identical.
+void sauvola_adaptive_threshold(const cv::Mat& cvimg, cv::Mat& img, double threshold, int S, size_t max_buffer_bytes=0);
+
+// The smallest integral image buffer, in bytes, that sauvola_adaptive_threshold() can work with
+// on a rows x cols image: a strip of at least 64 rows, plus a halo of S/2 rows on either side.
+size_t sauvola_min_buffer_bytes(int rows, int cols, int S);
+
+// The Sauvola threshold of each pixel of cvimg, as a CV_32FC1 image; max_val is the
+// maximum pixel value of the image that the thresholds will be applied to.
+void sauvola_threshold_surface(const cv::Mat& cvimg, cv::Mat& surface, double threshold, int S, double max_val);
+
+// Thresholds only the pixels of cvimg inside regions against surface, which was computed on a copy of
+// cvimg downsampled by factor (and is bilinearly interpolated); all other pixels are set to 255.
+void apply_threshold_surface(const cv::Mat& cvimg, const cv::Mat& surface, int factor, 
+    const std::vector<cv::Rect>& regions, cv::Mat& img);
 
 #endif // THRESHOLDING_H
 
@@ -0,0 +1,99 @@
+/*
+Copyright 2026 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#ifndef TIFF_REGION_READER_H
+#define TIFF_REGION_READER_H
+
+#include <stdint.h>
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <opencv2/core/core.hpp>
+
+// Decodes a rectangular region of a TIFF file without reading the rest of the pixel data.
+// The file is memory mapped, and only the strips (or tiles) that overlap the region are
+// touched, so that a few ROIs can be extracted from a very large scan cheaply.
+// Only uncompressed, chunky (interleaved), 8-bit or 16-bit unsigned greyscale, RGB or RGBA
+// images are supported; anything else should be decoded with cv::imread() instead.
+class Tiff_region_reader {
+  public:
+    Tiff_region_reader(const string& fname);
+    ~Tiff_region_reader(void);
+    
+    Tiff_region_reader(const Tiff_region_reader&) = delete;
+    Tiff_region_reader& operator=(const Tiff_region_reader&) = delete;
+    
+    bool supported(void) const { return valid; }
+    cv::Size size(void) const { return cv::Size(width, height); }
+    
+    // region must lie inside the image; the result has the same depth and
+    // channel order (BGR/BGRA) as cv::imread(fname, -1) would produce
+    bool read(const cv::Rect& region, cv::Mat& out) const;
+    
+  private:
+    bool map_file(const string& fname);
+    void unmap_file(void);
+    bool parse(void);
+    
+    uint16_t get_uint16(size_t offset) const;
+    uint32_t get_uint32(size_t offset) const;
+    // element idx of a SHORT or LONG valued IFD entry
+    bool field_value(size_t entry, uint32_t idx, uint32_t& value) const;
+    bool field_values(size_t entry, vector<uint64_t>& values) const;
+    
+    // copies the overlap of region with the rows [row0, row1) of a strip or tile
+    // whose top left corner is at (col0, row0), and whose rows are row_bytes apart
+    void copy_block(const cv::Rect& region, const char* block, int col0, int row0, int cols, int row1, size_t row_bytes, cv::Mat& out) const;
+    
+    void* mapped = nullptr;
+    #ifdef _WIN32
+    void* file_handle = nullptr;
+    void* map_handle = nullptr;
+    #endif
+    const char* base = nullptr;
+    size_t length = 0;
+    
+    bool big_endian = false;
+    bool valid = false;
+    
+    int width = 0;
+    int height = 0;
+    int bits_per_sample = 0;
+    int samples_per_pixel = 1;
+    
+    bool tiled = false;
+    int rows_per_strip = 0;
+    int tile_width = 0;
+    int tile_height = 0;
+    vector<uint64_t> offsets;     // one per strip or tile
+    vector<uint64_t> byte_counts; // one per strip or tile
+};
+
+#endif
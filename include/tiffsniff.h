@@ -45,6 +45,7 @@ using std::pair;
 using std::make_pair;
 
 #include "include/display_profile.h"
+#include "include/image_metadata.h"
 
 enum class jpeg_app_t {
     EXIF=1,
@@ -52,11 +53,21 @@ enum class jpeg_app_t {
     NONE=15
 };
 
+typedef struct {
+    uint16_t tag_id;
+    uint16_t data_type;
+    uint32_t data_count;
+    uint32_t data_offset;
+} tiff_field;
+
 class Tiffsniff {
   public:
     Tiffsniff(const string& fname, bool is_8bit = false);
     bool profile_found(void) const { return has_profile; }
     Display_profile profile(void);
+    // EXIF metadata from TIFF (including TIFF-based raw formats such as DNG,
+    // NEF, CR2 and ARW), JPEG EXIF blocks, ORF and RW2
+    const Image_metadata& metadata(void) const { return meta; }
     
   private:
     enum class profile_t {
@@ -69,6 +80,7 @@ class Tiffsniff {
     enum class ifd_t {
         ICC,
         TIFF,
+        SUBIFD,     // e.g., the full-resolution image of a DNG or NEF file
         EXIF,
         EXIF_INTEROP
     };
@@ -83,6 +95,10 @@ class Tiffsniff {
     vector< pair<jpeg_app_t, off_t> > scan_jpeg_app_blocks(void);
     double read_exif_gamma(off_t offset);
     void parse_png(off_t offset);
+    void read_metadata_field(const tiff_field& field, off_t base_offset, ifd_t ifd_type);
+    string read_ascii_field(const tiff_field& field, off_t base_offset);
+    double read_rational_field(const tiff_field& field, off_t base_offset);
+    uint32_t read_integer_field(const tiff_field& field);
     
     uint32_t read_uint32(void);
     uint16_t read_uint16(void);
@@ -96,6 +112,11 @@ class Tiffsniff {
     bool exif_gamma_found = false;
     bool exif_interop_r03 = false;
     
+    // false while reading an EXIF block only for its metadata, e.g., after an ICC profile
+    bool collect_colour = true;
+    bool primary_ifd_done = false;
+    Image_metadata meta;
+    
     profile_t inferred_profile = profile_t::UNKNOWN;
     off_t file_size;
     
@@ -104,13 +125,6 @@ class Tiffsniff {
     vector<double> luminance_weights {0.2225045, 0.7168786, 0.0606169}; // sRGB RGB->Y adapted to D50 by default
 };
 
-typedef struct {
-    uint16_t tag_id;
-    uint16_t data_type;
-    uint32_t data_count;
-    uint32_t data_offset;
-} tiff_field;
-
 typedef struct {
     uint32_t tag_signature;
     uint32_t data_offset;
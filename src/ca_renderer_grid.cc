@@ -29,6 +29,7 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #include "include/mtf_renderer_grid.h"
 #include "include/ca_renderer_grid.h"
 #include "include/grid_interpolator.h"
+#include "include/plot_raster.h"
 #include <memory>
 
 class Grid_functor_ca : public Grid_functor {
@@ -229,6 +230,32 @@ void Ca_renderer_grid::render(const vector<Block>& blocks) {
     int fontsize = std::max(long(10), lrint(10.0*gnuplot_width/1024.0));
     int title_fontsize = fontsize + 2;
     
+    if (builtin_plots) {
+        Plot_raster::Axes axes;
+        axes.xlabel = string("column (") + (lpmm_mode ? "mm" : "pixels") + ")";
+        axes.ylabel = string("row (") + (lpmm_mode ? "mm" : "pixels") + ")";
+        
+        Plot_raster plot(
+            width_in_pixels, lrint(width_in_pixels*2.3*grid_fine[0].rows/double(grid_fine[0].cols)),
+            fontsize, img_filename
+        );
+        for (size_t k=0; k < 2; k++) {
+            if (fraction_mode) {
+                axes.title = string(k == 0 ? "Red" : "Blue") + " vs Green (% of radial distance)";
+            } else {
+                axes.title = string(k == 0 ? "Red" : "Blue") + " vs Green (shift in " + (lpmm_mode ? "micron" : "pixels") + ")";
+            }
+            plot.heat_map(
+                Plot_raster::Panel(0, 0.5*k, 1, 0.5), grid_fine[k], 
+                img_dims.width/pixel_size, img_dims.height/pixel_size, g_zmin, g_zmax, axes
+            );
+        }
+        if (!plot.write(wdir + string("ca_image.png"))) {
+            logger.error("%s\n", "Failed to write CA image");
+        }
+        return;
+    }
+    
     FILE* gpf = fopen((wdir + std::string("ca_grid.gnuplot")).c_str(), "wt");
     fprintf(gpf, "%s\n", diverging_palette.c_str());
     fprintf(gpf, "set cbrange [%lf:%lf]\n", g_zmin, g_zmax);
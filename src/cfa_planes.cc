@@ -0,0 +1,51 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#include "include/cfa_planes.h"
+
+#include <assert.h>
+
+Cfa_planes::Cfa_planes(const cv::Mat& mosaic) 
+: source_data(mosaic.data), rows(mosaic.rows), cols(mosaic.cols) {
+
+    assert(mosaic.type() == CV_16UC1);
+    
+    for (int subset=0; subset < 4; subset++) {
+        int row_offset = subset >> 1;
+        int col_offset = subset & 1;
+        planes[subset] = cv::Mat((rows - row_offset + 1) / 2, (cols - col_offset + 1) / 2, CV_16UC1);
+        
+        cv::Mat& p = planes[subset];
+        for (int row=0; row < p.rows; row++) {
+            const uint16_t* src = mosaic.ptr<uint16_t>(2*row + row_offset) + col_offset;
+            uint16_t* dst = p.ptr<uint16_t>(row);
+            for (int col=0; col < p.cols; col++) {
+                dst[col] = src[2*col];
+            }
+        }
+    }
+}
@@ -0,0 +1,174 @@
+/*
+Copyright 2026 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#include "include/chart_layout.h"
+#include "include/edge_record.h"
+#include "include/logger.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <atomic>
+
+#ifdef _WIN32
+    #include <process.h>
+    #define GETPID _getpid
+#else
+    #include <unistd.h>
+    #define GETPID getpid
+#endif
+
+static const char* layout_magic = "# MTF Mapper chart layout, version 1";
+
+Chart_layout::Chart_layout(const vector<Block>& blocks, const cv::Size& image_size) 
+ : image_size(image_size) {
+ 
+    for (const Block& block: blocks) {
+        Entry e;
+        for (int k=0; k < 4; k++) {
+            e.centroids[k] = block.rect.centroids[k];
+            e.angles[k] = atan2(block.get_normal(k).y, block.get_normal(k).x);
+            e.edge_angles[k] = atan2(block.rect.edges[k].y, block.rect.edges[k].x);
+            for (int j=0; j < 3; j++) {
+                e.quad_coeffs[k][j] = block.rect.quad_coeffs[k][j];
+            }
+        }
+        e.boundary_length = block.rect.boundary_length;
+        entries.push_back(e);
+    }
+}
+
+bool Chart_layout::load(const string& fname) {
+    FILE* fin = fopen(fname.c_str(), "rt");
+    if (!fin) {
+        return false;
+    }
+    
+    char line[256];
+    int n = 0;
+    bool ok = fgets(line, sizeof(line), fin) && string(line).compare(0, strlen(layout_magic), layout_magic) == 0;
+    ok = ok && fscanf(fin, "%d %d %d", &image_size.width, &image_size.height, &n) == 3 && n >= 0;
+    
+    entries.clear();
+    for (int i=0; ok && i < n; i++) {
+        Entry e;
+        for (int k=0; ok && k < 4; k++) {
+            ok = fscanf(fin, "%lf %lf %lf %lf %lf %lf %lf", 
+                &e.centroids[k].x, &e.centroids[k].y, &e.angles[k], &e.edge_angles[k],
+                &e.quad_coeffs[k][0], &e.quad_coeffs[k][1], &e.quad_coeffs[k][2]
+            ) == 7;
+        }
+        unsigned long boundary_length = 0;
+        ok = ok && fscanf(fin, "%lu", &boundary_length) == 1;
+        e.boundary_length = boundary_length;
+        entries.push_back(e);
+    }
+    fclose(fin);
+    
+    if (!ok) {
+        logger.error("Could not parse chart layout file [%s], ignoring it\n", fname.c_str());
+        entries.clear();
+    }
+    return ok;
+}
+
+bool Chart_layout::save(const string& fname) const {
+    // write to a temporary file first, so that concurrent jobs never read a partial layout;
+    // the name is unique to this writer (process id, and a counter for the jobs within
+    // a process), so that concurrent writers cannot clobber each other's temporary file
+    static std::atomic<unsigned long> tmp_counter(0);
+    char tmp_suffix[64];
+    snprintf(tmp_suffix, sizeof(tmp_suffix), ".%lu.%lu.tmp", (unsigned long)GETPID(), tmp_counter++);
+    string tmp_fname = fname + tmp_suffix;
+    FILE* fout = fopen(tmp_fname.c_str(), "wt");
+    if (!fout) {
+        logger.error("Could not write chart layout file [%s]\n", fname.c_str());
+        return false;
+    }
+    
+    fprintf(fout, "%s\n", layout_magic);
+    fprintf(fout, "%d %d %d\n", image_size.width, image_size.height, int(entries.size()));
+    for (const Entry& e: entries) {
+        for (int k=0; k < 4; k++) {
+            fprintf(fout, "%.4lf %.4lf %.8lf %.8lf %.8le %.8le %.8le ", 
+                e.centroids[k].x, e.centroids[k].y, e.angles[k], e.edge_angles[k],
+                e.quad_coeffs[k][0], e.quad_coeffs[k][1], e.quad_coeffs[k][2]
+            );
+        }
+        fprintf(fout, "%lu\n", (unsigned long)e.boundary_length);
+    }
+    fclose(fout);
+    
+    remove(fname.c_str()); // rename() does not replace existing files on Windows
+    if (rename(tmp_fname.c_str(), fname.c_str()) != 0) {
+        logger.error("Could not write chart layout file [%s]\n", fname.c_str());
+        remove(tmp_fname.c_str());
+        return false;
+    }
+    return true;
+}
+
+Mrectangle Chart_layout::rectangle(size_t i) const {
+    const Entry& e = entries[i];
+    
+    Mrectangle initial;
+    initial.boundary_length = e.boundary_length;
+    
+    vector<Edge_record> edge_records(4);
+    for (int k=0; k < 4; k++) {
+        edge_records[k].centroid = e.centroids[k];
+        edge_records[k].angle = e.angles[k];
+    }
+    
+    Mrectangle rect(initial, edge_records);
+    for (int k=0; k < 4; k++) {
+        rect.edges[k] = Point2d(cos(e.edge_angles[k]), sin(e.edge_angles[k]));
+        for (int j=0; j < 3; j++) {
+            rect.quad_coeffs[k][j] = e.quad_coeffs[k][j];
+        }
+    }
+    return rect;
+}
+
+vector<cv::Rect> Chart_layout::regions(int margin) const {
+    vector<cv::Rect> r;
+    const cv::Rect bounds(0, 0, image_size.width, image_size.height);
+    for (size_t i=0; i < entries.size(); i++) {
+        Mrectangle rect = rectangle(i);
+        if (!rect.valid) {
+            continue;
+        }
+        cv::Rect box = cv::Rect(
+            int(rect.tl.x) - margin, int(rect.tl.y) - margin, 
+            int(rect.br.x - rect.tl.x) + 2*margin + 1, int(rect.br.y - rect.tl.y) + 2*margin + 1
+        ) & bounds;
+        if (box.area() > 0) {
+            r.push_back(box);
+        }
+    }
+    return r;
+}
@@ -84,7 +84,11 @@ void Component_labeller::configure(const cv::Mat& in_img,
     if (snapshot) {
         _draw_snapshot();
     }
-
+    
+    // the padded copy of the thresholded image is only needed while tracing boundaries
+    _pix_data.clear();
+    _pix_data.shrink_to_fit();
+    _pix = nullptr;
 }
 
 
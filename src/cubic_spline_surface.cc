@@ -30,6 +30,9 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/imgcodecs/imgcodecs.hpp>
 
+#include <cstdio>
+#include <stdexcept>
+
 Cubic_spline_surface::Cubic_spline_surface(int ncells_x, int ncells_y)
 : ncells_x(ncells_x), ncells_y(ncells_y), 
   kmax_x(ceil(ncells_x/4.0)), kmax_y(ceil(ncells_y/4.0)) {
@@ -69,12 +72,14 @@ Eigen::MatrixXd Cubic_spline_surface::spline_fit(const vector<Eigen::Vector3d>&
         if ((in_data[i][0] - dmin[0])/(dmax[0] - dmin[0]) >= 1 || 
             (in_data[i][1] - dmin[1])/(dmax[1] - dmin[1]) >= 1) {
             
-            printf("bounds exceeded with (%lf, %lf) vs (%lf, %lf), normalized = (%lf, %lf)\n",
+            char msg[256];
+            snprintf(msg, sizeof(msg), "bounds exceeded with (%lf, %lf) vs (%lf, %lf), normalized = (%lf, %lf)",
                 in_data[i][0], in_data[i][1],
                 dmax[0], dmax[1],
                 (in_data[i][0] - dmin[0])/(dmax[0] - dmin[0]), (in_data[i][1] - dmin[1])/(dmax[1] - dmin[1])
             );
-            exit(-1);
+            // only called by the grid renderers, whose exceptions are caught by Render_scheduler
+            throw std::out_of_range(msg);
         }
         data[i][0] = kmax_x * (in_data[i][0] - dmin[0])/(dmax[0] - dmin[0]);
         data[i][1] = kmax_y * (in_data[i][1] - dmin[1])/(dmax[1] - dmin[1]);
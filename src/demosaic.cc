@@ -30,6 +30,7 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #include "include/demosaic.h"
 #include <opencv2/imgcodecs/imgcodecs.hpp>
 #include "include/threadpool.h"
+#include <mutex>
 #include <string>
 using std::string;
 #include <vector>
@@ -38,7 +39,7 @@ using std::vector;
 void simple_demosaic_green(cv::Mat& cvimg, cv::Mat& rawimg, bool unbalanced_scene, bool swap_diag=false);
 void simple_demosaic_redblue(cv::Mat& cvimg, cv::Mat& rawimg, Bayer::bayer_t bayer, Bayer::cfa_pattern_t cfa_pattern);
 
-void simple_demosaic(cv::Mat& cvimg, cv::Mat& rawimg, Bayer::cfa_pattern_t cfa_pattern, Bayer::bayer_t bayer, bool unbalanced_scene) {
+bool simple_demosaic(cv::Mat& cvimg, cv::Mat& rawimg, Bayer::cfa_pattern_t cfa_pattern, Bayer::bayer_t bayer, bool unbalanced_scene) {
     // switch on Bayer subset
     if (bayer == Bayer::GREEN) {
         simple_demosaic_green(cvimg, rawimg, unbalanced_scene, cfa_pattern == Bayer::GRBG || cfa_pattern == Bayer::GBRG);
@@ -47,9 +48,10 @@ void simple_demosaic(cv::Mat& cvimg, cv::Mat& rawimg, Bayer::cfa_pattern_t cfa_p
             simple_demosaic_redblue(cvimg, rawimg, bayer, cfa_pattern);
         } else {
             logger.error("%s\n", "Fatal error: Unknown bayer subset requested. Aborting");
-            exit(-1);
+            return false;
         }
     }
+    return true;
 }
 
 static void match(const vector<int>& source, const vector<int>& target, vector<int>& m) {
@@ -68,6 +70,29 @@ static void match(const vector<int>& source, const vector<int>& target, vector<i
     }
 }
 
+// Split the rows [first_row, end_row) into one contiguous band per worker thread
+// and call f(band_start, band_end) on each band. The last band absorbs the
+// remainder, so every row is visited irrespective of the number of threads.
+template<class F>
+static void for_each_row_band(size_t first_row, size_t end_row, F&& f) {
+    if (end_row <= first_row) {
+        return;
+    }
+    ThreadPool& tp = ThreadPool::instance();
+    size_t n_rows = end_row - first_row;
+    size_t n_blocks = std::max(size_t(1), n_rows < 50 ? size_t(1) : tp.size());
+    size_t block_size = n_rows / n_blocks;
+    vector<std::future<void>> futures;
+    for (size_t block = 0; block < n_blocks; block++) {
+        size_t start_row = first_row + block * block_size;
+        size_t stop_row = block == n_blocks - 1 ? end_row : start_row + block_size;
+        futures.emplace_back(tp.enqueue([&f, start_row, stop_row] { f(start_row, stop_row); }));
+    }
+    for (size_t i = 0; i < futures.size(); i++) {
+        futures[i].wait();
+    }
+}
+
 void simple_demosaic_green(cv::Mat& cvimg, cv::Mat& rawimg, bool unbalanced_scene, bool swap_diag) {
     rawimg = cvimg.clone();
     
@@ -79,18 +104,47 @@ void simple_demosaic_green(cv::Mat& cvimg, cv::Mat& rawimg, bool unbalanced_scen
         tss2 = 2;
     }
     
+    int from_ss = 1;
+    int to_ss = 2;
+    if (swap_diag) {
+        from_ss = 0;
+        to_ss = 3;
+    }
+    
+    // per-subset lookup tables applied to raw values as they are read; only
+    // the from_ss subset is remapped when the green channels are balanced
+    vector<int> identity(65536);
+    for (int i=0; i < 65536; i++) {
+        identity[i] = i;
+    }
+    vector<int> m(identity);
+    const int* lut[4] = {identity.data(), identity.data(), identity.data(), identity.data()};
+    
     if (!unbalanced_scene) {
         logger.debug("%s\n", "Green Bayer subset specified, performing quick-and-dirty balancing of green channels");
+        // only the two green subsets take part in the matching; each row contains
+        // exactly one of them, at every second column
         vector < vector<int> > hist(4, vector<int>(65536, 0));
-        for (size_t row=0; row < (size_t)cvimg.rows; row++) {
-            for (int col=0; col < cvimg.cols; col++) {
-                int val = cvimg.at<uint16_t>(row, col);
-                int subset = ((row & 1) << 1) | (col & 1);
-                hist[subset][val]++;
+        std::mutex hist_mutex;
+        for_each_row_band(0, cvimg.rows, [&](size_t start_row, size_t end_row) {
+            vector < vector<int> > local_hist(4, vector<int>(65536, 0));
+            for (size_t row=start_row; row < end_row; row++) {
+                int subset = (from_ss >> 1) == int(row & 1) ? from_ss : to_ss;
+                vector<int>& h = local_hist[subset];
+                const uint16_t* rp = rawimg.ptr<uint16_t>(row);
+                for (int col=subset & 1; col < cvimg.cols; col += 2) {
+                    h[rp[col]]++;
+                }
             }
-        }
+            std::lock_guard<std::mutex> lock(hist_mutex);
+            for (int subset : {from_ss, to_ss}) {
+                for (size_t i=0; i < hist[subset].size(); i++) {
+                    hist[subset][i] += local_hist[subset][i];
+                }
+            }
+        });
         // convert histograms to cumulative histograms
-        for (int subset=0; subset < 4; subset++) {
+        for (int subset : {from_ss, to_ss}) {
             int acc = 0;
             for (size_t i=0; i < hist[subset].size(); i++) {
                 acc += hist[subset][i];
@@ -98,13 +152,6 @@ void simple_demosaic_green(cv::Mat& cvimg, cv::Mat& rawimg, bool unbalanced_scen
             }
         }
         
-        int from_ss = 1;
-        int to_ss = 2;
-        if (swap_diag) {
-            from_ss = 0;
-            to_ss = 3;
-        }
-        
         // NB: cumulative histogram totals must match
         // this can be distorted on cropped images
         if (hist[from_ss].back() > hist[to_ss].back()) {
@@ -113,74 +160,79 @@ void simple_demosaic_green(cv::Mat& cvimg, cv::Mat& rawimg, bool unbalanced_scen
             }
         }
         
-        vector<int> m(65536, 0);
         match(hist[to_ss], hist[from_ss], m);
-        for (size_t row=0; row < (size_t)cvimg.rows; row++) {
-            for (int col=0; col < cvimg.cols; col++) {
-                int subset = ((row & 1) << 1) | (col & 1);
-                if (subset == from_ss) { // TODO: optimize access pattern
-                    int val = cvimg.at<uint16_t>(row, col);
-                    cvimg.at<uint16_t>(row, col) = m[val];
-                }
-            }
-        }
+        lut[from_ss] = m.data();
     } else {
         logger.debug("%s\n", "ROI mode, not performing G1/G2 Bayer subset matching");
     }
 
-    ThreadPool& tp = ThreadPool::instance();
-    vector<std::future<void>> futures;
-    size_t n_blocks = std::max(1, int(cvimg.rows < 50 ? 1 : tp.size()));
-    size_t block_size = cvimg.rows / n_blocks;
-    for (size_t block = 0; block < n_blocks; block++) {
-        futures.emplace_back(
-            tp.enqueue([&, block] {
-                size_t start_row = std::min(4 + block*block_size, size_t(cvimg.rows - 1 - 4));
-                size_t end_row = std::min(4 + (block + 1) * block_size, size_t(cvimg.rows - 4));
-                uint16_t* cv_base = (uint16_t*)cvimg.data;
-                for (size_t row = start_row; row < end_row; row++) {
-                    for (int col = 4; col < cvimg.cols - 4; col++) {
-                        int subset = ((row & 1) << 1) | (col & 1);
-                        uint64_t cidx = row * cvimg.cols + col;
-                        uint16_t* cvp = cv_base + cidx;
-                        if (subset == tss1 || subset == tss2) {
-
-                            double hgrad = fabs(double(int32_t(cvp[-3]) + 3 * int32_t(cvp[-1]) - 3 * int32_t(cvp[1]) - int32_t(cvp[3])));
-                            double vgrad = fabs(double(int32_t(cvp[-3 * cvimg.cols]) + 3 * int32_t(cvp[-cvimg.cols]) - 3 * int32_t(cvp[cvimg.cols]) - int32_t(cvp[3 * cvimg.cols])));
+    // Apply the matching and the interpolation in a single pass over each band.
+    // All reads come from the unmodified rawimg (through the lookup tables), and
+    // each output pixel is written exactly once, so bands are independent and
+    // the result does not depend on the number of threads.
+    const int cols = cvimg.cols;
+    const int first_interp_row = 4;
+    const int end_interp_row = cvimg.rows - 4;
+    for_each_row_band(0, cvimg.rows, [&](size_t start_row, size_t end_row) {
+        for (size_t row = start_row; row < end_row; row++) {
+            const uint16_t* rp = rawimg.ptr<uint16_t>(row);
+            uint16_t* cvp = cvimg.ptr<uint16_t>(row);
+            
+            if ((from_ss >> 1) == int(row & 1)) {
+                const int* fm = lut[from_ss];
+                for (int col = from_ss & 1; col < cols; col += 2) {
+                    cvp[col] = fm[rp[col]];
+                }
+            }
+            
+            if (int(row) < first_interp_row || int(row) >= end_interp_row) {
+                continue;
+            }
+            
+            int subset = (tss1 >> 1) == int(row & 1) ? tss1 : tss2;
+            const int* hl = lut[subset ^ 1]; // horizontal neighbours
+            const int* vl = lut[subset ^ 2]; // vertical neighbours
+            for (int col = 4 + (subset & 1); col < cols - 4; col += 2) {
+                const uint16_t* p = rp + col;
+                int32_t left3 = hl[p[-3]];
+                int32_t left = hl[p[-1]];
+                int32_t right = hl[p[1]];
+                int32_t right3 = hl[p[3]];
+                int32_t up3 = vl[p[-3 * cols]];
+                int32_t up = vl[p[-cols]];
+                int32_t down = vl[p[cols]];
+                int32_t down3 = vl[p[3 * cols]];
+                
+                double hgrad = fabs(double(left3 + 3 * left - 3 * right - right3));
+                double vgrad = fabs(double(up3 + 3 * up - 3 * down - down3));
 
-                            if (max(hgrad, vgrad) < 1 || fabs(hgrad - vgrad) / max(hgrad, vgrad) < 0.1) {
-                                *cvp = (int32_t(cvp[-cvimg.cols]) + int32_t(cvp[cvimg.cols]) + int32_t(cvp[-1]) + int32_t(cvp[1])) / 4;
-                            }
-                            else {
-                                double l = (hgrad * hgrad + vgrad * vgrad);
-                                if (hgrad > vgrad) {
-                                    l = hgrad * hgrad / l;
-                                    if (l > 0.92388 * 0.92388) { // more horizontal than not
-                                        *cvp = (int32_t(cvp[-cvimg.cols]) + int32_t(cvp[cvimg.cols])) / 2;
-                                    }
-                                    else { // in between, blend it
-                                        *cvp = (2 * (int32_t(cvp[-cvimg.cols]) + int32_t(cvp[cvimg.cols])) + (int32_t(cvp[-1]) + int32_t(cvp[1]))) / 6.0;
-                                    }
-                                }
-                                else {
-                                    l = vgrad * vgrad / l;
-                                    if (l > 0.92388 * 0.92388) {
-                                        *cvp = (int32_t(cvp[-1]) + int32_t(cvp[1])) / 2;
-                                    }
-                                    else {
-                                        *cvp = (2 * (int32_t(cvp[-1]) + int32_t(cvp[1])) + (int32_t(cvp[-cvimg.cols]) + int32_t(cvp[cvimg.cols]))) / 6.0;
-                                    }
-                                }
-                            }
+                if (max(hgrad, vgrad) < 1 || fabs(hgrad - vgrad) / max(hgrad, vgrad) < 0.1) {
+                    cvp[col] = (up + down + left + right) / 4;
+                }
+                else {
+                    double l = (hgrad * hgrad + vgrad * vgrad);
+                    if (hgrad > vgrad) {
+                        l = hgrad * hgrad / l;
+                        if (l > 0.92388 * 0.92388) { // more horizontal than not
+                            cvp[col] = (up + down) / 2;
+                        }
+                        else { // in between, blend it
+                            cvp[col] = (2 * (up + down) + (left + right)) / 6.0;
+                        }
+                    }
+                    else {
+                        l = vgrad * vgrad / l;
+                        if (l > 0.92388 * 0.92388) {
+                            cvp[col] = (left + right) / 2;
+                        }
+                        else {
+                            cvp[col] = (2 * (left + right) + (up + down)) / 6.0;
                         }
                     }
                 }
-            })
-        );
-    }
-    for (size_t i = 0; i < futures.size(); i++) {
-        futures[i].wait();
-    }
+            }
+        }
+    });
     
     
     // since the relative row/column offsets are hardcoded, just swap the subsets
@@ -265,88 +317,68 @@ void simple_demosaic_redblue(cv::Mat& cvimg, cv::Mat& rawimg, Bayer::bayer_t bay
         }
     }
     
+    const int cols = cvimg.cols;
+    
     // interpolate the other channel (Red if we want blue, or Blue if we want red)
-    ThreadPool& tp = ThreadPool::instance();
-    vector<std::future<void>> futures;
-    size_t n_blocks = std::max(1, int(cvimg.rows < 50 ? 1 : tp.size()));
-    size_t block_size = cvimg.rows / n_blocks;
-    for (size_t block = 0; block < n_blocks; block++) {
-        futures.emplace_back(
-            tp.enqueue([&, block] {
-            size_t start_row = std::min(4 + block * block_size, size_t(cvimg.rows - 1 - 4));
-            size_t end_row = std::min(4 + (block + 1) * block_size, size_t(cvimg.rows - 4));
-            for (size_t row = start_row; row < end_row; row++) {
-                for (int col = 4; col < cvimg.cols - 4; col++) {
-                    int subset = ((row & 1) << 1) | (col & 1);
-                    if (subset == first_subset) { // TODO: really should optimize access pattern
-                        double d1grad = fabs(double((int32_t)cvimg.at<uint16_t>(row - 1, col - 1) - (int32_t)cvimg.at<uint16_t>(row + 1, col + 1)));
-                        double d2grad = fabs(double((int32_t)cvimg.at<uint16_t>(row - 1, col + 1) - (int32_t)cvimg.at<uint16_t>(row + 1, col - 1)));
+    // only the diagonal neighbours (which belong to the target subset) are read
+    for_each_row_band(4, cvimg.rows - 4, [&](size_t start_row, size_t end_row) {
+        for (size_t row = start_row; row < end_row; row++) {
+            if ((first_subset >> 1) != int(row & 1)) {
+                continue;
+            }
+            uint16_t* cvp = cvimg.ptr<uint16_t>(row);
+            for (int col = 4 + (first_subset & 1); col < cols - 4; col += 2) {
+                const uint16_t* p = cvp + col;
+                int32_t ul = p[-cols - 1];
+                int32_t ur = p[-cols + 1];
+                int32_t ll = p[cols - 1];
+                int32_t lr = p[cols + 1];
+                double d1grad = fabs(double(ul - lr));
+                double d2grad = fabs(double(ur - ll));
 
-                        if (max(d1grad, d2grad) < 1 || fabs(d1grad - d2grad) / max(d1grad, d2grad) < 0.001) {
-                            cvimg.at<uint16_t>(row, col) =
-                                ((int32_t)cvimg.at<uint16_t>(row - 1, col - 1) +
-                                (int32_t)cvimg.at<uint16_t>(row + 1, col + 1) +
-                                    (int32_t)cvimg.at<uint16_t>(row - 1, col + 1) +
-                                    (int32_t)cvimg.at<uint16_t>(row + 1, col - 1)) / 4;
-                        }
-                        else {
-                            if (d1grad > d2grad) {
-                                cvimg.at<uint16_t>(row, col) = ((int32_t)cvimg.at<uint16_t>(row - 1, col + 1) + (int32_t)cvimg.at<uint16_t>(row + 1, col - 1)) / 2;
-                            }
-                            else {
-                                cvimg.at<uint16_t>(row, col) = ((int32_t)cvimg.at<uint16_t>(row - 1, col - 1) + (int32_t)cvimg.at<uint16_t>(row + 1, col + 1)) / 2;
-                            }
-                        }
+                if (max(d1grad, d2grad) < 1 || fabs(d1grad - d2grad) / max(d1grad, d2grad) < 0.001) {
+                    cvp[col] = (ul + lr + ur + ll) / 4;
+                }
+                else {
+                    if (d1grad > d2grad) {
+                        cvp[col] = (ur + ll) / 2;
+                    }
+                    else {
+                        cvp[col] = (ul + lr) / 2;
                     }
                 }
             }
-        })
-        );
-    }
-    for (size_t i = 0; i < futures.size(); i++) {
-        futures[i].wait();
-    }
+        }
+    });
     
-    // interpolate the two green channels
-    futures.clear();
-    for (size_t block = 0; block < n_blocks; block++) {
-        futures.emplace_back(
-            tp.enqueue([&, block] {
-                size_t start_row = std::min(4 + block * block_size, size_t(cvimg.rows - 1 - 4));
-                size_t end_row = std::min(4 + (block + 1) * block_size, size_t(cvimg.rows - 4));
-                for (size_t row = start_row; row < end_row; row++) {
-                    for (int col = 4; col < cvimg.cols - 4; col++) {
-                        int subset = ((row & 1) << 1) | (col & 1);
-
-                        if (subset == h_ss || subset == v_ss) {
+    // interpolate the two green channels; each row holds exactly one of them
+    for_each_row_band(4, cvimg.rows - 4, [&](size_t start_row, size_t end_row) {
+        for (size_t row = start_row; row < end_row; row++) {
+            int subset = (h_ss >> 1) == int(row & 1) ? h_ss : v_ss;
+            uint16_t* cvp = cvimg.ptr<uint16_t>(row);
+            for (int col = 4 + (subset & 1); col < cols - 4; col += 2) {
+                const uint16_t* p = cvp + col;
+                int32_t left = p[-1];
+                int32_t right = p[1];
+                int32_t up = p[-cols];
+                int32_t down = p[cols];
+                double hgrad = fabs(double(left - right));
+                double vgrad = fabs(double(up - down));
 
-                            double hgrad = fabs(double((int32_t)cvimg.at<uint16_t>(row, col - 1) - (int32_t)cvimg.at<uint16_t>(row, col + 1)));
-                            double vgrad = fabs(double((int32_t)cvimg.at<uint16_t>(row - 1, col) - (int32_t)cvimg.at<uint16_t>(row + 1, col)));
-
-                            if (max(hgrad, vgrad) < 1 || fabs(hgrad - vgrad) / max(hgrad, vgrad) < 0.001) {
-                                cvimg.at<uint16_t>(row, col) =
-                                    ((int32_t)cvimg.at<uint16_t>(row - 1, col) +
-                                    (int32_t)cvimg.at<uint16_t>(row + 1, col) +
-                                        (int32_t)cvimg.at<uint16_t>(row, col - 1) +
-                                        (int32_t)cvimg.at<uint16_t>(row, col + 1)) / 4;
-                            }
-                            else {
-                                if (hgrad > vgrad) {
-                                    cvimg.at<uint16_t>(row, col) = ((int32_t)cvimg.at<uint16_t>(row - 1, col) + (int32_t)cvimg.at<uint16_t>(row + 1, col)) / 2;
-                                }
-                                else {
-                                    cvimg.at<uint16_t>(row, col) = ((int32_t)cvimg.at<uint16_t>(row, col - 1) + (int32_t)cvimg.at<uint16_t>(row, col + 1)) / 2;
-                                }
-                            }
-                        }
+                if (max(hgrad, vgrad) < 1 || fabs(hgrad - vgrad) / max(hgrad, vgrad) < 0.001) {
+                    cvp[col] = (up + down + left + right) / 4;
+                }
+                else {
+                    if (hgrad > vgrad) {
+                        cvp[col] = (up + down) / 2;
+                    }
+                    else {
+                        cvp[col] = (left + right) / 2;
                     }
                 }
-            })
-        );
-    }
-    for (size_t i = 0; i < futures.size(); i++) {
-        futures[i].wait();
-    }
+            }
+        }
+    });
     
     // on the first pass, interpolate the green channels
     for (size_t row=1; row < (size_t)cvimg.rows-1; row++) {
@@ -0,0 +1,100 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#include "include/edge_store.h"
+
+#include <algorithm>
+
+template <class T>
+T* Edge_store::allocate(vector<vector<T>>& chunks, size_t n, Entry& e) {
+    if (chunks.empty() || chunks.back().size() + n > chunks.back().capacity()) {
+        chunks.push_back(vector<T>());
+        // reserve once, so that existing data never moves
+        chunks.back().reserve(std::max(chunk_size, n));
+    }
+    vector<T>& chunk = chunks.back();
+    e.chunk = uint32_t(chunks.size() - 1);
+    e.offset = uint32_t(chunk.size());
+    e.length = uint32_t(n);
+    chunk.resize(chunk.size() + n);
+    return chunk.data() + e.offset;
+}
+
+Edge_store::id_t Edge_store::add_array(const vector<double>& values) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry e;
+    double* dest = allocate(chunks, values.size(), e);
+    std::copy(values.begin(), values.end(), dest);
+    arrays.push_back(e);
+    return id_t(arrays.size() - 1);
+}
+
+Edge_store::Span Edge_store::array(id_t id) const {
+    if (id >= arrays.size()) {
+        return Span();
+    }
+    const Entry& e = arrays[id];
+    return Span(chunks[e.chunk].data() + e.offset, e.length);
+}
+
+Edge_store::id_t Edge_store::add_scanset(const map<int, scanline>& scanset) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry e;
+    e.chunk = 0;
+    e.offset = uint32_t(scan_rows.size());
+    e.length = uint32_t(scanset.size());
+    for (const auto& row: scanset) {
+        scan_rows.push_back(row.first);
+        scan_rows.push_back(row.second.start);
+        scan_rows.push_back(row.second.end);
+    }
+    scansets.push_back(e);
+    return id_t(scansets.size() - 1);
+}
+
+map<int, scanline> Edge_store::scanset(id_t id) const {
+    map<int, scanline> result;
+    if (id >= scansets.size()) {
+        return result;
+    }
+    const Entry& e = scansets[id];
+    const int32_t* p = scan_rows.data() + e.offset;
+    for (uint32_t i=0; i < e.length; i++, p += 3) {
+        result.emplace_hint(result.end(), p[0], scanline(p[1], p[2]));
+    }
+    return result;
+}
+
+size_t Edge_store::memory_usage(void) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t total = (arrays.capacity() + scansets.capacity())*sizeof(Entry) + 
+        scan_rows.capacity()*sizeof(int32_t);
+    for (const auto& c: chunks) {
+        total += c.capacity()*sizeof(double);
+    }
+    return total;
+}
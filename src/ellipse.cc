@@ -177,7 +177,7 @@ int Ellipse_detector::fit(const Component_labeller& cl, const Gradient& gradient
     
     if (rhs.rows() != 5 || rhs.cols() != 1) {
         logger.debug("%s\n", "rhs undefined");
-        exit(1);
+        return 0;
     }
     
     for (size_t ri=0; ri < size_t(rhs.rows()); ri++) {
@@ -117,55 +117,43 @@ void Esf_sampler_deferred::sample(Edge_model& edge_model, vector<Ordered_point>&
         }
     }
     
-    for (map<int, scanline>::const_iterator it=m_scanset.begin(); it != m_scanset.end(); ++it) {
-        int y = it->first;
-        if (y < border_width || y > sampling_img.rows-1-border_width) continue;
-        int rowcode = (y & 1) << 1;
+    for_each_pixel(m_scanset, sampling_img, sampling_img, cfa_mask, [&](int x, int y, uint16_t value) {
+        // transform warped pixel to idealized rectilinear
+        cv::Point2d tp = undistort->inverse_transform_point(x, y);
         
-        for (int x=it->second.start; x <= it->second.end; ++x) {
-            
-            if (x < border_width || x > sampling_img.cols-1-border_width) continue;
-            
-            int code = 1 << ( (rowcode | (x & 1)) ^ 3 );
-            if ((code & cfa_mask) == 0) continue;
-            
-            // transform warped pixel to idealized rectilinear
-            cv::Point2d tp = undistort->inverse_transform_point(x, y);
+        bool inside_image = lrint(tp.x) >= 0 && lrint(tp.x) < geom_img.cols && lrint(tp.y) >= 0 && lrint(tp.y) < geom_img.rows;
+        if (!inside_image) return;
+        
+        Point2d d = tp - edge_model.get_centroid();
+        double perp = d.ddot(edge_model.get_normal()); 
+        double par = d.ddot(edge_model.get_direction());
+        
+        if (!undistort->rectilinear_equivalent()) {
+            // 'par' is gamma from the paper
+            // apply bracketing
+            Point2d pd(x, y);
+            Point2d bracketed = bracket_minimum(par, edge_model.get_direction(), edge_model.get_centroid(), pd);
             
-            bool inside_image = lrint(tp.x) >= 0 && lrint(tp.x) < geom_img.cols && lrint(tp.y) >= 0 && lrint(tp.y) < geom_img.rows;
-            if (!inside_image) continue;
+            // apply quadratic interpolation
+            Point2d p1(bracketed.x, norm(undistort->transform_point(bracketed.x*edge_model.get_direction() + edge_model.get_centroid()) - pd));
+            Point2d p2(0.5*(bracketed.x+bracketed.y), norm(undistort->transform_point((0.5*(bracketed.x+bracketed.y))*edge_model.get_direction() + edge_model.get_centroid()) - pd));
+            Point2d p3(bracketed.y, norm(undistort->transform_point(bracketed.y*edge_model.get_direction() + edge_model.get_centroid()) - pd));
+            double tau_star = quadmin(p1, p2, p3);
             
-            Point2d d = tp - edge_model.get_centroid();
-            double perp = d.ddot(edge_model.get_normal()); 
-            double par = d.ddot(edge_model.get_direction());
+            // find tangent, then project onto normal
+            Point2d tangent = derivative(tau_star, edge_model.get_direction(), edge_model.get_centroid());
+            tangent *= 1.0/norm(tangent);
+            Point2d lnorm(-tangent.y, tangent.x);
+            Point2d ppd = undistort->transform_point(tau_star*edge_model.get_direction() + edge_model.get_centroid());
             
-            if (!undistort->rectilinear_equivalent()) {
-                // 'par' is gamma from the paper
-                // apply bracketing
-                Point2d pd(x, y);
-                Point2d bracketed = bracket_minimum(par, edge_model.get_direction(), edge_model.get_centroid(), pd);
-                
-                // apply quadratic interpolation
-                Point2d p1(bracketed.x, norm(undistort->transform_point(bracketed.x*edge_model.get_direction() + edge_model.get_centroid()) - pd));
-                Point2d p2(0.5*(bracketed.x+bracketed.y), norm(undistort->transform_point((0.5*(bracketed.x+bracketed.y))*edge_model.get_direction() + edge_model.get_centroid()) - pd));
-                Point2d p3(bracketed.y, norm(undistort->transform_point(bracketed.y*edge_model.get_direction() + edge_model.get_centroid()) - pd));
-                double tau_star = quadmin(p1, p2, p3);
-                
-                // find tangent, then project onto normal
-                Point2d tangent = derivative(tau_star, edge_model.get_direction(), edge_model.get_centroid());
-                tangent *= 1.0/norm(tangent);
-                Point2d lnorm(-tangent.y, tangent.x);
-                Point2d ppd = undistort->transform_point(tau_star*edge_model.get_direction() + edge_model.get_centroid());
-                
-                perp = (pd - ppd).ddot(lnorm);
-            }
-            if (fabs(perp) < max_dot) {
-                local_ordered.push_back(Ordered_point(perp, sampling_img.at<uint16_t>(y,x) ));
-                max_along_edge = max(max_along_edge, par);
-                min_along_edge = min(min_along_edge, par);
-            }
+            perp = (pd - ppd).ddot(lnorm);
         }
-    }
+        if (fabs(perp) < max_dot) {
+            local_ordered.push_back(Ordered_point(perp, value));
+            max_along_edge = max(max_along_edge, par);
+            min_along_edge = min(min_along_edge, par);
+        }
+    });
         
     edge_length = max_along_edge - min_along_edge;
 }
@@ -38,28 +38,16 @@ void Esf_sampler_line::sample(Edge_model& edge_model, vector<Ordered_point>& loc
     double max_along_edge = -1e50;
     double min_along_edge = 1e50;
     
-    for (map<int, scanline>::const_iterator it=scanset.begin(); it != scanset.end(); ++it) {
-        int y = it->first;
-        if (y < border_width || y > geom_img.rows-1-border_width) continue;
-        int rowcode = (y & 1) << 1;
-        
-        for (int x=it->second.start; x <= it->second.end; ++x) {
-            
-            if (x < border_width || x > geom_img.cols-1-border_width) continue;
-            
-            int code = 1 << ( (rowcode | (x & 1)) ^ 3 );
-            if ((code & cfa_mask) == 0) continue;
-            
-            Point2d d = Point2d(x, y) - edge_model.get_centroid();
-            double perp = d.ddot(edge_model.get_normal()); 
-            double par = d.ddot(edge_model.get_direction());
-            if (fabs(perp) < max_dot && fabs(par) < max_edge_length) {
-                local_ordered.push_back(Ordered_point(perp, sampling_img.at<uint16_t>(y,x) ));
-                max_along_edge = max(max_along_edge, par);
-                min_along_edge = min(min_along_edge, par);
-            }
+    for_each_pixel(scanset, geom_img, sampling_img, cfa_mask, [&](int x, int y, uint16_t value) {
+        Point2d d = Point2d(x, y) - edge_model.get_centroid();
+        double perp = d.ddot(edge_model.get_normal()); 
+        double par = d.ddot(edge_model.get_direction());
+        if (fabs(perp) < max_dot && fabs(par) < max_edge_length) {
+            local_ordered.push_back(Ordered_point(perp, value));
+            max_along_edge = max(max_along_edge, par);
+            min_along_edge = min(min_along_edge, par);
         }
-    }
+    });
         
     edge_length = max_along_edge - min_along_edge;
 }
@@ -71,53 +71,32 @@ void Esf_sampler_quad::sample(Edge_model& edge_model, vector<Ordered_point>& loc
     const std::array<double, 3>& qp = edge_model.quad_coeffs();
     vector<double> roots;
     roots.reserve(3);
-    for (map<int, scanline>::const_iterator it=scanset.begin(); it != scanset.end(); ++it) {
-        int y = it->first;
-        if (y < border_width || y > geom_img.rows-1-border_width) continue;
-        int rowcode = (y & 1) << 1;
+    for_each_pixel(scanset, geom_img, sampling_img, cfa_mask, [&](int x, int y, uint16_t value) {
+        Point2d d = Point2d(x, y) - edge_model.get_centroid();
+        double perp = d.ddot(edge_model.get_normal()); 
+        double par = d.ddot(edge_model.get_direction());
         
-        for (int x=it->second.start; x <= it->second.end; ++x) {
-            
-            if (x < border_width || x > geom_img.cols-1-border_width) continue;
-            
-            int code = 1 << ( (rowcode | (x & 1)) ^ 3 );
-            if ((code & cfa_mask) == 0) continue;
-            
-            Point2d d = Point2d(x, y) - edge_model.get_centroid();
-            double perp = d.ddot(edge_model.get_normal()); 
-            double par = d.ddot(edge_model.get_direction());
-            
-            // (par, perp) is in the local coordinate frame of the parabola qp
-            // so find the closest point on qp
-            roots.clear();
-            quad_tangency(Point2d(par, perp), qp, roots);
-            perp = 1e20;
-            for (auto r: roots) {
-                Point2d on_qp(r, r*r*qp[0] + r*qp[1] + qp[2]);
-                Point2d recon = on_qp.x*edge_model.get_direction() + on_qp.y*edge_model.get_normal() + edge_model.get_centroid();
-                Point2d delta = Point2d(x, y) - recon;
-                double dist = std::copysign(norm(delta), delta.ddot(edge_model.get_normal()));
-                if (fabs(dist) < fabs(perp)) {
-                    perp = dist;
-                }
-            }
-            
-            if (fabs(perp) < max_dot) {
-                local_ordered.push_back(Ordered_point(perp, sampling_img.at<uint16_t>(y,x) ));
-                max_along_edge = max(max_along_edge, par);
-                min_along_edge = min(min_along_edge, par);
-                
-                /*
-                if ((x&1) || (y&1)) {
-                    cv::Vec3b& color = od_img.at<cv::Vec3b>(y, x);
-                    color[0] = 255;
-                    color[1] = 0;
-                    color[2] = 0;
-                }
-                */
+        // (par, perp) is in the local coordinate frame of the parabola qp
+        // so find the closest point on qp
+        roots.clear();
+        quad_tangency(Point2d(par, perp), qp, roots);
+        perp = 1e20;
+        for (auto r: roots) {
+            Point2d on_qp(r, r*r*qp[0] + r*qp[1] + qp[2]);
+            Point2d recon = on_qp.x*edge_model.get_direction() + on_qp.y*edge_model.get_normal() + edge_model.get_centroid();
+            Point2d delta = Point2d(x, y) - recon;
+            double dist = std::copysign(norm(delta), delta.ddot(edge_model.get_normal()));
+            if (fabs(dist) < fabs(perp)) {
+                perp = dist;
             }
         }
-    }
+        
+        if (fabs(perp) < max_dot) {
+            local_ordered.push_back(Ordered_point(perp, value));
+            max_along_edge = max(max_along_edge, par);
+            min_along_edge = min(min_along_edge, par);
+        }
+    });
     
     edge_length = max_along_edge - min_along_edge;
 }
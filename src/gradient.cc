@@ -34,7 +34,7 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #include <opencv2/imgproc/imgproc.hpp>
 
 //------------------------------------------------------------------------------
-Gradient::Gradient(const cv::Mat& in_img)
+Gradient::Gradient(const cv::Mat& in_img, size_t max_buffer_bytes)
  : _width(in_img.cols), _height(in_img.rows)
 {
     
@@ -42,6 +42,16 @@ Gradient::Gradient(const cv::Mat& in_img)
     double min_val = 0;
     double max_val = 0;
     minMaxLoc(in_img, &min_val, &max_val);
+    
+    if (max_buffer_bytes > 0) {
+        // the float copy and the smoothed image each need 4 bytes per pixel, plus a halo
+        int strip_rows = std::max(16, int(max_buffer_bytes / (2*sizeof(float)*size_t(in_img.cols))) - 2*strip_halo);
+        if (strip_rows < in_img.rows) {
+            _compute_gradients_strips(in_img, max_val, strip_rows);
+            return;
+        }
+    }
+    
     in_img.convertTo(in_float, CV_32FC1, 1.0/max_val);
     
     cv::Mat smoothed;
@@ -51,6 +61,54 @@ Gradient::Gradient(const cv::Mat& in_img)
     smoothed.release();
 }
 
+//------------------------------------------------------------------------------
+Gradient::Gradient(const cv::Mat& in_img, const vector<cv::Rect>& regions)
+ : _width(in_img.cols), _height(in_img.rows)
+{
+    double min_val = 0;
+    double max_val = 0;
+    minMaxLoc(in_img, &min_val, &max_val);
+    
+    _gradient_x = cv::Mat(in_img.rows, in_img.cols, CV_32FC1, cv::Scalar::all(0));
+    _gradient_y = cv::Mat(in_img.rows, in_img.cols, CV_32FC1, cv::Scalar::all(0));
+    
+    const cv::Rect bounds(0, 0, in_img.cols, in_img.rows);
+    for (const cv::Rect& unclipped: regions) {
+        const cv::Rect r = unclipped & bounds;
+        if (r.area() == 0) {
+            continue;
+        }
+        
+        // as with the strips, the halo hides the region boundary from the blur kernel
+        // and the central differences, except where it coincides with the image border
+        const cv::Rect h = cv::Rect(r.x - strip_halo, r.y - strip_halo, r.width + 2*strip_halo, r.height + 2*strip_halo) & bounds;
+        
+        cv::Mat in_float;
+        in_img(h).convertTo(in_float, CV_32FC1, 1.0/max_val);
+        
+        cv::Mat smoothed;
+        cv::GaussianBlur(in_float, smoothed, cv::Size(5,5), 1.2, 1.2);
+        in_float.release();
+        
+        for (int row=r.y; row < r.y + r.height; row++) {
+            const float* smp = smoothed.ptr<float>(row - h.y);
+            float* gxp = _gradient_x.ptr<float>(row);
+            for (int c=std::max(1, r.x); c < std::min(in_img.cols - 1, r.x + r.width); c++) {
+                gxp[c] = smp[c+1 - h.x] - smp[c-1 - h.x];
+            }
+            
+            if (row > 0 && row < in_img.rows - 1) {
+                const float* sp_prev = smoothed.ptr<float>(row - 1 - h.y);
+                const float* sp_next = smoothed.ptr<float>(row + 1 - h.y);
+                float* gyp = _gradient_y.ptr<float>(row);
+                for (int c=r.x; c < r.x + r.width; c++) {
+                    gyp[c] = sp_next[c - h.x] - sp_prev[c - h.x];
+                }
+            }
+        }
+    }
+}
+
 //------------------------------------------------------------------------------
 Gradient::~Gradient(void) {
 }
@@ -86,3 +144,51 @@ void Gradient::_compute_gradients(const cv::Mat& smoothed_im) {
     }
 }
 
+
+//------------------------------------------------------------------------------
+void Gradient::_compute_gradients_strips(const cv::Mat& in_img, double max_val, int strip_rows) {
+
+    _gradient_x = cv::Mat(in_img.rows, in_img.cols, CV_32FC1);
+    _gradient_y = cv::Mat(in_img.rows, in_img.cols, CV_32FC1);
+    
+    const int cols = in_img.cols;
+    
+    for (int r0=0; r0 < in_img.rows; r0 += strip_rows) {
+        int r1 = std::min(in_img.rows, r0 + strip_rows);
+        
+        // the halo covers the 5x5 blur kernel plus the central difference in y, so that
+        // the image borders are only ever seen where the whole-image path would see them
+        int h0 = std::max(0, r0 - strip_halo);
+        int h1 = std::min(in_img.rows, r1 + strip_halo);
+        
+        cv::Mat in_float;
+        in_img.rowRange(h0, h1).convertTo(in_float, CV_32FC1, 1.0/max_val);
+        
+        cv::Mat smoothed;
+        cv::GaussianBlur(in_float, smoothed, cv::Size(5,5), 1.2, 1.2);
+        in_float.release();
+        
+        for (int r=r0; r < r1; r++) {
+            const float* smp = smoothed.ptr<float>(r - h0);
+            float* gxp = _gradient_x.ptr<float>(r);
+            gxp[0] = 0;
+            for (int c=1; c < cols - 1; c++) {
+                gxp[c] = smp[c+1] - smp[c-1];
+            }
+            gxp[cols-1] = 0;
+            
+            float* gyp = _gradient_y.ptr<float>(r);
+            if (r == 0 || r == in_img.rows - 1) {
+                for (int c=0; c < cols; c++) {
+                    gyp[c] = 0;
+                }
+            } else {
+                const float* sp_prev = smoothed.ptr<float>(r - 1 - h0);
+                const float* sp_next = smoothed.ptr<float>(r + 1 - h0);
+                for (int c=0; c < cols; c++) {
+                    gyp[c] = sp_next[c] - sp_prev[c];
+                }
+            }
+        }
+    }
+}
@@ -30,32 +30,27 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 
 #include <opencv2/opencv.hpp>
 
+#include "image_pyramid.h"
+
+#include <utility>
+#include <memory>
+
+// A decoded image, ready for display (8-bit RGB), along with the properties
+// of the original image that the viewer reports
 class Cache_entry {
   public:
-    Cache_entry(void): img(cv::Mat()), seq_num(0) {}
-    Cache_entry(cv::Mat img): img(img), seq_num(counter()++) {}
-    
-    cv::Mat fetch(void) {
-        seq_num = counter()++;
-        return img;
-    }
-    
-    uint32_t seq(void) const { 
-        return seq_num;
-    }
+    Cache_entry(void) {}
     
     uint64_t size(void) const {
-        return uint64_t(img.total())*img.elemSize();
+        return uint64_t(img.total())*img.elemSize() + (pyramid ? pyramid->size() : 0);
     }
     
-  private:
     cv::Mat img;
-    uint32_t seq_num;
-    
-    static uint32_t& counter(void) {
-        static uint32_t global_counter = 1;
-        return global_counter;
-    }
+    std::shared_ptr<const Image_pyramid> pyramid;
+    int channels = 1;
+    int depth = 8;
+    bool assumed_linear = false;
+    std::pair<int, int> minmax{-1, -1};
 };
 
 #endif
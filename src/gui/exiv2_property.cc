@@ -28,6 +28,7 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 
 #include "include/logger.h"
 #include "exiv2_property.h"
+#include "include/tiffsniff.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -55,8 +56,14 @@ Exiv2_property::Exiv2_property(QString bin_name, QString ifname, QString tfname)
 : exiv2_binary(bin_name),ifname(ifname), tfname(tfname)
 {
 
+    // the standard EXIF tags are read in-process; exiv2 is only needed for the
+    // maker notes, or for files that Tiffsniff cannot parse (e.g., CR3 or RAF)
+    Tiffsniff sniffer(ifname.toLocal8Bit().constData());
+    const Image_metadata& meta = sniffer.metadata();
+    bool native = meta.found();
+
     // ping exiv2 to get camera make
-    QString make = extract_property(QString("Exif.Image.Make"));
+    QString make = native ? QString::fromStdString(meta.make) : extract_property(QString("Exif.Image.Make"));
 
     if (make.startsWith(QString("NIKON"), Qt::CaseInsensitive)) mode = NIKON;
     else if (make.startsWith(QString("Canon"), Qt::CaseInsensitive)) mode = CANON;
@@ -65,11 +72,26 @@ Exiv2_property::Exiv2_property(QString bin_name, QString ifname, QString tfname)
     else mode = OTHER;
 
     p_af_tune = extract_af_tune();
-    p_comment = extract_comment();
     p_focus_distance = extract_focus_distance();
-    p_focal_length = extract_focal_length();
-    p_aperture = extract_aperture();
-    p_focal_ratio = extract_focal_ratio();
+    
+    if (native) {
+        p_comment = meta.user_comment.empty() ? QString("N/A") : QString::fromStdString(meta.user_comment);
+        p_focal_length = meta.focal_length > 0 ? QString("%1 mm").arg(meta.focal_length, 0, 'f', 1) : QString("N/A");
+        p_aperture = meta.f_number > 0 ? QString("F%1").arg(meta.f_number, 0, 'g', 3) : QString("N/A");
+        
+        double focal_ratio = meta.focal_ratio();
+        if (focal_ratio <= 0) {
+            // e.g., Olympus records the sensor size in its maker notes
+            p_focal_ratio = extract_focal_ratio();
+        } else {
+            p_focal_ratio = QString("%1").arg(focal_ratio);
+        }
+    } else {
+        p_comment = extract_comment();
+        p_focal_length = extract_focal_length();
+        p_aperture = extract_aperture();
+        p_focal_ratio = extract_focal_ratio();
+    }
 }
 
 char*   Exiv2_property::eat_non_whitespace(char* cp) {
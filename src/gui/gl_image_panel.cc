@@ -40,15 +40,15 @@ GL_image_panel::GL_image_panel(QWidget *parent)
     : QOpenGLWidget(parent),
       program(0) {
       
+    connect(&provider, SIGNAL(image_ready(QString, quint64, bool)), this, SLOT(provider_image_ready(QString, quint64, bool)), Qt::QueuedConnection);
+    
     logger.debug("GL_image_panel ctor: OpenGL version: %d.%d, samples=%d\n", format().majorVersion(), format().minorVersion(), format().samples());
 }
 
 GL_image_panel::~GL_image_panel() {
     makeCurrent();
     vbo.destroy();
-    for (int i=0; i < (int)textures.size(); i++) {
-        delete textures[i];
-    }
+    release_tiles();
     delete program;
     doneCurrent();
 }
@@ -66,7 +66,7 @@ void GL_image_panel::initializeGL() {
     static int panel_counter = 0;
     logger.debug("initializeGL (panel = %d): OpenGL version: %d.%d, samples=%d\n", ++panel_counter, format().majorVersion(), format().minorVersion(), format().samples());
     
-    if (textures.size() == 0 && default_image != nullptr) {
+    if (!pyramid && default_image != nullptr) {
         load_image(*default_image);
     }
 
@@ -113,6 +113,10 @@ void GL_image_panel::initializeGL() {
     program->bind();
     program->setUniformValue("texture", 0);
     
+    // the tile quads are rebuilt for every frame
+    vbo.create();
+    vbo.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    
     // call any initialization code in derived classes
     initialize_overlay();
 }
@@ -134,21 +138,70 @@ void GL_image_panel::paintGL() {
     projection = QMatrix4x4();
     projection.ortho(0, w, h, 0, -1, 1);
     
-    program->bind();
-    program->setUniformValue("modelMatrix", view);
-    program->setUniformValue("projectionMatrix", projection);
-    
-    vbo.bind();
-    program->enableAttributeArray(prog_vert_att);
-    program->enableAttributeArray(prog_texcoord_att);
-    program->setAttributeBuffer(prog_vert_att, GL_FLOAT, 0, 3, 5 * sizeof(GLfloat));
-    program->setAttributeBuffer(prog_texcoord_att, GL_FLOAT, 3 * sizeof(GLfloat), 2, 5 * sizeof(GLfloat));
-    
-    program->setUniformValue("gamma", float(gamma_value));
-    
-    for (int i = 0; i < (int)textures.size(); i++) {
-        textures[i]->bind();
-        glDrawArrays(GL_TRIANGLE_FAN, i * 4, 4);
+    if (pyramid) {
+        frame_number++;
+        
+        // visible part of the image, in level 0 pixel coordinates
+        QRectF visible = visible_image_rect();
+        QPointF tl = visible.topLeft();
+        QPointF br = visible.bottomRight();
+        
+        // The coarsest level is a single tile that is drawn first, so that the
+        // whole image is visible while the tiles of the finer level are uploaded
+        // over a number of frames
+        size_t coarse_level = pyramid->levels() - 1;
+        size_t fine_level = pyramid->select_level(scale_factor);
+        
+        QVector<GLfloat> vertData;
+        vector<QOpenGLTexture*> draw_list;
+        int uploads = max_tile_uploads_per_frame;
+        bool incomplete = false;
+        vector<size_t> draw_levels(1, coarse_level);
+        if (fine_level != coarse_level) {
+            draw_levels.push_back(fine_level);
+        }
+        for (size_t level: draw_levels) {
+            cv::Point2d ls = pyramid->level_scale(level);
+            int tsize = Image_pyramid::tile_size;
+            int c0 = std::max(0, int(floor(tl.x() / ls.x / tsize)));
+            int c1 = std::min(pyramid->tile_columns(level) - 1, int(floor(br.x() / ls.x / tsize)));
+            int r0 = std::max(0, int(floor(tl.y() / ls.y / tsize)));
+            int r1 = std::min(pyramid->tile_rows(level) - 1, int(floor(br.y() / ls.y / tsize)));
+            for (int r=r0; r <= r1; r++) {
+                for (int c=c0; c <= c1; c++) {
+                    QOpenGLTexture* tex = tile_texture(level, c, r, uploads);
+                    if (!tex) {
+                        incomplete = true;
+                        continue;
+                    }
+                    append_tile_quad(vertData, level, c, r);
+                    draw_list.push_back(tex);
+                }
+            }
+        }
+        evict_tiles();
+        
+        program->bind();
+        program->setUniformValue("modelMatrix", view);
+        program->setUniformValue("projectionMatrix", projection);
+        
+        vbo.bind();
+        vbo.allocate(vertData.constData(), vertData.count() * sizeof(GLfloat));
+        program->enableAttributeArray(prog_vert_att);
+        program->enableAttributeArray(prog_texcoord_att);
+        program->setAttributeBuffer(prog_vert_att, GL_FLOAT, 0, 3, 5 * sizeof(GLfloat));
+        program->setAttributeBuffer(prog_texcoord_att, GL_FLOAT, 3 * sizeof(GLfloat), 2, 5 * sizeof(GLfloat));
+        
+        program->setUniformValue("gamma", float(gamma_value));
+        
+        for (int i = 0; i < (int)draw_list.size(); i++) {
+            draw_list[i]->bind();
+            glDrawArrays(GL_TRIANGLE_FAN, i * 4, 4);
+        }
+        
+        if (incomplete) { // upload the remaining tiles in the next frame
+            update();
+        }
     }
     
     // call any paint code in derived classes
@@ -181,266 +234,75 @@ bool GL_image_panel::load_image(const QString& fname) {
         return true;
     }
     
-    cv::Mat cvimg;
-    if (cache_enabled && image_cache.find(fname.toStdString()) != image_cache.end()) {
-        cvimg = image_cache[fname.toStdString()].fetch();
-    } else { 
-        cvimg = cv::imread(fname.toStdString(), cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH | cv::IMREAD_IGNORE_ORIENTATION);
-        if (cvimg.empty()) {
-            return false;
-        }
-        
-        img_channels = cvimg.channels();
-        img_depth = 8;
-        img_assumed_linear = false;
-        
-        // perform normalization / scaling before color conversion?
-        if (cvimg.depth() != CV_8U) {
-            double alpha = 1.0;
-            double beta = 0;
-            img_depth = 16;
-            img_assumed_linear = true;
-            
-            if (cvimg.depth() == CV_16U) {
-                logger.info("GL_image_panel::load_image: 16-bit histogram percentile scaling path\n");
-                
-                vector<uint64_t> histo(65536, 0);
-                size_t total_pixels = size_t(cvimg.channels())*size_t(cvimg.rows)*size_t(cvimg.cols);
-                uint16_t* ptr = (uint16_t*)cvimg.data;
-                uint16_t* sentinel = ptr + total_pixels;
-                while (ptr < sentinel) {
-                    histo[*ptr++]++;
-                }
-                // now we can extract the true (clipping) max and min values
-                int minval = histo.size();
-                int maxval = 0;
-                for (size_t i=0; i < histo.size(); i++) {
-                    int revi = histo.size() - 1 - i;
-                    minval = histo[revi] > 0 ? revi : minval;
-                    maxval = histo[i] > 0 ? i : maxval;
-                }
-                
-                // find upper percentile
-                size_t upper_c_target = total_pixels * 0.01;
-                uint64_t acc = 0;
-                size_t hist_upper = maxval;
-                while (hist_upper > 0 && acc < upper_c_target) {
-                    acc += histo[hist_upper];
-                    hist_upper--;
-                }
-                
-                // find lower percentile
-                size_t lower_c_target = total_pixels * 0.005;
-                acc = 0;
-                size_t hist_lower = minval;
-                while (hist_lower < size_t(maxval) && acc < lower_c_target) {
-                    acc += histo[hist_lower];
-                    hist_lower++;
-                }
-                
-                // prevent complete collapse on synthetic/degenerate images
-                if (fabs(double(hist_upper) - double(hist_lower)) < 0.05*(maxval - minval)) {
-                    hist_lower = minval;
-                    hist_upper = maxval;
-                }
-                
-                // scale intenisty so that minval -> 1 and maxval -> 254
-                if (hist_upper > hist_lower) {
-                    alpha = 253.0/double(hist_upper - hist_lower);
-                    beta = 1.0 - alpha * hist_lower;
-                }
-                
-                vector<uint8_t> lut(65536, 0);
-                size_t crush_thresh = std::min(2048, std::min(minval + 1, (int)hist_lower));
-                size_t saturation_thresh = maxval;
-                size_t pot = 1;
-                while (pot < 16 && (1 << pot) < maxval) {
-                    pot++;
-                }
-                saturation_thresh = std::max((1 << pot) - 1, (int)hist_upper);
-                
-                size_t lut_idx = 0;
-                while (lut_idx < crush_thresh) {
-                    lut[lut_idx++] = 0;
-                }
-                while (lut_idx < hist_lower) {
-                    lut[lut_idx++] = 1;
-                }
-                while (lut_idx < hist_upper) {
-                    lut[lut_idx] = std::max(1, std::min(254, int(lut_idx*alpha + beta)));
-                    lut_idx++;
-                }
-                while (lut_idx < saturation_thresh) {
-                    lut[lut_idx++] = 254;
-                }
-                while (lut_idx < lut.size()) {
-                    lut[lut_idx++] = 255;
-                }
-                
-                cv::Mat dst(cvimg.rows, cvimg.cols, cvimg.channels() == 1 ? CV_8UC1 : CV_8UC3);
-                uint16_t* in_ptr = (uint16_t*)cvimg.data;
-                uint8_t* out_ptr = (uint8_t*)dst.data;
-                while (in_ptr < sentinel) {
-                    *out_ptr++ = lut[*in_ptr++];
-                }
-                cvimg = dst;
-                
-                img_minmax.first = minval;
-                img_minmax.second = maxval;
-            } else {
-                logger.info("GL_image_panel::load_image: unspecified (not 8- or 16-bit) min-max scaling path\n");
-                double minval, maxval;
-                cv::minMaxIdx(cvimg.reshape(1), &minval, &maxval);
-                
-                if (maxval > minval) {
-                    alpha = 255.0/(maxval - minval);
-                    beta = -alpha * minval;
-                }
-                
-                img_minmax.first = minval;
-                img_minmax.second = maxval;
-                
-                cv::Mat dst;
-                cvimg.convertTo(dst, CV_8U, alpha, beta);
-                cvimg = dst;
-            }
-        } else {
-            double minval, maxval;
-            cv::minMaxIdx(cvimg.reshape(1), &minval, &maxval);
-            img_minmax.first = minval;
-            img_minmax.second = maxval;
-        }
-        
-        if (cvimg.channels() == 1) {
-            cv::cvtColor(cvimg, cvimg, cv::COLOR_GRAY2BGR);
-        }
-        
-        // manual conversion, cvtColor seems a bit slow
-        uint8_t* sptr = cvimg.data;
-        uint8_t* sentinel = sptr + size_t(cvimg.rows)*size_t(cvimg.cols*3);
-        while (sptr < sentinel) {
-            std::swap(*sptr, *(sptr+2));
-            sptr += 3;
-        }
-        
-        if (cache_enabled) {
-            image_cache[fname.toStdString()] = Cache_entry(cvimg);
-            image_cache_size += image_cache[fname.toStdString()].size();
-        }
-        
-        trim_cache();
+    // a synchronous load supersedes any outstanding request
+    pending_ticket = 0;
+    
+    Cache_entry entry;
+    if (!provider.fetch(fname, entry)) {
+        return false;
     }
+    return load_image(fname, entry);
+}
+
+void GL_image_panel::request_image(const QString& fname, const QStringList& prefetch) {
+    if (cache_enabled && fname.toStdString().compare(current_fname) == 0) {
+        pending_ticket = 0;
+        emit image_loaded(fname);
+        return;
+    }
+    pending_ticket = provider.request(fname, prefetch);
+}
+
+void GL_image_panel::provider_image_ready(QString fname, quint64 ticket, bool success) {
+    if (ticket != pending_ticket) { // superseded by a later request
+        return;
+    }
+    pending_ticket = 0;
+    
+    Cache_entry entry;
+    if (!success || !provider.take(ticket, entry)) {
+        emit image_load_failed(fname);
+        return;
+    }
+    load_image(fname, entry);
+    emit image_loaded(fname);
+}
+
+bool GL_image_panel::load_image(const QString& fname, const Cache_entry& entry) {
+    img_channels = entry.channels;
+    img_depth = entry.depth;
+    img_assumed_linear = entry.assumed_linear;
+    img_minmax = entry.minmax;
     
     current_fname = fname.toStdString();
     
-    return load_image(cvimg);
+    return load_image(entry.img, entry.pyramid);
 }
 
 bool GL_image_panel::load_image(QImage& qimg) {
-    cv::Mat cvimg(qimg.height(), qimg.width(), CV_8UC3, qimg.bits());
+    pending_ticket = 0;
+    // tiles are uploaded lazily, so we cannot borrow the pixels of qimg
+    cv::Mat cvimg = cv::Mat(qimg.height(), qimg.width(), CV_8UC3, qimg.bits(), qimg.bytesPerLine()).clone();
     current_fname = "mtf_mapper_logo";
     return load_image(cvimg);
 }
 
-bool GL_image_panel::load_image(cv::Mat cvimg) {
+bool GL_image_panel::load_image(cv::Mat cvimg, std::shared_ptr<const Image_pyramid> pyr) {
     // Some other GLWidget could have the current context, so it is vital that
     // we switch the context before we attempt to change resources like textures
     makeCurrent();
     
     current_cv_image = cvimg;
+    pyramid = pyr ? pyr : std::make_shared<const Image_pyramid>(cvimg);
+    release_tiles();
     
     bool keep_zoom = false;
-
-    vbo.release();
-    vbo.destroy();
-    for (int i=0; i < (int)textures.size(); i++) {
-        delete textures[i];
-    }
-    textures.clear();
-    
-    static GLsizei hw_texw = 0;
-    if (hw_texw == 0) { // we only really have to call this once 
-        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &hw_texw);
-    }
-    
-    int texw = std::min(hw_texw, 2048); // we do not want the last block to become too large
-    
     if (cvimg.cols == imgsize.width() && cvimg.rows == imgsize.height()) {
         keep_zoom = true;
     }
     
     imgsize = QSize(cvimg.cols, cvimg.rows);
     
-    // now trim down the texture block size if the image is small
-    texw = std::min(texw, std::max(next_pow2(imgsize.width()), next_pow2(imgsize.height())));
-    
-    QVector<GLfloat> vertData;
-    
-    int cblocks = (int)ceil(imgsize.width()/double(texw));
-    int rblocks = (int)ceil(imgsize.height()/double(texw));
-    
-    int x_off = imgsize.width() / 2;
-    int y_off = imgsize.height() / 2;
-    
-    for (int r=0; r < rblocks; r++) {
-        int rstart = r*texw;
-        int rend = std::min((r+1)*texw, imgsize.height());
-        for (int c=0; c < cblocks; c++) {
-            int cstart = c*texw;
-            int cend = std::min((c+1)*texw, imgsize.width());
-            
-            // obtain pow2 dimensions for this block
-            int tex_width = next_pow2(cend-cstart);
-            int tex_height = next_pow2(rend-rstart);
-            
-            vertData.append(cstart - x_off);
-            vertData.append(rstart - y_off);
-            vertData.append(0);
-            vertData.append(0);
-            vertData.append(0);
-            
-            vertData.append(cend - x_off);
-            vertData.append(rstart - y_off);
-            vertData.append(0);
-            vertData.append(double(cend - cstart)/tex_width);
-            vertData.append(0);
-            
-            vertData.append(cend - x_off);
-            vertData.append(rend - y_off);
-            vertData.append(0);
-            vertData.append(double(cend - cstart)/tex_width);
-            vertData.append(double(rend - rstart)/tex_height);
-            
-            vertData.append(cstart - x_off);
-            vertData.append(rend - y_off);
-            vertData.append(0);
-            vertData.append(0);
-            vertData.append(double(rend - rstart)/tex_height);
-            
-            // we copy parts of the cv::Mat image into a QImage
-            // this way we can have large images (>10k dims were problematic QT 5.7), and
-            // at the same time have auto-mipmaps (which we only get from QImage)
-            if ((cend - cstart) == tex_width && (rend - rstart) == tex_height) {
-                size_t offset = cstart * 3 + rstart * cvimg.elemSize()*cvimg.cols;
-                QImage tex_block(cvimg.data + offset, tex_width, tex_height, cvimg.elemSize()*cvimg.cols, QImage::Format_RGB888);
-                textures.push_back(new QOpenGLTexture(tex_block));
-            } else {
-                // only create a new image (power-of-2) if we have a partial block
-                QImage tex_block(tex_width, tex_height, QImage::Format_RGB888);
-                cv::Mat srcimg(cvimg, cv::Rect(cstart, rstart, cend-cstart, rend-rstart)); // the ROI we want
-                cv::Mat teximg(tex_height, tex_width, CV_8UC3, tex_block.bits());
-                teximg = cv::Scalar(255, 255, 255); // fill the image to avoid borders (during mipmap building)
-                srcimg.copyTo(teximg(cv::Rect(0, 0, cend-cstart, rend-rstart)));
-                textures.push_back(new QOpenGLTexture(tex_block));
-            }
-            
-            // but this looks better (other than the artifacts, of course)
-            textures.back()->setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
-            textures.back()->setMagnificationFilter(QOpenGLTexture::Linear);
-            textures.back()->setWrapMode(QOpenGLTexture::ClampToEdge);
-        }
-    }
-    
     double w = size().width();
     double h = size().height();
     if (!keep_zoom) {
@@ -451,15 +313,110 @@ bool GL_image_panel::load_image(cv::Mat cvimg) {
     }
     
     reset_scroll_range();
-
-    vbo.create();
-    vbo.setUsagePattern(QOpenGLBuffer::DynamicDraw);
-    vbo.bind();
-    vbo.allocate(vertData.constData(), vertData.count() * sizeof(GLfloat));
+    
     update();
     return true;
 }
 
+QOpenGLTexture* GL_image_panel::tile_texture(size_t level, int col, int row, int& uploads) {
+    uint64_t key = (uint64_t(level) << 48) | (uint64_t(row) << 24) | uint64_t(col);
+    auto it = tile_textures.find(key);
+    if (it != tile_textures.end()) {
+        tile_lru.splice(tile_lru.begin(), tile_lru, it->second.lru_pos);
+        it->second.frame = frame_number;
+        return it->second.texture;
+    }
+    
+    if (uploads <= 0) {
+        return nullptr;
+    }
+    uploads--;
+    
+    // we copy the tile into a (power-of-2) QImage; this way we
+    // have auto-mipmaps (which we only get from QImage)
+    cv::Rect roi = pyramid->tile_rect(level, col, row);
+    int tex_width = next_pow2(roi.width);
+    int tex_height = next_pow2(roi.height);
+    QImage tex_block(tex_width, tex_height, QImage::Format_RGB888);
+    cv::Mat teximg(tex_height, tex_width, CV_8UC3, tex_block.bits(), tex_block.bytesPerLine());
+    if (roi.width != tex_width || roi.height != tex_height) {
+        teximg = cv::Scalar(255, 255, 255); // fill the image to avoid borders (during mipmap building)
+    }
+    pyramid->level(level)(roi).copyTo(teximg(cv::Rect(0, 0, roi.width, roi.height)));
+    
+    QOpenGLTexture* texture = new QOpenGLTexture(tex_block);
+    texture->setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+    texture->setMagnificationFilter(QOpenGLTexture::Linear);
+    texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+    
+    tile_lru.push_front(key);
+    Tile_texture& tile = tile_textures[key];
+    tile.texture = texture;
+    tile.frame = frame_number;
+    tile.lru_pos = tile_lru.begin();
+    return texture;
+}
+
+void GL_image_panel::append_tile_quad(QVector<GLfloat>& vertData, size_t level, int col, int row) const {
+    cv::Rect roi = pyramid->tile_rect(level, col, row);
+    cv::Point2d ls = pyramid->level_scale(level);
+    double tex_width = next_pow2(roi.width);
+    double tex_height = next_pow2(roi.height);
+    
+    double x_off = imgsize.width() / 2;
+    double y_off = imgsize.height() / 2;
+    double cstart = roi.x * ls.x - x_off;
+    double cend = std::min(double(imgsize.width()), (roi.x + roi.width) * ls.x) - x_off;
+    double rstart = roi.y * ls.y - y_off;
+    double rend = std::min(double(imgsize.height()), (roi.y + roi.height) * ls.y) - y_off;
+    
+    vertData.append(cstart);
+    vertData.append(rstart);
+    vertData.append(0);
+    vertData.append(0);
+    vertData.append(0);
+    
+    vertData.append(cend);
+    vertData.append(rstart);
+    vertData.append(0);
+    vertData.append(roi.width / tex_width);
+    vertData.append(0);
+    
+    vertData.append(cend);
+    vertData.append(rend);
+    vertData.append(0);
+    vertData.append(roi.width / tex_width);
+    vertData.append(roi.height / tex_height);
+    
+    vertData.append(cstart);
+    vertData.append(rend);
+    vertData.append(0);
+    vertData.append(0);
+    vertData.append(roi.height / tex_height);
+}
+
+void GL_image_panel::evict_tiles(void) {
+    // tiles used in the current frame are never evicted, so the
+    // budget may be exceeded temporarily on very large displays
+    while (tile_textures.size() > max_resident_tiles) {
+        auto it = tile_textures.find(tile_lru.back());
+        if (it->second.frame == frame_number) {
+            break;
+        }
+        delete it->second.texture;
+        tile_textures.erase(it);
+        tile_lru.pop_back();
+    }
+}
+
+void GL_image_panel::release_tiles(void) {
+    for (auto& t: tile_textures) {
+        delete t.second.texture;
+    }
+    tile_textures.clear();
+    tile_lru.clear();
+}
+
 void GL_image_panel::move(int nx, int ny) {
     vp.centre = cv::Point2d(nx, ny);
 }
@@ -522,6 +479,14 @@ QPoint GL_image_panel::locate(QPoint pos) {
     return located_pos;
 }
 
+QRectF GL_image_panel::visible_image_rect(void) const {
+    QMatrix4x4 inv_view = view.inverted();
+    QPointF centre(imgsize.width()/2, imgsize.height()/2);
+    QPointF tl = inv_view.map(QPointF(0, 0)) + centre;
+    QPointF br = inv_view.map(QPointF(width(), height())) + centre;
+    return QRectF(tl, br).normalized();
+}
+
 // A bit of a hack, but this is required to ensure that small images remain
 // centered. Resetting this is necessary after scale changes, or window
 // resizing, or loading a new image
@@ -536,29 +501,7 @@ void GL_image_panel::reset_scroll_range(void) {
 }
 
 void GL_image_panel::set_cache_size(uint64_t size) { 
-    max_image_cache_size = size;
-    trim_cache();
-}
-
-void GL_image_panel::trim_cache(void) {
-    if (image_cache_size > max_image_cache_size) {
-        // evict entries if necessary (we cannot evict pre-emptively because 
-        // image dimensions are unknown until after imread())
-        vector< pair<uint32_t, string> > cache_age;
-        for (const auto& e: image_cache) {
-            cache_age.push_back(make_pair(e.second.seq(), e.first));
-        }
-        sort(cache_age.begin(), cache_age.end());
-        
-        
-        size_t ci = 0;
-        while (image_cache_size > max_image_cache_size && ci < cache_age.size()) {
-            auto cit = image_cache.find(cache_age[ci].second);
-            image_cache_size -= cit->second.size();
-            image_cache.erase(cit);
-            ci++;
-        }
-    }
+    Image_cache::instance().set_capacity(size);
 }
 
 void GL_image_panel::mouseMoveEvent(QMouseEvent* event) {
@@ -31,6 +31,9 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #include <vector>
 using std::vector;
 #include <map>
+#include <list>
+#include <unordered_map>
+#include <memory>
 using std::pair;
 using std::make_pair;
 #include <string>
@@ -47,7 +50,7 @@ using std::string;
 #include <QMatrix4x4>
 
 #include "sfr_marker.h"
-#include "cache_entry.h"
+#include "image_provider.h"
 #include "image_viewport.h"
 
 QT_FORWARD_DECLARE_CLASS(QOpenGLShaderProgram)
@@ -70,6 +73,12 @@ public:
     QPoint locate(QPoint pos);
     bool load_image(const QString& fname);
     bool load_image(QImage& qimg);
+    // decodes fname in the background, emitting image_loaded() or image_load_failed() when done;
+    // the prefetch files are decoded into the cache in anticipation of the next request
+    void request_image(const QString& fname, const QStringList& prefetch = QStringList());
+    // the decoded images (and their pyramids) are cached in Image_cache, which is
+    // shared by all panels; set_cache_state() only controls whether re-loading
+    // the current file name is skipped
     void set_cache_size(uint64_t size);
     void set_cache_state(bool s) { cache_enabled = s; }
     int image_channels(void) const { return img_channels; }
@@ -94,14 +103,27 @@ public:
     int get_img_max(void) { return img_minmax.second; }
     
     static int program_counter;
+    
+signals:
+    void image_loaded(QString fname);
+    void image_load_failed(QString fname);
+    
+private slots:
+    void provider_image_ready(QString fname, quint64 ticket, bool success);
 
 protected:
     void initializeGL() override;
     void paintGL() override;
     void resizeGL(int width, int height) override;
-    bool load_image(cv::Mat cvimg);
+    bool load_image(cv::Mat cvimg, std::shared_ptr<const Image_pyramid> pyr = nullptr);
+    bool load_image(const QString& fname, const Cache_entry& entry);
+    QOpenGLTexture* tile_texture(size_t level, int col, int row, int& uploads);
+    void append_tile_quad(QVector<GLfloat>& vertData, size_t level, int col, int row) const;
+    void evict_tiles(void);
+    void release_tiles(void);
     void reset_scroll_range(void);
-    void trim_cache(void);
+    // the part of the image currently inside the widget, in image pixel coordinates
+    QRectF visible_image_rect(void) const;
     
     QMatrix4x4 view;
     QMatrix4x4 projection;
@@ -118,13 +140,28 @@ protected:
     static constexpr int prog_texcoord_att = 1;
     
 private:
-    vector<QOpenGLTexture*> textures;
+    class Tile_texture {
+      public:
+        QOpenGLTexture* texture = nullptr;
+        uint64_t frame = 0;
+        std::list<uint64_t>::iterator lru_pos;
+    };
+    
+    // only the tiles of the visible part of the image, at the pyramid level
+    // that matches the current zoom, are uploaded to the GPU
+    static constexpr size_t max_resident_tiles = 256;
+    static constexpr int max_tile_uploads_per_frame = 16;
+    
+    std::shared_ptr<const Image_pyramid> pyramid;
+    std::unordered_map<uint64_t, Tile_texture> tile_textures;
+    std::list<uint64_t> tile_lru; // most recently used first
+    uint64_t frame_number = 0;
+    
     QOpenGLShaderProgram* program;
     QOpenGLBuffer vbo;
     
-    std::map<std::string, Cache_entry> image_cache;
-    uint64_t image_cache_size = 0;
-    uint64_t max_image_cache_size = uint64_t(1) << 30;
+    Image_provider provider;
+    quint64 pending_ticket = 0;
     bool cache_enabled = true;
     
     int img_channels = 1;
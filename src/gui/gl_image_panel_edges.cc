@@ -138,6 +138,22 @@ void GL_image_panel_edges::initialize_overlay(void) {
 
 void GL_image_panel_edges::paint_overlay(void) {
     img_centre = QPointF(imgsize.width()/2, imgsize.height()/2);
+    
+    double lsf = 1.0;
+    if (scale_factor < 1) {
+        lsf = 0.5/scale_factor + 0.75;
+    }
+    if (scale_factor == 1.0) {
+        lsf = 1.25;
+    }
+    
+    // only the ROIs that overlap the viewport are drawn; the extra padding
+    // accounts for the handle dots, which grow as we zoom out
+    QRectF visible = visible_image_rect();
+    roi_index.query(
+        Spatial_grid::Bounds(visible.left(), visible.top(), visible.right(), visible.bottom()).padded(10*lsf),
+        roi_candidates
+    );
 
     box_program->bind();
     box_program->setUniformValue("viewMatrix", view);
@@ -149,7 +165,8 @@ void GL_image_panel_edges::paint_overlay(void) {
     box_program->setAttributeBuffer(prog_vert_att, GL_FLOAT, 0, 3, 5 * sizeof(GLfloat));
     box_program->setAttributeBuffer(prog_texcoord_att, GL_FLOAT, 3 * sizeof(GLfloat), 2, 5 * sizeof(GLfloat));
     
-    for (auto& r : rois) {
+    for (uint32_t i: roi_candidates) {
+        auto& r = rois[i];
         draw_box(r.get(0) - img_centre, r.get(1) - img_centre, 56, 0.2, 0.75, 0.75, 0.3);
     }
     
@@ -170,7 +187,8 @@ void GL_image_panel_edges::paint_overlay(void) {
     };
     
     
-    for (auto& r : rois) {
+    for (uint32_t i: roi_candidates) {
+        auto& r = rois[i];
         int col_idx = &r == current_roi ? (closebox.is_valid() ? 1 : 0) : 0;
         draw_line(r.get(0) - img_centre, r.get(1) - img_centre, colours[col_idx][0], colours[col_idx][1], colours[col_idx][2]);
     }
@@ -185,7 +203,8 @@ void GL_image_panel_edges::paint_overlay(void) {
     dots_program->setAttributeBuffer(prog_vert_att, GL_FLOAT, 0, 3, 5 * sizeof(GLfloat));
     dots_program->setAttributeBuffer(prog_texcoord_att, GL_FLOAT, 3 * sizeof(GLfloat), 2, 5 * sizeof(GLfloat));
     
-    for (auto& r : rois) {
+    for (uint32_t i: roi_candidates) {
+        auto& r = rois[i];
         int col_idx = &r == current_roi ? (closebox.is_valid() ? 1 : 2) : 0;
         draw_dot(r.get(0).x() - img_centre.x(), r.get(0).y() - img_centre.y(), colours[col_idx][0], colours[col_idx][1], colours[col_idx][2]);
         draw_dot(r.get(1).x() - img_centre.x(), r.get(1).y() - img_centre.y(), colours[col_idx][0], colours[col_idx][1], colours[col_idx][2]);
@@ -203,14 +222,6 @@ void GL_image_panel_edges::paint_overlay(void) {
         box_program->setAttributeBuffer(prog_vert_att, GL_FLOAT, 0, 3, 5 * sizeof(GLfloat));
         box_program->setAttributeBuffer(prog_texcoord_att, GL_FLOAT, 3 * sizeof(GLfloat), 2, 5 * sizeof(GLfloat));
         
-        double lsf = 1.0;
-        if (scale_factor < 1) {
-            lsf = 0.5/scale_factor + 0.75;
-        }
-        if (scale_factor == 1.0) {
-            lsf = 1.25;
-        }
-        
         draw_box(
             closebox.get_pos() - lsf*10.0 * closebox.get_dir() - img_centre, 
             closebox.get_pos() + lsf*10.0 * closebox.get_dir() - img_centre, 
@@ -386,6 +397,7 @@ void GL_image_panel_edges::click_marker(QPoint pos, [[maybe_unused]] bool add) {
     
     rois.push_back(GL_roi(icoords, icoords));
     current_roi = &rois.back();
+    index_roi(rois.size() - 1);
     
     update();
     
@@ -396,6 +408,7 @@ void GL_image_panel_edges::line_endpoint(QPoint pos) {
     
     if (current_roi && current_roi_handle_idx >= 0 && current_roi_handle_idx <= 1) {
         current_roi->get(current_roi_handle_idx) = icoords;
+        index_roi(current_roi - rois.data());
         emit update_edge_length(current_roi->length());
     } else {
         emit update_edge_length(-1);
@@ -407,6 +420,7 @@ void GL_image_panel_edges::line_endpoint(QPoint pos) {
 
 void GL_image_panel_edges::clear_overlay(void) {
     rois.clear();
+    roi_index.clear();
     emit disable_save_button();
     current_roi = nullptr;
     closebox.make_invalid();
@@ -425,7 +439,10 @@ void GL_image_panel_edges::mousePressEvent(QMouseEvent* event) {
     if ( (state == NONE || state == ROI_SELECTED) &&
         !(closebox.is_valid() && closebox.selected(img_coords)) ) {
         
-        for (auto& r: rois) {
+        vector<uint32_t> candidates;
+        roi_index.query(Spatial_grid::Bounds(img_coords.x(), img_coords.y(), img_coords.x(), img_coords.y()), candidates);
+        for (uint32_t i: candidates) {
+            auto& r = rois[i];
             int handle_idx = r.handle_selected(img_coords);
             
             if (handle_idx >= 0) {
@@ -452,7 +469,12 @@ static double sqr(double x) {
 void GL_image_panel_edges::check_roi_boxes_and_handles(QPointF img_coords) {
     bool any_roi_hit = false;
     
-    for (auto& r: rois) {
+    // candidates are visited in the same order as rois, so overlapping
+    // ROIs resolve exactly as they would in a linear scan
+    vector<uint32_t> candidates;
+    roi_index.query(Spatial_grid::Bounds(img_coords.x(), img_coords.y(), img_coords.x(), img_coords.y()), candidates);
+    for (uint32_t i: candidates) {
+        auto& r = rois[i];
         int box_hit = r.box_selected(img_coords, 10.0, 28.0);
         
         if (box_hit) {
@@ -487,6 +509,17 @@ void GL_image_panel_edges::check_roi_boxes_and_handles(QPointF img_coords) {
     }
 }
 
+void GL_image_panel_edges::index_roi(size_t idx) {
+    roi_index.insert(uint32_t(idx), rois[idx].bounds(roi_pad));
+}
+
+void GL_image_panel_edges::rebuild_roi_index(void) {
+    roi_index.clear();
+    for (size_t i=0; i < rois.size(); i++) {
+        index_roi(i);
+    }
+}
+
 void GL_image_panel_edges::mouseReleaseEvent(QMouseEvent* event) {
     if (event->button() == Qt::LeftButton) {
         double d = sqrt( sqr(event->pos().x() - click.x()) + sqr(event->pos().y() - click.y()) );
@@ -524,6 +557,7 @@ void GL_image_panel_edges::mouseReleaseEvent(QMouseEvent* event) {
                     for (auto it=rois.begin(); it != rois.end();) {
                         if (&(*it) == current_roi) {
                             it = rois.erase(it);
+                            rebuild_roi_index();
                             current_roi = nullptr;
                             closebox.make_invalid();
                             emit update_edge_length(-1);
@@ -655,6 +689,7 @@ bool GL_image_panel_edges::load_rois(const QString& fname) {
     if (loaded_rois.size() > 0) {
         clear_overlay();
         rois = loaded_rois;
+        rebuild_roi_index();
         emit enable_save_button();
     }
     
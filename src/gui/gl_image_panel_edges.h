@@ -33,6 +33,7 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #include "gl_image_panel.h"
 #include "histogram_type.h"
 #include "include/bayer.h"
+#include "spatial_grid.h"
 
 #include <QPointF>
 #include <array>
@@ -73,6 +74,8 @@ class GL_image_panel_edges : public GL_image_panel {
     void draw_box(QPointF start, QPointF end, float box_width, double r, double g, double b, double t = 1.0);
     void draw_close_symbol(QPointF pos, QPointF dir, double r, double g, double b);
     void check_roi_boxes_and_handles(QPointF img_coords);
+    void index_roi(size_t idx);
+    void rebuild_roi_index(void);
     void broadcast_histogram(void);
     
     std::shared_ptr<QOpenGLShaderProgram> line_program;
@@ -109,6 +112,7 @@ class GL_image_panel_edges : public GL_image_panel {
         
         int handle_selected(QPointF p, double dist_thresh = 10.0);
         int box_selected(QPointF p, double dist_thresh = 10.0, double width_thresh = 28.0);
+        Spatial_grid::Bounds bounds(double pad) const;
         
       private:
         size_t n = 0;  
@@ -119,6 +123,12 @@ class GL_image_panel_edges : public GL_image_panel {
     int current_roi_handle_idx = -1;
     vector<GL_roi> rois;
     
+    // indexed by position in rois; the padding covers the box
+    // drawn around each ROI, which is also its pick region
+    static constexpr double roi_pad = 29.0;
+    Spatial_grid roi_index;
+    vector<uint32_t> roi_candidates;
+    
     class GL_closebox {
       public:
         GL_closebox(
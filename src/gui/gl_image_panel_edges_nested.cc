@@ -98,6 +98,10 @@ int GL_image_panel_edges::GL_roi::box_selected(QPointF p, double dist_thresh, do
     return 0;
 }
 
+Spatial_grid::Bounds GL_image_panel_edges::GL_roi::bounds(double pad) const {
+    return Spatial_grid::Bounds(pts[0].x(), pts[0].y(), pts[1].x(), pts[1].y()).padded(pad);
+}
+
 
 
 GL_image_panel_edges::GL_closebox::GL_closebox(QPointF handle_a, QPointF handle_b,
@@ -112,6 +112,7 @@ void GL_image_viewer::wheelEvent(QWheelEvent* e) {
 
 void GL_image_viewer::set_GL_widget(GL_image_panel* w) { 
     widget = w;
+    connect(widget, SIGNAL(image_loaded(QString)), this, SLOT(image_loaded(QString)));
 }
 
 void GL_image_viewer::keyPressEvent(QKeyEvent* event) {
@@ -217,6 +218,19 @@ bool GL_image_viewer::load_image(const QString& fname) {
         return false;
     }
 
+    update_hinted_size();
+    return true;
+}
+
+void GL_image_viewer::request_image(const QString& fname, const QStringList& prefetch) {
+    widget->request_image(fname, prefetch);
+}
+
+void GL_image_viewer::image_loaded([[maybe_unused]] QString fname) {
+    update_hinted_size();
+}
+
+void GL_image_viewer::update_hinted_size(void) {
     QScreen* screen = QGuiApplication::primaryScreen();
     QRect geom = screen->geometry();
 
@@ -229,7 +243,6 @@ bool GL_image_viewer::load_image(const QString& fname) {
 
     must_update_bars = true;
     widget->update();
-    return true;
 }
 
 bool GL_image_viewer::load_image(QImage* qimg) {
@@ -237,18 +250,7 @@ bool GL_image_viewer::load_image(QImage* qimg) {
         return false;
     }
 
-    QScreen* screen = QGuiApplication::primaryScreen();
-    QRect geom = screen->geometry();
-
-    hinted_size = QSize(
-        geom.width() < widget->img_size().width() ? geom.width() - 40 : widget->img_size().width(),
-        geom.height() < widget->img_size().height() ? geom.height() - 150 : widget->img_size().height()
-    );
-
-    updateGeometry();
-
-    must_update_bars = true;
-    widget->update();
+    update_hinted_size();
     return true;
 }
 
@@ -50,6 +50,7 @@ class GL_image_viewer : public QAbstractScrollArea {
     void set_GL_widget(GL_image_panel* w);
     bool load_image(const QString& fname);
     bool load_image(QImage* qimg);
+    void request_image(const QString& fname, const QStringList& prefetch = QStringList());
     void set_clickable(bool b);
     void set_resize_on_load(bool b);
 
@@ -57,6 +58,7 @@ class GL_image_viewer : public QAbstractScrollArea {
     
   private:
     void zoom_action(double direction, int zx, int zy);
+    void update_hinted_size(void);
     
     GL_image_panel* widget;
     
@@ -77,6 +79,7 @@ class GL_image_viewer : public QAbstractScrollArea {
     
   public slots:
     void clear_overlay();
+    void image_loaded(QString fname);
 };
 
 #endif
@@ -0,0 +1,130 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include "cache_entry.h"
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+using std::string;
+
+// Least-recently-used cache of decoded images (and their pyramids) with a
+// byte budget; all operations take constant time.
+class Image_cache {
+  public:
+    Image_cache(uint64_t capacity = uint64_t(1) << 30) : capacity(capacity) {}
+    
+    // shared by all the image panels
+    static Image_cache& instance(void) {
+        static Image_cache singleton;
+        return singleton;
+    }
+    
+    // marks the entry as most recently used
+    bool fetch(const string& key, Cache_entry& entry) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(key);
+        if (it == index.end()) {
+            return false;
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        entry = it->second->second;
+        return true;
+    }
+    
+    bool contains(const string& key) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return index.find(key) != index.end();
+    }
+    
+    // entries larger than the whole budget are not retained
+    void insert(const string& key, const Cache_entry& entry) {
+        std::lock_guard<std::mutex> lock(mutex);
+        erase_locked(key);
+        if (entry.size() > capacity) {
+            return;
+        }
+        entries.emplace_front(key, entry);
+        index[key] = entries.begin();
+        bytes += entry.size();
+        trim();
+    }
+    
+    void erase(const string& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        erase_locked(key);
+    }
+    
+    void set_capacity(uint64_t c) {
+        std::lock_guard<std::mutex> lock(mutex);
+        capacity = c;
+        trim();
+    }
+    
+    uint64_t size(void) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return bytes;
+    }
+    
+    void clear(void) {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+        index.clear();
+        bytes = 0;
+    }
+    
+  private:
+    void erase_locked(const string& key) {
+        auto it = index.find(key);
+        if (it != index.end()) {
+            bytes -= it->second->second.size();
+            entries.erase(it->second);
+            index.erase(it);
+        }
+    }
+    
+    void trim(void) {
+        while (bytes > capacity && !entries.empty()) {
+            bytes -= entries.back().second.size();
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+    
+    typedef std::list<std::pair<string, Cache_entry>> entry_list;
+    entry_list entries; // most recently used first
+    std::unordered_map<string, entry_list::iterator> index;
+    uint64_t bytes = 0;
+    uint64_t capacity;
+    mutable std::mutex mutex;
+};
+
+#endif
@@ -0,0 +1,339 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#include "include/logger.h"
+#include "image_provider.h"
+
+#include <QFileInfo>
+#include <QDateTime>
+
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+
+#include <cmath>
+#include <algorithm>
+
+Image_provider::Image_provider(QObject* parent) 
+: QObject(parent) {
+}
+
+Image_provider::~Image_provider(void) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+        queue.clear();
+    }
+    queue_cv.notify_all();
+    for (auto& t: threads) {
+        t.join();
+    }
+}
+
+void Image_provider::start_threads(void) {
+    // decoding is mostly serial (imread), so a few threads are enough to keep ahead of the user
+    if (threads.empty()) {
+        unsigned int n_threads = std::max(1u, std::min(3u, std::thread::hardware_concurrency() / 2));
+        for (unsigned int i=0; i < n_threads; i++) {
+            threads.push_back(std::thread(&Image_provider::decoder_run, this));
+        }
+    }
+}
+
+string Image_provider::cache_key(const QString& fname) {
+    // the GUI re-uses output file names, so include the modification time
+    QFileInfo fi(fname);
+    return fname.toStdString() + "@" + std::to_string(fi.lastModified().toMSecsSinceEpoch());
+}
+
+bool Image_provider::fetch(const QString& fname, Cache_entry& entry) {
+    string key = cache_key(fname);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        in_flight_cv.wait(lock, [this, &key]{ return in_flight.find(key) == in_flight.end(); });
+        if (cache.fetch(key, entry)) {
+            return true;
+        }
+    }
+    
+    if (!decode(fname.toStdString(), entry)) {
+        return false;
+    }
+    
+    cache.insert(key, entry);
+    return true;
+}
+
+quint64 Image_provider::request(const QString& fname, const QStringList& prefetch) {
+    quint64 ticket;
+    bool available = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        start_threads();
+        
+        // requests that have not started yet are stale now
+        queue.clear();
+        
+        ticket = ++current_ticket;
+        current_key = cache_key(fname);
+        current_delivered = false;
+        current_entry = Cache_entry();
+        
+        if (cache.fetch(current_key, current_entry)) {
+            current_delivered = true;
+            current_success = true;
+            available = true;
+        } else if (in_flight.find(current_key) == in_flight.end()) {
+            Request r;
+            r.fname = fname;
+            r.key = current_key;
+            queue.push_back(r);
+        } // otherwise the decoder already working on it will deliver it
+        
+        for (const QString& pf: prefetch) {
+            Request r;
+            r.fname = pf;
+            r.key = cache_key(pf);
+            r.prefetch = true;
+            if (r.key != current_key && !cache.contains(r.key) && in_flight.find(r.key) == in_flight.end()) {
+                queue.push_back(r);
+            }
+        }
+    }
+    queue_cv.notify_all();
+    
+    if (available) {
+        emit image_ready(fname, ticket, true);
+    }
+    return ticket;
+}
+
+bool Image_provider::take(quint64 ticket, Cache_entry& entry) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ticket != current_ticket || !current_delivered || !current_success) {
+        return false;
+    }
+    entry = current_entry;
+    current_entry = Cache_entry(); // the caller holds the only reference, unless it is cached
+    return true;
+}
+
+void Image_provider::decoder_run(void) {
+    while (true) {
+        Request r;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queue_cv.wait(lock, [this]{ return done || !queue.empty(); });
+            
+            if (done) { // for shutting down
+                break;
+            }
+            
+            r = queue.front();
+            queue.pop_front();
+            
+            // another thread may have completed it in the meantime
+            if (in_flight.find(r.key) != in_flight.end() || cache.contains(r.key)) {
+                continue;
+            }
+            in_flight.insert(r.key);
+        }
+        
+        Cache_entry entry;
+        bool success = decode(r.fname.toStdString(), entry);
+        
+        bool deliver = false;
+        quint64 ticket = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            in_flight.erase(r.key);
+            if (success) {
+                cache.insert(r.key, entry);
+            }
+            if (!current_delivered && r.key == current_key) {
+                current_entry = entry;
+                current_success = success;
+                current_delivered = true;
+                deliver = true;
+                ticket = current_ticket;
+            }
+        }
+        in_flight_cv.notify_all();
+        
+        if (deliver) {
+            emit image_ready(r.fname, ticket, success);
+        }
+    }
+}
+
+bool Image_provider::decode(const string& fname, Cache_entry& entry) {
+    cv::Mat cvimg;
+    try {
+        cvimg = cv::imread(fname, cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH | cv::IMREAD_IGNORE_ORIENTATION);
+    } catch (const cv::Exception& ex) {
+        logger.error("Image_provider::decode: could not read %s: %s\n", fname.c_str(), ex.what());
+        return false;
+    }
+    if (cvimg.empty()) {
+        return false;
+    }
+    
+    entry.channels = cvimg.channels();
+    entry.depth = 8;
+    entry.assumed_linear = false;
+    
+    // perform normalization / scaling before color conversion?
+    if (cvimg.depth() != CV_8U) {
+        double alpha = 1.0;
+        double beta = 0;
+        entry.depth = 16;
+        entry.assumed_linear = true;
+        
+        if (cvimg.depth() == CV_16U) {
+            logger.info("Image_provider::decode: 16-bit histogram percentile scaling path\n");
+            
+            vector<uint64_t> histo(65536, 0);
+            size_t total_pixels = size_t(cvimg.channels())*size_t(cvimg.rows)*size_t(cvimg.cols);
+            uint16_t* ptr = (uint16_t*)cvimg.data;
+            uint16_t* sentinel = ptr + total_pixels;
+            while (ptr < sentinel) {
+                histo[*ptr++]++;
+            }
+            // now we can extract the true (clipping) max and min values
+            int minval = histo.size();
+            int maxval = 0;
+            for (size_t i=0; i < histo.size(); i++) {
+                int revi = histo.size() - 1 - i;
+                minval = histo[revi] > 0 ? revi : minval;
+                maxval = histo[i] > 0 ? i : maxval;
+            }
+            
+            // find upper percentile
+            size_t upper_c_target = total_pixels * 0.01;
+            uint64_t acc = 0;
+            size_t hist_upper = maxval;
+            while (hist_upper > 0 && acc < upper_c_target) {
+                acc += histo[hist_upper];
+                hist_upper--;
+            }
+            
+            // find lower percentile
+            size_t lower_c_target = total_pixels * 0.005;
+            acc = 0;
+            size_t hist_lower = minval;
+            while (hist_lower < size_t(maxval) && acc < lower_c_target) {
+                acc += histo[hist_lower];
+                hist_lower++;
+            }
+            
+            // prevent complete collapse on synthetic/degenerate images
+            if (fabs(double(hist_upper) - double(hist_lower)) < 0.05*(maxval - minval)) {
+                hist_lower = minval;
+                hist_upper = maxval;
+            }
+            
+            // scale intenisty so that minval -> 1 and maxval -> 254
+            if (hist_upper > hist_lower) {
+                alpha = 253.0/double(hist_upper - hist_lower);
+                beta = 1.0 - alpha * hist_lower;
+            }
+            
+            vector<uint8_t> lut(65536, 0);
+            size_t crush_thresh = std::min(2048, std::min(minval + 1, (int)hist_lower));
+            size_t saturation_thresh = maxval;
+            size_t pot = 1;
+            while (pot < 16 && (1 << pot) < maxval) {
+                pot++;
+            }
+            saturation_thresh = std::max((1 << pot) - 1, (int)hist_upper);
+            
+            size_t lut_idx = 0;
+            while (lut_idx < crush_thresh) {
+                lut[lut_idx++] = 0;
+            }
+            while (lut_idx < hist_lower) {
+                lut[lut_idx++] = 1;
+            }
+            while (lut_idx < hist_upper) {
+                lut[lut_idx] = std::max(1, std::min(254, int(lut_idx*alpha + beta)));
+                lut_idx++;
+            }
+            while (lut_idx < saturation_thresh) {
+                lut[lut_idx++] = 254;
+            }
+            while (lut_idx < lut.size()) {
+                lut[lut_idx++] = 255;
+            }
+            
+            cv::Mat dst(cvimg.rows, cvimg.cols, cvimg.channels() == 1 ? CV_8UC1 : CV_8UC3);
+            uint16_t* in_ptr = (uint16_t*)cvimg.data;
+            uint8_t* out_ptr = (uint8_t*)dst.data;
+            while (in_ptr < sentinel) {
+                *out_ptr++ = lut[*in_ptr++];
+            }
+            cvimg = dst;
+            
+            entry.minmax.first = minval;
+            entry.minmax.second = maxval;
+        } else {
+            logger.info("Image_provider::decode: unspecified (not 8- or 16-bit) min-max scaling path\n");
+            double minval, maxval;
+            cv::minMaxIdx(cvimg.reshape(1), &minval, &maxval);
+            
+            if (maxval > minval) {
+                alpha = 255.0/(maxval - minval);
+                beta = -alpha * minval;
+            }
+            
+            entry.minmax.first = minval;
+            entry.minmax.second = maxval;
+            
+            cv::Mat dst;
+            cvimg.convertTo(dst, CV_8U, alpha, beta);
+            cvimg = dst;
+        }
+    } else {
+        double minval, maxval;
+        cv::minMaxIdx(cvimg.reshape(1), &minval, &maxval);
+        entry.minmax.first = minval;
+        entry.minmax.second = maxval;
+    }
+    
+    if (cvimg.channels() == 1) {
+        cv::cvtColor(cvimg, cvimg, cv::COLOR_GRAY2BGR);
+    }
+    
+    // manual conversion, cvtColor seems a bit slow
+    uint8_t* sptr = cvimg.data;
+    uint8_t* sentinel = sptr + size_t(cvimg.rows)*size_t(cvimg.cols*3);
+    while (sptr < sentinel) {
+        std::swap(*sptr, *(sptr+2));
+        sptr += 3;
+    }
+    
+    entry.img = cvimg;
+    entry.pyramid = std::make_shared<const Image_pyramid>(cvimg);
+    return true;
+}
@@ -0,0 +1,104 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#ifndef IMAGE_PROVIDER_H
+#define IMAGE_PROVIDER_H
+
+#include "image_cache.h"
+
+#include <vector>
+using std::vector;
+#include <deque>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+// Decodes images for display on a small pool of background threads, and
+// keeps the results (including their pyramids) in the shared Image_cache,
+// keyed by file name and modification time.
+// Only the most recent request() is delivered; older requests that have not
+// started decoding yet are cancelled.
+class Image_provider : public QObject {
+  Q_OBJECT
+  
+  public:
+    explicit Image_provider(QObject* parent = nullptr);
+    ~Image_provider(void);
+    
+    // decodes on the calling thread, unless the image is cached or already being decoded
+    bool fetch(const QString& fname, Cache_entry& entry);
+    
+    // image_ready() is emitted with the returned ticket once fname is available;
+    // the prefetch files are decoded into the cache afterwards
+    quint64 request(const QString& fname, const QStringList& prefetch = QStringList());
+    
+    // retrieves the image of the most recent request, once image_ready() has been emitted
+    bool take(quint64 ticket, Cache_entry& entry);
+    
+    // reads fname, and converts it to 8-bit RGB for display; 16-bit images are
+    // scaled with a percentile stretch. The display pyramid is built here too
+    static bool decode(const string& fname, Cache_entry& entry);
+    
+  signals:
+    void image_ready(QString fname, quint64 ticket, bool success);
+    
+  private:
+    class Request {
+      public:
+        QString fname;
+        string key;
+        bool prefetch = false;
+    };
+    
+    static string cache_key(const QString& fname);
+    void start_threads(void);
+    void decoder_run(void);
+    
+    std::mutex mutex;
+    std::condition_variable queue_cv;
+    std::condition_variable in_flight_cv;
+    std::deque<Request> queue;
+    std::set<string> in_flight;
+    Image_cache& cache = Image_cache::instance();
+    
+    // the request that will be delivered through image_ready()
+    string current_key;
+    quint64 current_ticket = 0;
+    bool current_delivered = true;
+    bool current_success = false;
+    Cache_entry current_entry;
+    
+    vector<std::thread> threads;
+    bool done = false;
+};
+
+#endif
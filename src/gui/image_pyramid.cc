@@ -0,0 +1,68 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#include "image_pyramid.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+Image_pyramid::Image_pyramid(const cv::Mat& img) {
+    level_imgs.push_back(img);
+    while (std::max(level_imgs.back().cols, level_imgs.back().rows) > tile_size) {
+        const cv::Mat& prev = level_imgs.back();
+        cv::Mat next;
+        // area averaging is a box filter for exact 2:1 reductions
+        cv::resize(prev, next, cv::Size((prev.cols + 1) / 2, (prev.rows + 1) / 2), 0, 0, cv::INTER_AREA);
+        level_imgs.push_back(next);
+    }
+}
+
+cv::Rect Image_pyramid::tile_rect(size_t l, int col, int row) const {
+    const cv::Mat& img = level_imgs[l];
+    int cstart = col * tile_size;
+    int rstart = row * tile_size;
+    return cv::Rect(
+        cstart, rstart, 
+        std::min(cstart + tile_size, img.cols) - cstart, 
+        std::min(rstart + tile_size, img.rows) - rstart
+    );
+}
+
+size_t Image_pyramid::select_level(double scale) const {
+    size_t l = 0;
+    while (l + 1 < level_imgs.size() && 1.0 / level_scale(l + 1).x >= scale) {
+        l++;
+    }
+    return l;
+}
+
+uint64_t Image_pyramid::size(void) const {
+    uint64_t bytes = 0;
+    for (size_t l=1; l < level_imgs.size(); l++) {
+        bytes += uint64_t(level_imgs[l].total())*level_imgs[l].elemSize();
+    }
+    return bytes;
+}
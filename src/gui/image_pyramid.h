@@ -0,0 +1,84 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#ifndef IMAGE_PYRAMID_H
+#define IMAGE_PYRAMID_H
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+using std::vector;
+
+// Successively halved copies of an 8-bit RGB image, so that a zoomed-out view
+// only has to touch the pixels of a level that matches the display scale.
+// Each level is divided into square tiles. Level 0 shares the pixel data of
+// the input image; the coarsest level fits into a single tile.
+class Image_pyramid {
+  public:
+    static constexpr int tile_size = 512;
+    
+    explicit Image_pyramid(const cv::Mat& img);
+    
+    size_t levels(void) const {
+        return level_imgs.size();
+    }
+    
+    const cv::Mat& level(size_t l) const {
+        return level_imgs[l];
+    }
+    
+    // number of level-0 pixels per pixel of level l, along x and y
+    cv::Point2d level_scale(size_t l) const {
+        return cv::Point2d(
+            double(level_imgs[0].cols) / level_imgs[l].cols,
+            double(level_imgs[0].rows) / level_imgs[l].rows
+        );
+    }
+    
+    int tile_columns(size_t l) const {
+        return (level_imgs[l].cols + tile_size - 1) / tile_size;
+    }
+    
+    int tile_rows(size_t l) const {
+        return (level_imgs[l].rows + tile_size - 1) / tile_size;
+    }
+    
+    // in the pixel coordinates of level l
+    cv::Rect tile_rect(size_t l, int col, int row) const;
+    
+    // the coarsest level that still has at least one pixel per screen pixel
+    // when level 0 is displayed at the specified scale
+    size_t select_level(double scale) const;
+    
+    // memory used by levels 1 and higher, in bytes
+    uint64_t size(void) const;
+    
+  private:
+    vector<cv::Mat> level_imgs;
+};
+
+#endif
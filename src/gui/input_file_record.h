@@ -30,6 +30,9 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #define INPUT_FILE_RECORD_H
 
 #include <QString>
+#include <cstdint>
+#include <memory>
+#include <atomic>
 
 #include "raw_developer.h"
 
@@ -38,7 +41,8 @@ class Input_file_record {
     enum class state_t {
         SUBMITTED,
         COMPLETED,
-        FAILED
+        FAILED,
+        ABORTED
     };
     
     Input_file_record(void) {}
@@ -78,10 +82,31 @@ class Input_file_record {
         state = new_state;
     }
     
+    uint64_t get_sequence(void) const {
+        return sequence;
+    }
+    
+    void set_sequence(uint64_t seq) {
+        sequence = seq;
+    }
+    
     std::shared_ptr<Raw_developer> get_raw_developer(void) const {
         return raw_developer;
     }
     
+    // shared by all the records of a batch, see Worker_thread::receive_abort()
+    void set_abort_flag(std::shared_ptr<std::atomic<bool>> flag) {
+        abort_flag = flag;
+    }
+    
+    std::shared_ptr<std::atomic<bool>> get_abort_flag(void) const {
+        return abort_flag;
+    }
+    
+    bool aborted(void) const {
+        return abort_flag && *abort_flag;
+    }
+    
     bool is_valid(void) const {
         return input_fname.length() > 0;
     }
@@ -91,7 +116,9 @@ class Input_file_record {
     QString temp_dir;
     QString output_fname;
     state_t state;
+    uint64_t sequence = 0;
     std::shared_ptr<Raw_developer> raw_developer;
+    std::shared_ptr<std::atomic<bool>> abort_flag;
 };
 
 #endif
@@ -199,6 +199,7 @@ mtfmapper_app::mtfmapper_app(QWidget *parent ATTRIBUTE_UNUSED)
     menuBar()->addMenu(help_menu);
     
     connect(datasets->selectionModel(), SIGNAL(currentChanged(const QModelIndex&, const QModelIndex&)), this, SLOT(dataset_selected_changed(const QModelIndex&, const QModelIndex&)));
+    connect(img_panel, SIGNAL(image_load_failed(QString)), this, SLOT(image_load_failed(QString)));
     
     connect(&processor, SIGNAL(send_parent_item(QString, QString, QString)), this, SLOT(parent_item(QString, QString, QString)));
     connect(&processor, SIGNAL(send_child_item(QString, QString)), this, SLOT(child_item(QString, QString)));
@@ -307,6 +308,7 @@ mtfmapper_app::~mtfmapper_app(void) {
 }
 
 void mtfmapper_app::clear_temp_files(void) {
+    edge_table.close(); // release the mapping before deleting the file
     QStringList dirnames;
     for (int i=0; i < tempfiles_to_delete.size(); i++) {
         QString fn(tempfiles_to_delete.at(i));
@@ -408,23 +410,57 @@ void mtfmapper_app::create_actions(void) {
     connect(about_act, SIGNAL(triggered()), about, SLOT( open() ));
 }
 
-void mtfmapper_app::view_image(const QString& fname) {
-    bool opencv_succeeded = true;
-    try {
-        img_viewer->load_image(fname);
-    }
-    catch (const cv::Exception&) {
-        // too bad, OpenCV cannot handle it either ...
-        opencv_succeeded = false;
+void mtfmapper_app::view_image(const QString& fname, const QStringList& prefetch) {
+    // decoded in the background; failures are reported through image_load_failed()
+    img_viewer->request_image(fname, prefetch);
+} 
+
+void mtfmapper_app::image_load_failed(QString fname) {
+    QMessageBox::information(
+        this, tr("Image Viewer"),
+        tr("Cannot load %1.").arg(fname)
+    );
+}
+
+int mtfmapper_app::dataset_file_index(int parent_row, int child_row) const {
+    int count_before = child_row + 1;
+    for (int row=parent_row-1; row >= 0; row--) {
+        count_before += dataset_contents.item(row)->rowCount() + 1;
     }
-    if (!opencv_succeeded) {
-        QMessageBox::information(
-            this, tr("Image Viewer"),
-            tr("Cannot load %1.").arg(fname)
-        );
-        return;
+    return count_before;
+}
+
+QStringList mtfmapper_app::prefetch_candidates(const QModelIndex& index) const {
+    // the user typically steps to the adjacent entry, or to the same
+    // output (e.g., "annotated") of the adjacent data set
+    QStringList prefetch;
+    int parent_row = index.parent() != QModelIndex() ? index.parent().row() : index.row();
+    int child_row = index.parent() != QModelIndex() ? index.row() : -1;
+    int file_index = dataset_file_index(parent_row, child_row);
+    QString text = dataset_contents.itemFromIndex(index)->text();
+    
+    for (int delta: {1, -1}) {
+        int adjacent = parent_row + delta;
+        if (adjacent >= 0 && adjacent < dataset_contents.rowCount()) {
+            QStandardItem* adjacent_item = dataset_contents.item(adjacent);
+            if (child_row < 0) {
+                prefetch << dataset_files.at(dataset_file_index(adjacent));
+            } else {
+                for (int row=0; row < adjacent_item->rowCount(); row++) {
+                    if (adjacent_item->child(row)->text().compare(text) == 0) {
+                        prefetch << dataset_files.at(dataset_file_index(adjacent, row));
+                        break;
+                    }
+                }
+            }
+        }
+        if (file_index + delta >= 0 && file_index + delta < dataset_files.size()) {
+            prefetch << dataset_files.at(file_index + delta);
+        }
     }
-} 
+    prefetch.removeDuplicates();
+    return prefetch;
+}
 
 void mtfmapper_app::open_auto() {
     open_action(false);
@@ -516,6 +552,7 @@ void mtfmapper_app::open_action(bool roi, bool focus, bool imatest, bool manual_
             ps.set_focus_mode(focus);
             ps.set_imatest_mode(imatest);
             ps.set_manual_roi_mode(manual_roi);
+            ps.set_raw_developer_threads(settings->helpers->get_raw_developer_threads());
             emit submit_batch(ps);
         }
     }
@@ -527,60 +564,30 @@ void mtfmapper_app::dataset_selected(const QModelIndex& index) {
     // filename associated with this entry. There must be a 
     // better way ...
     int count_before = 0;
-    int parent_row = 0;
     if (index.parent() != QModelIndex()) {
-        parent_row = index.parent().row();
-        count_before = index.row() + 1;
+        count_before = dataset_file_index(index.parent().row(), index.row());
     } else {
-        parent_row = index.row();
-    }
-    
-    for (int row=parent_row-1; row >= 0; row--) {
-        QStandardItem* current_dataset_item = dataset_contents.item(row);
-        count_before += current_dataset_item->rowCount() + 1;
+        count_before = dataset_file_index(index.row());
     }
     active_annotated_filename = std::pair<QString, QStandardItem*>("", nullptr);
     if (dataset_contents.itemFromIndex(index)->isEnabled()) {
-        view_image(dataset_files.at(count_before));
+        view_image(dataset_files.at(count_before), prefetch_candidates(index));
         display_exif_properties(count_before);
         if (dataset_contents.itemFromIndex(index)->text().compare(QString("annotated")) == 0) {
             img_viewer->setToolTip(zoom_scroll_tt + "\n\n" + annotated_tt);
             img_viewer->set_clickable(true);
-            sfr_list.clear();
-            
             QString sfr_source = QFileInfo(dataset_files.at(count_before)).dir().path() + QString("/serialized_edges.bin");
-            // go and fetch the corresponding "edge_sfr" entries
-            FILE* fin = fopen(sfr_source.toLocal8Bit().constData(), "rb");
-            if (!fin) {
+            // map the edge table; columnar files are used in place, older record streams are decoded
+            if (!edge_table.open(sfr_source.toLocal8Bit().constData())) {
                 logger.error("Could not open serialized edge info file [%s], SFR profiles not available\n", sfr_source.toLocal8Bit().constData());
                 logger.flush();
             } else {
-                // read header
-                size_t edge_count = 0;
-                Job_metadata job_metadata;
-                bool success = Edge_info::deserialize_header(fin, edge_count, job_metadata);
-                
-                if (!success) {
-                    logger.error("%s\n", "Could not read serialized edge info header.");
-                    logger.flush();
-                } else {
-                    size_t edges_processed = 0;
-                    while (success && edges_processed < edge_count) {
-                        Edge_info b = Edge_info::deserialize(fin, success);
-                        if (success) {
-                            b.set_metadata(job_metadata);
-                            sfr_list.push_back(Sfr_entry(b.centroid.x, b.centroid.y, b));
-                            edges_processed++;
-                        }
-                    }
-                    fclose(fin);
-                    active_annotated_filename = std::pair<QString, QStandardItem*>(dataset_files.at(count_before), dataset_contents.itemFromIndex(index));
-                }
+                active_annotated_filename = std::pair<QString, QStandardItem*>(dataset_files.at(count_before), dataset_contents.itemFromIndex(index));
             }
         } else {
             img_viewer->setToolTip(zoom_scroll_tt);
             img_viewer->set_clickable(false);
-            sfr_list.clear();
+            edge_table.close();
         }
     }
 }
@@ -594,31 +601,26 @@ void mtfmapper_app::parent_item(QString s, QString f, QString tempdir) {
     // take a peek at the edge info header to obtain the job metadata, which
     // will reveal the channel type
     QIcon channel_icon;
-    FILE* fin = fopen((tempdir + QString("/serialized_edges.bin")).toLocal8Bit().constData(), "rb");
-    if (fin) {
-        Job_metadata metadata;
-        size_t dummy_count = 0;
-        if (Edge_info::deserialize_header(fin, dummy_count, metadata)) {
-            switch (metadata.bayer) {
-            case Bayer::bayer_t::NONE: 
-                if (metadata.channels > 1) {
-                    channel_icon.addFile(":/Icons/Channel_RGB_to_L");
-                } else {
-                    channel_icon.addFile(":/Icons/Channel_Gray");
-                }
-                break;
-            case Bayer::bayer_t::RED: 
-                channel_icon.addFile(":/Icons/Channel_Red");
-                break;
-            case Bayer::bayer_t::GREEN: 
-                channel_icon.addFile(":/Icons/Channel_Green");
-                break;
-            case Bayer::bayer_t::BLUE: 
-                channel_icon.addFile(":/Icons/Channel_Blue");
-                break;
+    Job_metadata metadata;
+    if (Edge_table::peek_metadata((tempdir + QString("/serialized_edges.bin")).toLocal8Bit().constData(), metadata)) {
+        switch (metadata.bayer) {
+        case Bayer::bayer_t::NONE: 
+            if (metadata.channels > 1) {
+                channel_icon.addFile(":/Icons/Channel_RGB_to_L");
+            } else {
+                channel_icon.addFile(":/Icons/Channel_Gray");
             }
+            break;
+        case Bayer::bayer_t::RED: 
+            channel_icon.addFile(":/Icons/Channel_Red");
+            break;
+        case Bayer::bayer_t::GREEN: 
+            channel_icon.addFile(":/Icons/Channel_Green");
+            break;
+        case Bayer::bayer_t::BLUE: 
+            channel_icon.addFile(":/Icons/Channel_Blue");
+            break;
         }
-        fclose(fin);
     }
 
     current_dataset_item = new QStandardItem(channel_icon, s);
@@ -895,19 +897,11 @@ void mtfmapper_app::check_if_helpers_exist(void) {
 
 bool mtfmapper_app::edge_selected(int px, int py, bool /*ctrl_down*/, bool shift_down) {
     bool found = false;
-    if (sfr_list.size() > 0) {
+    if (edge_table.size() > 0) {
         
-        size_t close_idx = 0;
-        double close_dist = 1e50;
-        for (size_t i=0; i < sfr_list.size(); i++) {
-            double d = sfr_list[i].distance(px, py);
-            if (d < close_dist) {
-                close_dist = d;
-                close_idx = i;
-            }
-        }
+        int close_idx = edge_table.nearest(px, py, 50);
         
-        if (close_dist < 50) {
+        if (close_idx >= 0) {
             found = true;
             if (sfr_dialog->isVisible()) {
                 sfr_dialog_geom = sfr_dialog->geometry();
@@ -923,7 +917,8 @@ bool mtfmapper_app::edge_selected(int px, int py, bool /*ctrl_down*/, bool shift
                 sfr_dialog->clear();
                 sfr_pip_map.clear();
             }
-            sfr_dialog->add_entry(sfr_list[close_idx]);
+            const Edge_info info = edge_table.edge_info(close_idx);
+            sfr_dialog->add_entry(Sfr_entry(info.centroid.x, info.centroid.y, info));
             if (sfr_dialog_geom != QRect(-1, -1, 0, 0)) {
                 sfr_dialog->setGeometry(sfr_dialog_geom);
             }
@@ -1200,6 +1195,7 @@ void mtfmapper_app::dropEvent(QDropEvent* evt) {
             settings->get_argument_string(false),
             Raw_developer_factory::build(*settings->helpers)
         );
+        ps.set_raw_developer_threads(settings->helpers->get_raw_developer_threads());
         
         emit submit_batch(ps);
     }
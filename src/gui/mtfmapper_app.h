@@ -45,6 +45,7 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #include "processor_state.h"
 
 #include "sfr_entry.h"
+#include "include/edge_table.h"
 #include "sfr_dialog.h"
 
 #include "edge_select_dialog.h"
@@ -86,7 +87,9 @@ class mtfmapper_app : public QMainWindow
   
   private:
     void create_actions(void);
-    void view_image(const QString& fname);
+    void view_image(const QString& fname, const QStringList& prefetch = QStringList());
+    int dataset_file_index(int parent_row, int child_row = -1) const;
+    QStringList prefetch_candidates(const QModelIndex& index) const;
     void display_exif_properties(int index);
     void clear_temp_files(void);
     void check_and_purge_stale_temp_files(void);
@@ -164,7 +167,7 @@ class mtfmapper_app : public QMainWindow
     QImage* icon_image;
     
     Sfr_dialog*     sfr_dialog;
-    vector<Sfr_entry> sfr_list;
+    Edge_table      edge_table;
     std::pair<QString, QStandardItem*> active_annotated_filename;
     std::map<QString, std::pair<int, QStandardItem*>> sfr_pip_map;
 
@@ -195,6 +198,7 @@ class mtfmapper_app : public QMainWindow
     void open_imatest_chart();
     void dataset_selected(const QModelIndex&);
     void dataset_selected_changed(const QModelIndex&, const QModelIndex&);
+    void image_load_failed(QString fname);
     void parent_item(QString s, QString f, QString tempdir);
     void child_item(QString s, QString f);
     void close_item(void);
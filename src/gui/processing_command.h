@@ -31,6 +31,9 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #include <QString>
 #include <QStringList>
 
+#include <memory>
+#include <atomic>
+
 class Processing_command {
   public:
     enum class state_t {
@@ -62,12 +65,26 @@ class Processing_command {
         return img_filename.length() > 0;
     }
     
+    // shared by all the commands of a batch, see Worker_thread::receive_abort()
+    void set_abort_flag(std::shared_ptr<std::atomic<bool>> flag) {
+        abort_flag = flag;
+    }
+    
+    const std::atomic<bool>* get_abort_flag(void) const {
+        return abort_flag.get();
+    }
+    
+    bool aborted(void) const {
+        return abort_flag && *abort_flag;
+    }
+    
     QString program;
     QStringList arguments;
     QString img_filename;
     QString tmp_dirname;
     QString exif_filename;
     state_t state;
+    std::shared_ptr<std::atomic<bool>> abort_flag;
 };
 
 #endif
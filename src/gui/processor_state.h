@@ -66,6 +66,10 @@ class Processor_state {
         manual_roi_mode = manual_roi;
     }
     
+    void set_raw_developer_threads(int threads) {
+        raw_developer_threads = threads;
+    }
+    
     Processing_command::state_t initial_state(void) const {
         return manual_roi_mode ? Processing_command::state_t::AWAIT_ROI : Processing_command::state_t::READY;
     }
@@ -80,6 +84,7 @@ class Processor_state {
     bool focus_mode = false;
     bool imatest_mode = false;
     bool manual_roi_mode = false;
+    int raw_developer_threads = 1;
     
     QStringList input_files;
     QString gnuplot_binary;
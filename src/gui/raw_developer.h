@@ -65,7 +65,7 @@ class Raw_developer {
                   effective_input.toLocal8Bit().constData(), dcp.exitStatus(), dcp.exitCode()
               );
           } else {
-              post_proc(bayer_mode, input, output);
+              post_proc(bayer_mode, effective_input, output);
           }
           return dc_rval;
     }
@@ -79,13 +79,15 @@ class Raw_developer {
     virtual QStringList arguments(bool bayer_mode, const QString& input, const QString& output) = 0;
     virtual bool accepts_suffix(const QString& suffix) = 0;
     
-    // to support making a copy of the input file first
+    // to support making a copy of the input file first; note that a single
+    // developer instance is shared by concurrent process() calls, so neither
+    // pre_proc() nor post_proc() may keep per-file state in the instance
     virtual QString pre_proc([[maybe_unused]] bool bayer_mode, [[maybe_unused]] const QString& input, [[maybe_unused]] const QString& output) { 
         return input;
     }
     
     // optional clean up
-    virtual void post_proc([[maybe_unused]] bool bayer_mode, [[maybe_unused]] const QString& input, [[maybe_unused]] const QString& output) {}
+    virtual void post_proc([[maybe_unused]] bool bayer_mode, [[maybe_unused]] const QString& effective_input, [[maybe_unused]] const QString& output) {}
 };
 
 #include "settings_helpers_tab.h"
@@ -68,9 +68,19 @@ class Raw_developer_libraw : public Raw_developer {
         QString effective_ifname;
         if (bayer_mode) {
             effective_ifname = QFileInfo(output).absolutePath() + "/" + QFileInfo(input).fileName();
-            // make a copy of the input file in the output (temp) dir
+            // unprocessed_raw cannot be told where to write its output, so the input
+            // must appear in the output (temp) dir; a symbolic link avoids copying
+            // the whole raw file where the platform supports it
+            #ifndef _WIN32
+            if (QFile::link(QFileInfo(input).absoluteFilePath(), effective_ifname)) {
+                logger.info("linked [%s] to [%s] before raw development\n",
+                    input.toLocal8Bit().constData(),
+                    effective_ifname.toLocal8Bit().constData()
+                );
+                return effective_ifname;
+            }
+            #endif
             if (QFile::copy(input, effective_ifname)) {
-                copied_input = effective_ifname;
                 logger.info("copied [%s] to [%s] before raw development\n",
                     input.toLocal8Bit().constData(),
                     effective_ifname.toLocal8Bit().constData()
@@ -82,12 +92,12 @@ class Raw_developer_libraw : public Raw_developer {
         return effective_ifname;
     }
     
-    virtual void post_proc(bool bayer_mode, [[maybe_unused]] const QString& input, const QString& output) {
-        if (copied_input.length() > 0 && QFile::exists(copied_input)) {
-            QFile::remove(copied_input);
-        }
+    virtual void post_proc(bool bayer_mode, const QString& effective_input, const QString& output) {
         if (bayer_mode) {
-            QString raw_ofname = copied_input + ".tiff";
+            // removes only the link (or copy) in the temp dir
+            QFile::remove(effective_input);
+            
+            QString raw_ofname = effective_input + ".tiff";
             logger.info("after raw development, move [%s] to [%s] \n",
                 raw_ofname.toLocal8Bit().constData(),
                 output.toLocal8Bit().constData()
@@ -115,7 +125,6 @@ class Raw_developer_libraw : public Raw_developer {
   
     QString dcraw_emu_exec;
     QString unprocessed_raw_exec;
-    QString copied_input;
     vector<QString> suffixes = {
       "NEF",  // Nikon
       "ARW",  // Sony
@@ -84,7 +84,7 @@ QString Settings_dialog::get_argument_string(bool focus_mode) {
     
     if (io->cb_annotation->checkState()) {
         args = args + QString(" -a");
-        args = args + QString(" -v 2");
+        args = args + QString(" -v 3");
     }
     
     if (io->cb_profile->checkState()) {
@@ -230,6 +230,7 @@ void Settings_dialog::save_and_close() {
     settings.setValue(Settings_helpers_tab::setting_dcraw_emu, helpers->dcraw_emu_line->text());
     settings.setValue(Settings_helpers_tab::setting_unprocessed_raw, helpers->unproc_raw_line->text());
     settings.setValue(Settings_helpers_tab::setting_raw_developer, helpers->box_raw_developer->currentIndex());
+    settings.setValue(Settings_helpers_tab::setting_raw_threads, helpers->raw_threads_spin->value());
     settings.setValue(Settings_io_tab::setting_zscale, io->zscale_slider->value());
     settings.setValue(Settings_io_tab::setting_cache, io->cache_line->text());
     settings.setValue(Settings_io_tab::setting_lp1, io->lp1_line->text());
@@ -30,12 +30,15 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 
 #include "common.h"
 
+#include <algorithm>
+
 const QString Settings_helpers_tab::setting_gnuplot = "setting_gnuplot";
 const QString Settings_helpers_tab::setting_exiv = "setting_exiv";
 const QString Settings_helpers_tab::setting_dcraw = "setting_dcraw";
 const QString Settings_helpers_tab::setting_dcraw_emu = "setting_dcraw_emu";
 const QString Settings_helpers_tab::setting_unprocessed_raw = "setting_unprocessed_raw";
 const QString Settings_helpers_tab::setting_raw_developer = "setting_raw_developer";
+const QString Settings_helpers_tab::setting_raw_threads = "setting_raw_threads";
 #ifdef _WIN32
 QString Settings_helpers_tab::setting_gnuplot_default = "gnuplot.exe";
 QString Settings_helpers_tab::setting_exiv_default = "exiv2.exe";
@@ -50,6 +53,7 @@ QString Settings_helpers_tab::setting_dcraw_emu_default = "/usr/bin/dcraw_emu";
 QString Settings_helpers_tab::setting_unprocessed_raw_default = "/usr/bin/unprocessed_raw";
 #endif
 const int Settings_helpers_tab::setting_raw_developer_default = 0;
+const int Settings_helpers_tab::setting_raw_threads_default = 0; // automatic
 
 Settings_helpers_tab::Settings_helpers_tab(QWidget *parent ATTRIBUTE_UNUSED) {
 
@@ -85,6 +89,11 @@ Settings_helpers_tab::Settings_helpers_tab(QWidget *parent ATTRIBUTE_UNUSED) {
     box_raw_developer->addItem("LibRaw");
     box_raw_developer->addItem("dcraw");
     
+    raw_threads_label = new QLabel("Concurrent raw developers:", this);
+    raw_threads_spin = new QSpinBox(this);
+    raw_threads_spin->setRange(0, 64);
+    raw_threads_spin->setSpecialValueText("automatic");
+    
     #ifdef _WIN32
     setting_gnuplot_default = QCoreApplication::applicationDirPath() + QString("/gnuplot/gnuplot.exe");
     setting_exiv_default = QCoreApplication::applicationDirPath() + QString("/exiv2/exiv2.exe");
@@ -100,12 +109,15 @@ Settings_helpers_tab::Settings_helpers_tab(QWidget *parent ATTRIBUTE_UNUSED) {
     dcraw_emu_line->setText(settings.value(setting_dcraw_emu, setting_dcraw_emu_default).toString());
     unproc_raw_line->setText(settings.value(setting_unprocessed_raw, setting_unprocessed_raw_default).toString());
     box_raw_developer->setCurrentIndex(settings.value(setting_raw_developer, setting_raw_developer_default).toInt());
+    raw_threads_spin->setValue(settings.value(setting_raw_threads, setting_raw_threads_default).toInt());
     
     toggle_enabled_raw_develop_options(get_raw_developer());
     
     QGridLayout *helper_layout = new QGridLayout;
     helper_layout->addWidget(raw_developer_label, 0, 0);
     helper_layout->addWidget(box_raw_developer, 0, 1);
+    helper_layout->addWidget(raw_threads_label, 6, 0);
+    helper_layout->addWidget(raw_threads_spin, 6, 1, Qt::AlignLeft);
     helper_layout->addWidget(gnuplot_label, 1, 0);
     helper_layout->addWidget(gnuplot_line, 1, 1);
     helper_layout->addWidget(gnuplot_button, 1, 2);
@@ -297,6 +309,15 @@ int Settings_helpers_tab::get_raw_developer(void) const {
     return box_raw_developer->currentIndex();
 }
 
+int Settings_helpers_tab::get_raw_developer_threads(void) const {
+    if (raw_threads_spin->value() > 0) {
+        return raw_threads_spin->value();
+    }
+    // each developer is a single-threaded external process, but the analysis
+    // jobs that consume the developed images need most of the cores
+    return std::max(1, QThread::idealThreadCount() / 4);
+}
+
 void Settings_helpers_tab::toggle_enabled_raw_develop_options(int idx) {
     for (auto q: all_raw_lineedits) {
         q->setDisabled(true);
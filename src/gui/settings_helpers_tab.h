@@ -44,6 +44,7 @@ class Settings_helpers_tab : public QWidget {
     QString get_dcraw_emu_binary(void) const;
     QString get_unprocessed_raw_binary(void) const;
     int get_raw_developer(void) const;
+    int get_raw_developer_threads(void) const;
     
     void check_gnuplot_binary(void);
     void check_exiv2_binary(void);
@@ -75,6 +76,9 @@ class Settings_helpers_tab : public QWidget {
     QLabel* raw_developer_label;
     QComboBox* box_raw_developer;
     
+    QLabel* raw_threads_label;
+    QSpinBox* raw_threads_spin;
+    
     vector<QLineEdit*> all_raw_lineedits;
     vector<vector<QLineEdit*>> raw_lineedits;
     
@@ -84,12 +88,14 @@ class Settings_helpers_tab : public QWidget {
     static const QString setting_dcraw_emu;
     static const QString setting_unprocessed_raw;
     static const QString setting_raw_developer;
+    static const QString setting_raw_threads;
     static QString setting_gnuplot_default;
     static QString setting_exiv_default;
     static QString setting_dcraw_default;
     static QString setting_dcraw_emu_default;
     static QString setting_unprocessed_raw_default;
     static const int setting_raw_developer_default;
+    static const int setting_raw_threads_default;
     
     static constexpr int raw_developer_libraw = 0;
     static constexpr int raw_developer_dcraw = 1;
@@ -0,0 +1,193 @@
+/*
+Copyright 2020 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+using std::vector;
+
+// A uniform grid over axis-aligned bounding boxes that supports incremental
+// insertion, updates and removal. Items are identified by a caller-supplied
+// id (typically an index into the caller's own container), and an item is
+// listed in every cell that its bounding box overlaps, so that both point
+// picks and rectangular (viewport) queries only visit nearby items.
+class Spatial_grid {
+  public:
+    class Bounds {
+      public:
+        Bounds(double ax = 0, double ay = 0, double bx = 0, double by = 0)
+        : x0(std::min(ax, bx)), y0(std::min(ay, by)), x1(std::max(ax, bx)), y1(std::max(ay, by)) {}
+        
+        Bounds padded(double pad) const {
+            return Bounds(x0 - pad, y0 - pad, x1 + pad, y1 + pad);
+        }
+        
+        bool intersects(const Bounds& b) const {
+            return x0 <= b.x1 && b.x0 <= x1 && y0 <= b.y1 && b.y0 <= y1;
+        }
+        
+        double x0;
+        double y0;
+        double x1;
+        double y1;
+    };
+    
+    explicit Spatial_grid(double cell_size = 256.0) : cell_size(cell_size) {}
+    
+    void clear(void) {
+        cells.clear();
+        items.clear();
+    }
+    
+    size_t size(void) const {
+        return items.size();
+    }
+    
+    // inserts the item, or moves it if the id is already present
+    void insert(uint32_t id, const Bounds& b) {
+        auto it = items.find(id);
+        if (it != items.end()) {
+            if (same_cells(it->second, b)) {
+                it->second = b;
+                return;
+            }
+            remove_from_cells(id, it->second);
+            it->second = b;
+        } else {
+            items.emplace(id, b);
+        }
+        int c0, r0, c1, r1;
+        cell_range(b, c0, r0, c1, r1);
+        for (int r=r0; r <= r1; r++) {
+            for (int c=c0; c <= c1; c++) {
+                cells[key(c, r)].push_back(id);
+            }
+        }
+    }
+    
+    void remove(uint32_t id) {
+        auto it = items.find(id);
+        if (it != items.end()) {
+            remove_from_cells(id, it->second);
+            items.erase(it);
+        }
+    }
+    
+    // ids of all items whose bounds intersect the region, in ascending order
+    void query(const Bounds& region, vector<uint32_t>& ids) const {
+        ids.clear();
+        int c0, r0, c1, r1;
+        cell_range(region, c0, r0, c1, r1);
+        
+        auto visit = [&](const vector<uint32_t>& cell) {
+            for (uint32_t id: cell) {
+                if (items.at(id).intersects(region)) {
+                    ids.push_back(id);
+                }
+            }
+        };
+        
+        // a large region (e.g., a zoomed-out viewport) may cover many more
+        // cells than are occupied, in which case the occupied cells are scanned
+        if (double(c1 - c0 + 1)*double(r1 - r0 + 1) > double(cells.size())) {
+            for (const auto& cell: cells) {
+                int c = int(int32_t(cell.first & 0xffffffff));
+                int r = int(int32_t(cell.first >> 32));
+                if (c >= c0 && c <= c1 && r >= r0 && r <= r1) {
+                    visit(cell.second);
+                }
+            }
+        } else {
+            for (int r=r0; r <= r1; r++) {
+                for (int c=c0; c <= c1; c++) {
+                    auto it = cells.find(key(c, r));
+                    if (it != cells.end()) {
+                        visit(it->second);
+                    }
+                }
+            }
+        }
+        
+        // items spanning more than one cell are reported once
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    }
+    
+  private:
+    static uint64_t key(int c, int r) {
+        return (uint64_t(uint32_t(r)) << 32) | uint64_t(uint32_t(c));
+    }
+    
+    void cell_range(const Bounds& b, int& c0, int& r0, int& c1, int& r1) const {
+        c0 = cell_coord(b.x0);
+        r0 = cell_coord(b.y0);
+        c1 = cell_coord(b.x1);
+        r1 = cell_coord(b.y1);
+    }
+    
+    int cell_coord(double v) const {
+        constexpr double limit = double(1 << 30);
+        return int(std::max(-limit, std::min(limit, std::floor(v / cell_size))));
+    }
+    
+    bool same_cells(const Bounds& a, const Bounds& b) const {
+        int ac0, ar0, ac1, ar1;
+        int bc0, br0, bc1, br1;
+        cell_range(a, ac0, ar0, ac1, ar1);
+        cell_range(b, bc0, br0, bc1, br1);
+        return ac0 == bc0 && ar0 == br0 && ac1 == bc1 && ar1 == br1;
+    }
+    
+    void remove_from_cells(uint32_t id, const Bounds& b) {
+        int c0, r0, c1, r1;
+        cell_range(b, c0, r0, c1, r1);
+        for (int r=r0; r <= r1; r++) {
+            for (int c=c0; c <= c1; c++) {
+                auto it = cells.find(key(c, r));
+                if (it == cells.end()) {
+                    continue;
+                }
+                vector<uint32_t>& cell = it->second;
+                cell.erase(std::remove(cell.begin(), cell.end(), id), cell.end());
+                if (cell.empty()) {
+                    cells.erase(it);
+                }
+            }
+        }
+    }
+    
+    double cell_size;
+    std::unordered_map<uint64_t, vector<uint32_t>> cells;
+    std::unordered_map<uint32_t, Bounds> items;
+};
+
+#endif
@@ -33,12 +33,14 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #include <sstream>
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
 
 #include <QFileInfo>
 #include <QSharedPointer>
 #include <QCoreApplication>
-#include <QProcess>
 #include "mtfmapper_app.h"
+#include "include/mtf_job.h"
+#include "include/tiffsniff.h"
 
 using std::cout;
 using std::endl;
@@ -52,31 +54,65 @@ using std::string;
 
 Worker_thread::Worker_thread(QWidget* parent) 
 : parent(dynamic_cast<mtfmapper_app*>(parent)), tempdir_number(0), 
-  dev_done(false), pc_done(false), batch_done(false), abort(false) {
+  dev_done(false), pc_done(false), batch_done(false) {
   
   // initialize the threads a bit later when we are sure the mutexes have been initialized
-  dev_thread = std::thread(&Worker_thread::developer_run, this);
-  pc_thread = std::thread(&Worker_thread::processor_run, this);
+  // (the raw developer threads are started by receive_batch, which knows how many are wanted)
+  // each job is already multi-threaded, so a few concurrent jobs are enough to
+  // hide the serial stages (decoding, thresholding, labelling) of the others
+  unsigned int n_jobs = std::max(1u, std::min(4u, std::thread::hardware_concurrency() / 4));
+  for (unsigned int i=0; i < n_jobs; i++) {
+      pc_threads.push_back(std::thread(&Worker_thread::processor_run, this));
+  }
+  pc_capacity = 2*n_jobs;
   batch_thread = std::thread(&Worker_thread::batch_run, this);
 }
 
 Worker_thread::~Worker_thread(void) {
-    abort = true;
-    batch_done = true;
+    {
+        std::lock_guard<std::mutex> lock(batch_mutex);
+        batch_done = true;
+    }
     batch_cv.notify_one();
+    {
+        std::lock_guard<std::mutex> lock(file_mutex);
+        file_cv.notify_all();
+    }
+    receive_abort(); // also releases the threads waiting for queue space
     batch_thread.join();
-    dev_done = true;
-    dev_cv.notify_one();
-    dev_thread.join();
-    pc_done = true;
-    pc_cv.notify_one();
-    pc_thread.join();
+    {
+        std::lock_guard<std::mutex> lock(dev_mutex);
+        dev_done = true;
+    }
+    dev_cv.notify_all();
+    for (auto& t: dev_threads) {
+        t.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(pc_mutex);
+        pc_done = true;
+    }
+    pc_cv.notify_all();
+    for (auto& t: pc_threads) {
+        t.join();
+    }
 }
 
 void Worker_thread::receive_batch(Processor_state state) {
-    abort = false;
     QString arguments = state.updated_arguments();
     
+    auto abort_flag = std::make_shared<std::atomic<bool>>(false);
+    {
+        std::lock_guard<std::mutex> lock(abort_mutex);
+        batch_abort_flags.erase(
+            std::remove_if(batch_abort_flags.begin(), batch_abort_flags.end(), 
+                [](const std::weak_ptr<std::atomic<bool>>& f) { return f.expired(); }
+            ),
+            batch_abort_flags.end()
+        );
+        batch_abort_flags.push_back(abort_flag);
+    }
+    
     // start by assuming all files will pass raw development
     fif_add(state.input_files.size());
     {
@@ -84,13 +120,28 @@ void Worker_thread::receive_batch(Processor_state state) {
         batch_queue.push(state);
     }
     
-    for (int i=0; i < state.input_files.size(); i++) {
+    size_t n_developers = std::max(1, state.raw_developer_threads);
+    while (dev_threads.size() < n_developers) {
+        dev_threads.push_back(std::thread(&Worker_thread::developer_run, this));
+    }
+    {
+        std::lock_guard<std::mutex> lock(file_mutex);
+        file_window = 2*n_developers;
+    }
+    
+    {
         std::lock_guard<std::mutex> lock(dev_mutex);
-        QString tempdir = tr("%1/mtfmappertemp_%2").arg(QDir::tempPath()).arg(tempdir_number++);
-        dev_queue.push(Input_file_record(state.input_files.at(i), arguments, tempdir, state.raw_developer));
+        dev_limit = n_developers;
+        for (int i=0; i < state.input_files.size(); i++) {
+            QString tempdir = tr("%1/mtfmappertemp_%2").arg(QDir::tempPath()).arg(tempdir_number++);
+            Input_file_record record(state.input_files.at(i), arguments, tempdir, state.raw_developer);
+            record.set_sequence(dev_sequence++);
+            record.set_abort_flag(abort_flag);
+            dev_queue.push(record);
+        }
     }
     // this should be enough to trigger processing of 'state'
-    dev_cv.notify_one();
+    dev_cv.notify_all();
     batch_cv.notify_one();
 }
 
@@ -115,71 +166,96 @@ void Worker_thread::batch_run(void) {
                 batch_queue.pop();
             }
             
-            if (!abort) {    
-                if (state.is_valid()) {
-                    int remaining_files = state.input_files.size();
-                    
-                    while (!abort && remaining_files > 0) { 
-                        Input_file_record input;
-                        {
-                            std::unique_lock<std::mutex> file_lock(file_mutex);
-                            // while blocking in wait, file_mutex is not locked, so developer_run can obtain a lock
-                            // to add new entries without blocking indefinitely
-                            file_cv.wait(file_lock, [this]{ return !file_queue.empty(); });
-                            
-                            input = file_queue.front();
-                            file_queue.pop();
-                            remaining_files--;
+            // the files of a batch are consumed even after an abort, so that the
+            // sequence numbers of the next batch line up with file_sequence
+            if (state.is_valid()) {
+                int remaining_files = state.input_files.size();
+                
+                while (!batch_done && remaining_files > 0) { 
+                    Input_file_record input;
+                    {
+                        std::unique_lock<std::mutex> file_lock(file_mutex);
+                        // developers finish out of order, so wait for the next file in submission order;
+                        // while blocking in wait, file_mutex is not locked, so developer_run can obtain a lock
+                        // to add new entries without blocking indefinitely
+                        file_cv.wait(file_lock, [this]{ return batch_done || file_queue.count(file_sequence) > 0; });
+                        
+                        if (batch_done) { // for shutting down
+                            break;
                         }
                         
-                        if (input.is_valid()) {
-                            if (QFileInfo(input.get_output_name()).size() == 0 || input.get_state() == Input_file_record::state_t::FAILED) {
-                                add_failure(failure_t::RAW_DEVELOPER_FAILURE, input.get_input_name());
-                                fif_add(-1); // one less file to worry about
-                                continue;
-                            }
+                        auto it = file_queue.find(file_sequence);
+                        input = it->second;
+                        file_queue.erase(it);
+                        file_sequence++;
+                        remaining_files--;
+                    }
+                    file_space_cv.notify_all();
+                    
+                    if (input.aborted() || input.get_state() == Input_file_record::state_t::ABORTED) {
+                        fif_add(-1);
+                        continue;
+                    }
+                    
+                    if (input.is_valid()) {
+                        if (QFileInfo(input.get_output_name()).size() == 0 || input.get_state() == Input_file_record::state_t::FAILED) {
+                            add_failure(failure_t::RAW_DEVELOPER_FAILURE, input.get_input_name());
+                            fif_add(-1); // one less file to worry about
+                            continue;
+                        }
+                    
+                        QStringList mapper_args;
                         
-                            QStringList mapper_args;
-                            
-                            // if a "--focal-ratio" setting is already present, then assume this
-                            // was a user-provided override, otherwise try to calculate it from the EXIF data
-                            if (!input.get_arguments().contains("--focal-ratio")) {
+                        // if a "--focal-ratio" setting is already present, then assume this
+                        // was a user-provided override, otherwise try to calculate it from the EXIF data;
+                        // this must come from the original input, since the output of the raw developer
+                        // need not carry all the EXIF tags; exiv2 is only needed for the maker notes
+                        // (e.g., Olympus), or for files that Tiffsniff cannot parse (e.g., CR3 or RAF)
+                        if (!input.get_arguments().contains("--focal-ratio")) {
+                            Tiffsniff sniffer(input.get_input_name().toLocal8Bit().constData());
+                            double focal_ratio = sniffer.metadata().focal_ratio();
+                            if (focal_ratio > 0) {
+                                mapper_args << "--focal-ratio" << QString("%1").arg(focal_ratio);
+                            } else {
                                 Exiv2_property props(state.exiv2_binary, input.get_input_name(), input.get_temp_dir() + "/exifinfo.txt");
                                 mapper_args << "--focal-ratio" << props.get_focal_ratio();
                             }
-
-                            mapper_args << "--gnuplot-executable " + state.gnuplot_binary << input.get_output_name() << input.get_temp_dir() 
-                                << "--logfile " + input.get_temp_dir() + "/log.txt" 
-                                << input.get_arguments().split(QRegExp("\\s+"), EMPTY_STRING_PARTS);
-                            
-                            Processing_command pc(
-                                QCoreApplication::applicationDirPath() + "/mtf_mapper",
-                                mapper_args,
-                                input.get_output_name(), // output name of raw developer is input to mapper
-                                input.get_temp_dir(),
-                                input.get_input_name(), // original input file
-                                state.initial_state()
-                            );
-                            
-                            {
-                                std::lock_guard<std::mutex> pc_lock(pc_mutex);
-                                pc_queue.push(pc);
-                            }
-                            pc_cv.notify_one();
                         }
-                    }
-                    
-                    {
-                        // pass on all failures so far (usually raw developer failures before processing completes)
-                        std::lock_guard<std::mutex> lock(failure_mutex);
-                        for (const auto& failure : failure_list) {
-                            emit mtfmapper_call_failed(failure.first, failure.second);
+
+                        // the log output of the job goes to the log of the GUI itself
+                        mapper_args << "--gnuplot-executable " + state.gnuplot_binary << input.get_output_name() << input.get_temp_dir() 
+                            << input.get_arguments().split(QRegExp("\\s+"), EMPTY_STRING_PARTS);
+                        
+                        Processing_command pc(
+                            QCoreApplication::applicationDirPath() + "/mtf_mapper",
+                            mapper_args,
+                            input.get_output_name(), // output name of raw developer is input to mapper
+                            input.get_temp_dir(),
+                            input.get_input_name(), // original input file
+                            state.initial_state()
+                        );
+                        pc.set_abort_flag(input.get_abort_flag());
+                        
+                        {
+                            std::unique_lock<std::mutex> pc_lock(pc_mutex);
+                            // the analysis queue is bounded, which in turn stops the raw
+                            // developers from running too far ahead of the analysis
+                            pc_space_cv.wait(pc_lock, [this, &input]{ return input.aborted() || pc_queue.size() < pc_capacity; });
+                            pc_queue.push(pc);
                         }
-                        failure_list.clear();
+                        pc_cv.notify_one();
                     }
+                }
                 
+                {
+                    // pass on all failures so far (usually raw developer failures before processing completes)
+                    std::lock_guard<std::mutex> lock(failure_mutex);
+                    for (const auto& failure : failure_list) {
+                        emit mtfmapper_call_failed(failure.first, failure.second);
+                    }
+                    failure_list.clear();
                 }
-            } 
+            }
             
             {
                 std::lock_guard<std::mutex> lock(batch_mutex);
@@ -191,38 +267,71 @@ void Worker_thread::batch_run(void) {
 }
 
 void Worker_thread::receive_abort() {
-    abort = true;
+    {
+        std::lock_guard<std::mutex> lock(abort_mutex);
+        for (const auto& f: batch_abort_flags) {
+            if (auto flag = f.lock()) {
+                *flag = true;
+            }
+        }
+    }
+    // release the developers and batch_run if they are waiting for the analysis to catch up
+    {
+        std::lock_guard<std::mutex> lock(file_mutex);
+        file_space_cv.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(pc_mutex);
+        pc_space_cv.notify_all();
+    }
 }
 
 void Worker_thread::process_command(const Processing_command& command) {
     
-    QProcess process;
-    process.setProgram(command.program);
-    process.setArguments(command.arguments);
     const QString& tempdir = command.tmp_dirname;
     
-    bool q_output_requested = process.arguments().contains("-q");
-    bool e_output_requested = process.arguments().contains("-e") || process.arguments().contains("--esf");
+    bool q_output_requested = command.arguments.contains("-q");
+    bool e_output_requested = command.arguments.contains("-e") || command.arguments.contains("--esf");
 
     logger.debug("%s\n", "arguments to mtf mapper:");
+    vector<string> job_args;
+    job_args.push_back(command.program.toStdString());
     for (int kk = 0; kk < command.arguments.size(); kk++) {
         logger.debug("[%d]=%s\n", kk, command.arguments.at(kk).toLocal8Bit().constData());
+        job_args.push_back(command.arguments.at(kk).toLocal8Bit().constData());
+    }
+    
+    // the analysis runs in this thread, so that receive_abort() can stop it part-way
+    int exit_code = 0;
+    {
+        Mtf_job job;
+        job.set_exit_on_error(false);
+        job.set_abort_flag(command.get_abort_flag());
+        if (job.parse(job_args, exit_code)) {
+            exit_code = job.run();
+        } else if (exit_code == 0) {
+            exit_code = Mtf_engine::INVALID_OPTIONS; // --help or --version produce no outputs
+        }
     }
-    process.start();
-    process.waitForFinished(-1);
-    int rval = process.exitStatus() == QProcess::NormalExit && process.exitCode() == 0;
+    
+    if (exit_code == Mtf_engine::ABORTED) {
+        return;
+    }
+    
+    int rval = exit_code == 0;
     if (!rval) {
         failure_t failure = UNSPECIFIED;
-        switch (process.exitCode()) {
-        case 2: failure = IMAGE_OPEN_FAILURE; break;
-        case 4: failure = NO_TARGETS_FOUND; break;
-        case 5: failure = UNSUPPORTED_IMAGE_ENCODING; break;
+        switch (exit_code) {
+        case Mtf_engine::UNREADABLE_INPUT: failure = IMAGE_OPEN_FAILURE; break;
+        case Mtf_engine::NO_TARGETS_FOUND: failure = NO_TARGETS_FOUND; break;
+        case Mtf_engine::INVALID_IMAGE_TYPE: failure = UNSUPPORTED_IMAGE_ENCODING; break;
         default: failure = UNSPECIFIED; break;
         }
         add_failure(failure, command.img_filename);
     } else {
-        emit send_delete_item(tempdir + "/log.txt");
-
+        // concurrent jobs must not interleave their parent/child/close sequences
+        std::lock_guard<std::mutex> lock(emit_mutex);
+        
         // this call must come from within the worker thread, since we
         // may have to perform a raw conversion in the worker thread
         // which would cause the display image filename (root of each data set object)
@@ -330,83 +439,93 @@ void Worker_thread::process_command(const Processing_command& command) {
 }
 
 void Worker_thread::developer_run(void) {
-    while (!dev_done) {
+    while (true) {
+        Input_file_record state;
         {
             std::unique_lock<std::mutex> lock(dev_mutex);
-            dev_cv.wait(lock, [this]{ return dev_done || !dev_queue.empty(); });
+            dev_cv.wait(lock, [this]{ return dev_done || (!dev_queue.empty() && dev_active < dev_limit); });
             
             if (dev_done) { // for shutting down
                 break;
             }
+            
+            state = dev_queue.front();
+            dev_queue.pop();
+            dev_active++;
         }
         
-        bool dev_queue_done = false;
-        while (!dev_queue_done) {
-            
-            Input_file_record state;
-            {
-                std::lock_guard<std::mutex> lock(dev_mutex);
-                state = dev_queue.front();
-                dev_queue.pop();
-            }
-            
-            if (!abort) {
-            
-                QDir().mkdir(state.get_temp_dir());
+        {
+            // do not develop too far ahead of the analysis, otherwise the
+            // developed images just pile up in the temp directories
+            std::unique_lock<std::mutex> file_lock(file_mutex);
+            file_space_cv.wait(file_lock, [this, &state]{ 
+                return state.aborted() || state.get_sequence() < file_sequence + file_window; 
+            });
+        }
+        
+        if (!state.aborted()) {
+            develop(state);
+        } else {
+            state.set_state(Input_file_record::state_t::ABORTED);
+        }
+        
+        // every record is passed on, even if aborted, so that batch_run never
+        // waits for a sequence number that will not arrive
+        {
+            std::lock_guard<std::mutex> file_lock(file_mutex);
+            file_queue.emplace(state.get_sequence(), state);
+        }
+        file_cv.notify_one();
+        
+        {
+            std::lock_guard<std::mutex> lock(dev_mutex);
+            dev_active--;
+        }
+        dev_cv.notify_one();
+    }
+}
 
-                QFileInfo fi(state.get_input_name());
-                if (state.get_raw_developer()) {
-                    if (state.get_raw_developer()->accepts(fi.suffix())) {
-                        state.set_output_name(
-                            QString(state.get_temp_dir() + "/" + fi.completeBaseName() + QString(".tiff"))
-                        );
-                        
-                        // TODO: we can add a cache here that we can pass to process; if the input file + args match
-                        // just copy the previous raw developer output if it still exists. store cache in worker_thread
-                        // for persistance
-                        int dev_success = state.get_raw_developer()->process(
-                            state.get_input_name(), // input file to raw developer
-                            state.get_output_name(), // output file of raw developer
-                            state.get_arguments().contains(QString("--bayer")) // bayer_mode
-                        );
-                        
-                        if (dev_success) {
-                            state.set_state(Input_file_record::state_t::COMPLETED);
-                        } else {
-                            state.set_state(Input_file_record::state_t::FAILED);
-                        }
-                        
-                        emit send_delete_item(state.get_output_name()); // queued, will only be deleted on program exit, or clear() command
-                    } else {
-                        state.set_output_name(state.get_input_name());
-                        state.set_state(Input_file_record::state_t::COMPLETED);
-                    }
-                    
-                    {
-                        std::lock_guard<std::mutex> file_lock(file_mutex);
-                        file_queue.push(state);
-                    }
-                    file_cv.notify_one();
-                    
-                } else {
-                    // this should not happen at runtime
-                    logger.error("Raw developer not set in Worker_thread::run()\n");
-                    break;
-                }
-            } else {
-                fif_add(-1);
-            }
-            
-            {
-                std::lock_guard<std::mutex> lock(dev_mutex);
-                dev_queue_done = dev_queue.empty();
-            }
+void Worker_thread::develop(Input_file_record& state) {
+    QDir().mkdir(state.get_temp_dir());
+
+    QFileInfo fi(state.get_input_name());
+    if (!state.get_raw_developer()) {
+        // this should not happen at runtime
+        logger.error("Raw developer not set in Worker_thread::develop()\n");
+        state.set_state(Input_file_record::state_t::FAILED);
+        return;
+    }
+    
+    if (state.get_raw_developer()->accepts(fi.suffix())) {
+        state.set_output_name(
+            QString(state.get_temp_dir() + "/" + fi.completeBaseName() + QString(".tiff"))
+        );
+        
+        // TODO: we can add a cache here that we can pass to process; if the input file + args match
+        // just copy the previous raw developer output if it still exists. store cache in worker_thread
+        // for persistance
+        int dev_success = state.get_raw_developer()->process(
+            state.get_input_name(), // input file to raw developer
+            state.get_output_name(), // output file of raw developer
+            state.get_arguments().contains(QString("--bayer")) // bayer_mode
+        );
+        
+        if (dev_success) {
+            state.set_state(Input_file_record::state_t::COMPLETED);
+        } else {
+            state.set_state(Input_file_record::state_t::FAILED);
         }
+        
+        emit send_delete_item(state.get_output_name()); // queued, will only be deleted on program exit, or clear() command
+    } else {
+        state.set_output_name(state.get_input_name());
+        state.set_state(Input_file_record::state_t::COMPLETED);
     }
 }
 
 void Worker_thread::processor_run(void) {
-    while (!pc_done) {
+    while (true) {
+        Processing_command cmd;
         {
             std::unique_lock<std::mutex> lock(pc_mutex);
             pc_cv.wait(lock, [this]{ return pc_done || !pc_queue.empty(); });
@@ -414,35 +533,24 @@ void Worker_thread::processor_run(void) {
             if (pc_done) { // for shutting down
                 break;
             }
+            
+            // several processor threads share the queue, so take the command while holding the lock
+            cmd = pc_queue.front();
+            pc_queue.pop();
         }
+        pc_space_cv.notify_one();
         
-        bool pc_queue_done = false;
-        while (!pc_queue_done) {
-        
-            Processing_command cmd;
-            {
-                std::lock_guard<std::mutex> lock(pc_mutex);
-                cmd = pc_queue.front();
-                pc_queue.pop();
-            }
-            
-            if (!abort) {    
-                if (cmd.is_valid()) {
-                    if (cmd.get_state() == Processing_command::state_t::AWAIT_ROI) {
-                        send_processing_command(cmd);
-                    } else {
-                        process_command(cmd);
-                        fif_add(-1);
-                    }
+        if (!cmd.aborted()) {    
+            if (cmd.is_valid()) {
+                if (cmd.get_state() == Processing_command::state_t::AWAIT_ROI) {
+                    send_processing_command(cmd);
+                } else {
+                    process_command(cmd);
+                    fif_add(-1);
                 }
-            } else {
-                fif_add(-1);
-            }
-            
-            {
-                std::lock_guard<std::mutex> lock(pc_mutex);
-                pc_queue_done = pc_queue.empty();
             }
+        } else {
+            fif_add(-1);
         }
         
         {
@@ -42,6 +42,8 @@ using std::vector;
 #include <atomic>
 #include <queue>
 using std::queue;
+#include <map>
+#include <memory>
 
 #include <QThread>
 #include <QStringList>
@@ -95,6 +97,7 @@ class Worker_thread  : public QObject
     
   private:
     void developer_run(void);
+    void develop(Input_file_record& state);
     void processor_run(void);
     void batch_run(void);
     void add_failure(failure_t fail, const QString& fname);
@@ -104,21 +107,35 @@ class Worker_thread  : public QObject
     
     std::atomic_int tempdir_number;
     
+    // raw development runs on a pool of threads, each driving one external
+    // developer process; at most dev_limit of them are active at a time
     bool dev_done = false;
-    std::thread dev_thread;
+    vector<std::thread> dev_threads;
+    size_t dev_limit = 1;
+    size_t dev_active = 0;
+    uint64_t dev_sequence = 0;
     std::mutex dev_mutex;
     std::condition_variable dev_cv;
     queue<Input_file_record> dev_queue;
     
+    // developed files are passed on in submission order; a developer waits before
+    // starting a file that is more than file_window files ahead of batch_run
     std::mutex file_mutex;
     std::condition_variable file_cv;
-    queue<Input_file_record> file_queue;
+    std::condition_variable file_space_cv;
+    std::map<uint64_t, Input_file_record> file_queue;
+    uint64_t file_sequence = 0;
+    uint64_t file_window = 2;
     
+    // several analysis jobs run concurrently, each on its own thread
     bool pc_done = false;
-    std::thread pc_thread;
+    vector<std::thread> pc_threads;
     std::mutex pc_mutex;
     std::condition_variable pc_cv;
     queue<Processing_command> pc_queue;
+    // batch_run blocks once this many commands are waiting for analysis
+    size_t pc_capacity = 2;
+    std::condition_variable pc_space_cv;
     
     bool batch_done = false;
     std::thread batch_thread;
@@ -129,11 +146,18 @@ class Worker_thread  : public QObject
     std::mutex failure_mutex;
     vector<std::pair<failure_t, QString>> failure_list;
     
+    // keeps the items of a data set together in the emitted signal sequence
+    std::mutex emit_mutex;
+    
     // files-in-flight
     std::mutex fif_mutex;
     int fif_count = 0;
     
-    bool abort;
+    // each batch has its own abort flag, shared by its records and commands, so that
+    // a new batch does not clear an abort that jobs of an earlier batch have yet to see;
+    // receive_abort() sets the flags of all batches that are still in progress
+    std::mutex abort_mutex;
+    vector<std::weak_ptr<std::atomic<bool>>> batch_abort_flags;
 };
 
 #endif
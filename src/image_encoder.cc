@@ -0,0 +1,368 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#include "include/logger.h"
+#include "include/image_encoder.h"
+#include "include/threadpool.h"
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#include "config.h"
+#if mtfmapper_ZLIB_FOUND == 1
+    #include <zlib.h>
+#endif
+
+Image_encoder::~Image_encoder(void) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cv_work.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void Image_encoder::submit(const string& fname, const cv::Mat& img, const vector<int>& params) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!worker.joinable()) {
+            worker = std::thread(&Image_encoder::run, this);
+        }
+        jobs.push_back(Job{fname, img, params});
+    }
+    cv_work.notify_one();
+}
+
+// caller must hold the mutex
+bool Image_encoder::pending(const string& prefix) const {
+    if (busy > 0 && in_flight.compare(0, prefix.size(), prefix) == 0) {
+        return true;
+    }
+    for (const auto& job: jobs) {
+        if (job.fname.compare(0, prefix.size(), prefix) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Image_encoder::wait(const string& prefix) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv_done.wait(lock, [this, &prefix] { return !pending(prefix); });
+}
+
+void Image_encoder::run(void) {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv_work.wait(lock, [this] { return stop || !jobs.empty(); });
+            if (jobs.empty()) {
+                return; // only when stopping
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            in_flight = job.fname;
+            busy++;
+        }
+        
+        auto start = std::chrono::steady_clock::now();
+        if (!write(job.fname, job.img, job.params)) {
+            logger.error("Could not write image %s\n", job.fname.c_str());
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        logger.debug("Encoded %s in %.3lf s\n", job.fname.c_str(), elapsed.count()/1000.0);
+        
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            busy--;
+            in_flight.clear();
+        }
+        cv_done.notify_all();
+    }
+}
+
+bool Image_encoder::write(const string& fname, const cv::Mat& img, const vector<int>& params) const {
+    bool is_png = fname.size() > 4 && fname.compare(fname.size() - 4, 4, ".png") == 0;
+    
+    #if mtfmapper_ZLIB_FOUND == 1
+    if (is_png && params.empty() && (img.depth() == CV_8U || img.depth() == CV_16U) && 
+        (img.channels() == 1 || img.channels() == 3 || img.channels() == 4)) {
+        
+        return write_png(fname, img);
+    }
+    #endif
+    
+    if (is_png && params.empty()) {
+        return cv::imwrite(fname, img, vector<int>{cv::IMWRITE_PNG_COMPRESSION, png_level});
+    }
+    return cv::imwrite(fname, img, params);
+}
+
+#if mtfmapper_ZLIB_FOUND == 1
+
+static void put_uint32_be(vector<unsigned char>& out, uint32_t v) {
+    out.push_back((v >> 24) & 0xff);
+    out.push_back((v >> 16) & 0xff);
+    out.push_back((v >> 8) & 0xff);
+    out.push_back(v & 0xff);
+}
+
+static bool write_chunk(FILE* fout, const char* type, const unsigned char* data, size_t len) {
+    vector<unsigned char> head;
+    put_uint32_be(head, uint32_t(len));
+    head.insert(head.end(), type, type + 4);
+    uLong crc = crc32(0L, (const Bytef*)type, 4);
+    if (len > 0) {
+        crc = crc32(crc, data, uInt(len));
+    }
+    vector<unsigned char> tail;
+    put_uint32_be(tail, uint32_t(crc));
+    
+    bool ok = fwrite(head.data(), 1, head.size(), fout) == head.size();
+    ok &= len == 0 || fwrite(data, 1, len, fout) == len;
+    ok &= fwrite(tail.data(), 1, tail.size(), fout) == tail.size();
+    return ok;
+}
+
+// convert one image row to PNG sample order (RGB(A), big-endian 16-bit)
+static void png_row(const cv::Mat& img, int row, unsigned char* out) {
+    const int nc = img.channels();
+    const int order[4] = {nc >= 3 ? 2 : 0, 1, 0, 3}; // BGR(A) -> RGB(A)
+    if (img.depth() == CV_8U) {
+        const uint8_t* p = img.ptr<uint8_t>(row);
+        for (int c=0; c < img.cols; c++, p += nc) {
+            for (int ch=0; ch < nc; ch++) {
+                *out++ = p[nc == 1 ? 0 : order[ch]];
+            }
+        }
+    } else {
+        const uint16_t* p = img.ptr<uint16_t>(row);
+        for (int c=0; c < img.cols; c++, p += nc) {
+            for (int ch=0; ch < nc; ch++) {
+                uint16_t v = p[nc == 1 ? 0 : order[ch]];
+                *out++ = v >> 8;
+                *out++ = v & 0xff;
+            }
+        }
+    }
+}
+
+static inline unsigned char paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return (unsigned char)a;
+    if (pb <= pc) return (unsigned char)b;
+    return (unsigned char)c;
+}
+
+// apply the PNG filter (out of the five standard ones) that minimises the
+// sum of absolute residuals, as suggested in the PNG specification
+static void filter_row(const unsigned char* cur, const unsigned char* prev, size_t len, size_t bpp, 
+    vector<unsigned char>& scratch, unsigned char* out) {
+    
+    scratch.resize(5*len);
+    size_t best_sum = 0;
+    int best = 0;
+    for (int f=0; f < 5; f++) {
+        unsigned char* d = scratch.data() + f*len;
+        size_t sum = 0;
+        for (size_t i=0; i < len; i++) {
+            int a = i >= bpp ? cur[i - bpp] : 0;
+            int b = prev ? prev[i] : 0;
+            int c = (i >= bpp && prev) ? prev[i - bpp] : 0;
+            unsigned char pred = 0;
+            switch (f) {
+            case 1: pred = (unsigned char)a; break;
+            case 2: pred = (unsigned char)b; break;
+            case 3: pred = (unsigned char)((a + b) >> 1); break;
+            case 4: pred = paeth(a, b, c); break;
+            default: break;
+            }
+            d[i] = (unsigned char)(cur[i] - pred);
+            sum += d[i] < 128 ? d[i] : 256 - d[i];
+        }
+        if (f == 0 || sum < best_sum) {
+            best_sum = sum;
+            best = f;
+        }
+    }
+    out[0] = (unsigned char)best;
+    memcpy(out + 1, scratch.data() + best*len, len);
+}
+
+bool Image_encoder::write_png(const string& fname, const cv::Mat& img) const {
+    const size_t bytes_per_sample = img.depth() == CV_16U ? 2 : 1;
+    const size_t bpp = img.channels()*bytes_per_sample;
+    const size_t row_bytes = img.cols*bpp;
+    const size_t filtered_row_bytes = row_bytes + 1;
+    
+    // about 4 MB of filtered data per band, but at least one band per thread for large images
+    const size_t nthreads = std::max(size_t(1), ThreadPool::instance().size());
+    size_t band_rows = std::max(size_t(16), (size_t(4) << 20) / filtered_row_bytes);
+    band_rows = std::min(band_rows, std::max(size_t(16), (img.rows + nthreads - 1) / nthreads));
+    const size_t nbands = (img.rows + band_rows - 1) / band_rows;
+    
+    // phase 1: filter each band
+    vector<vector<unsigned char>> filtered(nbands);
+    vector<std::future<void>> futures;
+    for (size_t b=0; b < nbands; b++) {
+        futures.push_back(ThreadPool::instance().enqueue([&, b] {
+            size_t r0 = b*band_rows;
+            size_t r1 = std::min(size_t(img.rows), r0 + band_rows);
+            vector<unsigned char> prev(row_bytes);
+            vector<unsigned char> cur(row_bytes);
+            vector<unsigned char> scratch;
+            if (r0 > 0) {
+                png_row(img, int(r0 - 1), prev.data());
+            }
+            filtered[b].resize((r1 - r0)*filtered_row_bytes);
+            for (size_t r=r0; r < r1; r++) {
+                png_row(img, int(r), cur.data());
+                filter_row(cur.data(), r > 0 ? prev.data() : nullptr, row_bytes, bpp, scratch, 
+                    filtered[b].data() + (r - r0)*filtered_row_bytes);
+                std::swap(cur, prev);
+            }
+        }));
+    }
+    for (auto& f: futures) {
+        f.get();
+    }
+    futures.clear();
+    
+    // phase 2: deflate each band as a raw stream, primed with the tail of the previous
+    // band; all but the last band end on a byte boundary (sync flush) so they concatenate
+    vector<vector<unsigned char>> compressed(nbands);
+    vector<uLong> adler(nbands);
+    vector<int> status(nbands, Z_OK);
+    const int level = png_level;
+    for (size_t b=0; b < nbands; b++) {
+        futures.push_back(ThreadPool::instance().enqueue([&, b] {
+            const vector<unsigned char>& in = filtered[b];
+            adler[b] = adler32(adler32(0L, Z_NULL, 0), in.data(), uInt(in.size()));
+            
+            z_stream strm;
+            memset(&strm, 0, sizeof(strm));
+            status[b] = deflateInit2(&strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+            if (status[b] != Z_OK) return;
+            
+            if (b > 0 && level > 0) {
+                const vector<unsigned char>& dict = filtered[b-1];
+                size_t dlen = std::min(dict.size(), size_t(32768));
+                deflateSetDictionary(&strm, dict.data() + dict.size() - dlen, uInt(dlen));
+            }
+            
+            compressed[b].resize(deflateBound(&strm, uLong(in.size())) + 64);
+            strm.next_in = (Bytef*)in.data();
+            strm.avail_in = uInt(in.size());
+            int flush = b + 1 == nbands ? Z_FINISH : Z_SYNC_FLUSH;
+            int rval = Z_OK;
+            do {
+                if (strm.total_out == compressed[b].size()) {
+                    compressed[b].resize(compressed[b].size()*2);
+                }
+                strm.next_out = compressed[b].data() + strm.total_out;
+                strm.avail_out = uInt(compressed[b].size() - strm.total_out);
+                rval = deflate(&strm, flush);
+            } while ((flush == Z_FINISH && rval == Z_OK) || (flush == Z_SYNC_FLUSH && strm.avail_out == 0));
+            
+            if (rval != Z_STREAM_END && rval != Z_OK) {
+                status[b] = rval;
+            }
+            compressed[b].resize(strm.total_out);
+            deflateEnd(&strm);
+        }));
+    }
+    for (auto& f: futures) {
+        f.get();
+    }
+    
+    for (size_t b=0; b < nbands; b++) {
+        if (status[b] != Z_OK) {
+            logger.error("PNG compression of %s failed (zlib error %d)\n", fname.c_str(), status[b]);
+            return false;
+        }
+    }
+    
+    uLong checksum = adler32(0L, Z_NULL, 0);
+    for (size_t b=0; b < nbands; b++) {
+        checksum = adler32_combine(checksum, adler[b], z_off_t(filtered[b].size()));
+    }
+    
+    FILE* fout = fopen(fname.c_str(), "wb");
+    if (!fout) {
+        return false;
+    }
+    
+    const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    bool ok = fwrite(signature, 1, 8, fout) == 8;
+    
+    vector<unsigned char> ihdr;
+    put_uint32_be(ihdr, uint32_t(img.cols));
+    put_uint32_be(ihdr, uint32_t(img.rows));
+    ihdr.push_back(uint8_t(8*bytes_per_sample));
+    const uint8_t colour_type[5] = {0, 0, 0, 2, 6};
+    ihdr.push_back(colour_type[img.channels()]);
+    ihdr.push_back(0); // deflate
+    ihdr.push_back(0); // adaptive filtering
+    ihdr.push_back(0); // no interlace
+    ok &= write_chunk(fout, "IHDR", ihdr.data(), ihdr.size());
+    
+    // one IDAT per band; the zlib header goes with the first, the checksum with the last
+    for (size_t b=0; b < nbands; b++) {
+        vector<unsigned char>& data = compressed[b];
+        if (b == 0) {
+            const unsigned char zlib_header[2] = {0x78, 0x9c};
+            data.insert(data.begin(), zlib_header, zlib_header + 2);
+        }
+        if (b + 1 == nbands) {
+            put_uint32_be(data, uint32_t(checksum));
+        }
+        ok &= write_chunk(fout, "IDAT", data.data(), data.size());
+    }
+    ok &= write_chunk(fout, "IEND", nullptr, 0);
+    
+    ok &= fclose(fout) == 0;
+    return ok;
+}
+
+#else
+
+bool Image_encoder::write_png(const string& fname, const cv::Mat& img) const {
+    return cv::imwrite(fname, img, vector<int>{cv::IMWRITE_PNG_COMPRESSION, png_level});
+}
+
+#endif
@@ -0,0 +1,181 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#include "include/memory_tracker.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+#if defined(__linux__)
+// reads a "VmRSS:     1234 kB" style entry from /proc/self/status
+static size_t read_proc_status(const char* key) {
+    FILE* fin = fopen("/proc/self/status", "rt");
+    if (!fin) {
+        return 0;
+    }
+    char line[256];
+    size_t value = 0;
+    size_t keylen = strlen(key);
+    while (fgets(line, sizeof(line), fin)) {
+        if (strncmp(line, key, keylen) == 0) {
+            unsigned long long kb = 0;
+            if (sscanf(line + keylen, "%llu", &kb) == 1) {
+                value = size_t(kb) << 10;
+            }
+            break;
+        }
+    }
+    fclose(fin);
+    return value;
+}
+#endif
+
+Memory_tracker::Memory_tracker(void) {
+    #if defined(__linux__)
+    // writing "5" to clear_refs resets VmHWM (Linux 4.0 and later); probe it once
+    FILE* fout = fopen("/proc/self/clear_refs", "w");
+    if (fout) {
+        resettable = fputs("5", fout) >= 0;
+        resettable &= fclose(fout) == 0;
+    }
+    #endif
+}
+
+size_t Memory_tracker::resident(void) {
+    #if defined(__linux__)
+    return read_proc_status("VmRSS:");
+    #elif defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        return size_t(pmc.WorkingSetSize);
+    }
+    return 0;
+    #else
+    return 0;
+    #endif
+}
+
+size_t Memory_tracker::sample_peak(bool reset) {
+    size_t hwm = 0;
+    #if defined(__linux__)
+    hwm = read_proc_status("VmHWM:");
+    if (reset && resettable) {
+        FILE* fout = fopen("/proc/self/clear_refs", "w");
+        if (fout) {
+            fputs("5", fout);
+            fclose(fout);
+        }
+    }
+    #elif defined(_WIN32)
+    (void)reset;
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        hwm = size_t(pmc.PeakWorkingSetSize);
+    }
+    #else
+    (void)reset;
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        #if defined(__APPLE__)
+        hwm = size_t(usage.ru_maxrss);         // bytes
+        #else
+        hwm = size_t(usage.ru_maxrss) << 10;   // kilobytes
+        #endif
+    }
+    #endif
+    hwm = std::max(hwm, resident());
+    process_peak = std::max(process_peak, hwm);
+    return hwm;
+}
+
+size_t Memory_tracker::open_watermark(void) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    // fold the peak so far into the enclosing watermarks before the OS mark is reset
+    size_t hwm = sample_peak(true);
+    size_t current = resident();
+    for (size_t i=0; i < marks.size(); i++) {
+        if (open[i]) {
+            marks[i] = std::max(marks[i], hwm);
+        }
+    }
+    
+    for (size_t i=0; i < marks.size(); i++) {
+        if (!open[i]) {
+            open[i] = true;
+            marks[i] = current;
+            return i;
+        }
+    }
+    marks.push_back(current);
+    open.push_back(true);
+    return marks.size() - 1;
+}
+
+size_t Memory_tracker::close_watermark(size_t handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (handle >= marks.size() || !open[handle]) {
+        return 0;
+    }
+    
+    // without a resettable OS mark, the process peak only tells us something if it grew
+    size_t previous_peak = process_peak;
+    size_t hwm = sample_peak(false);
+    if (resettable || hwm > previous_peak) {
+        for (size_t i=0; i < marks.size(); i++) {
+            if (open[i]) {
+                marks[i] = std::max(marks[i], hwm);
+            }
+        }
+    }
+    marks[handle] = std::max(marks[handle], resident());
+    open[handle] = false;
+    return marks[handle];
+}
+
+size_t Memory_tracker::peak(void) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return sample_peak(false);
+}
+
+size_t Memory_tracker::scratch_allowance(size_t committed_bytes) const {
+    if (budget_bytes == 0) {
+        return 0;
+    }
+    size_t used = resident() + committed_bytes;
+    size_t headroom = budget_bytes > used ? budget_bytes - used : 0;
+    // leave half of the headroom for the allocator, and for other threads
+    return std::max(min_scratch_bytes, headroom / 2);
+}
@@ -34,6 +34,7 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 #include "include/mtf50_edge_quality_rating.h"
 #include "include/savitzky_golay_tables.h"
 #include "include/ellipse_decoder.h"
+#include "include/stage_trace.h"
 
 #include <opencv2/imgproc/imgproc.hpp>
 
@@ -51,6 +52,9 @@ static std::mutex global_mutex;
 
 void Mtf_core::search_borders(const Point2d& cent, int label) {
     
+    Stage_trace::Scope scope("search_borders", "object");
+    Stage_trace::count("objects considered");
+    
     Mrectangle rrect;
     bool valid = extract_rectangle(cent, label, rrect);
     
@@ -77,63 +81,30 @@ void Mtf_core::search_borders(const Point2d& cent, int label) {
             }
             
             if (ed.valid && ed.code >= 0 && hole_found) {
-                {
-                    std::lock_guard<std::mutex> lock(global_mutex);
-                    e.valid = ed.valid;
-                    e.set_code(ed.code);
-                    ellipses.push_back(e);
-                    logger.debug("Fiducial with code %d extracted at (%.2lf %.2lf)\n", e.code, e.centroid_x, e.centroid_y);
-                }
-                
-                for (double theta=0; theta < 2*M_PI; theta += M_PI/720.0) {
-                    double synth_x = e.major_axis * cos(theta);
-                    double synth_y = e.minor_axis * sin(theta);
-                    double rot_x = cos(e.angle)*synth_x - sin(e.angle)*synth_y + e.centroid_x;
-                    double rot_y = sin(e.angle)*synth_x + cos(e.angle)*synth_y + e.centroid_y;
-
-                    // clip to image size, just in case
-                    rot_x = max(rot_x, 0.0);
-                    rot_x = min(rot_x, (double)(od_img.cols-1));
-                    rot_y = max(rot_y, 0.0);
-                    rot_y = min(rot_y, (double)(od_img.rows-1));
-
-                    cv::Vec3b& color = od_img.at<cv::Vec3b>(lrint(rot_y), lrint(rot_x));
-                    color[0] = 255;
-                    color[1] = 255;
-                    color[2] = 0;
-                    
-                    
-                }
-                
-                char buffer[20];
-                int baseline = 0;
-                sprintf(buffer, "%d", e.code);
-                cv::Size ts = cv::getTextSize(buffer, cv::FONT_HERSHEY_SIMPLEX, 0.5, 1, &baseline);
-                cv::Point to(-ts.width/2,  ts.height/2);
-                to.x += e.centroid_x;
-                to.y += e.centroid_y;
-                
-                cv::putText(od_img, buffer, to, 
-                    cv::FONT_HERSHEY_SIMPLEX, 0.5, 
-                    CV_RGB(20, 20, 20), 2, cv::LINE_AA
-                );
-                cv::putText(od_img, buffer, to, 
-                    cv::FONT_HERSHEY_SIMPLEX, 0.5, 
-                    CV_RGB(0, 255, 255), 1, cv::LINE_AA
-                );
+                // the overlay outline and label are drawn from 'ellipses' in detection_overlay()
+                std::lock_guard<std::mutex> lock(global_mutex);
+                e.valid = ed.valid;
+                e.set_code(ed.code);
+                ellipses.push_back(e);
+                logger.debug("Fiducial with code %d extracted at (%.2lf %.2lf)\n", e.code, e.centroid_x, e.centroid_y);
+                Stage_trace::count("fiducials found");
+                return;
             }
         } 
+        Stage_trace::count("objects rejected: not a quadrangle or fiducial");
         return;
     }
     
     Block block(rrect);
 
     if (block.get_area() <= 225) {
+        Stage_trace::count("objects rejected: too small");
         return;
     }
     
     if (!rrect.corners_ok() || !rrect.valid) {
         logger.debug("%s\n", "discarding broken square (early)");
+        Stage_trace::count("objects rejected: broken corners");
         return;
     }
     
@@ -146,20 +117,92 @@ void Mtf_core::search_borders(const Point2d& cent, int label) {
     if (!ridges_only) {
         if (!homogenous(cent, label, rrect)) {
             logger.debug("%s\n", "discarding inhomogenous object");
+            Stage_trace::count("objects rejected: inhomogeneous");
             return;
         }
     }
     
+    measure_rectangle(rrect, label);
+}
+
+void Mtf_core::measure_layout_block(const Chart_layout& layout, size_t i) {
+    Stage_trace::Scope scope("measure_layout_block", "object");
+    
+    Mrectangle rrect = layout.rectangle(i);
+    if (!rrect.valid || !rrect.corners_ok()) {
+        Stage_trace::count("layout blocks rejected: broken corners");
+        return;
+    }
+    
+    // labels only have to be unique, since there is no labelled image in this case
+    measure_rectangle(rrect, int(i) + 1);
+}
+
+bool Mtf_core::layout_aligned(const Chart_layout& layout) const {
+    const size_t max_checked = 24;
+    const double tolerance = 1.5; // pixels
+    
+    // spread the checks over the layout, and over the four sides of the blocks
+    const size_t n_edges = 4*layout.size();
+    size_t stride = std::max(size_t(1), n_edges / max_checked);
+    if (stride % 4 == 0) {
+        stride++;
+    }
+    
+    size_t checked = 0;
+    size_t passed = 0;
+    for (size_t e=0; e < n_edges; e += stride) {
+        const Chart_layout::Entry& entry = layout[e / 4];
+        const Point2d& c = entry.centroids[e % 4];
+        const Point2d n(cos(entry.angles[e % 4]), sin(entry.angles[e % 4]));
+        
+        // the gradient profile across the edge must still peak at the reference edge centroid
+        double peak = 0;
+        double peak_t = 0;
+        double background = 0;
+        int n_background = 0;
+        bool inside = true;
+        for (double t=-8; t <= 8 && inside; t += 0.5) {
+            int x = lrint(c.x + t*n.x);
+            int y = lrint(c.y + t*n.y);
+            if (x < 1 || y < 1 || x >= g.width() - 1 || y >= g.height() - 1) {
+                inside = false;
+                break;
+            }
+            double m = fabs(g.grad_x(x, y)*n.x + g.grad_y(x, y)*n.y);
+            if (m > peak) {
+                peak = m;
+                peak_t = t;
+            }
+            if (fabs(t) >= 6) {
+                background += m;
+                n_background++;
+            }
+        }
+        if (!inside) {
+            continue;
+        }
+        
+        checked++;
+        if (fabs(peak_t) <= tolerance && peak > 4*background/n_background) {
+            passed++;
+        }
+    }
     
+    logger.debug("Chart layout check: %d of %d edges in place\n", int(passed), int(checked));
+    return checked > 0 && passed >= 0.8*checked;
+}
+
+void Mtf_core::measure_rectangle(Mrectangle& rrect, int label) {
+    Block block(rrect);
     
+    vector<cv::Point> local_points;
+    vector<std::array<cv::Point2d, 4>> local_quads;
     for (size_t k=0; k < 4; k++) {
         if (rrect.corners[k].x >= 0 && rrect.corners[k].x < g.width() &&
             rrect.corners[k].y >= 0 && rrect.corners[k].y < g.height()) {
             
-            cv::Vec3b& color = od_img.at<cv::Vec3b>(rrect.corners[k].y, rrect.corners[k].x);
-            color[0] = 255;
-            color[1] = 255;
-            color[2] = 0;
+            local_points.push_back(cv::Point(int(rrect.corners[k].x), int(rrect.corners[k].y)));
         }
     }
     
@@ -183,9 +226,7 @@ void Mtf_core::search_borders(const Point2d& cent, int label) {
             par_dist_bias = std::max(par_dist_bias, par_dist);
         }
 
-        for (int kk=0; kk < 4; kk++) {
-            cv::line(od_img, nr.corners[kk], nr.corners[(kk+1)%4], cv::Scalar(0, 255, 128));
-        }
+        local_quads.push_back({nr.corners[0], nr.corners[1], nr.corners[2], nr.corners[3]});
         
         edge_model[k] = std::shared_ptr<Edge_model>(new Edge_model(rrect.centroids[k], rrect.edges[k], rrect.quad_coeffs[k]));
         Edge_model* emk = edge_model[k].get();
@@ -231,12 +272,19 @@ void Mtf_core::search_borders(const Point2d& cent, int label) {
         reduce_success &= edge_record[k].reduce();
     }
     
+    {
+        std::lock_guard<std::mutex> lock(global_mutex);
+        od_points.insert(od_points.end(), local_points.begin(), local_points.end());
+        od_quads.insert(od_quads.end(), local_quads.begin(), local_quads.end());
+    }
+    
     double max_shift = 0;
     if (!ridges_only && !small_target && reduce_success) {
         // re-calculate the ROI after we have refined the edge centroid above
         Mrectangle newrect(rrect, edge_record);
         if (!newrect.corners_ok()) {
             logger.debug("%s\n", "discarding broken square (after updates)");
+            Stage_trace::count("objects rejected: broken corners after refinement");
             return;
         }
         
@@ -293,6 +341,7 @@ void Mtf_core::search_borders(const Point2d& cent, int label) {
         Mrectangle newrect(rrect, edge_record);
         if (!newrect.corners_ok()) {
             logger.debug("%s\n", "discarding broken square (after updates)");
+            Stage_trace::count("objects rejected: broken corners after refinement");
             return;
         }
         
@@ -343,6 +392,7 @@ void Mtf_core::search_borders(const Point2d& cent, int label) {
     
     if (!reduce_success) {
         logger.debug("%s\n", "reduce failed, probably not a rectangle/quadrangle");
+        Stage_trace::count("objects rejected: edge refinement failed");
         return;
     }
     
@@ -408,30 +458,42 @@ void Mtf_core::search_borders(const Point2d& cent, int label) {
         
         double mtf50 = 0.01;
         double edge_length = 0;
+        vector<Subset_measurement> extra;
+        vector<double> mtf_levels;
         if (!ridges_only) {
-            mtf50 = compute_mtf(*edge_model[k], scansets[k], quality, edge_length, sfr, esf, snr);
+            mtf50 = compute_mtf(*edge_model[k], scansets[k], quality, edge_length, sfr, esf, snr, false, Bayer::DEFAULT, &mtf_levels);
+            extra = measure_extra_subsets(*edge_model[k], scansets[k], false);
         }
         
         allzero &= fabs(mtf50) < 1e-6;
         
+        Stage_trace::count(mtf50 <= 1.2 ? "edges accepted" : "edges rejected: MTF50 above 1.2");
         if (mtf50 <= 1.2) { // reject mtf values above 1.2, since these are impossible, and likely to be erroneous
             std::lock_guard<std::mutex> lock(global_mutex);
             if (shared_blocks_map.find(label) == shared_blocks_map.end()) {
                 shared_blocks_map[label] = block;
+                shared_blocks_map[label].attach_store(edge_store);
             }
             shared_blocks_map[label].set_mtf50_value(k, mtf50, quality);
+            shared_blocks_map[label].set_mtf_levels(k, mtf_levels);
             shared_blocks_map[label].set_normal(k, Point2d(cos(edge_record[k].angle), sin(edge_record[k].angle)));
             shared_blocks_map[label].set_sfr(k, sfr);
             shared_blocks_map[label].set_esf(k, esf);
             shared_blocks_map[label].set_snr(k, snr);
             shared_blocks_map[label].rect.centroids[k] = edge_record[k].centroid;
-            shared_blocks_map[label].set_scanset(k, scansets[k]);
-            shared_blocks_map[label].set_edge_model(k, edge_model[k]);
+            if (retain_edge_geometry) {
+                shared_blocks_map[label].set_scanset(k, scansets[k]);
+                shared_blocks_map[label].set_edge_model(k, edge_model[k]);
+            }
             shared_blocks_map[label].set_edge_valid(k);
             shared_blocks_map[label].set_edge_length(k, edge_length);
+            for (size_t c=0; c < extra.size(); c++) {
+                shared_blocks_map[label].set_channel_result(c, k, extra[c].mtf50, extra[c].quality, extra[c].sfr, extra[c].esf, extra[c].snr);
+            }
         }
     }
     if (allzero) {
+        Stage_trace::count("objects rejected: no measurable edges");
         std::lock_guard<std::mutex> lock(global_mutex);
         auto it = shared_blocks_map.find(label);
         if (it != shared_blocks_map.end()) {
@@ -500,9 +562,13 @@ static double angle_reduce(double x) {
 double Mtf_core::compute_mtf(Edge_model& edge_model, const map<int, scanline>& scanset,
     double& quality,  double& edge_length,
     vector<double>& sfr, vector<double>& esf, 
-    Snr& snr, bool allow_peak_shift) {
+    Snr& snr, bool allow_peak_shift, Bayer::cfa_mask_t cfa_mask,
+    vector<double>* mtf_levels) {
     
     quality = 1.0; // assume this is a good edge
+    if (mtf_levels) {
+        mtf_levels->assign(extra_mtf_contrasts.size(), 0.0);
+    }
     
     vector<Ordered_point> ordered;
     edge_length = 0;
@@ -513,7 +579,11 @@ double Mtf_core::compute_mtf(Edge_model& edge_model, const map<int, scanline>& s
 
     fill(fft_out_buffer.begin(), fft_out_buffer.end(), 0);
     
-    esf_sampler->sample(edge_model, ordered, scanset, edge_length, img, bayer_img);
+    {
+        Stage_trace::Scope scope("esf sampling", "kernel");
+        esf_sampler->sample(edge_model, ordered, scanset, edge_length, img, bayer_img, cfa_mask);
+    }
+    Stage_trace::sample("esf samples per edge", ordered.size());
     
     #ifdef MDEBUG
     // The noise is added sequentially, row-by-row, which should be most similar to the way
@@ -534,13 +604,21 @@ double Mtf_core::compute_mtf(Edge_model& edge_model, const map<int, scanline>& s
         return 0;
     }
     
+    Stage_trace::Scope fit_scope("esf model fit", "kernel");
     int success = esf_model->build_esf(ordered, fft_out_buffer.data(), FFT_SIZE,  max_dot, esf, snr, allow_peak_shift); // bin_fit computes the ESF derivative as part of the fitting procedure
+    fit_scope.stop();
     if (success < 0) {
         quality = poor_quality;
         logger.debug("failed edge at (%.1lf, %.1lf)\n", edge_model.get_centroid().x, edge_model.get_centroid().y);
+        if (mtf_levels) {
+            mtf_levels->assign(extra_mtf_contrasts.size(), 1.0);
+        }
         return 1.0;
     }
-    afft.realfft(fft_out_buffer.data());
+    {
+        Stage_trace::Scope scope("fft", "kernel");
+        afft.realfft(fft_out_buffer.data());
+    }
 
     double quad = angle_reduce(atan2(edge_model.get_direction().y, edge_model.get_direction().x));
     
@@ -637,6 +715,54 @@ double Mtf_core::compute_mtf(Edge_model& edge_model, const map<int, scanline>& s
 
     const vector<double>& base_mtf = esf_model->get_correction();
 
+    double mtf50 = mtf_crossing(magnitude, base_mtf, n0, mtf_contrast, quad);
+    
+    if (mtf_levels) {
+        mtf_levels->resize(extra_mtf_contrasts.size());
+        for (size_t l=0; l < extra_mtf_contrasts.size(); l++) {
+            (*mtf_levels)[l] = mtf_crossing(magnitude, base_mtf, n0, extra_mtf_contrasts[l], quad);
+        }
+    }
+
+    if (absolute_sfr) {
+        for (size_t i=0; i < sfr.size();  i++) {
+            sfr[i] = (n0*magnitude[i] / base_mtf[i])/(65536*2);
+        }
+    } else {
+        for (size_t i=0; i < sfr.size();  i++) {
+            sfr[i] = magnitude[i] / base_mtf[i];
+        }
+    }
+
+    // derate the quality of the known poor angles
+    if (quad <= 1) {
+        quality = poor_quality;
+    }
+
+    if (fabs(quad - 26.565051) < 1) {
+        quality = medium_quality;
+    }
+
+    if (quad >= 44) {
+        quality = poor_quality;
+    }
+    
+    if (edge_length < 25) {  // derate short edges
+        quality *= poor_quality;
+    }
+    
+    if (success > 0) {  // possibly contaminated edge
+        quality = very_poor_quality;
+    }
+    
+    return mtf50;
+}
+
+// locate the frequency at which the (corrected) SFR drops below the specified contrast level, 
+// returned in cycles per pixel
+double Mtf_core::mtf_crossing(const vector<double>& magnitude, const vector<double>& base_mtf, 
+    double n0, double contrast, double quad) const {
+    
     double prev_freq = 0;
     double prev_val  = n0;
     
@@ -648,10 +774,10 @@ double Mtf_core::compute_mtf(Edge_model& edge_model, const map<int, scanline>& s
     for (int i=0; i < NYQUIST_FREQ*2 && !done; i++) {
         double mag = magnitude[i];
         mag /= base_mtf[i];
-        if (prev_val > mtf_contrast && mag <= mtf_contrast) {
+        if (prev_val > contrast && mag <= contrast) {
             // interpolate
             double m = -(mag - prev_val)*(FFT_SIZE);
-            mtf50 = -(mtf_contrast - prev_val - m*prev_freq) / m;
+            mtf50 = -(contrast - prev_val - m*prev_freq) / m;
             cross_idx = i;
             done = true;
         }
@@ -681,7 +807,7 @@ double Mtf_core::compute_mtf(Edge_model& edge_model, const map<int, scanline>& s
             
             Eigen::VectorXd sol = design.colPivHouseholderQr().solve(b);
             
-            double mid = sol[0] + mtf_contrast*sol[1] + mtf_contrast*mtf_contrast*sol[2];
+            double mid = sol[0] + contrast*sol[1] + contrast*contrast*sol[2];
             mid = (mid + double(cross_idx))/double(FFT_SIZE);
             
             // at lower MTF50s, slowly blend in the smoothed value
@@ -698,40 +824,22 @@ double Mtf_core::compute_mtf(Edge_model& edge_model, const map<int, scanline>& s
     if (!done || fabs(quad) < 0.1) {
         mtf50 = 0.125;
     }
-    mtf50 *= 8;
-
-    if (absolute_sfr) {
-        for (size_t i=0; i < sfr.size();  i++) {
-            sfr[i] = (n0*magnitude[i] / base_mtf[i])/(65536*2);
-        }
-    } else {
-        for (size_t i=0; i < sfr.size();  i++) {
-            sfr[i] = magnitude[i] / base_mtf[i];
-        }
-    }
-
-    // derate the quality of the known poor angles
-    if (quad <= 1) {
-        quality = poor_quality;
-    }
-
-    if (fabs(quad - 26.565051) < 1) {
-        quality = medium_quality;
-    }
+    return mtf50 * 8;
+}
 
-    if (quad >= 44) {
-        quality = poor_quality;
-    }
-    
-    if (edge_length < 25) {  // derate short edges
-        quality *= poor_quality;
-    }
-    
-    if (success > 0) {  // possibly contaminated edge
-        quality = very_poor_quality;
+vector<Mtf_core::Subset_measurement> Mtf_core::measure_extra_subsets(Edge_model& edge_model, const map<int, scanline>& scanset, bool allow_peak_shift) {
+    vector<Subset_measurement> extra(extra_bayer_subsets.size());
+    for (size_t c=0; c < extra_bayer_subsets.size(); c++) {
+        Subset_measurement& m = extra[c];
+        m.sfr = vector<double>(mtf_width, 0);
+        m.esf = vector<double>(FFT_SIZE, 0);
+        double edge_length = 0;
+        m.mtf50 = compute_mtf(
+            edge_model, scanset, m.quality, edge_length, m.sfr, m.esf, m.snr, allow_peak_shift, 
+            Bayer::to_cfa_mask(extra_bayer_subsets[c], cfa_pattern)
+        );
     }
-    
-    return mtf50;
+    return extra;
 }
 
 void Mtf_core::process_with_sliding_window(Mrectangle& rrect) {
@@ -742,6 +850,7 @@ void Mtf_core::process_with_sliding_window(Mrectangle& rrect) {
     const vector<Point2d>& corners = rrect.corners;
     
     vector<Mtf_profile_sample> local_samples;
+    vector<cv::Point> local_points;
 
     vector< pair<double, int> > dims;
     for (int k=0; k < 4; k++) {
@@ -976,10 +1085,7 @@ void Mtf_core::process_with_sliding_window(Mrectangle& rrect) {
             
             #endif
             
-            cv::Vec3b& color = od_img.at<cv::Vec3b>(lrint(edge_record.centroid.y), lrint(edge_record.centroid.x));
-            color[0] = 255;
-            color[1] = 255;
-            color[2] = 0;
+            local_points.push_back(cv::Point(lrint(edge_record.centroid.x), lrint(edge_record.centroid.y)));
             
             double quality = 0;
             double edge_length = 0;
@@ -998,6 +1104,11 @@ void Mtf_core::process_with_sliding_window(Mrectangle& rrect) {
         }
     }
     
+    if (local_points.size() > 0) {
+        std::lock_guard<std::mutex> lock(global_mutex);
+        od_points.insert(od_points.end(), local_points.begin(), local_points.end());
+    }
+    
     if (local_samples.size() > 0) {
         std::lock_guard<std::mutex> lock(global_mutex);
         samples.insert(samples.end(), local_samples.begin(), local_samples.end());
@@ -1166,7 +1277,9 @@ void Mtf_core::process_image_as_roi(const cv::Rect2i& bounds, cv::Point2d handle
     vector <double> sfr(mtf_width, 0);
     vector <double> esf(FFT_SIZE, 0);
     Snr snr;
-    double mtf50 = compute_mtf(*em, scanset, quality, edge_length, sfr, esf, snr, true);
+    vector<double> mtf_levels;
+    double mtf50 = compute_mtf(*em, scanset, quality, edge_length, sfr, esf, snr, true, Bayer::DEFAULT, &mtf_levels);
+    vector<Subset_measurement> extra = measure_extra_subsets(*em, scanset, true);
     
     // add a block with the correct properties ....
     if (mtf50 <= 1.2) { 
@@ -1174,39 +1287,46 @@ void Mtf_core::process_image_as_roi(const cv::Rect2i& bounds, cv::Point2d handle
         rect.centroids[0] = er.centroid;
         rect.thetas[0] = er.angle;
         Block block(rect);
+        block.attach_store(edge_store);
         block.centroid = er.centroid; // just in case
         block.set_mtf50_value(0, mtf50, quality);
+        block.set_mtf_levels(0, mtf_levels);
         block.set_normal(0, Point2d(cos(er.angle), sin(er.angle)));
         
         block.set_sfr(0, sfr);
         block.set_esf(0, esf);
         block.set_snr(0, snr);
         block.set_line_deviation(0, em->line_deviation());
-        block.set_scanset(0, scanset);
-        block.set_edge_model(0, em);
+        if (retain_edge_geometry) {
+            block.set_scanset(0, scanset);
+            block.set_edge_model(0, em);
+        }
         block.set_edge_valid(0);
         block.set_edge_length(0, edge_length);
         
+        for (size_t c=0; c < extra.size(); c++) {
+            block.set_channel_result(c, 0, extra[c].mtf50, extra[c].quality, extra[c].sfr, extra[c].esf, extra[c].snr);
+        }
+        
         for (int k=1; k < 4; k++) {
             block.set_mtf50_value(k, 1.0, 0.0);
             block.set_sfr(k, vector<double>(NYQUIST_FREQ*2, 0));
             block.set_esf(k, vector<double>(FFT_SIZE/2, 0));
         }
         
-        shared_blocks_map[1] = block;     // TODO: major concurrency issue here, must fix!
+        // straight into detected_blocks: get_blocks() only reads shared_blocks_map
+        // while detected_blocks is empty, and get_channel_blocks() requires it to be empty
         detected_blocks.push_back(block);
     }
 }
 
-void Mtf_core::process_manual_rois(const string& roi_fname) {
+bool Mtf_core::read_manual_rois(const string& roi_fname, vector<std::pair<Point2d, Point2d>>& rois) {
     FILE* fin = fopen(roi_fname.c_str(), "rt");
     
     if (!fin) {
-        logger.error("Could not open --roi-file [%s]\n", roi_fname.c_str());
-        return;
+        return false;
     }
     
-    // TODO: we could process all these ROIs in parallel, after loading them
     while (!feof(fin)) {
         Point2d handle_a;
         Point2d handle_b;
@@ -1216,15 +1336,86 @@ void Mtf_core::process_manual_rois(const string& roi_fname) {
         );
         
         if (nread == 4) {
-            printf("going to process %.1lf %.1lf -> %.1lf %.1lf\n", 
-                handle_a.x, handle_a.y,
-                handle_b.x, handle_b.y
-            );
-            
-            Rect_roi roi(handle_a, handle_b, max_dot);
-            process_image_as_roi(roi.bounds(img), handle_a, handle_b);
+            rois.push_back(std::make_pair(handle_a, handle_b));
         }
     }
     
     fclose(fin);
+    return true;
+}
+
+void Mtf_core::process_manual_rois(const string& roi_fname) {
+    vector<std::pair<Point2d, Point2d>> rois;
+    if (!read_manual_rois(roi_fname, rois)) {
+        logger.error("Could not open --roi-file [%s]\n", roi_fname.c_str());
+        return;
+    }
+    
+    // TODO: we could process all these ROIs in parallel, after loading them
+    for (const auto& handles: rois) {
+        printf("going to process %.1lf %.1lf -> %.1lf %.1lf\n", 
+            handles.first.x, handles.first.y,
+            handles.second.x, handles.second.y
+        );
+        
+        Point2d handle_a = handles.first - roi_origin;
+        Point2d handle_b = handles.second - roi_origin;
+        Rect_roi roi(handle_a, handle_b, max_dot);
+        process_image_as_roi(roi.bounds(img), handle_a, handle_b);
+    }
+}
+
+cv::Mat Mtf_core::detection_overlay(void) const {
+    cv::Mat temp;
+    img.convertTo(temp, CV_8U, 256.0/16384.0);
+    cv::Mat overlay;
+    cv::cvtColor(temp, overlay, cv::COLOR_GRAY2RGB);
+    
+    const cv::Vec3b marker(255, 255, 0);
+    
+    for (const auto& e: ellipses) {
+        for (double theta=0; theta < 2*M_PI; theta += M_PI/720.0) {
+            double synth_x = e.major_axis * cos(theta);
+            double synth_y = e.minor_axis * sin(theta);
+            double rot_x = cos(e.angle)*synth_x - sin(e.angle)*synth_y + e.centroid_x;
+            double rot_y = sin(e.angle)*synth_x + cos(e.angle)*synth_y + e.centroid_y;
+
+            // clip to image size, just in case
+            rot_x = min(max(rot_x, 0.0), (double)(overlay.cols-1));
+            rot_y = min(max(rot_y, 0.0), (double)(overlay.rows-1));
+
+            overlay.at<cv::Vec3b>(lrint(rot_y), lrint(rot_x)) = marker;
+        }
+        
+        char buffer[20];
+        int baseline = 0;
+        sprintf(buffer, "%d", e.code);
+        cv::Size ts = cv::getTextSize(buffer, cv::FONT_HERSHEY_SIMPLEX, 0.5, 1, &baseline);
+        cv::Point to(-ts.width/2,  ts.height/2);
+        to.x += e.centroid_x;
+        to.y += e.centroid_y;
+        
+        cv::putText(overlay, buffer, to, 
+            cv::FONT_HERSHEY_SIMPLEX, 0.5, 
+            CV_RGB(20, 20, 20), 2, cv::LINE_AA
+        );
+        cv::putText(overlay, buffer, to, 
+            cv::FONT_HERSHEY_SIMPLEX, 0.5, 
+            CV_RGB(0, 255, 255), 1, cv::LINE_AA
+        );
+    }
+    
+    for (const auto& q: od_quads) {
+        for (int kk=0; kk < 4; kk++) {
+            cv::line(overlay, q[kk], q[(kk+1)%4], cv::Scalar(0, 255, 128));
+        }
+    }
+    
+    for (const auto& p: od_points) {
+        if (p.x >= 0 && p.x < overlay.cols && p.y >= 0 && p.y < overlay.rows) {
+            overlay.at<cv::Vec3b>(p.y, p.x) = marker;
+        }
+    }
+    
+    return overlay;
 }
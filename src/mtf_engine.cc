@@ -0,0 +1,844 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+
+#include "include/mtf_engine.h"
+#include "include/logger.h"
+#include "include/thresholding.h"
+#include "include/mtf_core.h"
+#include "include/mtf_core_tbb_adaptor.h"
+#include "include/ca_core.h"
+#include "include/ca_core_tbb_adaptor.h"
+#include "include/auto_crop.h"
+#include "include/imatest_crop.h"
+#include "include/demosaic.h"
+#include "include/cfa_planes.h"
+#include "include/stride_range.h"
+#include "include/distortion_optimizer.h"
+#include "include/undistort_rectilinear.h"
+#include "include/undistort_equiangular.h"
+#include "include/undistort_stereographic.h"
+#include "include/esf_sampler.h"
+#include "include/esf_model_kernel.h"
+#include "include/esf_model_loess.h"
+#include "include/tiffsniff.h"
+#include "include/tiff_region_reader.h"
+#include "include/stage_trace.h"
+#include "include/memory_tracker.h"
+
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+
+#include <memory>
+
+//------------------------------------------------------------------------------
+Mtf_engine::Mtf_engine(const Mtf_engine_options& options)
+ : opts(options) {
+}
+
+//------------------------------------------------------------------------------
+Mtf_engine::status_t Mtf_engine::validate(void) const {
+    if (opts.equiangular > 0 && opts.pixel_pitch <= 0) {
+        logger.error("%s\n", "Fatal error: You must specify the pixel size (pitch) with the --pixelsize option when using --equiangular option. Aborting.");
+        return INVALID_OPTIONS;
+    }
+
+    if (opts.stereographic > 0 && opts.pixel_pitch <= 0) {
+        logger.error("%s\n", "Fatal error: You must specify the pixel size (pitch) with the --pixelsize option when using --stereographic option. Aborting.");
+        return INVALID_OPTIONS;
+    }
+
+    if (opts.stereographic > 0 && opts.equiangular > 0) {
+        logger.error("%s\n", "Fatal error: You may only specify one of --stereographic and --equiangular. Aborting.");
+        return INVALID_OPTIONS;
+    }
+
+    if (!(opts.detection_downsample == 1 || opts.detection_downsample == 2 || opts.detection_downsample == 4)) {
+        logger.error("%s\n", "Fatal error: The --coarse-detection factor must be 1, 2 or 4. Aborting.");
+        return INVALID_OPTIONS;
+    }
+
+    bool undistort = opts.equiangular > 0 || opts.stereographic > 0;
+    if (opts.esf_sampler.compare("deferred") == 0 && !undistort && !opts.optimize_distortion) {
+        logger.error("%s\n", "Error: Deferred ESF sampler cannot be used if no undistortion model is specified."
+            "See '--optimize-distortion, --equiangular, or --stereographic' options");
+        return INVALID_OPTIONS;
+    }
+
+    return OK;
+}
+
+//------------------------------------------------------------------------------
+bool Mtf_engine::decode_roi_region(const string& fname, cv::Mat& img, cv::Rect& dimensions) const {
+    // the options that modify the geometry of the whole image, or that produce outputs
+    // other than the measured blocks (see restore_input_frame()), must decode the full image
+    if (opts.roi_file.empty() || opts.single_roi || opts.autocrop || opts.border || opts.imatest_chart ||
+        opts.equiangular > 0 || opts.stereographic > 0 || opts.optimize_distortion ||
+        opts.ca || opts.focus || opts.mf_profile || opts.chart_orientation || !opts.layout_file.empty()) {
+        return false;
+    }
+    
+    Tiff_region_reader reader(fname);
+    if (!reader.supported()) {
+        return false;
+    }
+    
+    vector<std::pair<Point2d, Point2d>> rois;
+    if (!Mtf_core::read_manual_rois(opts.roi_file, rois) || rois.empty()) {
+        return false;
+    }
+    
+    double min_x = rois[0].first.x;
+    double min_y = rois[0].first.y;
+    double max_x = min_x;
+    double max_y = min_y;
+    for (const auto& r: rois) {
+        min_x = std::min(min_x, std::min(r.first.x, r.second.x));
+        min_y = std::min(min_y, std::min(r.first.y, r.second.y));
+        max_x = std::max(max_x, std::max(r.first.x, r.second.x));
+        max_y = std::max(max_y, std::max(r.first.y, r.second.y));
+    }
+    
+    // each ROI extends max_dot pixels on either side of its handles; the rest of the
+    // margin keeps the gradient and ESF sampling clear of the region boundary
+    const double margin = max_dot + 36;
+    const cv::Size size = reader.size();
+    int x0 = std::max(0, int(floor(min_x - margin)));
+    int y0 = std::max(0, int(floor(min_y - margin)));
+    int x1 = std::min(size.width, int(ceil(max_x + margin)));
+    int y1 = std::min(size.height, int(ceil(max_y + margin)));
+    
+    // an even offset preserves the CFA phase of Bayer images
+    x0 &= ~1;
+    y0 &= ~1;
+    
+    if (x1 - x0 < 2 || y1 - y0 < 2) {
+        return false;
+    }
+    
+    cv::Rect region(x0, y0, x1 - x0, y1 - y0);
+    if (!reader.read(region, img)) {
+        return false;
+    }
+    
+    logger.info("Only decoding the %dx%d region at (%d, %d) of the %dx%d input image that contains the ROIs\n",
+        region.width, region.height, region.x, region.y, size.width, size.height
+    );
+    
+    // same convention as Auto_cropper::subset()
+    dimensions = cv::Rect(x0, y0, size.width, size.height);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void Mtf_engine::restore_input_frame(const cv::Rect& dimensions, Mtf_engine_result& result) {
+    const Point2d offset(dimensions.x, dimensions.y);
+    for (auto& b: result.blocks) {
+        b.translate(offset);
+    }
+    for (auto& level: result.level_blocks) {
+        for (auto& b: level) {
+            b.translate(offset);
+        }
+    }
+    for (auto& channel: result.channel_blocks) {
+        for (auto& b: channel) {
+            b.translate(offset);
+        }
+    }
+    for (auto& s: result.samples) {
+        s.p += offset;
+    }
+    
+    // the renderers take the image dimensions (e.g., the lens centre) from the image, and the
+    // annotated image must place the blocks where they are in the input; only the decoded
+    // region carries image data
+    if (result.image.data) {
+        cv::Mat full(dimensions.height, dimensions.width, result.image.type(), cv::Scalar::all(0));
+        cv::Rect region(dimensions.x, dimensions.y, result.image.cols, result.image.rows);
+        region &= cv::Rect(0, 0, full.cols, full.rows);
+        result.image(cv::Rect(0, 0, region.width, region.height)).copyTo(full(region));
+        result.image = full;
+    }
+    result.img_dimension_correction = cv::Rect(0, 0, dimensions.width, dimensions.height);
+}
+
+//------------------------------------------------------------------------------
+vector<cv::Rect> Mtf_engine::coarse_detection(const cv::Mat& cvimg, int factor, double threshold, int S, cv::Mat& masked_img) const {
+    vector<cv::Rect> regions;
+    
+    cv::Mat coarse;
+    cv::resize(cvimg, coarse, cv::Size(cvimg.cols/factor, cvimg.rows/factor), 0, 0, cv::INTER_AREA);
+    if (coarse.rows < 16 || coarse.cols < 16) {
+        return regions;
+    }
+    
+    // Sauvola's window statistics are dominated by the chart contrast rather than by fine
+    // detail, so the thresholds computed at coarse scale carry over to full resolution
+    double min_val = 0;
+    double max_val = 0;
+    cv::minMaxLoc(cvimg, &min_val, &max_val);
+    cv::Mat surface;
+    sauvola_threshold_surface(coarse, surface, threshold, std::max(4, S/factor), std::max(max_val, 1.0));
+    
+    cv::Mat coarse_mask;
+    apply_threshold_surface(coarse, surface, 1, vector<cv::Rect>(1, cv::Rect(0, 0, coarse.cols, coarse.rows)), coarse_mask);
+    coarse.release();
+    
+    Component_labeller::zap_borders(coarse_mask);
+    const int64_t boundary_long_side = 2*std::max(surface.rows, surface.cols)*0.4;
+    const int64_t boundary_short_side = 2*std::min(surface.rows, surface.cols)*0.4;
+    const int64_t max_boundary_length = std::max(int64_t(8000/factor), boundary_long_side + boundary_short_side);
+    Component_labeller cl(coarse_mask, 60/factor, false, max_boundary_length);
+    coarse_mask.release();
+    
+    // The candidate tests proper (rectangle fitting, ellipse fitting) need the full-resolution
+    // boundaries and gradients, so here only objects that are too thin to be targets are dropped.
+    // The margin covers the boundary uncertainty at coarse scale, plus the edge search and ESF sampling distance
+    const int margin = 2*factor + 2*int(max_dot) + 8;
+    for (const auto& b: cl.get_boundaries()) {
+        double min_x = cvimg.cols;
+        double min_y = cvimg.rows;
+        double max_x = 0;
+        double max_y = 0;
+        for (const auto& p: b.second) {
+            min_x = std::min(min_x, p.x);
+            min_y = std::min(min_y, p.y);
+            max_x = std::max(max_x, p.x);
+            max_y = std::max(max_y, p.y);
+        }
+        if (max_x - min_x < 2 || max_y - min_y < 2) {
+            continue;
+        }
+        int x0 = int(floor(min_x))*factor - margin;
+        int y0 = int(floor(min_y))*factor - margin;
+        int x1 = (int(ceil(max_x)) + 1)*factor + margin;
+        int y1 = (int(ceil(max_y)) + 1)*factor + margin;
+        cv::Rect r = cv::Rect(x0, y0, x1 - x0, y1 - y0) & cv::Rect(0, 0, cvimg.cols, cvimg.rows);
+        if (r.area() > 0) {
+            regions.push_back(r);
+        }
+    }
+    
+    if (regions.empty()) {
+        logger.info("%s\n", "No candidate targets found on the downsampled image, thresholding at full resolution");
+        return regions;
+    }
+    
+    size_t covered = 0;
+    for (const auto& r: regions) {
+        covered += size_t(r.area());
+    }
+    logger.info("Coarse detection found %d candidate targets, covering at most %.1lf%% of the image\n",
+        int(regions.size()), 100.0*std::min(1.0, double(covered)/(double(cvimg.rows)*double(cvimg.cols)))
+    );
+    
+    apply_threshold_surface(cvimg, surface, factor, regions, masked_img);
+    return regions;
+}
+
+//------------------------------------------------------------------------------
+int Mtf_engine::threshold_window_size(const cv::Mat& cvimg) const {
+    return opts.border ?
+        max(cvimg.cols, cvimg.rows) :
+        max(opts.min_threshold_window, int(min(cvimg.cols, cvimg.rows)*opts.threshold_window));
+}
+
+//------------------------------------------------------------------------------
+double Mtf_engine::clamp_mtf_contrast(double contrast) {
+    if (contrast < 10) {
+        if (contrast < 1) {
+            logger.error("Warning: Requested MTF%02d, clamped to MTF01 instead\n", int(contrast));
+            contrast = 1;
+        } else {
+            logger.error("Warning: Requested MTF%02d, which is highly likely to be affected by noise, and may cause some edges not be detected.\n", int(contrast));
+        }
+    }
+    if (contrast > 90) {
+        logger.error("Warning: Requested MTF%02d, clamped to MTF90 instead\n", int(contrast));
+        contrast = 90;
+    }
+    return contrast;
+}
+
+//------------------------------------------------------------------------------
+Mtf_engine::status_t Mtf_engine::process(const string& fname, Mtf_engine_result& result) {
+    cv::Mat img;
+    cv::Rect dimensions;
+    bool region_decoded = false;
+    try {
+        Stage_trace::Scope scope("decode");
+        region_decoded = decode_roi_region(fname, img, dimensions);
+        if (!region_decoded) {
+            img = cv::imread(fname, -1);
+            dimensions = cv::Rect(0, 0, img.cols, img.rows);
+        }
+    } catch (const cv::Exception& ex) {
+        cout << ex.what() << endl;
+    }
+
+    if (!img.data) {
+        logger.error("Fatal error: could not open input file <%s>.\nFile is missing, or not where you said it would be, or you do not have read permission.\n", fname.c_str());
+        return UNREADABLE_INPUT;
+    }
+
+    if (!(img.depth() == CV_8U || img.depth() == CV_16U)) {
+        logger.error("%s\n", "Fatal error: Invalid image type. Only 8-bit unsigned and 16-bit unsigned integer images supported.");
+        return INVALID_IMAGE_TYPE;
+    }
+
+    Tiffsniff tiff(fname, img.elemSize1() == 1);
+    Display_profile profile;
+    if (tiff.profile_found()) {
+        profile = tiff.profile();
+    } else {
+        if (img.elemSize1() == 1 && !opts.linear) {
+            profile.force_sRGB();
+        }
+    }
+
+    Mtf_engine_options file_opts(opts);
+    file_opts.display_profile = profile;
+    if (file_opts.focal_ratio <= 0) {
+        // not provided by the user, so try the EXIF data
+        double exif_focal_ratio = tiff.metadata().focal_ratio(dimensions.width);
+        if (exif_focal_ratio > 0) {
+            logger.debug("Using focal ratio %.3lf derived from EXIF data\n", exif_focal_ratio);
+            file_opts.focal_ratio = exif_focal_ratio;
+        }
+    }
+    Mtf_engine file_engine(file_opts);
+    file_engine.set_abort_flag(abort_flag);
+    if (region_decoded) {
+        file_engine.input_dimensions = dimensions;
+    }
+    file_engine.owns_input = true;
+    status_t status = file_engine.process(img, result);
+    if (status == OK && region_decoded) {
+        restore_input_frame(dimensions, result);
+    }
+    return status;
+}
+
+//------------------------------------------------------------------------------
+Mtf_engine::status_t Mtf_engine::process(const cv::Mat& img, Mtf_engine_result& result) {
+    status_t status = validate();
+    if (status != OK) {
+        return status;
+    }
+
+    if (!img.data || !(img.depth() == CV_8U || img.depth() == CV_16U)) {
+        logger.error("%s\n", "Fatal error: Invalid image type. Only 8-bit unsigned and 16-bit unsigned integer images supported.");
+        return INVALID_IMAGE_TYPE;
+    }
+
+    result = Mtf_engine_result();
+    result.job_metadata = Job_metadata(
+        opts.pixel_pitch > 0 ? 1000 / opts.pixel_pitch : 1,
+        0.5, // will be updated later after clamping
+        Bayer::from_string(opts.bayer)
+    );
+    result.job_metadata.channels = img.channels();
+
+    Display_profile display_profile = opts.display_profile;
+    if (opts.linear) {
+        display_profile.force_linear();
+    }
+
+    cv::Mat cvimg = img;
+    if (!img.isContinuous() || (!owns_input && img.type() == CV_16UC1)) {
+        // the pixel loops below assume a continuous buffer, and the caller's image must
+        // not be modified: to_luminance() returns a 16-bit grayscale image itself (after
+        // applying its LUT in place), which simple_demosaic() and the Imatest bar fill write into
+        cvimg = img.clone();
+    }
+    if (cvimg.channels() == 4) {
+        logger.info("%s\n", "Input image had 4 channels. Only the first 3 will be used.");
+        cv::Mat reduced(cvimg.rows, cvimg.cols, (cvimg.elemSize1() == 1) ? CV_8UC3 : CV_16UC3);
+        int from_to[] = {0,0, 1,1, 2,2};
+        cv::mixChannels(&cvimg, 1, &reduced, 1, from_to, 3);
+        cvimg = reduced;
+    }
+
+    result.input_channels = cvimg.channels();
+    cv::Mat rgb_img;
+
+    if (opts.ca && cvimg.channels() == 3) {
+        rgb_img = cvimg; // TODO: proper linearization ?
+    }
+
+    {
+        Stage_trace::Scope scope("linearise");
+        cvimg = display_profile.to_luminance(cvimg);
+    }
+
+    assert(cvimg.type() == CV_16UC1);
+
+    const int border_width = 100;
+    if (opts.border) {
+        logger.info("The -b option has been specified, adding a %d-pixel border to the image\n", border_width);
+        double max_val = 0;
+        double min_val = 0;
+        cv::minMaxLoc(cvimg, &min_val, &max_val);
+        cv::Mat border;
+        cv::copyMakeBorder(cvimg, border, border_width, border_width, border_width, border_width, cv::BORDER_CONSTANT, cv::Scalar((int)max_val));
+        cvimg = border;
+    }
+
+    if (Memory_tracker::instance().budget() > 0) {
+        // The decoded image cannot be tiled, but everything from here onwards can be
+        // bounded: the luminance image (and its Bayer copy) stays resident, while the
+        // gradient images (8 bytes/pixel) and labels plus thresholded image (5 bytes/pixel)
+        // are needed at the same time during edge detection. Before that, thresholding
+        // needs its output image plus integral images that span at least the threshold
+        // window, however small the strips are.
+        const size_t pixels = size_t(cvimg.rows)*size_t(cvimg.cols);
+        const size_t threshold_bytes = pixels + sauvola_min_buffer_bytes(cvimg.rows, cvimg.cols, threshold_window_size(cvimg));
+        size_t required = Memory_tracker::resident() + std::max(pixels*(8 + 5), threshold_bytes);
+        if (Bayer::from_string(opts.bayer) != Bayer::NONE) {
+            required += pixels*cvimg.elemSize();
+        }
+        const size_t budget = Memory_tracker::instance().budget();
+        if (required > budget) {
+            logger.error("Fatal error: a %dx%d image needs at least %lu MB, which exceeds the memory budget of %lu MB. Aborting.\n",
+                cvimg.cols, cvimg.rows, (unsigned long)(required >> 20), (unsigned long)(budget >> 20)
+            );
+            return MEMORY_BUDGET_EXCEEDED;
+        }
+    }
+
+    cv::Mat masked_img;
+
+    cv::Rect img_dimension_correction(0,0, cvimg.cols, cvimg.rows);
+    if (input_dimensions.width > 0) {
+        img_dimension_correction = input_dimensions;
+    }
+
+    if (opts.autocrop) {
+        Auto_cropper ac(cvimg);
+        cvimg = ac.subset(cvimg, &img_dimension_correction);
+    }
+    if (opts.imatest_chart) {
+        Imatest_cropper ic(cvimg);
+        ic.fill_bars(cvimg);
+    }
+    result.img_dimension_correction = img_dimension_correction;
+
+    cv::Mat rawimg = cvimg;
+    if (Bayer::from_string(opts.bayer) != Bayer::NONE) {
+        Stage_trace::Scope scope("demosaic");
+        bool demosaiced = simple_demosaic(cvimg, rawimg,
+            Bayer::from_cfa_string(opts.cfa_pattern),
+            Bayer::from_string(opts.bayer), opts.single_roi
+        );
+        if (!demosaiced) {
+            return INVALID_OPTIONS;
+        }
+    }
+
+    string esf_sampler_name = opts.esf_sampler;
+
+    std::unique_ptr<Undistort> undistort;
+    if (opts.equiangular > 0) {
+        logger.info("Treating input image as equi-angular with focal length %.2lf, unmapping\n", opts.equiangular);
+        undistort = std::unique_ptr<Undistort>(new Undistort_equiangular(img_dimension_correction, opts.equiangular, opts.pixel_pitch/1000.0));
+        undistort->set_rectilinear_equivalent(opts.rectilinear_equivalent);
+    }
+    if (opts.stereographic > 0) {
+        logger.info("Treating input image as stereographic with focal length %.2lf, unmapping\n", opts.stereographic);
+        undistort = std::unique_ptr<Undistort>(new Undistort_stereographic(img_dimension_correction, opts.stereographic, opts.pixel_pitch/1000.0));
+        undistort->set_rectilinear_equivalent(opts.rectilinear_equivalent);
+    }
+    if (undistort) {
+        undistort->set_allow_crop(opts.undistort_crop);
+        if (esf_sampler_name.compare("deferred") != 0) {
+            logger.info("Warning: Because you specified an undistortion model,"
+                " your ESF sampler choice of '%s' has been changed to 'deferred'\n",
+                esf_sampler_name.c_str()
+            );
+        }
+    }
+
+    if (opts.focus || opts.mf_profile) {
+        esf_sampler_name = "line";
+        logger.info("%s\n", "Note: because --focus output option was selected, the --esf_sampler option has been changed to \"line\".");
+    }
+
+    vector<Bayer::bayer_t> extra_subsets;
+    for (const auto& name: opts.extra_bayer) {
+        extra_subsets.push_back(Bayer::from_string(name));
+    }
+
+    double mtf_contrast = clamp_mtf_contrast(opts.mtf_contrast);
+    result.job_metadata.mtf_contrast = mtf_contrast / 100.0;
+
+    vector<double> extra_contrasts;
+    for (double contrast: opts.extra_mtf_contrasts) {
+        extra_contrasts.push_back(clamp_mtf_contrast(contrast) / 100.0);
+    }
+
+    int detection_downsample = opts.detection_downsample;
+    if (detection_downsample > 1 && (opts.single_roi || !opts.roi_file.empty() || opts.border || opts.checkerboard)) {
+        logger.info("%s\n", "Coarse detection does not apply to --single-roi, --roi-file, -b or --checkerboard, detecting at full resolution");
+        detection_downsample = 1;
+    }
+    #ifdef MDEBUG
+    if (opts.bradley) {
+        detection_downsample = 1;
+    }
+    #endif
+
+    Chart_layout layout;
+    bool reuse_layout = false;
+    bool layout_ignored = false;
+    if (!opts.layout_file.empty()) {
+        layout_ignored = opts.single_roi || !opts.roi_file.empty() || opts.autocrop || opts.focus || opts.mf_profile || 
+            opts.chart_orientation || undistort || opts.optimize_distortion;
+        if (layout_ignored) {
+            logger.info("%s\n", "The chart layout file is not used with --single-roi, --roi-file, --autocrop, --focus, "
+                "--mf-profile, --chart-orientation or lens distortion options");
+        } else if (layout.load(opts.layout_file) && layout.matches(cvimg.size()) && layout.size() > 0) {
+            reuse_layout = true;
+        } else {
+            logger.info("No usable chart layout in [%s], running full detection to record one\n", opts.layout_file.c_str());
+        }
+    }
+    const int layout_margin = 2*int(max_dot) + 16;
+
+    bool finished;
+    bool distortion_applied = false;
+    do {
+        finished = true;
+
+        if (undistort) {
+            Stage_trace::Scope scope("undistort");
+            cvimg = undistort->unmap(cvimg, rawimg);
+        }
+
+        const size_t pixels = size_t(cvimg.rows)*size_t(cvimg.cols);
+        vector<cv::Rect> candidate_regions;
+        std::unique_ptr<Component_labeller> labeller;
+        if (reuse_layout) {
+            // the block rectangles come from the layout, so only the gradients around them are needed
+            labeller = std::unique_ptr<Component_labeller>(new Component_labeller());
+            candidate_regions = layout.regions(layout_margin);
+        } else {
+            logger.info("%s\n", "Thresholding image ...");
+            Stage_trace::Scope threshold_scope("threshold");
+            int brad_S = threshold_window_size(cvimg);
+            double brad_threshold = opts.threshold;
+            if (detection_downsample > 1) {
+                Stage_trace::Scope coarse_scope("coarse detection");
+                candidate_regions = coarse_detection(cvimg, detection_downsample, brad_threshold/0.55*0.85, brad_S, masked_img);
+            }
+            if (candidate_regions.empty()) {
+                const size_t threshold_allowance = Memory_tracker::instance().scratch_allowance(pixels);
+                #ifdef MDEBUG
+                    if (opts.bradley) {
+                        printf("using Bradley thresholding\n");
+                        bradley_adaptive_threshold(cvimg, masked_img, brad_threshold, brad_S);
+                    } else {
+                        sauvola_adaptive_threshold(cvimg, masked_img, brad_threshold/0.55*0.85, brad_S, threshold_allowance);
+                    }
+                #else
+                    sauvola_adaptive_threshold(cvimg, masked_img, brad_threshold/0.55*0.85, brad_S, threshold_allowance); // fudge the threshold to maintain backwards compatibility
+                #endif
+            }
+
+            const int erosion_size = std::min(5, std::max(1, opts.checkerboard_radius));
+            if (opts.checkerboard) {
+                // first do a small-scale closing operation to prevent
+                // small interior / boundary holes from growing in the subsequent dilation
+                cv::Mat open_element = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3));
+                cv::morphologyEx(masked_img, masked_img, cv::MORPH_OPEN, open_element);
+
+                // dilate masked image to break checkerboard corners
+                cv::Mat element = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(2*erosion_size + 1, 2*erosion_size + 1));
+                cv::morphologyEx(masked_img, masked_img, cv::MORPH_DILATE, element);
+            }
+
+            threshold_scope.stop();
+        
+            if (aborted()) {
+                return ABORTED;
+            }
+
+            logger.info("%s\n", "Component labelling ...");
+            Stage_trace::Scope labelling_scope("labelling");
+            Component_labeller::zap_borders(masked_img);
+            // largest component boundary length determined empirically
+            const int64_t boundary_long_side = 2*std::max(cvimg.rows, cvimg.cols)*0.4;
+            const int64_t boundary_short_side = 2*std::min(cvimg.rows, cvimg.cols)*0.4;
+            const int64_t max_boundary_length = std::max(int64_t(8000), boundary_long_side + boundary_short_side);
+            labeller = std::unique_ptr<Component_labeller>(new Component_labeller(masked_img, 60, false, max_boundary_length));
+            labelling_scope.stop();
+
+            if (labeller->get_boundaries().size() == 0 && !(opts.single_roi || !opts.roi_file.empty())) {
+                logger.error("%s\n", "Error: No black objects found. Try a lower threshold value with the -t option.");
+                return NO_TARGETS_FOUND;
+            }
+
+            // try to restore the object boundaries to compensate for dilation of thresholded image
+            if (opts.checkerboard) {
+                labeller->inflate_boundaries(erosion_size);
+            }
+
+            // now we can destroy the thresholded image, before the gradient images are allocated
+            masked_img.release();
+        
+            if (aborted()) {
+                return ABORTED;
+            }
+        }
+        Component_labeller& cl = *labeller;
+
+        logger.info("%s\n", "Computing gradients ...");
+        Stage_trace::Scope gradient_scope("gradient");
+        Gradient gradient = candidate_regions.empty() ?
+            Gradient(cvimg, Memory_tracker::instance().scratch_allowance(2*sizeof(float)*pixels)) :
+            Gradient(cvimg, candidate_regions);
+        gradient_scope.stop();
+
+        Mtf_core mtf_core(
+            cl, gradient, cvimg, rawimg, opts.bayer, opts.cfa_pattern,
+            undistort ? "deferred" : (opts.optimize_distortion ? "line" : esf_sampler_name), // force deferred sampler if an undistortion model is specified
+            undistort.get(),
+            opts.border ? border_width+1 : 0
+        );
+        if (!mtf_core.valid()) {
+            return INVALID_OPTIONS;
+        }
+        mtf_core.set_absolute_sfr(opts.absolute_sfr);
+        mtf_core.set_sfr_smoothing(opts.sfr_smoothing);
+        mtf_core.set_abort_flag(abort_flag);
+
+        std::unique_ptr<Cfa_planes> cfa_planes;
+        if (opts.cfa_planes && Bayer::from_string(opts.bayer) != Bayer::NONE) {
+            logger.info("%s\n", "Deinterleaving Bayer subsets ...");
+            cfa_planes = std::unique_ptr<Cfa_planes>(new Cfa_planes(rawimg));
+            mtf_core.set_cfa_planes(cfa_planes.get());
+        }
+
+        mtf_core.set_extra_bayer_subsets(extra_subsets);
+
+        if (opts.border) {
+            logger.debug("setting border to %d\n", border_width);
+        }
+        if (opts.esf_model.compare("kernel") == 0) {
+            mtf_core.set_esf_model(std::unique_ptr<Esf_model>(new Esf_model_kernel()));
+        } else { // only alternative at the moment is "loess"
+            #ifdef MDEBUG
+            mtf_core.set_esf_model(
+                std::unique_ptr<Esf_model>(
+                    new Esf_model_loess(
+                        opts.alpha > 0 ? opts.alpha : 5.5,
+                        opts.ridge
+                    )
+                )
+            );
+            #else
+            mtf_core.set_esf_model(std::unique_ptr<Esf_model>(new Esf_model_loess()));
+            #endif
+        }
+        mtf_core.get_esf_model()->set_monotonic_filter(opts.monotonic_filter);
+
+        if (opts.alpha > 0) {
+            mtf_core.set_esf_model_alpha_parm(opts.alpha);
+        }
+
+        if (opts.snap_angle >= 0) {
+            mtf_core.set_snap_angle(opts.snap_angle/180*M_PI);
+        }
+        if (opts.focus || opts.mf_profile) {
+            mtf_core.set_sliding(true);
+            if (opts.mf_profile) {
+                mtf_core.set_samples_per_edge(5);
+            }
+        }
+        if (opts.chart_orientation) {
+            mtf_core.set_find_fiducials(true);
+        }
+
+        if (opts.optimize_distortion && !distortion_applied) {
+            mtf_core.set_ridges_only(true);
+        }
+        mtf_core.set_retain_edge_geometry(opts.ca || (opts.optimize_distortion && !distortion_applied));
+
+        if (opts.full_sfr) {
+            mtf_core.use_full_sfr();
+        }
+
+        mtf_core.set_mtf_contrast(mtf_contrast / 100.0);
+        mtf_core.set_extra_mtf_contrasts(extra_contrasts);
+        #ifdef MDEBUG
+        mtf_core.noise_seed = opts.noise_seed;
+        mtf_core.noise_sd = opts.noise_sd;
+        #endif
+
+        Mtf_core_tbb_adaptor ca(&mtf_core);
+
+        Stage_trace::Scope detection_scope("edge detection");
+        if (reuse_layout) {
+            if (!mtf_core.layout_aligned(layout)) {
+                logger.info("%s\n", "The chart has moved relative to the recorded layout, running full detection");
+                reuse_layout = false;
+                finished = false;
+                continue;
+            }
+            logger.info("Measuring %d blocks from the recorded chart layout\n", int(layout.size()));
+            Mtf_core_layout_adaptor la(&mtf_core, &layout);
+            Stride_range::parallel_for(la, ThreadPool::instance(), layout.size());
+        } else if (opts.single_roi) {
+            mtf_core.process_image_as_roi(cv::Rect2i(0, 0, cvimg.cols, cvimg.rows));
+        } else {
+            if (!opts.roi_file.empty()) {
+                mtf_core.set_roi_origin(Point2d(input_dimensions.x, input_dimensions.y));
+                mtf_core.process_manual_rois(opts.roi_file);
+            } else {
+                #ifdef MDEBUG
+                if (opts.single_threaded) {
+                    ca(Stride_range(size_t(0), mtf_core.num_objects()-1, 1));
+                } else {
+                    logger.debug("Parallel MTF%2d calculation\n", int(mtf_core.get_mtf_contrast()*100));
+                    Stride_range::parallel_for(ca, ThreadPool::instance(), mtf_core.num_objects());
+                }
+                #else
+                Stride_range::parallel_for(ca, ThreadPool::instance(), mtf_core.num_objects());
+                #endif
+            }
+        }
+
+        detection_scope.stop();
+
+        // the remaining stages only need the blocks, so release the large intermediate images
+        gradient.release();
+        cl.release();
+        
+        if (aborted()) {
+            logger.info("%s\n", "Processing aborted.");
+            return ABORTED;
+        }
+
+        if (reuse_layout && mtf_core.get_blocks().size() < 0.9*layout.size()) {
+            logger.info("Only %d of the %d blocks in the recorded layout could be measured, running full detection\n",
+                int(mtf_core.get_blocks().size()), int(layout.size())
+            );
+            reuse_layout = false;
+            finished = false;
+            continue;
+        }
+
+        if (mtf_core.get_blocks().size() == 0 && !(opts.focus || opts.mf_profile)) {
+            logger.error("%s\n", "Error: No suitable target objects found.");
+            return NO_TARGETS_FOUND;
+        }
+
+        if (!opts.layout_file.empty() && !reuse_layout && !layout_ignored) {
+            // this frame becomes the reference for later frames
+            Chart_layout(mtf_core.get_blocks(), cvimg.size()).save(opts.layout_file);
+        }
+
+        if (opts.optimize_distortion && !distortion_applied) {
+            Stage_trace::Scope scope("distortion optimisation");
+            Distortion_optimizer dist_opt(mtf_core.get_blocks(), Point2d(rawimg.cols/2, rawimg.rows/2));
+            dist_opt.solve();
+            logger.info("Optimal distortion coefficients: %lg %lg\n", dist_opt.best_sol[0], dist_opt.best_sol[1]);
+
+            vector<double> coeffs(2);
+            for (int i=0; i < 2; i++) {
+                coeffs[i] = dist_opt.best_sol[i];
+            }
+            undistort = std::unique_ptr<Undistort>(new Undistort_rectilinear(img_dimension_correction, coeffs));
+            undistort->set_max_val(dist_opt.get_max_val());
+
+            finished = false;
+            distortion_applied = true;
+            logger.info("%s\n", "Performing second pass on undistorted image.");
+            continue; // effectively jump back to the start
+        }
+
+        if (opts.ca) {
+            Stage_trace::Scope scope("chromatic aberration");
+            Ca_core chromatic(mtf_core);
+            if (opts.ca_all_edges) {
+                chromatic.set_allow_all_edges();
+            }
+
+            if (result.input_channels == 3) {
+                logger.info("%s\n", "Using original RGB input image to estimate CA.");
+                vector<cv::Mat> channels = display_profile.to_linear_rgb(rgb_img);
+
+                if (undistort) {
+                    undistort->apply_padding(channels);
+                }
+
+                chromatic.set_rgb_channels(channels);
+            }
+
+            Ca_core_tbb_adaptor ca_adaptor(chromatic);
+
+            size_t num_blocks = mtf_core.get_blocks().size();
+            if (num_blocks >= 1) {
+                #ifdef MDEBUG
+                if (opts.single_threaded) {
+                    ca_adaptor(Stride_range(size_t(0), num_blocks - 1, 1));
+                } else {
+                    logger.info("Parallel CA calculation with %ld blocks\n", num_blocks);
+                    Stride_range::parallel_for(ca_adaptor, ThreadPool::instance(), num_blocks);
+                }
+                #else
+                logger.info("Parallel CA calculation with %ld blocks\n", num_blocks);
+                Stride_range::parallel_for(ca_adaptor, ThreadPool::instance(), num_blocks);
+                #endif
+            }
+        }
+
+        if (opts.mf_profile || opts.focus || opts.chart_orientation) {
+            result.distance_scale.construct(mtf_core, true, &img_dimension_correction, opts.focal_ratio, opts.fiducial_correspondence_file);
+        }
+
+        // copy out everything that the renderers need, so that the images can be released
+        result.image = cvimg;
+        result.bayer = mtf_core.bayer;
+        result.mtf_contrast = mtf_core.get_mtf_contrast();
+        result.extra_mtf_contrasts = mtf_core.get_extra_mtf_contrasts();
+        mtf_core.get_blocks(); // materialise the blocks once, before the views below are taken
+        for (size_t level=0; level < result.extra_mtf_contrasts.size(); level++) {
+            result.level_blocks.push_back(mtf_core.get_level_blocks(level));
+        }
+        result.extra_bayer_subsets = extra_subsets;
+        for (size_t ch=0; ch < extra_subsets.size(); ch++) {
+            result.channel_blocks.push_back(mtf_core.get_channel_blocks(ch));
+        }
+        result.blocks = std::move(mtf_core.get_blocks());
+        result.samples = std::move(mtf_core.get_samples());
+        result.sliding_edges = mtf_core.get_sliding_edges();
+        result.ellipses = mtf_core.ellipses;
+
+    } while (!finished);
+
+    return OK;
+}
@@ -0,0 +1,865 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#include <assert.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+
+#include <tclap/CmdLine.h>
+
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+
+using std::string;
+using std::stringstream;
+
+#include "include/logger.h"
+#include "include/common_types.h"
+#include "include/mtf_core.h"
+#include "include/output_version.h"
+#include "include/mtf_renderer_annotate.h"
+#include "include/mtf_renderer_profile.h"
+#include "include/mtf_renderer_mfprofile.h"
+#include "include/mtf_renderer_grid.h"
+#include "include/mtf_renderer_print.h"
+#include "include/mtf_renderer_stats.h"
+#include "include/mtf_renderer_sfr.h"
+#include "include/mtf_renderer_esf.h"
+#include "include/mtf_renderer_edges.h"
+#include "include/mtf_renderer_lensprofile.h"
+#include "include/mtf_renderer_chart_orientation.h"
+#include "include/mtf_renderer_focus.h"
+#include "include/ca_renderer_print.h"
+#include "include/ca_renderer_grid.h"
+#include "include/render_scheduler.h"
+#include "include/image_encoder.h"
+#include "include/stage_trace.h"
+#include "include/distance_scale.h"
+#include "include/bayer.h"
+#include "include/esf_sampler.h"
+#include "include/job_metadata.h"
+#include "include/mtf_job.h"
+#include "include/memory_tracker.h"
+#include "config.h"
+
+//-----------------------------------------------------------------------------
+static string version_string(void) {
+    stringstream ss;
+    ss << mtfmapper_VERSION_MAJOR << "." << mtfmapper_VERSION_MINOR << "." << mtfmapper_VERSION_SUB;
+    return ss.str();
+}
+
+//-----------------------------------------------------------------------------
+// true if exe names an existing file, either directly or by searching PATH
+static bool executable_exists(const string& exe) {
+    struct STAT sb;
+    if (exe.find_first_of("/\\") != string::npos) {
+        return STAT(exe.c_str(), &sb) == 0 && !S_ISDIR(sb.st_mode);
+    }
+    
+    #ifdef _WIN32
+    const char path_sep = ';';
+    const vector<string> suffixes{"", ".exe"};
+    #else
+    const char path_sep = ':';
+    const vector<string> suffixes{""};
+    #endif
+    
+    const char* path_env = getenv("PATH");
+    if (!path_env) {
+        return false;
+    }
+    stringstream ss(path_env);
+    string dir;
+    while (std::getline(ss, dir, path_sep)) {
+        if (dir.empty()) continue;
+        for (const auto& suffix: suffixes) {
+            string candidate = dir + "/" + exe + suffix;
+            if (STAT(candidate.c_str(), &sb) == 0 && !S_ISDIR(sb.st_mode)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+struct Mtf_job::Arguments {
+    Arguments(void);
+    
+    TCLAP::CmdLine cmd;
+    TCLAP::UnlabeledValueArg<std::string>  tc_in_name{"<input_filename>", 
+        "Input image file name (many extensions supported)", true, "input.png", "image_filename", cmd
+    };
+    TCLAP::UnlabeledValueArg<std::string>  tc_wdir{"<working_directory>", 
+        "Working directory (for output files); \".\" is fine", true, ".", "directory", cmd
+    };
+    TCLAP::SwitchArg tc_profile{"p","profile","Generate MTF50 profile", cmd, false};
+    TCLAP::SwitchArg tc_mf_profile{"","mf-profile","Generate MTF50 profile (Manual focus chart)", cmd, false};
+    TCLAP::SwitchArg tc_annotate{"a","annotate","Annotate input image with MTF50 values", cmd, false};
+    TCLAP::SwitchArg tc_surface{"s","surface","Generate MTF50 surface plots", cmd, false};
+    TCLAP::SwitchArg tc_linear{"l","linear","Input image is linear 8-bit (default for 8-bit is assumed to be sRGB gamma corrected)", cmd, false};
+    TCLAP::SwitchArg tc_print{"r","raw","Print raw MTF50 values", cmd, false};
+    TCLAP::SwitchArg tc_edges{"q","edges","Print raw MTF50 values, grouped by edge location", cmd, false};
+    TCLAP::SwitchArg tc_sfr{"f","sfr","Store raw SFR curves for each edge", cmd, false};
+    TCLAP::SwitchArg tc_esf{"e","esf","Store raw ESF and PSF curves for each edge", cmd, false};
+    TCLAP::SwitchArg tc_gzip_text{"","gzip-text","Compress the text outputs of -r, -f, -e and -q with gzip", cmd, false};
+    TCLAP::SwitchArg tc_lensprof{"","lensprofile","Render M/S lens profile plot", cmd, false};
+    TCLAP::SwitchArg tc_chart_orientation{"","chart-orientation","Visualize chart orientation relative to camera", cmd, false};
+    TCLAP::SwitchArg tc_border{"b","border","Add a border of 20 pixels to the image", cmd, false};
+    TCLAP::SwitchArg tc_absolute{"","absolute-sfr","Generate absolute SFR curve (MTF) i.s.o. relative SFR curve", cmd, false};
+    TCLAP::SwitchArg tc_smooth{"","nosmoothing","Disable SFR curve (MTF) smoothing", cmd, false};
+    TCLAP::SwitchArg tc_autocrop{"","autocrop","Automatically crop image to the chart area", cmd, false};
+    TCLAP::SwitchArg tc_focus{"","focus","Compute focus depth using special 'focus' type chart", cmd, false};
+    TCLAP::SwitchArg tc_log_append{"", "log-append", "Append to log file in stead of overwriting log file", cmd, false};
+    TCLAP::SwitchArg tc_debug{"", "debug", "Enable debug output messages", cmd, false};
+    TCLAP::SwitchArg tc_single_roi{"", "single-roi", "Treat the entire input image as the ROI", cmd, false};
+    TCLAP::SwitchArg tc_distort_opt{"", "optimize-distortion", "Optimize lens distortion coefficients", cmd, false};
+    TCLAP::SwitchArg tc_rectilinear{"", "rectilinear-equivalent", "Measure MTF in rectilinear equivalent projection", cmd, false};
+    TCLAP::SwitchArg tc_distort_crop{"", "no-undistort-crop", "Do not crop undistorted image (equiangular, stereographic)", cmd, false};
+    TCLAP::SwitchArg tc_full_sfr{"", "full-sfr", "Output the full SFR/MTF curve (up to 4 c/p) when combined with -q or -f", cmd, false};
+    TCLAP::SwitchArg tc_ima_mode{"", "imatest-chart", "Treat the input image as an Imatest chart (crop black bars out)", cmd, false};
+    TCLAP::SwitchArg tc_lensprofile_fixed{"", "lensprofile-fixed-size", "Lens profile output is scaled to maximum sensor radius", cmd, false};
+    TCLAP::SwitchArg tc_monotonic_filter{"", "monotonic-esf-filter", "Force the application of a monontonic ESF noise filter (use at own risk!)", cmd, false};
+    TCLAP::SwitchArg tc_ca{"", "ca", "Estimate chromatic aberration", cmd, false};
+    TCLAP::SwitchArg tc_ca_fraction{"", "ca-fraction", "Chromatic aberration image generated in units of radial distance fraction", cmd, false};
+    TCLAP::SwitchArg tc_jpeg{"", "jpeg", "Annotated image saved in JPEG format to gain speed", cmd, false};
+    TCLAP::ValueArg<int> tc_png_level{"", "png-compression", "PNG compression level [0,9], default 1. Lower is faster, higher produces smaller files", false, 1, "level", cmd};
+    TCLAP::ValueArg<double> tc_annotate_scale{"", "annotate-scale", "Downscale the annotated image by this factor (0,1], default 1", false, 1.0, "factor", cmd};
+    TCLAP::SwitchArg tc_checkerboard{"", "checkerboard", "Process the input image as a checkerboard pattern", cmd, false};
+    TCLAP::SwitchArg tc_ca_all{"", "ca-all-edges", "Chromatic aberration is calculated on all edges, not just tangential edges", cmd, false};
+    TCLAP::SwitchArg tc_cfa_planes{"", "cfa-planes", "Deinterleave the Bayer mosaic into per-subset planes to speed up --bayer sampling", cmd, false};
+    #ifdef MDEBUG
+    TCLAP::SwitchArg tc_bradley{"", "bradley", "Use Bradley thresholding i.s.o Sauvola thresholding", cmd, false};
+    #endif
+    TCLAP::ValueArg<double> tc_angle{"g", "angle", "Angular filter [0,360)", false, 0, "angle", cmd};
+    TCLAP::ValueArg<double> tc_snap{"", "snap-angle", "Snap-to angle modulus [0,90)", false, 1000, "angle", cmd};
+    TCLAP::ValueArg<double> tc_thresh{"t", "threshold", "Dark object threshold (0,1), default 0.55", false, 0.55, "threshold", cmd};
+    TCLAP::ValueArg<string> tc_gnuplot{"", "gnuplot-executable", "Full path (including filename) to gnuplot executable ", false, "gnuplot", "filepath", cmd};
+    vector<string> allowed_plot_backends{"builtin", "gnuplot"};
+    TCLAP::ValuesConstraint<string> plot_backend_constraints{allowed_plot_backends};
+    TCLAP::ValueArg<string> tc_plot_backend{"", "plot-backend", "Render plots with the built-in rasteriser, or with gnuplot. Defaults to gnuplot if the gnuplot executable can be found, otherwise to the built-in rasteriser", false, "gnuplot", &plot_backend_constraints, cmd};
+    TCLAP::ValueArg<double> tc_pixelsize{"", "pixelsize", "Pixel size in microns. This also switches units to lp/mm", false, 1.0, "size", cmd};
+    TCLAP::ValueArg<double> tc_lp1{"", "lp1", "Lens profile resolution 1 (lp/mm or c/p)", false, 10.0, "lp/mm", cmd};
+    TCLAP::ValueArg<double> tc_lp2{"", "lp2", "Lens profile resolution 2 (lp/mm or c/p)", false, 30.0, "lp/mm", cmd};
+    TCLAP::ValueArg<double> tc_lp3{"", "lp3", "Lens profile resolution 3 (lp/mm or c/p)", false, 50.0, "lp/mm", cmd};
+    TCLAP::ValueArg<string> tc_trace{"", "trace", "Record stage timings and counters, write them as a Chrome/Perfetto trace to <filename>, and print a summary", false, "", "filename", cmd};
+    TCLAP::ValueArg<int> tc_memory_budget{"", "memory-budget", "Limit the working memory of the large intermediate images to approximately <MB> megabytes", false, 0, "MB", cmd};
+    TCLAP::ValueArg<string> tc_logfile{"", "logfile", "Output written to <logfile> in stead of standard out", false, "", "filename", cmd};
+    TCLAP::ValueArg<int> tc_gpwidth{"", "gnuplot-width", "Width of images rendered by gnuplot", false, 1024, "pixels", cmd};
+    TCLAP::ValueArg<double> tc_focal{"", "focal-ratio", "Specify focal ratio for use in chart orientation estimation", false, -2, "ratio", cmd};
+    TCLAP::ValueArg<double> tc_equiangular{"", "equiangular", "Treat input image as equi-angular mapping (fisheye) with the specified focal length", false, 16.0, "focal length(mm)", cmd};
+    TCLAP::ValueArg<double> tc_stereographic{"", "stereographic", "Treat input image as stereographic mapping (fisheye) with the specified focal length", false, 8.0, "focal length(mm)", cmd};
+    TCLAP::ValueArg<double> tc_zscale{"", "zscale", "Z-axis scaling of '-s' outputs [0,1]. A value of 0 means z-axis scale starts at zero, and 1.0 means z-axis starts from minimum measurement", false, 0.0, "scale factor", cmd};
+    TCLAP::ValueArg<double> tc_thresh_win{"", "threshold-window", "Fraction of min(img width, img height) to use as window size during thresholding; range (0,1]", false, 0.33333, "fraction", cmd};
+    TCLAP::ValueArg<double> tc_mtf_contrast{"", "mtf", "Specify target contrast, e.g., --mtf 30 yields MTF30 results. Range [10, 90], default is 50", false, 50.0, "percentage", cmd};
+    TCLAP::MultiArg<double> tc_extra_mtf_contrast{"", "extra-mtf", "Also report results at the specified target contrast (may be repeated), e.g., --extra-mtf 10 --extra-mtf 30. Range as for --mtf", false, "percentage", cmd};
+    TCLAP::ValueArg<double> tc_alpha{"", "alpha", "Standard deviation of smoothing kernel [1,20]", false, 13, "unitless", cmd};
+    TCLAP::ValueArg<double> tc_surface_max{"", "surface-max", "Specify maximum value in MTF50 surface plots", false, -1, "units depend on other settings", cmd};
+    TCLAP::ValueArg<string> tc_roi_file{"", "roi-file", "Only process ROIs defined in <roifile>, rather than using automatic target selection", false, "", "<roifile>", cmd};
+    vector<int> allowed_detection_downsample{1, 2, 4};
+    TCLAP::ValuesConstraint<int> detection_downsample_constraints{allowed_detection_downsample};
+    TCLAP::ValueArg<int> tc_detection_downsample{"", "coarse-detection", "Find candidate targets on an image downsampled by <factor> (1, 2 or 4), then measure them at full resolution", false, 1, &detection_downsample_constraints, cmd};
+    TCLAP::ValueArg<string> tc_layout_file{"", "layout-file", "Reuse the chart layout recorded in <layoutfile> if the chart has not moved, otherwise detect targets and record their layout there", false, "", "<layoutfile>", cmd};
+    TCLAP::ValueArg<int> tc_checkerboard_radius{"", "checkerboard-radius", "Radius of dilation structuring element when processing checkerboard images", false, 2, "pixels", cmd};
+    #ifdef MDEBUG
+    TCLAP::ValueArg<double> tc_ridge{"", "ridge", "Specify ridge regression parameter [0,+infy)", false, 5e-8, "unitless", cmd};
+    TCLAP::ValueArg<double> tc_noise_seed{"", "noise-seed", "Image noise seed", false, 10, "unitless", cmd};
+    TCLAP::ValueArg<double> tc_noise_sd{"", "noise-sd", "Image noise sd", false, 0, "unitless", cmd};
+    TCLAP::SwitchArg tc_single{"","single-threaded","Force single-threaded operation", cmd, false};
+    #endif
+    
+    vector<int> allowed_output_versions{Output_version::instance().get_versions()};
+    TCLAP::ValuesConstraint<int> output_version_constraints{allowed_output_versions};
+    TCLAP::ValueArg<int> tc_output_version{"v", "output-version", "Specify output format version (affects -q; version 3 writes serialized_edges.bin as a columnar edge table)", false, 1, &output_version_constraints};
+
+    vector<string> allowed_bayer_subsets{"red", "green", "blue", "none"};
+    TCLAP::ValuesConstraint<string> bayer_constraints{allowed_bayer_subsets};
+    TCLAP::ValueArg<std::string> tc_bayer{"", "bayer", "Select Bayer subset", false, "none", &bayer_constraints };
+    TCLAP::MultiArg<std::string> tc_extra_bayer{"", "extra-bayer", "Also measure the specified Bayer subset on every edge (may be repeated)", false, &bayer_constraints};
+    
+    vector<string> allowed_esf_samplers{Esf_sampler::esf_sampler_names.begin(), Esf_sampler::esf_sampler_names.end()};
+    TCLAP::ValuesConstraint<string> esf_sampler_constraints{allowed_esf_samplers};
+    TCLAP::ValueArg<std::string> tc_esf_sampler{"", "esf-sampler", "Select ESF sampler type", false, "piecewise-quadratic", &esf_sampler_constraints};
+    
+    vector<string> allowed_cfa_patterns{"rggb", "bggr", "grbg", "gbrg"};
+    TCLAP::ValuesConstraint<string> cfa_pattern_constraints{allowed_cfa_patterns};
+    TCLAP::ValueArg<std::string> tc_cfa_pattern{"", "cfa-pattern", "Select CFA pattern", false, "rggb", &cfa_pattern_constraints};
+    
+    vector<string> allowed_esf_models{Esf_model::esf_model_names.begin(), Esf_model::esf_model_names.end()};
+    TCLAP::ValuesConstraint<string> esf_model_constraints{allowed_esf_models};
+    TCLAP::ValueArg<std::string> tc_esf_model{"", "esf-model", "Select ESF model type", false, "kernel", &esf_model_constraints};
+};
+
+Mtf_job::Arguments::Arguments(void)
+ : cmd("Measure MTF50 values across edges of rectangular targets", ' ', version_string()) {
+
+    // the arguments with constraints are not registered in their constructors
+    cmd.add(tc_output_version);
+    cmd.add(tc_bayer);
+    cmd.add(tc_extra_bayer);
+    cmd.add(tc_esf_sampler);
+    cmd.add(tc_cfa_pattern);
+    cmd.add(tc_esf_model);
+}
+
+//-----------------------------------------------------------------------------
+Mtf_job::Mtf_job(void) : args(new Arguments) {
+}
+
+//-----------------------------------------------------------------------------
+Mtf_job::~Mtf_job(void) {
+}
+
+//-----------------------------------------------------------------------------
+bool Mtf_job::parse(int argc, char** argv, int& exit_code) {
+    vector<string> arguments(argv, argv + argc);
+    return parse(arguments, exit_code);
+}
+
+//-----------------------------------------------------------------------------
+bool Mtf_job::parse(const vector<string>& argv, int& exit_code) {
+    exit_code = 0;
+    args->cmd.setExceptionHandling(exit_on_error_flag);
+    
+    vector<string> arguments(argv);
+    try {
+        args->cmd.parse(arguments);
+    } catch (const TCLAP::ArgException& ex) {
+        logger.error("Fatal error: %s %s\n", ex.error().c_str(), ex.argId().c_str());
+        exit_code = 1;
+        return false;
+    } catch (const TCLAP::ExitException& ex) { // --help or --version
+        exit_code = ex.getExitStatus();
+        return false;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+int Mtf_job::apply_process_settings(void) {
+    if (args->tc_logfile.isSet()) {
+        logger.redirect(args->tc_logfile.getValue(), args->tc_log_append.getValue());
+    }
+    if (args->tc_debug.getValue()) {
+        logger.enable_level(Logger::LOGGER_DEBUG);
+    }
+    if (args->tc_trace.isSet()) {
+        Stage_trace::instance().enable();
+        Stage_trace::name_thread("main");
+    }
+    if (args->tc_memory_budget.isSet()) {
+        if (args->tc_memory_budget.getValue() <= 0) {
+            logger.error("%s\n", "Fatal error: --memory-budget must be a positive number of megabytes. Aborting.");
+            return 1;
+        }
+        Memory_tracker::instance().set_budget(size_t(args->tc_memory_budget.getValue()) << 20);
+    }
+
+    if (args->tc_png_level.getValue() < 0 || args->tc_png_level.getValue() > 9) {
+        logger.error("Warning: PNG compression level %d is outside the range [0, 9], clamping it\n", args->tc_png_level.getValue());
+    }
+    Image_encoder::instance().set_png_level(args->tc_png_level.getValue());
+    
+    process_settings_applied = true;
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+int Mtf_job::run(void) {
+    if (!process_settings_applied) {
+        vector<string> ignored;
+        if (args->tc_logfile.isSet()) ignored.push_back("--logfile");
+        if (args->tc_trace.isSet()) ignored.push_back("--trace");
+        if (args->tc_memory_budget.isSet()) ignored.push_back("--memory-budget");
+        if (args->tc_png_level.isSet()) ignored.push_back("--png-compression");
+        for (const auto& opt: ignored) {
+            logger.info("Warning: %s is a process-wide setting, and is ignored in an embedded job\n", opt.c_str());
+        }
+    }
+    
+    bool lpmm_mode = false;
+    double pixel_size = 1;
+    if (args->tc_pixelsize.isSet()) {
+        logger.info("%s\n", "Info: Pixel size has been specified, measurement will be reported in lp/mm, rather than c/p");
+        lpmm_mode = true;
+        pixel_size = 1000 / args->tc_pixelsize.getValue();
+        logger.info("working with=%lf pixels per mm\n", pixel_size);
+    }
+    
+    if (!args->tc_profile.isSet() && !args->tc_annotate.isSet() && !args->tc_surface.isSet() && !args->tc_print.isSet() && !args->tc_sfr.isSet() && !args->tc_edges.isSet()) {
+        logger.info("%s\n", "Warning: No output specified. You probably want to specify at least one of the following flags: [-r -p -a -s -f -q]");
+    }
+
+    if (args->tc_annotate_scale.getValue() <= 0 || args->tc_annotate_scale.getValue() > 1) {
+        logger.error("%s\n", "Fatal error: --annotate-scale must be in the range (0, 1]. Aborting.");
+        return 1;
+    }
+
+    struct STAT sb;
+    if (STAT(args->tc_wdir.getValue().c_str(), &sb) != 0) {
+        logger.error("Fatal error: specified output directory <%s> does not exist\n", args->tc_wdir.getValue().c_str());
+        return 3;
+    } else {
+        if (!S_ISDIR(sb.st_mode)) {
+            logger.error("Fatal error: speficied output directory <%s> is not a directory\n", args->tc_wdir.getValue().c_str());
+            return 3;
+        }
+    }
+
+    int gnuplot_width = std::max(1024, args->tc_gpwidth.getValue());
+    
+    // process working directory
+    std::string wdir(args->tc_wdir.getValue());
+    if (wdir[wdir.length()-1]) {
+        wdir = args->tc_wdir.getValue() + "/";
+    }
+
+    char slashchar='/';
+    #ifdef _WIN32
+    // on windows, mangle the '/' into a '\\'
+    std::string wdm;
+    for (size_t i=0; i < wdir.length(); i++) {
+        if (wdir[i] == '/') {
+            wdm.push_back('\\');
+            wdm.push_back('\\');
+        } else {
+            wdm.push_back(wdir[i]);
+        }
+    }
+    wdir = wdm;
+    slashchar='\\';
+    #endif
+    
+    // strip off supposed extention suffix,
+    // and supposed path prefix
+    std::string in_img_name = args->tc_in_name.getValue();
+    std::replace(in_img_name.begin(), in_img_name.end(), '/', slashchar);
+    int ext_idx=-1;
+    int path_idx=0;
+    for (int idx= in_img_name.length()-1; idx >= 0 && path_idx == 0; idx--) {
+        if (in_img_name[idx] == '.' && ext_idx < 0) {
+            ext_idx = idx;
+        }
+        if (in_img_name[idx] == slashchar && path_idx == 0) {
+            path_idx = idx;
+        }
+    }
+    if (ext_idx < 0) {
+        ext_idx = in_img_name.length();
+    }
+    std::string img_filename;
+    for (int idx=path_idx; idx < ext_idx; idx++) {
+        char c = in_img_name[idx];
+        if (c == slashchar) continue;
+        if (c == '_') {
+            img_filename.push_back('\\');
+            img_filename.push_back('\\');
+        }
+        img_filename.push_back(c);
+    }
+    Mtf_engine_options options;
+    options.linear = args->tc_linear.getValue();
+    options.border = args->tc_border.getValue();
+    options.autocrop = args->tc_autocrop.getValue();
+    options.imatest_chart = args->tc_ima_mode.getValue();
+    options.bayer = args->tc_bayer.getValue();
+    options.cfa_pattern = args->tc_cfa_pattern.getValue();
+    options.extra_bayer = args->tc_extra_bayer.getValue();
+    options.cfa_planes = args->tc_cfa_planes.getValue();
+    options.threshold = args->tc_thresh.getValue();
+    options.threshold_window = args->tc_thresh_win.getValue();
+    options.min_threshold_window = args->tc_thresh_win.isSet() ? 20 : 500;
+    options.checkerboard = args->tc_checkerboard.getValue();
+    options.checkerboard_radius = args->tc_checkerboard_radius.getValue();
+    options.single_roi = args->tc_single_roi.getValue();
+    options.roi_file = args->tc_roi_file.isSet() ? args->tc_roi_file.getValue() : string();
+    options.detection_downsample = args->tc_detection_downsample.getValue();
+    options.layout_file = args->tc_layout_file.isSet() ? args->tc_layout_file.getValue() : string();
+    options.equiangular = args->tc_equiangular.isSet() ? args->tc_equiangular.getValue() : 0;
+    options.stereographic = args->tc_stereographic.isSet() ? args->tc_stereographic.getValue() : 0;
+    options.pixel_pitch = args->tc_pixelsize.isSet() ? args->tc_pixelsize.getValue() : 0;
+    options.rectilinear_equivalent = args->tc_rectilinear.getValue();
+    options.undistort_crop = !args->tc_distort_crop.getValue();
+    options.optimize_distortion = args->tc_distort_opt.getValue();
+    options.esf_sampler = args->tc_esf_sampler.getValue();
+    options.esf_model = args->tc_esf_model.getValue();
+    options.alpha = args->tc_alpha.isSet() ? args->tc_alpha.getValue() : 0;
+    options.monotonic_filter = args->tc_monotonic_filter.getValue();
+    options.snap_angle = args->tc_snap.isSet() ? args->tc_snap.getValue() : -1;
+    options.absolute_sfr = args->tc_absolute.getValue();
+    options.sfr_smoothing = !args->tc_smooth.getValue();
+    options.full_sfr = args->tc_full_sfr.getValue();
+    options.mtf_contrast = args->tc_mtf_contrast.getValue();
+    options.extra_mtf_contrasts = args->tc_extra_mtf_contrast.getValue();
+    options.focus = args->tc_focus.getValue();
+    options.mf_profile = args->tc_mf_profile.getValue();
+    options.chart_orientation = args->tc_chart_orientation.getValue();
+    options.focal_ratio = args->tc_focal.getValue();
+    options.fiducial_correspondence_file = wdir + string("fiducial_correspondence.txt");
+    options.ca = args->tc_ca.getValue();
+    options.ca_all_edges = args->tc_ca_all.getValue();
+    #ifdef MDEBUG
+    options.bradley = args->tc_bradley.getValue();
+    options.single_threaded = args->tc_single.getValue();
+    options.ridge = args->tc_ridge.getValue();
+    options.noise_seed = args->tc_noise_seed.getValue();
+    options.noise_sd = args->tc_noise_sd.getValue();
+    #endif
+    
+    Mtf_engine engine(options);
+    Mtf_engine::status_t status = engine.validate();
+    if (status != Mtf_engine::OK) {
+        return status;
+    }
+    
+    engine.set_abort_flag(abort_flag);
+    Mtf_engine_result result;
+    status = engine.process(args->tc_in_name.getValue(), result);
+    if (status != Mtf_engine::OK) {
+        return status;
+    }
+    
+    cv::Mat& cvimg = result.image;
+    cv::Rect& img_dimension_correction = result.img_dimension_correction;
+    Distance_scale& distance_scale = result.distance_scale;
+    const Job_metadata& job_metadata = result.job_metadata;
+    const vector<Bayer::bayer_t>& extra_subsets = result.extra_bayer_subsets;
+    
+    // now render the computed MTF values
+    // Renderers only read the (now immutable) blocks and samples, so independent
+    // renderers are executed concurrently; the scheduler respects the declared dependencies
+    const vector<Block>& blocks = result.blocks;
+    Render_scheduler scheduler;
+    bool builtin_plots = args->tc_plot_backend.getValue().compare("builtin") == 0;
+    if (!args->tc_plot_backend.isSet() && !executable_exists(args->tc_gnuplot.getValue())) {
+        logger.info("Info: gnuplot executable <%s> not found, plots will be rendered with the built-in rasteriser\n", args->tc_gnuplot.getValue().c_str());
+        builtin_plots = true;
+    }
+    
+    if (args->tc_annotate.getValue()){
+        scheduler.add("annotate", [&] {
+            Mtf_renderer_annotate annotate(cvimg, wdir + string("annotated"), lpmm_mode, pixel_size, args->tc_jpeg.getValue());
+            annotate.set_output_scale(args->tc_annotate_scale.getValue());
+            annotate.render(blocks);
+        });
+    }
+    
+    bool gnuplot_warning = true;
+    bool few_edges = blocks.size() < 10;
+    if (few_edges && (args->tc_profile.getValue() || args->tc_surface.getValue())) {
+        logger.info("Warning: fewer than 10 edges found, so MTF%2d surfaces/profiles will not be generated. Are you using suitable input images?\n", int(result.mtf_contrast*100));
+    }
+    
+    // the grid renderers only warn about gnuplot if the profile renderer did not already do so
+    vector<Render_scheduler::task_id> gnuplot_dependencies;
+    if (args->tc_profile.getValue() && !few_edges) {
+        gnuplot_dependencies.push_back(scheduler.add("profile", [&] {
+            Mtf_renderer_profile profile(
+                img_filename,
+                wdir, 
+                string("profile.txt"),
+                args->tc_gnuplot.getValue(),
+                cvimg,
+                gnuplot_width,
+                lpmm_mode,
+                pixel_size,
+                int(result.mtf_contrast*100)
+            );
+            profile.set_builtin_plots(builtin_plots);
+            profile.render(blocks);
+            gnuplot_warning = !profile.gnuplot_failed();
+        }));
+    }
+    
+    // mfprofile and focus both write focus_peak.png; retain the serial order
+    vector<Render_scheduler::task_id> focus_peak_dependencies;
+    if (args->tc_mf_profile.getValue()) {
+        focus_peak_dependencies.push_back(scheduler.add("mfprofile", [&] {
+            Mtf_renderer_mfprofile profile(
+                distance_scale,
+                wdir, 
+                string("focus_peak.png"),
+                cvimg,
+                lpmm_mode,
+                pixel_size
+            );
+            profile.render(result.samples);
+        }));
+    }
+
+    if (args->tc_surface.getValue() && !few_edges) {
+        scheduler.add("grid", [&] {
+            Mtf_renderer_grid grid(
+                img_filename,
+                wdir, 
+                string("grid.txt"),
+                args->tc_gnuplot.getValue(),
+                cvimg,
+                gnuplot_width,
+                lpmm_mode,
+                pixel_size,
+                args->tc_zscale.getValue(),
+                args->tc_surface_max.getValue(),
+                lrint(result.mtf_contrast*100)
+            );
+            grid.set_gnuplot_warning(gnuplot_warning);
+            grid.set_sparse_chart(args->tc_ima_mode.getValue());
+            grid.set_builtin_plots(builtin_plots);
+            grid.render(blocks);
+        }, gnuplot_dependencies);
+    }
+    
+    if (args->tc_print.getValue()) {
+        scheduler.add("print", [&] {
+            Mtf_renderer_print printer(
+                wdir + string("raw_mtf_values.txt"), 
+                args->tc_angle.isSet(), 
+                args->tc_angle.getValue()/180.0*M_PI,
+                lpmm_mode,
+                pixel_size
+            );
+            printer.set_compressed_output(args->tc_gzip_text.getValue());
+            printer.render(blocks);
+        });
+    }
+    
+    if (args->tc_edges.getValue()) {
+        scheduler.add("edges", [&] {
+            Mtf_renderer_edges printer(
+                wdir + string("edge_mtf_values.txt"), 
+                wdir + string("edge_sfr_values.txt"),
+                wdir + string("edge_line_deviation.txt"),
+                wdir + string("serialized_edges.bin"),
+                Output_version::type(args->tc_output_version.getValue()),
+                job_metadata,
+                lpmm_mode, pixel_size
+            );
+            printer.set_compressed_output(args->tc_gzip_text.getValue());
+            printer.render(blocks);
+        });
+    }
+    
+    if (args->tc_lensprof.getValue()) {
+    
+        vector<double> resolutions;
+        // try to infer what resolutions the user wants
+        if (!(args->tc_lp1.isSet() || args->tc_lp2.isSet() || args->tc_lp3.isSet())) {
+            if (lpmm_mode) {
+                // if nothing is specified explicitly, use the first two defaults
+                resolutions.push_back(args->tc_lp1.getValue());
+                resolutions.push_back(args->tc_lp2.getValue());
+            } else {
+                // otherwise just pick some arbitrary values
+                resolutions.push_back(0.1);
+                resolutions.push_back(0.2);
+            }
+        } else {
+            if (args->tc_lp1.isSet()) {
+                resolutions.push_back(args->tc_lp1.getValue());
+            }
+            if (args->tc_lp2.isSet()) {
+                resolutions.push_back(args->tc_lp2.getValue());
+            }
+            if (args->tc_lp3.isSet()) {
+                resolutions.push_back(args->tc_lp3.getValue());
+            }
+        }
+
+        sort(resolutions.begin(), resolutions.end());
+        
+        scheduler.add("lensprofile", [&, resolutions] {
+            Mtf_renderer_lensprofile printer(
+                img_filename,
+                wdir, 
+                string("lensprofile.txt"),
+                args->tc_gnuplot.getValue(),
+                cvimg,
+                resolutions,
+                gnuplot_width,
+                lpmm_mode,
+                pixel_size
+            );
+            printer.set_sparse_chart(args->tc_ima_mode.getValue());
+            printer.set_builtin_plots(builtin_plots);
+            printer.set_fixed_size(args->tc_lensprofile_fixed.getValue());
+            printer.render(blocks);
+        });
+    }
+    
+    if (args->tc_chart_orientation.getValue()) {
+        scheduler.add("chart_orientation", [&] {
+            Mtf_renderer_chart_orientation co_renderer(
+                img_filename,
+                wdir, 
+                string("chart_orientation.png"),
+                cvimg,
+                gnuplot_width,
+                distance_scale,
+                &img_dimension_correction
+            );
+            co_renderer.render(blocks);
+        });
+    }
+
+    if (args->tc_sfr.getValue() || args->tc_absolute.getValue()) {
+        scheduler.add("sfr", [&] {
+            Mtf_renderer_sfr sfr_writer(
+                wdir + string("raw_sfr_values.txt"), 
+                lpmm_mode,
+                pixel_size
+            );
+            sfr_writer.set_compressed_output(args->tc_gzip_text.getValue());
+            sfr_writer.render(blocks);
+        });
+    }
+    
+    if (args->tc_esf.getValue()) {
+        scheduler.add("esf", [&] {
+            Output_version::type ver = Output_version::type(args->tc_output_version.getValue());
+            Mtf_renderer_esf esf_writer(
+                wdir + string("raw_esf_values.txt"), 
+                wdir + (ver >= Output_version::V2 ? string("raw_lsf_values.txt") : string("raw_psf_values.txt")),
+                ver
+            );
+            esf_writer.set_compressed_output(args->tc_gzip_text.getValue());
+            esf_writer.render(blocks);
+        });
+    }
+    
+    if (args->tc_focus.getValue()) {
+        scheduler.add("focus", [&] {
+            Mtf_renderer_focus profile(
+                distance_scale,
+                result.sliding_edges,
+                wdir, 
+                string("focus_peak.png"),
+                cvimg,
+                lpmm_mode,
+                pixel_size
+            );
+            profile.render(result.samples, result.bayer, &result.ellipses, &img_dimension_correction);
+        }, focus_peak_dependencies);
+    }
+    
+    // outputs at the extra contrast levels, derived from the same SFRs as the primary level
+    for (size_t level=0; level < result.extra_mtf_contrasts.size(); level++) {
+        int contrast = lrint(result.extra_mtf_contrasts[level]*100);
+        char suffix_buffer[16];
+        sprintf(suffix_buffer, "_mtf%02d", contrast);
+        string suffix(suffix_buffer);
+        
+        scheduler.add(string("levels") + suffix, [&, level, contrast, suffix] {
+            const vector<Block>& level_blocks = result.level_blocks[level];
+            
+            if (args->tc_profile.getValue() && !few_edges) {
+                Mtf_renderer_profile profile(
+                    img_filename,
+                    wdir, 
+                    string("profile") + suffix + string(".txt"),
+                    args->tc_gnuplot.getValue(),
+                    cvimg,
+                    gnuplot_width,
+                    lpmm_mode,
+                    pixel_size,
+                    contrast
+                );
+                profile.set_output_suffix(suffix);
+                profile.set_builtin_plots(builtin_plots);
+                profile.render(level_blocks);
+            }
+            
+            if (args->tc_surface.getValue() && !few_edges) {
+                Mtf_renderer_grid grid(
+                    img_filename,
+                    wdir, 
+                    string("grid") + suffix + string(".txt"),
+                    args->tc_gnuplot.getValue(),
+                    cvimg,
+                    gnuplot_width,
+                    lpmm_mode,
+                    pixel_size,
+                    args->tc_zscale.getValue(),
+                    args->tc_surface_max.getValue(),
+                    contrast
+                );
+                grid.set_gnuplot_warning(gnuplot_warning);
+                grid.set_sparse_chart(args->tc_ima_mode.getValue());
+                grid.set_output_suffix(suffix);
+                grid.set_builtin_plots(builtin_plots);
+                grid.render(level_blocks);
+            }
+            
+            if (args->tc_print.getValue()) {
+                Mtf_renderer_print printer(
+                    wdir + string("raw_mtf_values") + suffix + string(".txt"), 
+                    args->tc_angle.isSet(), 
+                    args->tc_angle.getValue()/180.0*M_PI,
+                    lpmm_mode,
+                    pixel_size
+                );
+                printer.set_compressed_output(args->tc_gzip_text.getValue());
+                printer.render(level_blocks);
+            }
+        }, gnuplot_dependencies);
+    }
+    
+    // outputs of the extra Bayer subsets, measured on the same edges as the primary subset
+    vector<string> channel_suffixes;
+    for (size_t ch=0; ch < extra_subsets.size(); ch++) {
+        // "none" selects all CFA sites of the raw mosaic
+        string suffix = "_" + (extra_subsets[ch] == Bayer::NONE ? string("all") : Bayer::to_string(extra_subsets[ch]));
+        channel_suffixes.push_back(suffix);
+        
+        scheduler.add(string("channel") + suffix, [&, ch, suffix] {
+            const vector<Block>& channel_blocks = result.channel_blocks[ch];
+            
+            if (args->tc_print.getValue()) {
+                Mtf_renderer_print printer(
+                    wdir + string("raw_mtf_values") + suffix + string(".txt"), 
+                    args->tc_angle.isSet(), 
+                    args->tc_angle.getValue()/180.0*M_PI,
+                    lpmm_mode,
+                    pixel_size
+                );
+                printer.set_compressed_output(args->tc_gzip_text.getValue());
+                printer.render(channel_blocks);
+            }
+            
+            if (args->tc_edges.getValue()) {
+                Job_metadata channel_metadata(job_metadata);
+                channel_metadata.bayer = extra_subsets[ch];
+                Mtf_renderer_edges printer(
+                    wdir + string("edge_mtf_values") + suffix + string(".txt"), 
+                    wdir + string("edge_sfr_values") + suffix + string(".txt"),
+                    wdir + string("edge_line_deviation") + suffix + string(".txt"),
+                    wdir + string("serialized_edges") + suffix + string(".bin"),
+                    Output_version::type(args->tc_output_version.getValue()),
+                    channel_metadata,
+                    lpmm_mode, pixel_size
+                );
+                printer.set_compressed_output(args->tc_gzip_text.getValue());
+                printer.render(channel_blocks);
+            }
+            
+            if (args->tc_sfr.getValue() || args->tc_absolute.getValue()) {
+                Mtf_renderer_sfr sfr_writer(
+                    wdir + string("raw_sfr_values") + suffix + string(".txt"), 
+                    lpmm_mode,
+                    pixel_size
+                );
+                sfr_writer.set_compressed_output(args->tc_gzip_text.getValue());
+                sfr_writer.render(channel_blocks);
+            }
+            
+            if (args->tc_esf.getValue()) {
+                Output_version::type ver = Output_version::type(args->tc_output_version.getValue());
+                Mtf_renderer_esf esf_writer(
+                    wdir + string("raw_esf_values") + suffix + string(".txt"), 
+                    wdir + (ver >= Output_version::V2 ? string("raw_lsf_values") : string("raw_psf_values")) + suffix + string(".txt"),
+                    ver
+                );
+                esf_writer.set_compressed_output(args->tc_gzip_text.getValue());
+                esf_writer.render(channel_blocks);
+            }
+        });
+    }
+    
+    if (args->tc_ca.getValue()) {
+        scheduler.add("ca_print", [&] {
+            Ca_renderer_print ca_print(wdir + string("chromatic_aberration.txt"), cvimg, args->tc_ca_all.getValue());
+            ca_print.render(blocks);
+        });
+        
+        scheduler.add("ca_grid", [&] {
+            Ca_renderer_grid grid(
+                img_filename,
+                wdir, 
+                string("ca_grid.txt"),
+                args->tc_gnuplot.getValue(),
+                cvimg,
+                gnuplot_width,
+                lpmm_mode,
+                pixel_size,
+                args->tc_ca_fraction.getValue(),
+                args->tc_ca_all.getValue()
+            );
+            grid.set_sparse_chart(args->tc_ima_mode.getValue());
+            grid.set_builtin_plots(builtin_plots);
+            grid.render(blocks);
+        });
+    }
+    
+    {
+        Stage_trace::Scope scope("render");
+        size_t failed_renderers = scheduler.run();
+        if (failed_renderers > 0) {
+            logger.error("Error: %lu renderer(s) failed or were skipped, some outputs are missing\n", (unsigned long)failed_renderers);
+        }
+    }
+    
+    // the summary statistics are printed last, after all the renderers have completed
+    Mtf_renderer_stats stats(lpmm_mode, pixel_size);
+    if (args->tc_focus.getValue() || args->tc_mf_profile.getValue()) {
+        stats.render(result.samples);
+    } else {
+        stats.render(blocks);
+    }
+    
+    for (size_t ch=0; ch < extra_subsets.size(); ch++) {
+        logger.info("Extra Bayer subset %s:\n", channel_suffixes[ch].c_str() + 1);
+        Mtf_renderer_stats channel_stats(lpmm_mode, pixel_size);
+        channel_stats.render(result.channel_blocks[ch]);
+    }
+    
+    // images are encoded in the background; ours must be on disk before we return,
+    // but there is no need to wait for those of other jobs sharing the encoder
+    {
+        Stage_trace::Scope scope("image encoding wait");
+        Image_encoder::instance().wait(wdir);
+    }
+    
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+void Mtf_job::report_process_statistics(void) {
+    if (Memory_tracker::instance().budget() > 0) {
+        logger.info("Peak memory use was %.1lf MB (budget %.1lf MB)\n", 
+            Memory_tracker::instance().peak() / 1048576.0, Memory_tracker::instance().budget() / 1048576.0
+        );
+    }
+    
+    if (args->tc_trace.isSet()) {
+        Stage_trace::instance().print_summary();
+        if (!Stage_trace::instance().write_chrome_trace(args->tc_trace.getValue())) {
+            logger.error("Error: could not write trace to %s\n", args->tc_trace.getValue().c_str());
+        }
+    }
+}
@@ -27,6 +27,7 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 */
 
 #include "include/mtf_renderer_annotate.h"
+#include "include/image_encoder.h"
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/imgcodecs/imgcodecs.hpp>
 
@@ -174,11 +175,18 @@ void Mtf_renderer_annotate::render(const vector<Block>& blocks) {
             }
         }
     }
+    if (output_scale < 1.0) {
+        cv::Mat scaled;
+        cv::resize(out_img, scaled, cv::Size(), output_scale, output_scale, cv::INTER_AREA);
+        out_img = scaled;
+    }
+    // encoding a full-resolution image takes a while, so it is queued rather than
+    // holding up the remaining renderers
     if (jpeg_output) {
         vector<int> parms = {cv::IMWRITE_JPEG_QUALITY, 98};
-        imwrite(ofname + ".jpg", out_img, parms);
+        Image_encoder::instance().submit(ofname + ".jpg", out_img, parms);
     } else {
-        imwrite(ofname + ".png", out_img);
+        Image_encoder::instance().submit(ofname + ".png", out_img);
     }
     
 }
@@ -500,7 +500,7 @@ void Mtf_renderer_focus::render(const vector<Mtf_profile_sample>& samples, Bayer
     } 
     
     
-    imwrite(wdir + prname, merged);
+    Image_encoder::instance().submit(wdir + prname, merged);
     
 }
 
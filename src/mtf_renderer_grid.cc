@@ -26,6 +26,7 @@ authors and should not be interpreted as representing official policies, either
 or implied, of the Council for Scientific and Industrial Research (CSIR).
 */
 #include "include/mtf_renderer_grid.h"
+#include "include/plot_raster.h"
 #include <opencv2/imgproc/imgproc.hpp>
 
 class Grid_functor_mtf : public Grid_functor {
@@ -213,7 +214,45 @@ void Mtf_renderer_grid::render(const vector<Block>& blocks) {
     int fontsize3d = std::max(long(9), lrint(9.0*gnuplot_width/1024.0));
     double linewidth = std::max(double(0.5), double(0.5)*gnuplot_width/1024.0);
     
-    FILE* gpf = fopen((wdir + std::string("grid.gnuplot")).c_str(), "wt");
+    if (builtin_plots) {
+        char title[128];
+        string units = lpmm_mode ? "lp/mm" : "c/p";
+        cv::Mat mer_scaled = grid_mer_fine * pixel_size;
+        cv::Mat sag_scaled = grid_sag_fine * pixel_size;
+        
+        Plot_raster::Axes axes;
+        axes.xlabel = string("column (") + (lpmm_mode ? "mm" : "pixels") + ")";
+        axes.ylabel = string("row (") + (lpmm_mode ? "mm" : "pixels") + ")";
+        
+        Plot_raster image_plot(
+            width_in_pixels, lrint(width_in_pixels*2.3*grid_mer_fine.rows/double(grid_mer_fine.cols)), 
+            fontsize, img_filename
+        );
+        sprintf(title, "Meridional MTF%2d (%s)", mtf_contrast, units.c_str());
+        axes.title = title;
+        image_plot.heat_map(Plot_raster::Panel(0, 0, 1, 0.5), mer_scaled, img.cols/pixel_size, img.rows/pixel_size, zmin, zmax, axes);
+        sprintf(title, "Sagittal MTF%2d (%s)", mtf_contrast, units.c_str());
+        axes.title = title;
+        image_plot.heat_map(Plot_raster::Panel(0, 0.5, 1, 0.5), sag_scaled, img.cols/pixel_size, img.rows/pixel_size, zmin, zmax, axes);
+        
+        Plot_raster surface_plot(
+            lrint(width_in_pixels*2*grid_mer_fine.rows/double(grid_mer_fine.cols)), height_in_pixels_3d,
+            fontsize3d, img_filename
+        );
+        sprintf(title, "Meridional MTF%2d (%s)", mtf_contrast, units.c_str());
+        surface_plot.surface(Plot_raster::Panel(0, 0, 1, 0.5), grid_mer_coarse * pixel_size, zmin, zmax, title);
+        sprintf(title, "Sagittal MTF%2d (%s)", mtf_contrast, units.c_str());
+        surface_plot.surface(Plot_raster::Panel(0, 0.5, 1, 0.5), grid_sag_coarse * pixel_size, zmin, zmax, title);
+        
+        if (!image_plot.write(wdir + string("grid_image") + output_suffix + string(".png")) ||
+            !surface_plot.write(wdir + string("grid_surface") + output_suffix + string(".png"))) {
+            
+            logger.error("%s\n", "Failed to write grid images");
+        }
+        return;
+    }
+    
+    FILE* gpf = fopen((wdir + std::string("grid") + output_suffix + std::string(".gnuplot")).c_str(), "wt");
     
     fprintf(gpf, "%s\n", diverging_palette.c_str());
     fprintf(gpf, "set cbrange [%lf:%lf]\n", zmin, zmax);
@@ -245,7 +284,7 @@ void Mtf_renderer_grid::render(const vector<Block>& blocks) {
         fontsize
     );
     
-    fprintf(gpf, "set output \"%sgrid_image.png\"\n", wdir.c_str());
+    fprintf(gpf, "set output \"%sgrid_image%s.png\"\n", wdir.c_str(), output_suffix.c_str());
     if (img_filename.length() > 0) {
         fprintf(gpf, "set multiplot title \"%s\" font \",%d\"\n", img_filename.c_str(), title_fontsize);
         fprintf(gpf, "set tmargin 4\n");
@@ -280,7 +319,7 @@ void Mtf_renderer_grid::render(const vector<Block>& blocks) {
         #endif
         fontsize3d
     );
-    fprintf(gpf, "set output \"%sgrid_surface.png\"\n", wdir.c_str());
+    fprintf(gpf, "set output \"%sgrid_surface%s.png\"\n", wdir.c_str(), output_suffix.c_str());
     fprintf(gpf, "unset xlab\n");
     fprintf(gpf, "unset ylab\n");
     if (img_filename.length() > 0) {
@@ -305,9 +344,9 @@ void Mtf_renderer_grid::render(const vector<Block>& blocks) {
     
     char* buffer = new char[1024];
     #ifdef _WIN32
-    sprintf(buffer, "\"\"%s\" \"%sgrid.gnuplot\"\"", gnuplot_binary.c_str(), wdir.c_str());
+    sprintf(buffer, "\"\"%s\" \"%sgrid%s.gnuplot\"\"", gnuplot_binary.c_str(), wdir.c_str(), output_suffix.c_str());
     #else
-    sprintf(buffer, "\"%s\" \"%sgrid.gnuplot\"", gnuplot_binary.c_str(), wdir.c_str());
+    sprintf(buffer, "\"%s\" \"%sgrid%s.gnuplot\"", gnuplot_binary.c_str(), wdir.c_str(), output_suffix.c_str());
     #endif
     int rval = system(buffer);
     if (rval != 0) {
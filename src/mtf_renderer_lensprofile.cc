@@ -28,6 +28,7 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 
 #include "include/mtf_renderer_lensprofile.h"
 #include "include/sampling_rate.h"
+#include "include/plot_raster.h"
 #include <opencv2/imgcodecs/imgcodecs.hpp>
 
 void Mtf_renderer_lensprofile::render(const vector<Block>& blocks) {
@@ -57,7 +58,7 @@ void Mtf_renderer_lensprofile::render(const vector<Block>& blocks) {
             Point2d norm = blocks[i].get_normal(k);
             double delta = dir.x*norm.x + dir.y*norm.y;
             
-            const vector<double>& sfr = blocks[i].get_sfr(k);
+            const Edge_store::Span sfr = blocks[i].get_sfr(k);
             for (size_t j=0; j < resolution.size(); j++) {
                 double res = resolution[j] * NYQUIST_FREQ*2;
                 int lidx = min((int)floor(res), NYQUIST_FREQ*2-2);
@@ -181,6 +182,65 @@ void Mtf_renderer_lensprofile::render(const vector<Block>& blocks) {
     
     string resmode = lpmm_mode ? "lp/mm" : "c/p";
     
+    if (builtin_plots) {
+        const cv::Scalar line_bgr[3] = {cv::Scalar(0, 0, 224), cv::Scalar(255, 128, 0), cv::Scalar(0, 192, 0)};
+        const cv::Scalar shade_bgr[6] = {
+            cv::Scalar(224, 224, 255), cv::Scalar(208, 208, 240), 
+            cv::Scalar(247, 208, 208), cv::Scalar(240, 208, 208),
+            cv::Scalar(208, 247, 208), cv::Scalar(208, 240, 208)
+        };
+        double linewidth = std::max(1.0, 2*gnuplot_width/1024.0);
+        
+        vector<Plot_raster::Series> series;
+        for (size_t j=0; j < resolution.size(); j++) {
+            Plot_raster::Series s_band(Plot_raster::FILLED_POLYGON, shade_bgr[2*j]);
+            Plot_raster::Series m_band(Plot_raster::FILLED_POLYGON, shade_bgr[2*j+1]);
+            s_band.opacity = m_band.opacity = 0.5;
+            for (size_t i=0; i < s_spread[j].size(); i++) {
+                s_band.points.push_back(Point2d(scale*s_spread[j][i].first, s_spread[j][i].second));
+            }
+            for (size_t i=0; i < m_spread[j].size(); i++) {
+                m_band.points.push_back(Point2d(scale*m_spread[j][i].first, m_spread[j][i].second));
+            }
+            series.push_back(s_band);
+            series.push_back(m_band);
+        }
+        for (size_t j=0; j < resolution.size(); j++) {
+            double res = lpmm_mode ? resolution[j]*pixel_size : resolution[j];
+            char label[64];
+            sprintf(label, "S %.2lf %s", res, resmode.c_str());
+            Plot_raster::Series s_curve(Plot_raster::LINES, line_bgr[j], linewidth, label);
+            sprintf(label, "M %.2lf %s", res, resmode.c_str());
+            Plot_raster::Series m_curve(Plot_raster::DASHED_LINES, line_bgr[j], linewidth, label);
+            for (size_t i=0; i < s_fitted[j].size(); i++) {
+                s_curve.points.push_back(Point2d(scale*s_fitted[j][i].first, s_fitted[j][i].second));
+            }
+            for (size_t i=0; i < m_fitted[j].size(); i++) {
+                m_curve.points.push_back(Point2d(scale*m_fitted[j][i].first, m_fitted[j][i].second));
+            }
+            series.push_back(s_curve);
+            series.push_back(m_curve);
+        }
+        
+        Plot_raster::Axes axes;
+        axes.xlabel = string("distance (") + (lpmm_mode ? "mm" : "pixels") + ")";
+        axes.ylabel = "contrast";
+        axes.ymin = min(-0.05, lower_limit);
+        axes.ymax = max(1.0, upper_limit);
+        axes.ytic = 0.1;
+        if (fixed_size) {
+            axes.xmin = 0;
+            axes.xmax = sqrt(img.cols*img.cols/4 + img.rows*img.rows/4) / pixel_size;
+        }
+        
+        Plot_raster plot(gnuplot_width, int(gnuplot_width*768.0/1024.0), lrint(12.0*gnuplot_width/1024.0), img_filename);
+        plot.line_plot(Plot_raster::Panel(), series, axes);
+        if (!plot.write(wdir + string("lensprofile.png"))) {
+            logger.error("%s\n", "Failed to write lens profile image");
+        }
+        return;
+    }
+    
     FILE* gpf = fopen( (wdir + string("lensprofile.gnuplot")).c_str(), "wt");
     fprintf(gpf, "set xlab \"distance (%s)\"\n", lpmm_mode ? "mm" : "pixels");
     fprintf(gpf, "set ylab \"contrast\"\n");
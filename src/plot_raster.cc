@@ -0,0 +1,509 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+
+#include "include/plot_raster.h"
+#include "include/image_encoder.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+
+// Moreland's diverging colour map (see also diverging_palette in mtf_renderer_grid.h)
+static const double diverging_stops[33][4] = {
+    {0,       0.2314, 0.2980, 0.7529},
+    {0.03125, 0.2667, 0.3529, 0.8000},
+    {0.0625,  0.3020, 0.4078, 0.8431},
+    {0.09375, 0.3412, 0.4588, 0.8824},
+    {0.125,   0.3843, 0.5098, 0.9176},
+    {0.15625, 0.4235, 0.5569, 0.9451},
+    {0.1875,  0.4667, 0.6039, 0.9686},
+    {0.21875, 0.5098, 0.6471, 0.9843},
+    {0.25,    0.5529, 0.6902, 0.9961},
+    {0.28125, 0.5961, 0.7255, 1.0000},
+    {0.3125,  0.6392, 0.7608, 1.0000},
+    {0.34375, 0.6824, 0.7882, 0.9922},
+    {0.375,   0.7216, 0.8157, 0.9765},
+    {0.40625, 0.7608, 0.8353, 0.9569},
+    {0.4375,  0.8000, 0.8510, 0.9333},
+    {0.46875, 0.8353, 0.8588, 0.9020},
+    {0.5,     0.8667, 0.8667, 0.8667},
+    {0.53125, 0.8980, 0.8471, 0.8196},
+    {0.5625,  0.9255, 0.8275, 0.7725},
+    {0.59375, 0.9451, 0.8000, 0.7255},
+    {0.625,   0.9608, 0.7686, 0.6784},
+    {0.65625, 0.9686, 0.7333, 0.6275},
+    {0.6875,  0.9686, 0.6941, 0.5804},
+    {0.71875, 0.9686, 0.6510, 0.5294},
+    {0.75,    0.9569, 0.6039, 0.4824},
+    {0.78125, 0.9451, 0.5529, 0.4353},
+    {0.8125,  0.9255, 0.4980, 0.3882},
+    {0.84375, 0.8980, 0.4392, 0.3451},
+    {0.875,   0.8706, 0.3765, 0.3020},
+    {0.90625, 0.8353, 0.3137, 0.2588},
+    {0.9375,  0.7961, 0.2431, 0.2196},
+    {0.96875, 0.7529, 0.1569, 0.1843},
+    {1,       0.7059, 0.0157, 0.1490}
+};
+
+static const cv::Scalar black(0, 0, 0);
+static const cv::Scalar grid_grey(240, 240, 240);
+static const cv::Scalar contour_grey(48, 48, 48);
+static const int font_face = cv::FONT_HERSHEY_SIMPLEX;
+
+Plot_raster::Plot_raster(int width, int height, int font_size, const string& title) 
+: canvas(std::max(height, 16), std::max(width, 16), CV_8UC3, cv::Scalar(255, 255, 255)), 
+  font_size(std::max(font_size, 8)), title_height(0) {
+  
+    // FONT_HERSHEY_SIMPLEX glyphs are roughly 22 pixels high at scale 1.0
+    font_scale = this->font_size / 22.0;
+    
+    if (title.length() > 0) {
+        title_height = 2*this->font_size;
+        text(title, cv::Point(canvas.cols/2, lrint(1.4*this->font_size)), 1.15, 0);
+    }
+}
+
+cv::Scalar Plot_raster::palette(double t) {
+    t = std::max(0.0, std::min(1.0, t));
+    int i = 0;
+    while (i < 31 && diverging_stops[i+1][0] < t) {
+        i++;
+    }
+    double w = (t - diverging_stops[i][0]) / (diverging_stops[i+1][0] - diverging_stops[i][0]);
+    double rgb[3];
+    for (int c=0; c < 3; c++) {
+        rgb[c] = 255*((1 - w)*diverging_stops[i][c+1] + w*diverging_stops[i+1][c+1]);
+    }
+    return cv::Scalar(rgb[2], rgb[1], rgb[0]);
+}
+
+cv::Rect Plot_raster::panel_rect(const Panel& panel) const {
+    int avail_h = canvas.rows - title_height;
+    return cv::Rect(
+        lrint(panel.x*canvas.cols), title_height + lrint(panel.y*avail_h),
+        lrint(panel.w*canvas.cols), lrint(panel.h*avail_h)
+    );
+}
+
+cv::Size Plot_raster::text_size(const string& s, double scale) const {
+    int baseline = 0;
+    int thickness = std::max(1, int(lrint(font_size*scale/14.0)));
+    return cv::getTextSize(s, font_face, font_scale*scale, thickness, &baseline);
+}
+
+// halign: -1 -> left aligned at p, 0 -> centred on p, 1 -> right aligned at p; p.y is the text baseline,
+// or the left edge of the text column for vertical text
+void Plot_raster::text(const string& s, cv::Point p, double scale, int halign, bool vertical) {
+    int thickness = std::max(1, int(lrint(font_size*scale/14.0)));
+    cv::Size ts = text_size(s, scale);
+    if (!vertical) {
+        p.x -= halign < 0 ? 0 : (halign == 0 ? ts.width/2 : ts.width);
+        cv::putText(canvas, s, p, font_face, font_scale*scale, black, thickness, cv::LINE_AA);
+        return;
+    }
+    
+    // render horizontally into a scratch image, then rotate it into place
+    cv::Mat scratch(ts.height*2, ts.width + 2, CV_8UC3, cv::Scalar(255, 255, 255));
+    cv::putText(scratch, s, cv::Point(1, lrint(ts.height*1.5)), font_face, font_scale*scale, black, thickness, cv::LINE_AA);
+    cv::Mat rotated;
+    cv::rotate(scratch, rotated, cv::ROTATE_90_COUNTERCLOCKWISE);
+    
+    cv::Rect dest(p.x, p.y - rotated.rows/2, rotated.cols, rotated.rows);
+    cv::Rect clipped = dest & cv::Rect(0, 0, canvas.cols, canvas.rows);
+    if (clipped.area() > 0) {
+        cv::Mat src = rotated(cv::Rect(clipped.x - dest.x, clipped.y - dest.y, clipped.width, clipped.height));
+        cv::Mat dst = canvas(clipped);
+        cv::min(dst, src, dst);
+    }
+}
+
+vector<double> Plot_raster::tics(double lower, double upper, double step) {
+    vector<double> t;
+    if (!(upper > lower)) {
+        return t;
+    }
+    if (step <= 0) {
+        double raw = (upper - lower) / 6.0;
+        double mag = pow(10.0, floor(log10(raw)));
+        double frac = raw / mag;
+        step = (frac < 1.5 ? 1 : (frac < 3.5 ? 2 : (frac < 7.5 ? 5 : 10))) * mag;
+    }
+    for (double v = ceil(lower/step - 1e-9)*step; v <= upper + 1e-9*step; v += step) {
+        t.push_back(fabs(v) < 1e-12*step ? 0 : v);
+    }
+    return t;
+}
+
+string Plot_raster::tic_label(double v, double step) {
+    char buffer[64];
+    int decimals = std::max(0, int(ceil(-log10(step) - 1e-9)));
+    sprintf(buffer, "%.*lf", decimals, v);
+    return string(buffer);
+}
+
+void Plot_raster::line_plot(const Panel& panel, const vector<Series>& series, const Axes& axes) {
+    cv::Rect pr = panel_rect(panel);
+    
+    double xmin = axes.xmin;
+    double xmax = axes.xmax;
+    double ymin = axes.ymin;
+    double ymax = axes.ymax;
+    double dxmin = 1e50, dxmax = -1e50, dymin = 1e50, dymax = -1e50;
+    for (const auto& s: series) {
+        for (const auto& p: s.points) {
+            dxmin = std::min(dxmin, p.x);
+            dxmax = std::max(dxmax, p.x);
+            dymin = std::min(dymin, p.y);
+            dymax = std::max(dymax, p.y);
+        }
+    }
+    if (std::isnan(xmin)) xmin = dxmin;
+    if (std::isnan(xmax)) xmax = dxmax;
+    if (std::isnan(ymin)) ymin = dymin;
+    if (std::isnan(ymax)) ymax = dymax;
+    if (!(xmax > xmin)) { xmin -= 0.5; xmax = xmin + 1; }
+    if (!(ymax > ymin)) { ymin -= 0.5; ymax = ymin + 1; }
+    
+    const int fs = font_size;
+    int top = pr.y + (axes.title.empty() ? fs : lrint(2.5*fs));
+    int left = pr.x + 6*fs;
+    int bottom = pr.y + pr.height - 3*fs;
+    int right = pr.x + pr.width - fs;
+    if (right - left < 16 || bottom - top < 16) {
+        return;
+    }
+    cv::Rect plot(left, top, right - left, bottom - top);
+    
+    auto to_px = [&](const Point2d& p) {
+        return cv::Point(
+            lrint((p.x - xmin)/(xmax - xmin)*plot.width),
+            lrint(plot.height - (p.y - ymin)/(ymax - ymin)*plot.height)
+        );
+    };
+    
+    // grid lines and tic labels
+    vector<double> xt = tics(xmin, xmax);
+    vector<double> yt = tics(ymin, ymax, axes.ytic);
+    double xstep = xt.size() > 1 ? xt[1] - xt[0] : 1;
+    double ystep = yt.size() > 1 ? yt[1] - yt[0] : 1;
+    for (double x: xt) {
+        int px = plot.x + to_px(Point2d(x, ymin)).x;
+        cv::line(canvas, cv::Point(px, plot.y), cv::Point(px, plot.y + plot.height), grid_grey, 1);
+        cv::line(canvas, cv::Point(px, plot.y + plot.height), cv::Point(px, plot.y + plot.height + fs/3), black, 1);
+        text(tic_label(x, xstep), cv::Point(px, plot.y + plot.height + lrint(1.4*fs)), 0.85, 0);
+    }
+    for (double y: yt) {
+        int py = plot.y + to_px(Point2d(xmin, y)).y;
+        cv::line(canvas, cv::Point(plot.x, py), cv::Point(plot.x + plot.width, py), grid_grey, 1);
+        cv::line(canvas, cv::Point(plot.x - fs/3, py), cv::Point(plot.x, py), black, 1);
+        text(tic_label(y, ystep), cv::Point(plot.x - fs/2, py + fs/3), 0.85, 1);
+    }
+    
+    // series are drawn into the plot area only, which clips them
+    cv::Mat roi = canvas(plot);
+    for (const auto& s: series) {
+        int lw = std::max(1, int(lrint(s.line_width)));
+        vector<cv::Point> px;
+        for (const auto& p: s.points) {
+            px.push_back(to_px(p));
+        }
+        switch (s.style) {
+        case FILLED_POLYGON: 
+            if (px.size() > 2) {
+                cv::Mat overlay = roi.clone();
+                const cv::Point* pts = px.data();
+                int npts = px.size();
+                cv::fillPoly(overlay, &pts, &npts, 1, s.colour, cv::LINE_AA);
+                cv::addWeighted(overlay, s.opacity, roi, 1 - s.opacity, 0, roi);
+            }
+            break;
+        case LINES:
+            for (size_t i=1; i < px.size(); i++) {
+                cv::line(roi, px[i-1], px[i], s.colour, lw, cv::LINE_AA);
+            }
+            break;
+        case DASHED_LINES: {
+                double dash = 4*lw + 6;
+                double travelled = 0;
+                for (size_t i=1; i < px.size(); i++) {
+                    Point2d a(px[i-1].x, px[i-1].y);
+                    Point2d d(px[i].x - a.x, px[i].y - a.y);
+                    double len = sqrt(d.x*d.x + d.y*d.y);
+                    for (double l=0; l < len; ) {
+                        double phase = fmod(travelled + l, 2*dash);
+                        double seg = std::min(len - l, phase < dash ? dash - phase : 2*dash - phase);
+                        if (phase < dash) {
+                            Point2d p0 = a + d*(l/len);
+                            Point2d p1 = a + d*((l + seg)/len);
+                            cv::line(roi, cv::Point(lrint(p0.x), lrint(p0.y)), cv::Point(lrint(p1.x), lrint(p1.y)), s.colour, lw, cv::LINE_AA);
+                        }
+                        l += std::max(seg, 1e-3);
+                    }
+                    travelled += len;
+                }
+            }
+            break;
+        case POINTS:
+            for (const auto& p: px) {
+                cv::circle(roi, p, lw, s.colour, -1, cv::LINE_AA);
+            }
+            break;
+        case IMPULSES: {
+                int base = to_px(Point2d(xmin, std::max(ymin, 0.0))).y;
+                for (const auto& p: px) {
+                    cv::line(roi, cv::Point(p.x, base), p, s.colour, lw, cv::LINE_AA);
+                }
+            }
+            break;
+        }
+    }
+    cv::rectangle(canvas, plot, black, 1);
+    
+    // legend
+    int nlabels = 0;
+    for (const auto& s: series) {
+        nlabels += s.label.empty() ? 0 : 1;
+    }
+    int entry = 0;
+    for (const auto& s: series) {
+        if (s.label.empty()) continue;
+        int ly = axes.legend_top ? 
+            plot.y + lrint((entry + 1.2)*1.3*fs) : 
+            plot.y + plot.height - lrint((nlabels - entry - 0.2)*1.3*fs);
+        int lx = axes.legend_top ? plot.x + plot.width - lrint(14*fs) : plot.x + fs;
+        int lw = std::max(1, int(lrint(s.line_width)));
+        if (s.style == POINTS) {
+            cv::circle(canvas, cv::Point(lx + fs, ly - fs/3), lw + 1, s.colour, -1, cv::LINE_AA);
+        } else {
+            cv::line(canvas, cv::Point(lx, ly - fs/3), cv::Point(lx + 2*fs, ly - fs/3), s.colour, lw + 1, cv::LINE_AA);
+        }
+        text(s.label, cv::Point(lx + lrint(2.5*fs), ly), 0.85);
+        entry++;
+    }
+    
+    if (!axes.xlabel.empty()) {
+        text(axes.xlabel, cv::Point(plot.x + plot.width/2, plot.y + plot.height + lrint(2.7*fs)), 1.0, 0);
+    }
+    if (!axes.ylabel.empty()) {
+        text(axes.ylabel, cv::Point(pr.x + fs/4, plot.y + plot.height/2), 1.0, 0, true);
+    }
+    if (!axes.title.empty()) {
+        text(axes.title, cv::Point(plot.x + plot.width/2, pr.y + lrint(1.7*fs)), 1.0, 0);
+    }
+}
+
+void Plot_raster::colour_bar(const cv::Rect& r, double zmin, double zmax) {
+    for (int y=0; y < r.height; y++) {
+        cv::Scalar c = palette(1.0 - y/double(std::max(1, r.height - 1)));
+        cv::line(canvas, cv::Point(r.x, r.y + y), cv::Point(r.x + r.width - 1, r.y + y), c, 1);
+    }
+    cv::rectangle(canvas, r, black, 1);
+    vector<double> zt = tics(zmin, zmax);
+    double zstep = zt.size() > 1 ? zt[1] - zt[0] : 1;
+    for (double z: zt) {
+        int py = r.y + lrint((zmax - z)/(zmax - zmin)*(r.height - 1));
+        cv::line(canvas, cv::Point(r.x + r.width, py), cv::Point(r.x + r.width + font_size/3, py), black, 1);
+        text(tic_label(z, zstep), cv::Point(r.x + r.width + font_size/2, py + font_size/3), 0.85);
+    }
+}
+
+void Plot_raster::heat_map(const Panel& panel, const cv::Mat& values, double x_extent, double y_extent,
+    double zmin, double zmax, const Axes& axes, int contour_levels) {
+    
+    cv::Rect pr = panel_rect(panel);
+    const int fs = font_size;
+    if (!(zmax > zmin)) {
+        zmax = zmin + 1;
+    }
+    
+    int top = pr.y + (axes.title.empty() ? fs : lrint(2.5*fs));
+    int left = pr.x + 6*fs;
+    int avail_w = pr.width - 6*fs - 8*fs; // room for the colour bar and its labels
+    int avail_h = pr.height - (top - pr.y) - 3*fs;
+    if (avail_w < 16 || avail_h < 16 || values.rows < 2 || values.cols < 2) {
+        return;
+    }
+    double aspect = y_extent / x_extent;
+    int plot_w = std::min(double(avail_w), avail_h / aspect);
+    int plot_h = lrint(plot_w * aspect);
+    left += (avail_w - plot_w)/2;
+    top += (avail_h - plot_h)/2;
+    cv::Rect plot(left, top, plot_w, plot_h);
+    
+    cv::Mat resized;
+    cv::resize(values, resized, cv::Size(plot_w, plot_h), 0, 0, cv::INTER_CUBIC);
+    
+    vector<cv::Vec3b> lut(256);
+    for (int i=0; i < 256; i++) {
+        cv::Scalar c = palette(i/255.0);
+        lut[i] = cv::Vec3b(c[0], c[1], c[2]);
+    }
+    
+    cv::Mat level(plot_h, plot_w, CV_32SC1);
+    for (int y=0; y < plot_h; y++) {
+        for (int x=0; x < plot_w; x++) {
+            double t = std::max(0.0, std::min(1.0, (resized.at<float>(y, x) - zmin)/(zmax - zmin)));
+            canvas.at<cv::Vec3b>(plot.y + y, plot.x + x) = lut[lrint(t*255)];
+            level.at<int>(y, x) = std::min(contour_levels - 1, int(floor(t*contour_levels)));
+        }
+    }
+    if (contour_levels > 1) {
+        for (int y=0; y < plot_h - 1; y++) {
+            for (int x=0; x < plot_w - 1; x++) {
+                int l = level.at<int>(y, x);
+                if (l != level.at<int>(y, x+1) || l != level.at<int>(y+1, x)) {
+                    canvas.at<cv::Vec3b>(plot.y + y, plot.x + x) = cv::Vec3b(contour_grey[0], contour_grey[1], contour_grey[2]);
+                }
+            }
+        }
+    }
+    cv::rectangle(canvas, plot, black, 1);
+    
+    // axes: row 0 is at the top
+    vector<double> xt = tics(0, x_extent);
+    vector<double> yt = tics(0, y_extent);
+    double xstep = xt.size() > 1 ? xt[1] - xt[0] : 1;
+    double ystep = yt.size() > 1 ? yt[1] - yt[0] : 1;
+    for (double x: xt) {
+        int px = plot.x + lrint(x/x_extent*(plot_w - 1));
+        cv::line(canvas, cv::Point(px, plot.y + plot_h), cv::Point(px, plot.y + plot_h + fs/3), black, 1);
+        text(tic_label(x, xstep), cv::Point(px, plot.y + plot_h + lrint(1.4*fs)), 0.85, 0);
+    }
+    for (double y: yt) {
+        int py = plot.y + lrint(y/y_extent*(plot_h - 1));
+        cv::line(canvas, cv::Point(plot.x - fs/3, py), cv::Point(plot.x, py), black, 1);
+        text(tic_label(y, ystep), cv::Point(plot.x - fs/2, py + fs/3), 0.85, 1);
+    }
+    
+    colour_bar(cv::Rect(plot.x + plot_w + 2*fs, plot.y, lrint(1.2*fs), plot_h), zmin, zmax);
+    
+    if (!axes.xlabel.empty()) {
+        text(axes.xlabel, cv::Point(plot.x + plot_w/2, plot.y + plot_h + lrint(2.7*fs)), 1.0, 0);
+    }
+    if (!axes.ylabel.empty()) {
+        text(axes.ylabel, cv::Point(pr.x + fs/4, plot.y + plot_h/2), 1.0, 0, true);
+    }
+    if (!axes.title.empty()) {
+        text(axes.title, cv::Point(plot.x + plot_w/2, plot.y - fs), 1.0, 0);
+    }
+}
+
+void Plot_raster::surface(const Panel& panel, const cv::Mat& values, double zmin, double zmax, 
+    const string& title, double elevation, double azimuth) {
+    
+    cv::Rect pr = panel_rect(panel);
+    const int fs = font_size;
+    if (!(zmax > zmin)) {
+        zmax = zmin + 1;
+    }
+    if (values.rows < 2 || values.cols < 2) {
+        return;
+    }
+    
+    // a mesh of at most 48 cells along the longer side is dense enough for display purposes
+    cv::Mat mesh = values;
+    int longest = std::max(values.rows, values.cols);
+    if (longest > 48) {
+        cv::resize(values, mesh, cv::Size(std::max(2, values.cols*48/longest), std::max(2, values.rows*48/longest)), 0, 0, cv::INTER_AREA);
+    }
+    
+    const double aspect = mesh.rows / double(mesh.cols);
+    const double ca = cos(azimuth/180.0*M_PI);
+    const double sa = sin(azimuth/180.0*M_PI);
+    const double ce = cos(elevation/180.0*M_PI);
+    const double se = sin(elevation/180.0*M_PI);
+    
+    // rotate about the z axis, then tilt about the x axis, and project orthographically
+    vector<Point2d> proj(mesh.rows*mesh.cols);
+    vector<double> depth(mesh.rows*mesh.cols);
+    vector<double> tval(mesh.rows*mesh.cols);
+    double pxmin = 1e50, pxmax = -1e50, pymin = 1e50, pymax = -1e50;
+    for (int r=0; r < mesh.rows; r++) {
+        for (int c=0; c < mesh.cols; c++) {
+            double t = std::max(0.0, std::min(1.0, (mesh.at<float>(r, c) - zmin)/(zmax - zmin)));
+            double X = c/double(mesh.cols - 1) - 0.5;
+            double Y = (0.5 - r/double(mesh.rows - 1))*aspect;
+            double Z = 0.6*t;
+            double x1 = X*ca - Y*sa;
+            double y1 = X*sa + Y*ca;
+            size_t idx = r*mesh.cols + c;
+            proj[idx] = Point2d(x1, y1*ce + Z*se);
+            depth[idx] = -y1*se + Z*ce;
+            tval[idx] = t;
+            pxmin = std::min(pxmin, proj[idx].x);
+            pxmax = std::max(pxmax, proj[idx].x);
+            pymin = std::min(pymin, proj[idx].y);
+            pymax = std::max(pymax, proj[idx].y);
+        }
+    }
+    
+    int top = pr.y + (title.empty() ? fs : lrint(2.5*fs));
+    cv::Rect plot(pr.x + fs, top, pr.width - 2*fs, pr.y + pr.height - fs - top);
+    if (plot.width < 16 || plot.height < 16) {
+        return;
+    }
+    double scale = std::min(plot.width/(pxmax - pxmin), plot.height/(pymax - pymin));
+    double ox = plot.x + 0.5*(plot.width - scale*(pxmax - pxmin));
+    double oy = plot.y + 0.5*(plot.height - scale*(pymax - pymin));
+    auto to_px = [&](size_t idx) {
+        return cv::Point(lrint(ox + (proj[idx].x - pxmin)*scale), lrint(oy + (pymax - proj[idx].y)*scale));
+    };
+    
+    // painter's algorithm: draw the cells furthest from the viewer first
+    vector<std::pair<double, size_t>> cells;
+    for (int r=0; r < mesh.rows - 1; r++) {
+        for (int c=0; c < mesh.cols - 1; c++) {
+            size_t i00 = r*mesh.cols + c;
+            double d = depth[i00] + depth[i00+1] + depth[i00+mesh.cols] + depth[i00+mesh.cols+1];
+            cells.push_back(std::make_pair(d, i00));
+        }
+    }
+    sort(cells.begin(), cells.end());
+    
+    for (const auto& cell: cells) {
+        size_t i00 = cell.second;
+        size_t idx[4] = {i00, i00 + 1, i00 + mesh.cols + 1, i00 + mesh.cols};
+        cv::Point quad[4];
+        double t = 0;
+        for (int k=0; k < 4; k++) {
+            quad[k] = to_px(idx[k]);
+            t += 0.25*tval[idx[k]];
+        }
+        cv::fillConvexPoly(canvas, quad, 4, palette(t), cv::LINE_AA);
+        const cv::Point* pts = quad;
+        int npts = 4;
+        cv::polylines(canvas, &pts, &npts, 1, true, contour_grey, 1, cv::LINE_AA);
+    }
+    
+    if (!title.empty()) {
+        text(title, cv::Point(pr.x + pr.width/2, pr.y + lrint(1.7*fs)), 1.0, 0);
+    }
+}
+
+bool Plot_raster::write(const string& fname) const {
+    return Image_encoder::instance().write(fname, canvas);
+}
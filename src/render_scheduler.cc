@@ -0,0 +1,149 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+
+#include "include/logger.h"
+#include "include/render_scheduler.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "include/stage_trace.h"
+
+#include <opencv2/core/core.hpp>
+
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+
+Render_scheduler::Render_scheduler(size_t max_concurrent) 
+: max_concurrent(max_concurrent) {
+
+    if (max_concurrent == 0) {
+        this->max_concurrent = std::max(size_t(2), size_t(std::thread::hardware_concurrency()));
+    }
+}
+
+Render_scheduler::task_id Render_scheduler::add(const string& name, std::function<void(void)> task, 
+    const vector<task_id>& dependencies) {
+    
+    task_id id = tasks.size();
+    tasks.push_back(Task(name, task));
+    for (task_id d: dependencies) {
+        if (d >= id) {
+            throw std::invalid_argument("Render_scheduler: tasks may only depend on previously added tasks");
+        }
+        tasks[d].dependents.push_back(id);
+        tasks[id].pending++;
+    }
+    return id;
+}
+
+size_t Render_scheduler::run(void) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    vector<std::thread> threads;
+    size_t running = 0;
+    size_t completed = 0;
+    size_t failed = 0;
+    
+    // caller must hold the mutex
+    auto finish = [this, &completed, &failed](Task& task) {
+        for (task_id d: task.dependents) {
+            tasks[d].pending--;
+            if (task.failed && tasks[d].failed_dependency.empty()) {
+                tasks[d].failed_dependency = task.name;
+            }
+        }
+        if (task.failed) {
+            failed++;
+        }
+        completed++;
+    };
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    while (completed < tasks.size()) {
+        size_t last_completed = completed;
+        
+        // tasks are started in the order in which they were added; dependents
+        // always follow their dependencies, so skips propagate in one pass
+        for (task_id id=0; id < tasks.size() && running < max_concurrent; id++) {
+            Task& task = tasks[id];
+            if (task.started || task.pending > 0) continue;
+            
+            task.started = true;
+            if (!task.failed_dependency.empty()) {
+                logger.error("Error: renderer %s skipped, since renderer %s failed\n", 
+                    task.name.c_str(), task.failed_dependency.c_str()
+                );
+                task.failed = true;
+                finish(task);
+                continue;
+            }
+            
+            running++;
+            threads.emplace_back([this, id, &mutex, &cv, &running, &finish] {
+                Task& task = tasks[id];
+                auto start = std::chrono::steady_clock::now();
+                bool ok = false;
+                try {
+                    Stage_trace::Scope scope(Stage_trace::intern("render " + task.name), "render");
+                    task.func();
+                    ok = true;
+                } catch (const cv::Exception& e) {
+                    logger.error("Error: renderer %s failed with an OpenCV error (%s)\n", task.name.c_str(), e.what());
+                } catch (const std::exception& e) {
+                    logger.error("Error: renderer %s failed (%s)\n", task.name.c_str(), e.what());
+                } catch (...) {
+                    // an exception escaping the thread would terminate the process
+                    logger.error("Error: renderer %s failed with an unknown exception\n", task.name.c_str());
+                }
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                logger.debug("renderer %s completed in %.3lf s\n", task.name.c_str(), elapsed);
+                
+                {
+                    std::lock_guard<std::mutex> guard(mutex);
+                    task.failed = !ok;
+                    running--;
+                    finish(task);
+                }
+                cv.notify_one();
+            });
+        }
+        
+        // skipped tasks complete without a thread, so only wait if nothing completed during this pass
+        cv.wait(lock, [&completed, last_completed] { return completed != last_completed; });
+    }
+    lock.unlock();
+    
+    for (auto& t: threads) {
+        t.join();
+    }
+    tasks.clear();
+    
+    return failed;
+}
@@ -0,0 +1,208 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#include "include/stage_trace.h"
+#include "include/logger.h"
+#include "include/text_writer.h"
+
+#include <algorithm>
+
+const char* Stage_trace::intern(const string& name) {
+    Stage_trace& trace = instance();
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    return trace.interned.insert(name).first->c_str();
+}
+
+Stage_trace::Thread_buffer& Stage_trace::buffer(void) {
+    // the buffers are owned by the trace, so that events survive short-lived threads
+    thread_local std::shared_ptr<Thread_buffer> local;
+    if (!local) {
+        local = std::make_shared<Thread_buffer>();
+        std::lock_guard<std::mutex> lock(mutex);
+        local->tid = buffers.size() + 1;
+        buffers.push_back(local);
+    }
+    return *local;
+}
+
+void Stage_trace::record(const char* name, const char* category, clock::time_point start, clock::time_point end, size_t peak_bytes) {
+    Thread_buffer& tb = buffer();
+    Event e;
+    e.name = name;
+    e.category = category;
+    e.start_us = std::chrono::duration<double, std::micro>(start - origin).count();
+    e.duration_us = std::chrono::duration<double, std::micro>(end - start).count();
+    e.peak_bytes = peak_bytes;
+    e.depth = --tb.depth;
+    std::lock_guard<std::mutex> lock(tb.mutex);
+    tb.events.push_back(e);
+}
+
+static void put_json_string(Text_writer& out, const char* s) {
+    out.put('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            out.put('\\');
+        }
+        out.put(*s);
+    }
+    out.put('"');
+}
+
+bool Stage_trace::write_chrome_trace(const string& fname) {
+    Text_writer out(fname);
+    if (!out.is_open()) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    out.put("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (const auto& tb: buffers) {
+        std::lock_guard<std::mutex> tb_lock(tb->mutex);
+        if (!tb->name.empty()) {
+            out.put(first ? "" : ",\n");
+            out.printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", int(tb->tid));
+            put_json_string(out, tb->name.c_str());
+            out.put("}}");
+            first = false;
+        }
+        for (const Event& e: tb->events) {
+            out.put(first ? "{\"name\":" : ",\n{\"name\":");
+            put_json_string(out, e.name);
+            out.put(",\"cat\":");
+            put_json_string(out, e.category);
+            out.put(",\"ph\":\"X\",\"pid\":1,\"tid\":").integer(tb->tid);
+            out.put(",\"ts\":").fixed(e.start_us, 3);
+            out.put(",\"dur\":").fixed(e.duration_us, 3);
+            if (e.peak_bytes > 0) {
+                out.put(",\"args\":{\"peak_mb\":").fixed(e.peak_bytes / double(1 << 20), 1).put('}');
+            }
+            out.put('}');
+            first = false;
+        }
+    }
+    out.put("\n],\"otherData\":{\"peak_memory_mb\":").fixed(Memory_tracker::instance().peak() / double(1 << 20), 1);
+    
+    // the counters are summed over all threads
+    std::map<string, int64_t> counters;
+    for (const auto& tb: buffers) {
+        std::lock_guard<std::mutex> tb_lock(tb->mutex);
+        for (const auto& c: tb->counters) {
+            counters[c.first] += c.second;
+        }
+    }
+    for (const auto& c: counters) {
+        out.put(',');
+        put_json_string(out, c.first.c_str());
+        out.put(':').integer(c.second);
+    }
+    out.put("}}\n");
+    
+    return out.close();
+}
+
+void Stage_trace::print_summary(void) {
+    double wall_s = std::chrono::duration<double>(clock::now() - origin).count();
+    
+    std::map<string, Stat> stages;
+    std::map<string, size_t> stage_peaks;
+    std::map<string, int64_t> counters;
+    std::map<string, Stat> samples;
+    vector<std::pair<string, double>> busy;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& tb: buffers) {
+            std::lock_guard<std::mutex> tb_lock(tb->mutex);
+            double busy_s = 0;
+            for (const Event& e: tb->events) {
+                stages[e.name].add(e.duration_us * 1e-3);
+                if (e.peak_bytes > 0) {
+                    stage_peaks[e.name] = std::max(stage_peaks[e.name], e.peak_bytes);
+                }
+                if (e.depth == 0) {
+                    busy_s += e.duration_us * 1e-6;
+                }
+            }
+            for (const auto& c: tb->counters) {
+                counters[c.first] += c.second;
+            }
+            for (const auto& s: tb->samples) {
+                samples[s.first].merge(s.second);
+            }
+            if (busy_s > 0) {
+                string name = tb->name.empty() ? "thread " + std::to_string(tb->tid) : tb->name;
+                busy.push_back(make_pair(name, busy_s));
+            }
+        }
+    }
+    
+    vector<std::pair<string, Stat>> sorted(stages.begin(), stages.end());
+    std::sort(sorted.begin(), sorted.end(), [](const std::pair<string, Stat>& a, const std::pair<string, Stat>& b) {
+        return a.second.sum > b.second.sum;
+    });
+    
+    logger.info("\nStage timing summary (wall time %.3lf s):\n", wall_s);
+    logger.info("%-32s %10s %12s %12s %12s %12s\n", "stage", "calls", "total (s)", "mean (ms)", "max (ms)", "peak (MB)");
+    for (const auto& s: sorted) {
+        auto peak = stage_peaks.find(s.first);
+        if (peak != stage_peaks.end()) {
+            logger.info("%-32s %10ld %12.3lf %12.3lf %12.3lf %12.1lf\n", s.first.c_str(), long(s.second.count), 
+                s.second.sum * 1e-3, s.second.sum / s.second.count, s.second.max_value, peak->second / double(1 << 20)
+            );
+        } else {
+            logger.info("%-32s %10ld %12.3lf %12.3lf %12.3lf %12s\n", s.first.c_str(), long(s.second.count), 
+                s.second.sum * 1e-3, s.second.sum / s.second.count, s.second.max_value, "-"
+            );
+        }
+    }
+    logger.info("Process memory high-water mark: %.1lf MB\n", Memory_tracker::instance().peak() / double(1 << 20));
+    
+    if (!counters.empty()) {
+        logger.info("\n%-48s %10s\n", "counter", "value");
+        for (const auto& c: counters) {
+            logger.info("%-48s %10ld\n", c.first.c_str(), long(c.second));
+        }
+    }
+    
+    if (!samples.empty()) {
+        logger.info("\n%-32s %10s %12s %12s %12s\n", "distribution", "count", "mean", "min", "max");
+        for (const auto& s: samples) {
+            logger.info("%-32s %10ld %12.2lf %12.2lf %12.2lf\n", s.first.c_str(), long(s.second.count), 
+                s.second.sum / s.second.count, s.second.min_value, s.second.max_value
+            );
+        }
+    }
+    
+    if (!busy.empty() && wall_s > 0) {
+        logger.info("\n%-32s %12s %10s\n", "thread", "busy (s)", "busy (%)");
+        for (const auto& b: busy) {
+            logger.info("%-32s %12.3lf %10.1lf\n", b.first.c_str(), b.second, 100*b.second/wall_s);
+        }
+    }
+    logger.info("\n");
+}
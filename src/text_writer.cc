@@ -0,0 +1,161 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#include "include/text_writer.h"
+#include "include/logger.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdarg>
+#include <cstring>
+
+#include "config.h"
+#if mtfmapper_ZLIB_FOUND == 1
+    #include <zlib.h>
+#endif
+
+Text_writer::Text_writer(const string& fname, bool compress, size_t buffer_size)
+  : fname(fname), buffer(std::max(buffer_size, size_t(4*max_number_length))) {
+    
+    if (compress) {
+        #if mtfmapper_ZLIB_FOUND == 1
+        this->fname = fname + ".gz";
+        gzout = gzopen(this->fname.c_str(), "wb6");
+        if (!gzout) {
+            logger.error("Could not open compressed output file %s\n", this->fname.c_str());
+        }
+        return;
+        #else
+        logger.error("Compressed output requested, but zlib support is not available. Writing %s uncompressed\n", fname.c_str());
+        #endif
+    }
+    
+    // text mode, as with the fprintf-based writers, so that line endings match
+    fout = fopen(fname.c_str(), "wt");
+    if (!fout) {
+        logger.error("Could not open output file %s\n", fname.c_str());
+    }
+}
+
+Text_writer::~Text_writer(void) {
+    close();
+}
+
+Text_writer& Text_writer::put(const char* s) {
+    size_t len = strlen(s);
+    while (len > 0) {
+        reserve(std::min(len, buffer.size()));
+        size_t n = std::min(len, buffer.size() - pos);
+        memcpy(buffer.data() + pos, s, n);
+        pos += n;
+        s += n;
+        len -= n;
+    }
+    return *this;
+}
+
+Text_writer& Text_writer::printf(const char* format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    va_list ap_copy;
+    va_copy(ap_copy, ap);
+    int len = vsnprintf(nullptr, 0, format, ap_copy);
+    va_end(ap_copy);
+    
+    if (len > 0) {
+        vector<char> formatted(len + 1);
+        vsnprintf(formatted.data(), formatted.size(), format, ap);
+        put(formatted.data());
+    }
+    va_end(ap);
+    return *this;
+}
+
+void Text_writer::flush(void) {
+    if (pos == 0) {
+        return;
+    }
+    if (fout) {
+        size_t nwritten = fwrite(buffer.data(), 1, pos, fout);
+        failed |= nwritten != pos;
+    }
+    #if mtfmapper_ZLIB_FOUND == 1
+    if (gzout) {
+        int nwritten = gzwrite((gzFile)gzout, buffer.data(), (unsigned int)pos);
+        failed |= nwritten != int(pos);
+    }
+    #endif
+    pos = 0;
+}
+
+bool Text_writer::close(void) {
+    if (!is_open()) {
+        return false;
+    }
+    flush();
+    if (fout) {
+        failed |= fclose(fout) != 0;
+        fout = nullptr;
+    }
+    #if mtfmapper_ZLIB_FOUND == 1
+    if (gzout) {
+        failed |= gzclose((gzFile)gzout) != Z_OK;
+        gzout = nullptr;
+    }
+    #endif
+    if (failed) {
+        logger.error("Error writing to output file %s\n", fname.c_str());
+    }
+    return !failed;
+}
+
+size_t Text_writer::format_fixed(char* out, double val, int precision) {
+    #if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    if (std::isfinite(val)) {
+        auto result = std::to_chars(out, out + max_number_length, val, std::chars_format::fixed, precision);
+        return result.ptr - out;
+    }
+    #endif
+    // non-finite values (and toolchains without floating-point to_chars) take the slow path
+    return snprintf(out, max_number_length, "%.*lf", precision, val);
+}
+
+size_t Text_writer::format_shortest(char* out, double val) {
+    #if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    if (std::isfinite(val)) {
+        auto result = std::to_chars(out, out + max_number_length, val);
+        return result.ptr - out;
+    }
+    #endif
+    return snprintf(out, max_number_length, "%.17lg", val);
+}
+
+size_t Text_writer::format_integer(char* out, int64_t val) {
+    auto result = std::to_chars(out, out + max_number_length, val);
+    return result.ptr - out;
+}
@@ -27,10 +27,12 @@ or implied, of the Council for Scientific and Industrial Research (CSIR).
 */
 #include <math.h>
 
+#include "include/logger.h"
 #include "include/thresholding.h"
 #include "include/common_types.h"
 
 #include <stdint.h>
+#include <algorithm>
 
 // D. Bradley, G. Roth. ACM Journal of Graphics Tools. 2007. Vol 12, No. 2: 13-21.
 //
@@ -103,96 +105,201 @@ void bradley_adaptive_threshold(const cv::Mat& cvimg, cv::Mat& out, double thres
     delete [] integralImg;
 }
 
+static const int min_strip_rows = 64;
+
+size_t sauvola_min_buffer_bytes(int rows, int cols, int S) {
+    const int s2 = S/2;
+    return size_t(std::min(rows, min_strip_rows + 2*s2 + 1)) * size_t(cols) * 2*sizeof(uint64_t);
+}
+
 // Efficient Implementation of Local Adaptive Thresholding Techniques Using Integral Images,
 // F. Shafait, D. Keysers, T.M. Breuel, ...
-void sauvola_adaptive_threshold(const cv::Mat& cvimg, cv::Mat& out, double threshold, int S) {
+void sauvola_adaptive_threshold(const cv::Mat& cvimg, cv::Mat& out, double threshold, int S, size_t max_buffer_bytes) {
     ThreadPool& tp = ThreadPool::instance();
 
     out = cv::Mat(cvimg.rows, cvimg.cols, CV_8UC1);
 
-    uint64_t sum=0;
-    uint64_t sq_sum = 0;
     const int s2 = S/2;
     
-    // create the integral image
-    uint64_t* integralImg = new uint64_t[out.rows*out.cols];
-    uint64_t* sq_integralImg = new uint64_t[out.rows*out.cols];
-    
     uint16_t scale = 0;
-
-    const uint16_t* it1 = cvimg.ptr<uint16_t>(0);
-    // complete first row, then move on to the rest
-    sum = sq_sum = 0;
-    for (int i=0; i < out.cols; i++) {
-        
-        scale = std::max(scale, *it1);
-        sum += uint64_t(*it1);
-        sq_sum += uint64_t(*it1) * uint64_t(*it1);
-        
-        integralImg[i] = sum;
-        sq_integralImg[i] = sq_sum;
-        ++it1;
+    for (int j=0; j < out.rows; j++) {
+        const uint16_t* rowptr = cvimg.ptr<uint16_t>(j);
+        for (int i=0; i < out.cols; i++) {
+            scale = std::max(scale, rowptr[i]);
+        }
     }
+    double dscale = 2.0/double(scale);
     
-    for (int j=1; j < out.rows; j++) {
-        // reset this row sum
-        sum = sq_sum = 0;
-        int index = j * out.cols; 
-
+    // Each strip of output rows needs the integral image rows within s2 of the strip. Since
+    // only differences between integral image rows are used, the integral images of a strip
+    // can start at its first row, which yields exactly the same sums as whole-image integrals.
+    int strip_rows = out.rows;
+    if (max_buffer_bytes > 0) {
+        // the halo rows are part of every strip, so the strip size is what remains after the halo
+        if (max_buffer_bytes < sauvola_min_buffer_bytes(out.rows, out.cols, S)) {
+            logger.error("Warning: thresholding with a %d-pixel window needs %lu MB, more than the %lu MB left within the memory budget\n",
+                S, (unsigned long)(sauvola_min_buffer_bytes(out.rows, out.cols, S) >> 20), (unsigned long)(max_buffer_bytes >> 20)
+            );
+        }
+        int64_t buffer_rows = int64_t(max_buffer_bytes / (2*sizeof(uint64_t)*out.cols));
+        strip_rows = int(std::max(int64_t(min_strip_rows), std::min(int64_t(out.rows), buffer_rows - 2*s2 - 1)));
+    }
+    
+    size_t max_strip_size = size_t(std::min(out.rows, strip_rows + 2*s2 + 1)) * out.cols;
+    uint64_t* integralImg = new uint64_t[max_strip_size];
+    uint64_t* sq_integralImg = new uint64_t[max_strip_size];
+    
+    for (int r0=0; r0 < out.rows; r0 += strip_rows) {
+        const int r1 = std::min(out.rows, r0 + strip_rows);
+        const int base = std::max(0, r0 - s2);
+        const int top = std::min(out.rows - 1, r1 - 1 + s2);
+        
+        uint64_t sum = 0;
+        uint64_t sq_sum = 0;
+        
+        const uint16_t* it1 = cvimg.ptr<uint16_t>(base);
+        // complete first row, then move on to the rest
         for (int i=0; i < out.cols; i++) {
-            
-            scale = std::max(scale, *it1);
             sum += uint64_t(*it1);
             sq_sum += uint64_t(*it1) * uint64_t(*it1);
             
-            integralImg[index] = integralImg[index - out.cols] + sum;
-            sq_integralImg[index] = sq_integralImg[index - out.cols] + sq_sum;
-            
+            integralImg[i] = sum;
+            sq_integralImg[i] = sq_sum;
             ++it1;
-            index++;
+        }
+        
+        for (int j=base+1; j <= top; j++) {
+            // reset this row sum
+            sum = sq_sum = 0;
+            int index = (j - base) * out.cols; 
+            it1 = cvimg.ptr<uint16_t>(j);
+
+            for (int i=0; i < out.cols; i++) {
+                
+                sum += uint64_t(*it1);
+                sq_sum += uint64_t(*it1) * uint64_t(*it1);
+                
+                integralImg[index] = integralImg[index - out.cols] + sum;
+                sq_integralImg[index] = sq_integralImg[index - out.cols] + sq_sum;
+                
+                ++it1;
+                index++;
+            }
+        }
+        
+        vector< std::future<void> > futures;
+        for (size_t block=0; block < tp.size(); block++) {
+            futures.emplace_back( 
+                tp.enqueue( [&, block] {
+                    for (int j=r0 + block; j < r1; j += tp.size()) {
+                        const uint16_t* rowptr = cvimg.ptr<uint16_t>(j);
+                        uint8_t* outptr = out.ptr<uint8_t>(j);
+                        
+                        for (int i=0; i < out.cols; i++) {
+
+                            int x1=i-s2; 
+                            int x2=i+s2;
+                            int y1=j-s2; 
+                            int y2=j+s2;
+
+                            // check the border
+                            x1 = max(0, x1);
+                            x2 = min(x2, out.cols - 1);
+                            y1 = max(0, y1);
+                            y2 = min(y2, out.rows -1);
+
+                            uint64_t count = (x2-x1)*(y2-y1);
+                            
+                            // rows relative to the start of the strip integral images
+                            y1 -= base;
+                            y2 -= base;
+
+                            uint64_t bsum = integralImg[y2*out.cols+x2] -
+                                  integralImg[y1*out.cols+x2] -
+                                  integralImg[y2*out.cols+x1] +
+                                  integralImg[y1*out.cols+x1];
+                                  
+                            uint64_t bsq_sum = sq_integralImg[y2*out.cols+x2] -
+                                     sq_integralImg[y1*out.cols+x2] -
+                                     sq_integralImg[y2*out.cols+x1] +
+                                     sq_integralImg[y1*out.cols+x1];
+                                     
+                            double mean = double(bsum)/count;
+                            double sigma = sqrt(double(bsq_sum)/count - mean*mean);
+                            double t = mean*(1 + threshold*(sigma*dscale - 1));
+                            
+                            outptr[i] = (rowptr[i] < t) ? 0 : 255;
+                        }
+                    }
+                })
+            );
+        }
+        for (size_t i=0; i < futures.size(); i++) {
+            futures[i].wait();
         }
     }
+
+    delete [] integralImg;
+    delete [] sq_integralImg;
+}
+
+//------------------------------------------------------------------------------
+void sauvola_threshold_surface(const cv::Mat& cvimg, cv::Mat& surface, double threshold, int S, double max_val) {
+    ThreadPool& tp = ThreadPool::instance();
+
+    surface = cv::Mat(cvimg.rows, cvimg.cols, CV_32FC1);
+
+    const int s2 = S/2;
+    const int cols = cvimg.cols;
+    const double dscale = 2.0/max_val;
     
-    double dscale = 2.0/double(scale);
+    // the surface is only computed on downsampled images, so whole-image integrals are affordable
+    vector<uint64_t> integralImg(size_t(cvimg.rows)*cols);
+    vector<uint64_t> sq_integralImg(size_t(cvimg.rows)*cols);
+    for (int j=0; j < cvimg.rows; j++) {
+        uint64_t sum = 0;
+        uint64_t sq_sum = 0;
+        const uint16_t* it1 = cvimg.ptr<uint16_t>(j);
+        size_t index = size_t(j)*cols;
+        for (int i=0; i < cols; i++) {
+            sum += uint64_t(it1[i]);
+            sq_sum += uint64_t(it1[i]) * uint64_t(it1[i]);
+            
+            integralImg[index] = (j > 0 ? integralImg[index - cols] : 0) + sum;
+            sq_integralImg[index] = (j > 0 ? sq_integralImg[index - cols] : 0) + sq_sum;
+            index++;
+        }
+    }
     
     vector< std::future<void> > futures;
     for (size_t block=0; block < tp.size(); block++) {
         futures.emplace_back( 
             tp.enqueue( [&, block] {
-                for (int j=block; j < out.rows; j += tp.size()) {
-                    int index_base = j*out.cols;
-                    const uint16_t* rowptr = cvimg.ptr<uint16_t>(0);
+                for (int j=block; j < cvimg.rows; j += tp.size()) {
+                    float* outptr = surface.ptr<float>(j);
                     
-                    for (int i=0; i < out.cols; i++) {
-
-                        int x1=i-s2; 
-                        int x2=i+s2;
-                        int y1=j-s2; 
-                        int y2=j+s2;
-
-                        // check the border
-                        x1 = max(0, x1);
-                        x2 = min(x2, out.cols - 1);
-                        y1 = max(0, y1);
-                        y2 = min(y2, out.rows -1);
+                    for (int i=0; i < cols; i++) {
+                        // same window, border handling and statistics as sauvola_adaptive_threshold()
+                        int x1 = max(0, i-s2);
+                        int x2 = min(i+s2, cols - 1);
+                        int y1 = max(0, j-s2);
+                        int y2 = min(j+s2, cvimg.rows - 1);
 
                         uint64_t count = (x2-x1)*(y2-y1);
 
-                        uint64_t bsum = integralImg[y2*out.cols+x2] -
-                              integralImg[y1*out.cols+x2] -
-                              integralImg[y2*out.cols+x1] +
-                              integralImg[y1*out.cols+x1];
+                        uint64_t bsum = integralImg[y2*cols+x2] -
+                              integralImg[y1*cols+x2] -
+                              integralImg[y2*cols+x1] +
+                              integralImg[y1*cols+x1];
                               
-                        uint64_t bsq_sum = sq_integralImg[y2*out.cols+x2] -
-                                 sq_integralImg[y1*out.cols+x2] -
-                                 sq_integralImg[y2*out.cols+x1] +
-                                 sq_integralImg[y1*out.cols+x1];
+                        uint64_t bsq_sum = sq_integralImg[y2*cols+x2] -
+                                 sq_integralImg[y1*cols+x2] -
+                                 sq_integralImg[y2*cols+x1] +
+                                 sq_integralImg[y1*cols+x1];
                                  
                         double mean = double(bsum)/count;
                         double sigma = sqrt(double(bsq_sum)/count - mean*mean);
-                        double t = mean*(1 + threshold*(sigma*dscale - 1));
-                        
-                        out.data[index_base + i] = (rowptr[index_base + i] < t) ? 0 : 255;
+                        outptr[i] = float(mean*(1 + threshold*(sigma*dscale - 1)));
                     }
                 }
             })
@@ -201,8 +308,92 @@ void sauvola_adaptive_threshold(const cv::Mat& cvimg, cv::Mat& out, double thres
     for (size_t i=0; i < futures.size(); i++) {
         futures[i].wait();
     }
-
-    delete [] integralImg;
-    delete [] sq_integralImg;
 }
 
+//------------------------------------------------------------------------------
+void apply_threshold_surface(const cv::Mat& cvimg, const cv::Mat& surface, int factor, 
+    const std::vector<cv::Rect>& regions, cv::Mat& out) {
+    
+    ThreadPool& tp = ThreadPool::instance();
+    
+    out = cv::Mat(cvimg.rows, cvimg.cols, CV_8UC1, cv::Scalar::all(255));
+    
+    // surface sample positions and bilinear weights of each column and row, with
+    // pixel centres aligned the same way as cv::resize()
+    auto sample_positions = [&](int n, int surface_n, vector<int>& idx, vector<float>& w) {
+        idx.resize(n);
+        w.resize(n);
+        for (int k=0; k < n; k++) {
+            double p = std::min(std::max((k + 0.5)/factor - 0.5, 0.0), double(surface_n - 1));
+            idx[k] = std::min(int(p), std::max(0, surface_n - 2));
+            w[k] = float(p - idx[k]);
+        }
+    };
+    vector<int> col_idx;
+    vector<float> col_w;
+    vector<int> row_idx;
+    vector<float> row_w;
+    sample_positions(cvimg.cols, surface.cols, col_idx, col_w);
+    sample_positions(cvimg.rows, surface.rows, row_idx, row_w);
+    const int next_col = surface.cols > 1 ? 1 : 0;
+    const int next_row = surface.rows > 1 ? 1 : 0;
+    
+    // the column spans of every row covered by the regions, merged so that overlapping
+    // regions are thresholded once, and all rows are processed in a single parallel pass
+    vector< vector< std::pair<int, int> > > spans(cvimg.rows);
+    for (const cv::Rect& unclipped: regions) {
+        const cv::Rect r = unclipped & cv::Rect(0, 0, cvimg.cols, cvimg.rows);
+        for (int j=r.y; j < r.y + r.height && r.width > 0; j++) {
+            spans[j].push_back(std::make_pair(r.x, r.x + r.width));
+        }
+    }
+    vector<int> rows;
+    for (int j=0; j < cvimg.rows; j++) {
+        if (spans[j].empty()) {
+            continue;
+        }
+        vector< std::pair<int, int> >& row_spans = spans[j];
+        std::sort(row_spans.begin(), row_spans.end());
+        size_t merged = 0;
+        for (size_t k=1; k < row_spans.size(); k++) {
+            if (row_spans[k].first <= row_spans[merged].second) {
+                row_spans[merged].second = std::max(row_spans[merged].second, row_spans[k].second);
+            } else {
+                row_spans[++merged] = row_spans[k];
+            }
+        }
+        row_spans.resize(merged + 1);
+        rows.push_back(j);
+    }
+    
+    vector< std::future<void> > futures;
+    for (size_t block=0; block < tp.size(); block++) {
+        futures.emplace_back( 
+            tp.enqueue( [&, block] {
+                for (size_t k=block; k < rows.size(); k += tp.size()) {
+                    const int j = rows[k];
+                    const uint16_t* rowptr = cvimg.ptr<uint16_t>(j);
+                    const float* s0 = surface.ptr<float>(row_idx[j]);
+                    const float* s1 = surface.ptr<float>(row_idx[j] + next_row);
+                    const float wy = row_w[j];
+                    uint8_t* outptr = out.ptr<uint8_t>(j);
+                    
+                    for (const auto& span: spans[j]) {
+                        for (int i=span.first; i < span.second; i++) {
+                            const int c = col_idx[i];
+                            const float wx = col_w[i];
+                            float top = s0[c] + wx*(s0[c + next_col] - s0[c]);
+                            float bottom = s1[c] + wx*(s1[c + next_col] - s1[c]);
+                            float t = top + wy*(bottom - top);
+                            
+                            outptr[i] = (rowptr[i] < t) ? 0 : 255;
+                        }
+                    }
+                }
+            })
+        );
+    }
+    for (size_t i=0; i < futures.size(); i++) {
+        futures[i].wait();
+    }
+}
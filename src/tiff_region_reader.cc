@@ -0,0 +1,396 @@
+/*
+Copyright 2026 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+#include "include/tiff_region_reader.h"
+#include "include/logger.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#ifdef _WIN32
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+namespace {
+    enum {
+        TAG_IMAGE_WIDTH = 256,
+        TAG_IMAGE_LENGTH = 257,
+        TAG_BITS_PER_SAMPLE = 258,
+        TAG_COMPRESSION = 259,
+        TAG_PHOTOMETRIC = 262,
+        TAG_STRIP_OFFSETS = 273,
+        TAG_SAMPLES_PER_PIXEL = 277,
+        TAG_ROWS_PER_STRIP = 278,
+        TAG_STRIP_BYTE_COUNTS = 279,
+        TAG_PLANAR_CONFIG = 284,
+        TAG_TILE_WIDTH = 322,
+        TAG_TILE_LENGTH = 323,
+        TAG_TILE_OFFSETS = 324,
+        TAG_TILE_BYTE_COUNTS = 325,
+        TAG_SAMPLE_FORMAT = 339
+    };
+    
+    enum {
+        TYPE_SHORT = 3,
+        TYPE_LONG = 4
+    };
+    
+    bool host_is_big_endian(void) {
+        const uint16_t probe = 1;
+        return *(const unsigned char*)&probe == 0;
+    }
+}
+
+Tiff_region_reader::Tiff_region_reader(const string& fname) {
+    if (!map_file(fname)) {
+        return;
+    }
+    valid = parse();
+    if (!valid) {
+        unmap_file();
+    }
+}
+
+Tiff_region_reader::~Tiff_region_reader(void) {
+    unmap_file();
+}
+
+bool Tiff_region_reader::map_file(const string& fname) {
+    #ifdef _WIN32
+    HANDLE fh = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fh == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fsize;
+    if (!GetFileSizeEx(fh, &fsize) || fsize.QuadPart == 0) {
+        CloseHandle(fh);
+        return false;
+    }
+    HANDLE mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mh) {
+        CloseHandle(fh);
+        return false;
+    }
+    mapped = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+    if (!mapped) {
+        CloseHandle(mh);
+        CloseHandle(fh);
+        return false;
+    }
+    file_handle = fh;
+    map_handle = mh;
+    length = size_t(fsize.QuadPart);
+    #else
+    int fd = ::open(fname.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    mapped = p;
+    length = size_t(st.st_size);
+    #endif
+    base = (const char*)mapped;
+    return true;
+}
+
+void Tiff_region_reader::unmap_file(void) {
+    if (!mapped) {
+        return;
+    }
+    #ifdef _WIN32
+    UnmapViewOfFile(mapped);
+    CloseHandle((HANDLE)map_handle);
+    CloseHandle((HANDLE)file_handle);
+    map_handle = nullptr;
+    file_handle = nullptr;
+    #else
+    munmap(mapped, length);
+    #endif
+    mapped = nullptr;
+    base = nullptr;
+    length = 0;
+}
+
+uint16_t Tiff_region_reader::get_uint16(size_t offset) const {
+    const unsigned char* b = (const unsigned char*)base + offset;
+    if (big_endian) {
+        return (uint16_t(b[0]) << 8) | uint16_t(b[1]);
+    }
+    return (uint16_t(b[1]) << 8) | uint16_t(b[0]);
+}
+
+uint32_t Tiff_region_reader::get_uint32(size_t offset) const {
+    const unsigned char* b = (const unsigned char*)base + offset;
+    if (big_endian) {
+        return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+    }
+    return (uint32_t(b[3]) << 24) | (uint32_t(b[2]) << 16) | (uint32_t(b[1]) << 8) | uint32_t(b[0]);
+}
+
+bool Tiff_region_reader::field_value(size_t entry, uint32_t idx, uint32_t& value) const {
+    uint16_t type = get_uint16(entry + 2);
+    uint32_t count = get_uint32(entry + 4);
+    if (idx >= count || (type != TYPE_SHORT && type != TYPE_LONG)) {
+        return false;
+    }
+    size_t elem_size = type == TYPE_SHORT ? 2 : 4;
+    size_t pos = entry + 8; // values that fit into 4 bytes are stored in the entry itself
+    if (count*elem_size > 4) {
+        pos = get_uint32(entry + 8);
+    }
+    pos += idx*elem_size;
+    if (pos + elem_size > length) {
+        return false;
+    }
+    value = type == TYPE_SHORT ? get_uint16(pos) : get_uint32(pos);
+    return true;
+}
+
+bool Tiff_region_reader::field_values(size_t entry, vector<uint64_t>& values) const {
+    uint32_t count = get_uint32(entry + 4);
+    if (count == 0 || count > length) {
+        return false;
+    }
+    values.resize(count);
+    for (uint32_t i=0; i < count; i++) {
+        uint32_t v = 0;
+        if (!field_value(entry, i, v)) {
+            return false;
+        }
+        values[i] = v;
+    }
+    return true;
+}
+
+bool Tiff_region_reader::parse(void) {
+    if (length < 8) {
+        return false;
+    }
+    if (memcmp(base, "II", 2) == 0) {
+        big_endian = false;
+    } else if (memcmp(base, "MM", 2) == 0) {
+        big_endian = true;
+    } else {
+        return false;
+    }
+    if (get_uint16(2) != 42) { // BigTIFF and the raw format variants are left to the usual decoders
+        return false;
+    }
+    
+    size_t ifd = get_uint32(4);
+    if (ifd + 2 > length) {
+        return false;
+    }
+    uint16_t entries = get_uint16(ifd);
+    if (ifd + 2 + size_t(entries)*12 > length) {
+        return false;
+    }
+    
+    uint32_t compression = 1;
+    uint32_t photometric = 0xffff;
+    uint32_t planar_config = 1;
+    uint32_t sample_format = 1;
+    uint32_t value = 0;
+    for (uint16_t i=0; i < entries; i++) {
+        size_t entry = ifd + 2 + size_t(i)*12;
+        switch (get_uint16(entry)) {
+        case TAG_IMAGE_WIDTH: if (field_value(entry, 0, value)) width = int(value); break;
+        case TAG_IMAGE_LENGTH: if (field_value(entry, 0, value)) height = int(value); break;
+        case TAG_BITS_PER_SAMPLE: 
+            // all channels must have the same depth
+            for (uint32_t s=0; field_value(entry, s, value); s++) {
+                if (s > 0 && int(value) != bits_per_sample) {
+                    return false;
+                }
+                bits_per_sample = int(value);
+            }
+            break;
+        case TAG_COMPRESSION: field_value(entry, 0, compression); break;
+        case TAG_PHOTOMETRIC: field_value(entry, 0, photometric); break;
+        case TAG_SAMPLES_PER_PIXEL: if (field_value(entry, 0, value)) samples_per_pixel = int(value); break;
+        case TAG_ROWS_PER_STRIP: if (field_value(entry, 0, value)) rows_per_strip = int(std::min(value, uint32_t(1 << 30))); break;
+        case TAG_PLANAR_CONFIG: field_value(entry, 0, planar_config); break;
+        case TAG_SAMPLE_FORMAT: field_value(entry, 0, sample_format); break;
+        case TAG_TILE_WIDTH: if (field_value(entry, 0, value)) tile_width = int(value); tiled = true; break;
+        case TAG_TILE_LENGTH: if (field_value(entry, 0, value)) tile_height = int(value); tiled = true; break;
+        case TAG_STRIP_OFFSETS:
+        case TAG_TILE_OFFSETS:
+            if (!field_values(entry, offsets)) {
+                return false;
+            }
+            break;
+        case TAG_STRIP_BYTE_COUNTS:
+        case TAG_TILE_BYTE_COUNTS:
+            if (!field_values(entry, byte_counts)) {
+                return false;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    
+    if (compression != 1 || planar_config != 1 || sample_format != 1) {
+        return false;
+    }
+    if (!(bits_per_sample == 8 || bits_per_sample == 16)) {
+        return false;
+    }
+    if (!((samples_per_pixel == 1 && photometric == 1) || 
+          ((samples_per_pixel == 3 || samples_per_pixel == 4) && photometric == 2))) {
+        return false;
+    }
+    if (width <= 0 || height <= 0 || offsets.empty() || offsets.size() != byte_counts.size()) {
+        return false;
+    }
+    
+    const size_t pixel_bytes = size_t(samples_per_pixel)*(bits_per_sample/8);
+    size_t block_bytes = 0;
+    size_t blocks = 0;
+    if (tiled) {
+        if (tile_width <= 0 || tile_height <= 0) {
+            return false;
+        }
+        size_t across = (size_t(width) + tile_width - 1) / tile_width;
+        size_t down = (size_t(height) + tile_height - 1) / tile_height;
+        blocks = across*down;
+        block_bytes = size_t(tile_width)*tile_height*pixel_bytes;
+    } else {
+        if (rows_per_strip <= 0 || rows_per_strip > height) {
+            rows_per_strip = height;
+        }
+        blocks = (size_t(height) + rows_per_strip - 1) / rows_per_strip;
+        block_bytes = size_t(rows_per_strip)*width*pixel_bytes;
+    }
+    if (offsets.size() < blocks) {
+        return false;
+    }
+    
+    // every block that read() can visit must be fully present, so that read() never has 
+    // to check bounds; surplus offsets are ignored
+    // (the last strip may be shorter than rows_per_strip)
+    for (size_t b=0; b < blocks; b++) {
+        size_t expected = block_bytes;
+        if (!tiled && b == blocks - 1) {
+            expected = size_t(height - int(b)*rows_per_strip)*width*pixel_bytes;
+        }
+        if (byte_counts[b] < expected || offsets[b] + expected > length) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+void Tiff_region_reader::copy_block(const cv::Rect& region, const char* block, int col0, int row0, int cols, int row1, size_t row_bytes, cv::Mat& out) const {
+    const size_t pixel_bytes = out.elemSize();
+    int c_start = std::max(region.x, col0);
+    int c_end = std::min(region.x + region.width, col0 + cols);
+    int r_start = std::max(region.y, row0);
+    int r_end = std::min(region.y + region.height, row1);
+    if (c_start >= c_end || r_start >= r_end) {
+        return;
+    }
+    for (int row=r_start; row < r_end; row++) {
+        const char* src = block + size_t(row - row0)*row_bytes + size_t(c_start - col0)*pixel_bytes;
+        memcpy(out.ptr(row - region.y, c_start - region.x), src, size_t(c_end - c_start)*pixel_bytes);
+    }
+}
+
+bool Tiff_region_reader::read(const cv::Rect& region, cv::Mat& out) const {
+    if (!valid || region.area() <= 0 || (region & cv::Rect(0, 0, width, height)) != region) {
+        return false;
+    }
+    
+    const int depth = bits_per_sample == 8 ? CV_8U : CV_16U;
+    out.create(region.height, region.width, CV_MAKETYPE(depth, samples_per_pixel));
+    const size_t pixel_bytes = out.elemSize();
+    
+    if (tiled) {
+        const size_t row_bytes = size_t(tile_width)*pixel_bytes;
+        int across = (width + tile_width - 1) / tile_width;
+        for (int ty=region.y / tile_height; ty*tile_height < region.y + region.height; ty++) {
+            for (int tx=region.x / tile_width; tx*tile_width < region.x + region.width; tx++) {
+                int row0 = ty*tile_height;
+                copy_block(
+                    region, base + offsets[size_t(ty)*across + tx], tx*tile_width, row0, 
+                    tile_width, std::min(row0 + tile_height, height), row_bytes, out
+                );
+            }
+        }
+    } else {
+        const size_t row_bytes = size_t(width)*pixel_bytes;
+        for (int s=region.y / rows_per_strip; s*rows_per_strip < region.y + region.height; s++) {
+            int row0 = s*rows_per_strip;
+            copy_block(
+                region, base + offsets[s], 0, row0, 
+                width, std::min(row0 + rows_per_strip, height), row_bytes, out
+            );
+        }
+    }
+    
+    if (depth == CV_16U && big_endian != host_is_big_endian()) {
+        for (int row=0; row < out.rows; row++) {
+            uint16_t* p = out.ptr<uint16_t>(row);
+            for (int i=0; i < out.cols*out.channels(); i++) {
+                p[i] = uint16_t((p[i] << 8) | (p[i] >> 8));
+            }
+        }
+    }
+    
+    // match the channel order produced by cv::imread
+    if (samples_per_pixel == 3) {
+        cv::cvtColor(out, out, cv::COLOR_RGB2BGR);
+    } else if (samples_per_pixel == 4) {
+        cv::cvtColor(out, out, cv::COLOR_RGBA2BGRA);
+    }
+    
+    logger.debug("Decoded %dx%d region at (%d, %d) from a %dx%d %s TIFF\n", 
+        region.width, region.height, region.x, region.y, width, height, tiled ? "tiled" : "stripped"
+    );
+    
+    return true;
+}
@@ -77,11 +77,21 @@ Tiffsniff::Tiffsniff(const string& fname, bool is_8bit) {
                         }
                     }
                     
+                    // the EXIF block is always read for its metadata, but it only
+                    // determines the colour space if there is no ICC block
                     bool exif_found = false;
-                    if (!icc_found) { // no ICC block, settle for EXIF
-                        for (size_t i=0; i < blocks.size() && !exif_found; i++) {
-                            if (blocks[i].first == jpeg_app_t::EXIF) {
-                                exif_found = true;
+                    for (size_t i=0; i < blocks.size() && !exif_found; i++) {
+                        if (blocks[i].first == jpeg_app_t::EXIF) {
+                            exif_found = true;
+                            if (icc_found) {
+                                collect_colour = false;
+                                try {
+                                    parse_tiff(blocks[i].second);
+                                } catch (int) {
+                                    logger.debug("%s\n", "Unable to parse the EXIF block of a JPEG file with an ICC profile.");
+                                }
+                                collect_colour = true;
+                            } else {
                                 parse_tiff(blocks[i].second);
                             }
                         }
@@ -98,6 +108,13 @@ Tiffsniff::Tiffsniff(const string& fname, bool is_8bit) {
         }
     }
     
+    if (meta.found()) {
+        logger.debug("EXIF metadata: make=[%s], model=[%s], focal length=%.1lf mm (35 mm equiv. %.0lf mm), f-number=%.1lf, pixel pitch=%.3lf micron\n",
+            meta.make.c_str(), meta.model.c_str(), meta.focal_length, meta.focal_length_35mm, 
+            meta.f_number, meta.pixel_pitch()
+        );
+    }
+    
     if (inferred_profile == profile_t::UNKNOWN) {
         logger.debug("No ICC profile found, attempting to infer profile from Exif information, Exif CS: %d\n", exif_cs);
         if (exif_cs < 0) {
@@ -166,6 +183,11 @@ void Tiffsniff::parse_tiff(off_t offset) {
     if (fin->seekg(offset).good()) {
         const char be_id[4] = {0x4D, 0x4D, 0x00, 0x2A};
         const char le_id[4] = {0x49, 0x49, 0x2A, 0x00};
+        // raw formats that use the TIFF structure, but with a different magic number
+        const char orf_be_id[4] = {0x4D, 0x4D, 0x4F, 0x52}; // Olympus ORF
+        const char orf_le_id[4] = {0x49, 0x49, 0x52, 0x4F};
+        const char ors_le_id[4] = {0x49, 0x49, 0x53, 0x52};
+        const char rw2_le_id[4] = {0x49, 0x49, 0x55, 0x00}; // Panasonic RW2
         
         unsigned char magic[4];
         
@@ -189,6 +211,17 @@ void Tiffsniff::parse_tiff(off_t offset) {
                 is_valid_tiff = true;
                 big_endian = true;
             }
+            if (memcmp(orf_le_id, magic, 4) == 0 || memcmp(ors_le_id, magic, 4) == 0 || 
+                memcmp(rw2_le_id, magic, 4) == 0) {
+                
+                logger.debug("%s\n", "Little endian TIFF-based raw file detected.");
+                is_valid_tiff = true;
+            }
+            if (memcmp(orf_be_id, magic, 4) == 0) {
+                logger.debug("%s\n", "Big endian TIFF-based raw file detected.");
+                is_valid_tiff = true;
+                big_endian = true;
+            }
             
             if (is_valid_tiff) {
                 uint32_t ifd_offset = read_uint32();
@@ -212,6 +245,12 @@ void Tiffsniff::read_ifd(off_t offset, off_t base_offset, ifd_t ifd_type) {
             throw -1;
         }
         
+        // image dimensions are only meaningful in a TIFF file, not in an embedded EXIF block
+        bool image_ifd = (ifd_type == ifd_t::TIFF || ifd_type == ifd_t::SUBIFD) && base_offset == 0;
+        uint32_t ifd_width = 0;
+        uint32_t ifd_height = 0;
+        uint32_t subfile_type = 0;
+        
         tiff_field field;
         for (uint16_t i=0; i < cur_ifd_entries; i++) {
             field.tag_id = read_uint16();
@@ -226,7 +265,7 @@ void Tiffsniff::read_ifd(off_t offset, off_t base_offset, ifd_t ifd_type) {
             
             auto fpos = fin->tellg();
             
-            if (ifd_type == ifd_t::TIFF && field.tag_id == 0x8773) { // ICC profile 
+            if (collect_colour && ifd_type == ifd_t::TIFF && field.tag_id == 0x8773) { // ICC profile 
                 read_icc_profile(field.data_offset);
             }
             
@@ -234,13 +273,48 @@ void Tiffsniff::read_ifd(off_t offset, off_t base_offset, ifd_t ifd_type) {
                 read_ifd(base_offset + field.data_offset, base_offset, ifd_t::EXIF);
             }
             
-            if (ifd_type == ifd_t::EXIF && field.tag_id == 0xa001) { // EXIF colourspace tag
+            if (image_ifd) {
+                switch (field.tag_id) {
+                case 0x00fe: subfile_type = read_integer_field(field); break; // NewSubfileType
+                case 0x0100: ifd_width = read_integer_field(field); break;
+                case 0x0101: ifd_height = read_integer_field(field); break;
+                default: break;
+                }
+                fin->seekg(fpos);
+            }
+            
+            // raw formats such as DNG and NEF keep a thumbnail in IFD0, and the full-resolution image in a SubIFD
+            if (image_ifd && ifd_type == ifd_t::TIFF && field.tag_id == 0x014a && field.data_count > 0 && field.data_count <= 8) {
+                vector<uint32_t> subifd_offsets;
+                if (field.data_count == 1) {
+                    subifd_offsets.push_back(field.data_offset);
+                } else if (fin->seekg(base_offset + field.data_offset).good()) {
+                    for (uint32_t k=0; k < field.data_count; k++) {
+                        subifd_offsets.push_back(read_uint32());
+                    }
+                }
+                for (uint32_t subifd_offset: subifd_offsets) {
+                    if (subifd_offset == 0 || subifd_offset > file_size || !fin->good()) {
+                        break;
+                    }
+                    try {
+                        read_ifd(base_offset + subifd_offset, base_offset, ifd_t::SUBIFD);
+                    } catch (int) {
+                        // a malformed SubIFD only costs us the image dimensions
+                        fin->clear();
+                    }
+                }
+                fin->clear();
+                fin->seekg(fpos);
+            }
+            
+            if (collect_colour && ifd_type == ifd_t::EXIF && field.tag_id == 0xa001) { // EXIF colourspace tag
                 if (fin->seekg(-4, fin->cur).good()) {
                     exif_cs = read_uint16();
                 }
             }
             
-            if (ifd_type == ifd_t::EXIF && field.tag_id == 0xa500) { // EXIF gamma tag
+            if (collect_colour && ifd_type == ifd_t::EXIF && field.tag_id == 0xa500) { // EXIF gamma tag
                 double gamma = read_exif_gamma(base_offset + field.data_offset);
                 gparm[0] = gamma;
                 exif_gamma_found = true;
@@ -250,7 +324,7 @@ void Tiffsniff::read_ifd(off_t offset, off_t base_offset, ifd_t ifd_type) {
                 read_ifd(base_offset + field.data_offset, base_offset, ifd_t::EXIF_INTEROP);
             }
             
-            if (ifd_type == ifd_t::EXIF_INTEROP && field.tag_id == 0x0001) { // EXIF interoperability tag
+            if (collect_colour && ifd_type == ifd_t::EXIF_INTEROP && field.tag_id == 0x0001) { // EXIF interoperability tag
                 char ids[4];
                 if (fin->seekg(-4, fin->cur).good() && fin->read((char*)ids, 4).good()) {
                     exif_interop_r03 = strncmp(ids, "R03", 3) == 0;
@@ -258,6 +332,18 @@ void Tiffsniff::read_ifd(off_t offset, off_t base_offset, ifd_t ifd_type) {
             }
             
             fin->seekg(fpos);
+            read_metadata_field(field, base_offset, ifd_type);
+            fin->seekg(fpos);
+        }
+        
+        if (ifd_type == ifd_t::TIFF) {
+            primary_ifd_done = true;
+        }
+        
+        // the largest full-resolution (not reduced, bit 0 of NewSubfileType) image
+        if (image_ifd && (subfile_type & 1) == 0 && int(ifd_width) > meta.full_width) {
+            meta.full_width = int(ifd_width);
+            meta.full_height = int(ifd_height);
         }
         
         // read next IDF offset
@@ -266,13 +352,166 @@ void Tiffsniff::read_ifd(off_t offset, off_t base_offset, ifd_t ifd_type) {
             if (next_offset > file_size || !fin->good()) {
                 throw -1;
             }
-            read_ifd(base_offset + next_offset, base_offset, ifd_t::TIFF);
+            read_ifd(base_offset + next_offset, base_offset, ifd_type == ifd_t::SUBIFD ? ifd_t::SUBIFD : ifd_t::TIFF);
         }
     } else {
         throw -1;
     }
 }
 
+static string trim_ascii(const string& s) {
+    string t = s.substr(0, s.find('\0'));
+    while (!t.empty() && isspace((unsigned char)t.back())) {
+        t.pop_back();
+    }
+    return t;
+}
+
+// expects the stream to be positioned just after the field entry
+void Tiffsniff::read_metadata_field(const tiff_field& field, off_t base_offset, ifd_t ifd_type) {
+    if (ifd_type != ifd_t::TIFF && ifd_type != ifd_t::EXIF) {
+        return;
+    }
+    
+    if (ifd_type == ifd_t::TIFF && !primary_ifd_done) {
+        switch (field.tag_id) {
+        case 0x010f: meta.make = trim_ascii(read_ascii_field(field, base_offset)); break;
+        case 0x0110: meta.model = trim_ascii(read_ascii_field(field, base_offset)); break;
+        default: break;
+        }
+    }
+    
+    // TIFF/EP files (and some raw formats) store these in IFD0 rather
+    // than the EXIF IFD, so the first occurrence of each tag is kept
+    switch (field.tag_id) {
+    case 0x920a: // FocalLength
+        if (meta.focal_length <= 0) {
+            meta.focal_length = read_rational_field(field, base_offset);
+        }
+        break;
+    case 0x829d: // FNumber
+        if (meta.f_number <= 0) {
+            meta.f_number = read_rational_field(field, base_offset);
+        }
+        break;
+    case 0xa405: // FocalLengthIn35mmFilm, zero means unknown
+        if (meta.focal_length_35mm <= 0) {
+            uint32_t f35 = read_integer_field(field);
+            meta.focal_length_35mm = f35 > 0 ? double(f35) : -1;
+        }
+        break;
+    case 0xa20e: // FocalPlaneXResolution
+    case 0x920e: // TIFF/EP equivalent
+        if (meta.focal_plane_x_res <= 0) {
+            meta.focal_plane_x_res = read_rational_field(field, base_offset);
+        }
+        break;
+    case 0xa20f: // FocalPlaneYResolution
+    case 0x920f:
+        if (meta.focal_plane_y_res <= 0) {
+            meta.focal_plane_y_res = read_rational_field(field, base_offset);
+        }
+        break;
+    case 0xa210: // FocalPlaneResolutionUnit
+    case 0x9210:
+        meta.focal_plane_res_unit = read_integer_field(field);
+        break;
+    case 0xa002: // PixelXDimension
+        if (meta.pixel_x_dimension <= 0) {
+            meta.pixel_x_dimension = read_integer_field(field);
+        }
+        break;
+    case 0xa003: // PixelYDimension
+        if (meta.pixel_y_dimension <= 0) {
+            meta.pixel_y_dimension = read_integer_field(field);
+        }
+        break;
+    case 0x9286: // UserComment, which starts with an 8-byte character code
+        if (meta.user_comment.empty() && field.data_count > 8) {
+            string raw = read_ascii_field(field, base_offset);
+            if (raw.size() > 8) {
+                string text;
+                if (raw.compare(0, 7, "UNICODE") == 0) {
+                    // UCS-2; keep only the ASCII subset
+                    for (size_t i=8; i < raw.size(); i++) {
+                        if (raw[i] != 0 && (unsigned char)raw[i] < 128) {
+                            text.push_back(raw[i]);
+                        }
+                    }
+                } else {
+                    text = raw.substr(8);
+                }
+                meta.user_comment = trim_ascii(text);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+string Tiffsniff::read_ascii_field(const tiff_field& field, off_t base_offset) {
+    if (field.data_count == 0 || field.data_count > 65535) {
+        return string();
+    }
+    if (field.data_count <= 4) {
+        fin->seekg(-4, fin->cur);
+    } else {
+        fin->seekg(base_offset + field.data_offset);
+    }
+    string s(field.data_count, '\0');
+    if (!fin->read(&s[0], field.data_count).good()) {
+        fin->clear();
+        return string();
+    }
+    return s;
+}
+
+double Tiffsniff::read_rational_field(const tiff_field& field, off_t base_offset) {
+    if (field.data_type != 5 && field.data_type != 10) { // RATIONAL or SRATIONAL
+        return -1;
+    }
+    if (!fin->seekg(base_offset + field.data_offset).good()) {
+        fin->clear();
+        return -1;
+    }
+    uint32_t num = read_uint32();
+    uint32_t den = read_uint32();
+    if (!fin->good() || den == 0) {
+        fin->clear();
+        return -1;
+    }
+    if (field.data_type == 10) {
+        return double(int32_t(num)) / double(int32_t(den));
+    }
+    return double(num) / double(den);
+}
+
+uint32_t Tiffsniff::read_integer_field(const tiff_field& field) {
+    switch (field.data_type) {
+    case 1: // BYTE
+        if (fin->seekg(-4, fin->cur).good()) {
+            int b = fin->get();
+            return b >= 0 ? uint32_t(b) : 0;
+        }
+        break;
+    case 3: // SHORT
+        if (fin->seekg(-4, fin->cur).good()) {
+            uint16_t v = read_uint16();
+            if (fin->good()) {
+                return v;
+            }
+        }
+        break;
+    case 4: // LONG
+        return field.data_offset;
+    default:
+        break;
+    }
+    fin->clear();
+    return 0;
+}
+
 void Tiffsniff::read_icc_profile(off_t offset) {
     char icc_header[128];
     if (fin->seekg(offset).good()) {
@@ -0,0 +1,123 @@
+#!/bin/bash
+#
+# End-to-end benchmark of mtf_mapper on deterministic synthetic images generated by
+# mtf_generate_rectangle (fixed noise seed), at several resolutions. Reports the median
+# wall time, edges/s and MP/s, and checks the mean measured MTF50 against the MTF50
+# reported by the generator; the exit code is 2 if the accuracy check fails.
+#
+# usage: macro_benchmark.sh <directory with mtf_mapper binaries> <work directory> [json|csv]
+#
+# Environment variables MACRO_SIZES (rectangle image sizes), MACRO_GRIDS (grid chart
+# sizes, in squares per row), MACRO_REPS and MACRO_TOLERANCE override the defaults below.
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <bin dir> <work dir> [json|csv]"
+    exit 1
+fi
+
+BIN=$1
+WORK=$2
+FORMAT=${3:-json}
+SIZES=${MACRO_SIZES-"1000 2000 4000"}
+GRIDS=${MACRO_GRIDS-"10 20"}
+REPS=${MACRO_REPS:-3}
+TOLERANCE=${MACRO_TOLERANCE:-0.03}
+SEED=10
+
+mkdir -p "$WORK" || exit 1
+
+# writes a grid of n x round(2n/3) squares, rotated by 5 degrees, in the --target-poly format
+write_grid() {
+    awk -v n=$1 'BEGIN {
+        pitch = 200; half = 50; theta = 5/180*3.14159265358979;
+        rows = int(2*n/3 + 0.5);
+        for (r=0; r < rows; r++) {
+            for (c=0; c < n; c++) {
+                cx = (c + 0.5)*pitch; cy = (r + 0.5)*pitch;
+                print 4;
+                for (k=0; k < 4; k++) {
+                    a = theta + (k + 0.5)*3.14159265358979/2;
+                    printf "%.6f %.6f\n", cx + half*sqrt(2)*cos(a), cy + half*sqrt(2)*sin(a);
+                }
+            }
+        }
+    }' > "$2"
+}
+
+# generated images are reused between runs, since they only depend on the (fixed) arguments
+generate() {
+    local name=$1
+    shift
+    if [ ! -f "$WORK/$name.png" ] || [ ! -f "$WORK/$name.txt" ]; then
+        "$BIN/mtf_generate_rectangle" "$@" -s $SEED -l --b16 -o "$WORK/$name.png" > "$WORK/$name.txt" || exit 1
+    fi
+}
+
+# prints "width height expected_mtf50" for a generated image
+image_info() {
+    awk '/dimension:/ { split($NF, d, "x"); w = d[1]; h = d[2] }
+         /setting image dimensions to:/ { w = $(NF-1); sub(",", "", w); h = $NF }
+         $1 ~ /MTF50/ { m = $3 }
+         END { print w, h, m }' "$WORK/$1.txt"
+}
+
+FIRST=1
+emit() { # name width height median_s edges expected measured
+    awk -v name=$1 -v w=$2 -v h=$3 -v t=$4 -v edges=$5 -v expected=$6 -v measured=$7 \
+        -v format=$FORMAT -v first=$FIRST -v tol=$TOLERANCE 'BEGIN {
+        mp = w*h/1e6;
+        rel = expected > 0 ? (measured - expected)/expected : 0;
+        if (format == "csv") {
+            if (first) print "benchmark,megapixels,reps,median_ms,edges_per_s,mp_per_s,mtf50_expected,mtf50_measured,mtf50_rel_error";
+            printf "%s,%.3f,%d,%.1f,%.1f,%.3f,%.5f,%.5f,%.5f\n", name, mp, '"$REPS"', t*1000, edges/t, mp/t, expected, measured, rel;
+        } else {
+            printf "%s    {\"benchmark\": \"%s\", \"megapixels\": %.3f, \"reps\": %d, \"median_ms\": %.1f, \"edges_per_s\": %.1f, \"mp_per_s\": %.3f, \"mtf50_expected\": %.5f, \"mtf50_measured\": %.5f, \"mtf50_rel_error\": %.5f}", first ? "" : ",\n", name, mp, '"$REPS"', t*1000, edges/t, mp/t, expected, measured, rel;
+        }
+        exit (rel > tol || rel < -tol) ? 2 : 0;
+    }'
+    local status=$?
+    FIRST=0
+    return $status
+}
+
+run_case() { # name
+    local name=$1
+    local out="$WORK/out_$name"
+    mkdir -p "$out"
+    local times=""
+    for rep in $(seq 1 $REPS); do
+        local start=$(date +%s.%N)
+        "$BIN/mtf_mapper" "$WORK/$name.png" "$out" -q -l > "$out/log.txt" 2>&1
+        local end=$(date +%s.%N)
+        times="$times $(echo "$start $end" | awk '{ printf "%.6f", $2 - $1 }')"
+    done
+    local median=$(echo $times | tr ' ' '\n' | sort -g | awk '{ t[NR] = $1 } END { print ((NR % 2) ? t[(NR+1)/2] : 0.5*(t[NR/2] + t[NR/2+1])) }')
+    local stats=$(awk '!/^#/ && NF >= 4 { n++; s += $4 } END { printf "%d %.6f", n, (n > 0 ? s/n : 0) }' "$out/edge_mtf_values.txt")
+    set -- $(image_info $name)
+    local w=$1 h=$2 expected=$3
+    set -- $stats
+    emit $name $w $h $median $1 $expected $2
+}
+
+[ "$FORMAT" = "json" ] && echo "{\"benchmarks\": ["
+
+STATUS=0
+for d in $SIZES; do
+    generate "rectangle_$d" -d $d -a 5 -m 0.3
+    run_case "rectangle_$d" || STATUS=2
+done
+
+for n in $GRIDS; do
+    if [ ! -f "$WORK/grid_$n.txt" ]; then
+        write_grid $n "$WORK/grid_${n}_poly.txt"
+    fi
+    generate "grid_$n" -p gaussian-sampled --target-poly "$WORK/grid_${n}_poly.txt" -m 0.3
+    run_case "grid_$n" || STATUS=2
+done
+
+[ "$FORMAT" = "json" ] && echo -e "\n]}"
+
+if [ $STATUS -ne 0 ]; then
+    echo "MTF50 accuracy check failed (tolerance $TOLERANCE)" >&2
+fi
+exit $STATUS
@@ -0,0 +1,529 @@
+/*
+Copyright 2011 Frans van den Bergh. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Frans van den Bergh ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Frans van den Bergh OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of the Council for Scientific and Industrial Research (CSIR).
+*/
+
+// Micro- and macro-benchmarks of the MTF Mapper processing kernels on deterministic
+// synthetic charts. Results are written as JSON or CSV; the MTF50 values measured
+// on the synthetic charts are compared to the analytical MTF50 of the chart, so that
+// a change which alters the results is flagged (non-zero exit code) rather than
+// being reported as a speedup.
+
+#include "include/logger.h"
+Logger logger;
+
+#include "include/common_types.h"
+#include "include/thresholding.h"
+#include "include/gradient.h"
+#include "include/component_labelling.h"
+#include "include/mtf_core.h"
+#include "include/mtf_core_tbb_adaptor.h"
+#include "include/esf_sampler_line.h"
+#include "include/esf_sampler_quad.h"
+#include "include/esf_sampler_piecewise_quad.h"
+#include "include/esf_model_kernel.h"
+#include "include/esf_model_loess.h"
+#include "include/afft.h"
+#include "include/undistort_rectilinear.h"
+#include "include/stride_range.h"
+#include "include/threadpool.h"
+
+#include "tclap/CmdLine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <random>
+#include <sstream>
+
+class Bench_result {
+  public:
+    string name;
+    double megapixels = 0;    // image size, zero for kernels that do not process whole images
+    int reps = 0;
+    double median_ms = 0;
+    double mean_ms = 0;
+    double edges = 0;         // edges processed per repetition
+    double pixels = 0;        // pixels processed per repetition
+    double expected_mtf50 = std::numeric_limits<double>::quiet_NaN();
+    double measured_mtf50 = std::numeric_limits<double>::quiet_NaN();
+    double mtf50_rel_error = std::numeric_limits<double>::quiet_NaN();
+    
+    double edges_per_s(void) const {
+        return median_ms > 0 ? edges / (median_ms * 1e-3) : 0;
+    }
+    
+    double mp_per_s(void) const {
+        return median_ms > 0 ? pixels * 1e-6 / (median_ms * 1e-3) : 0;
+    }
+};
+
+// Calls setup() and then times body(), repeating until both min_reps and min_time have been reached.
+// Only body() is timed; the median is reported since it is less sensitive to scheduling noise.
+static void time_it(Bench_result& r, double min_time, int min_reps, 
+    const std::function<void(void)>& setup, const std::function<void(void)>& body) {
+    
+    typedef std::chrono::steady_clock clock;
+    vector<double> times;
+    double total = 0;
+    while (int(times.size()) < min_reps || total < min_time) {
+        setup();
+        auto start = clock::now();
+        body();
+        double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        times.push_back(elapsed);
+        total += elapsed;
+    }
+    sort(times.begin(), times.end());
+    size_t n = times.size();
+    r.reps = int(n);
+    r.median_ms = 1e3 * ((n % 2) ? times[n/2] : 0.5*(times[n/2 - 1] + times[n/2]));
+    r.mean_ms = 1e3 * total / n;
+}
+
+static void time_it(Bench_result& r, double min_time, int min_reps, const std::function<void(void)>& body) {
+    time_it(r, min_time, min_reps, [] {}, body);
+}
+
+// Renders a regular grid of dark squares, rotated by a few degrees, on a light background.
+// Edges are blurred by a Gaussian PSF and integrated over a square photosite with 4x4
+// supersampling, so that the expected system MTF is known analytically (see chart_mtf50()).
+// A fixed seed is used for the additive noise, so the image is identical between runs.
+class Synthetic_chart {
+  public:
+    Synthetic_chart(int width, int height, double sigma, double noise_sd=0.004, unsigned seed=10) 
+    : sigma(sigma) {
+        
+        const double dark = 0.2 * 65535;
+        const double bright = 0.8 * 65535;
+        const double half_side = 0.25 * pitch;
+        const double theta = 5.0 / 180.0 * M_PI;
+        const double ct = cos(theta);
+        const double st = sin(theta);
+        const double blur_extent = 5*sigma + 1;
+        
+        int cols = width / int(pitch);
+        int rows = height / int(pitch);
+        squares = size_t(std::max(0, cols - 1) * std::max(0, rows - 1)); // the outer row and column are left blank
+        
+        std::mt19937 mt(seed);
+        std::normal_distribution<double> noise(0.0, noise_sd * 65535);
+        
+        img = cv::Mat(height, width, CV_16UC1);
+        for (int y=0; y < height; y++) {
+            uint16_t* row = img.ptr<uint16_t>(y);
+            for (int x=0; x < width; x++) {
+                double sum = 0;
+                int sx = std::max(1, std::min(cols - 1, int(floor(x / pitch + 0.5))));
+                int sy = std::max(1, std::min(rows - 1, int(floor(y / pitch + 0.5))));
+                bool inside_grid = cols > 1 && rows > 1;
+                
+                double d_centre = inside_grid ? square_distance(x - sx*pitch, y - sy*pitch, ct, st, half_side) : 1e6;
+                if (fabs(d_centre) > blur_extent) {
+                    sum = d_centre < 0 ? dark : bright;
+                } else {
+                    for (int j=0; j < 4; j++) {
+                        for (int i=0; i < 4; i++) {
+                            double px = x + (i + 0.5)/4.0 - 0.5;
+                            double py = y + (j + 0.5)/4.0 - 0.5;
+                            double d = square_distance(px - sx*pitch, py - sy*pitch, ct, st, half_side);
+                            sum += bright - (bright - dark) * 0.5 * erfc(d / (M_SQRT2 * sigma));
+                        }
+                    }
+                    sum /= 16.0;
+                }
+                row[x] = cv::saturate_cast<uint16_t>(sum + noise(mt));
+            }
+        }
+    }
+    
+    // Gaussian PSF MTF times the MTF of the 4x4 point supersampling of the photosite
+    double chart_mtf(double f) const {
+        double box = f == 0 ? 1.0 : fabs(sin(M_PI*f) / (4*sin(M_PI*f/4)));
+        return exp(-2*M_PI*M_PI*sigma*sigma*f*f) * box;
+    }
+    
+    double chart_mtf50(void) const {
+        double lower = 0;
+        double upper = 0.5;
+        for (int i=0; i < 60; i++) {
+            double mid = 0.5*(lower + upper);
+            if (chart_mtf(mid) > 0.5) {
+                lower = mid;
+            } else {
+                upper = mid;
+            }
+        }
+        return 0.5*(lower + upper);
+    }
+    
+    cv::Mat img;
+    size_t squares = 0;
+    
+  private:
+    // approximate signed distance to the boundary of a rotated square (negative inside)
+    static double square_distance(double dx, double dy, double ct, double st, double half_side) {
+        double u = dx*ct + dy*st;
+        double v = -dx*st + dy*ct;
+        return std::max(fabs(u), fabs(v)) - half_side;
+    }
+    
+    static constexpr double pitch = 200;
+    double sigma;
+};
+
+// the same processing sequence as mtf_mapper, minus the image decoding and outputs
+class Detection {
+  public:
+    Detection(const cv::Mat& img, bool retain_geometry=false) {
+        int brad_S = std::max(500, int(std::min(img.cols, img.rows)*0.33333));
+        cv::Mat masked;
+        sauvola_adaptive_threshold(img, masked, 0.85, brad_S);
+        gradient = std::unique_ptr<Gradient>(new Gradient(img));
+        Component_labeller::zap_borders(masked);
+        cl = std::unique_ptr<Component_labeller>(new Component_labeller(masked, 60, false, max_boundary_length(img)));
+        
+        core = std::unique_ptr<Mtf_core>(new Mtf_core(*cl, *gradient, img, img, "none", "rggb", "piecewise-quadratic"));
+        core->set_retain_edge_geometry(retain_geometry);
+        Mtf_core_tbb_adaptor adaptor(core.get());
+        Stride_range::parallel_for(adaptor, ThreadPool::instance(), core->num_objects());
+    }
+    
+    static int max_boundary_length(const cv::Mat& img) {
+        const int64_t boundary_long_side = 2*std::max(img.rows, img.cols)*0.4;
+        const int64_t boundary_short_side = 2*std::min(img.rows, img.cols)*0.4;
+        return int(std::max(int64_t(8000), boundary_long_side + boundary_short_side));
+    }
+    
+    size_t valid_edges(void) {
+        size_t n = 0;
+        for (const Block& b: core->get_blocks()) {
+            for (size_t k=0; k < 4; k++) {
+                n += b.get_edge_valid(k) ? 1 : 0;
+            }
+        }
+        return n;
+    }
+    
+    double mean_mtf50(void) {
+        double sum = 0;
+        size_t n = 0;
+        for (const Block& b: core->get_blocks()) {
+            for (size_t k=0; k < 4; k++) {
+                if (b.get_edge_valid(k)) {
+                    sum += b.get_mtf50_value(k);
+                    n++;
+                }
+            }
+        }
+        return n > 0 ? sum / n : 0;
+    }
+    
+    std::unique_ptr<Gradient> gradient;
+    std::unique_ptr<Component_labeller> cl;
+    std::unique_ptr<Mtf_core> core;
+};
+
+static void write_number(FILE* fout, double v, const char* missing) {
+    if (std::isnan(v)) {
+        fprintf(fout, "%s", missing);
+    } else {
+        fprintf(fout, "%.6lg", v);
+    }
+}
+
+static bool write_results(const string& fname, bool csv, const vector<Bench_result>& results, size_t threads) {
+    FILE* fout = fname.empty() ? stdout : fopen(fname.c_str(), "wt");
+    if (!fout) {
+        logger.error("Could not open %s for writing\n", fname.c_str());
+        return false;
+    }
+    
+    if (csv) {
+        fprintf(fout, "benchmark,megapixels,reps,median_ms,mean_ms,edges_per_s,mp_per_s,mtf50_expected,mtf50_measured,mtf50_rel_error\n");
+        for (const auto& r: results) {
+            fprintf(fout, "%s,%.3lf,%d,%.4lf,%.4lf,%.1lf,%.3lf,", r.name.c_str(), r.megapixels, r.reps, 
+                r.median_ms, r.mean_ms, r.edges_per_s(), r.mp_per_s()
+            );
+            write_number(fout, r.expected_mtf50, "");
+            fprintf(fout, ",");
+            write_number(fout, r.measured_mtf50, "");
+            fprintf(fout, ",");
+            write_number(fout, r.mtf50_rel_error, "");
+            fprintf(fout, "\n");
+        }
+    } else {
+        fprintf(fout, "{\n  \"threads\": %d,\n  \"benchmarks\": [\n", int(threads));
+        for (size_t i=0; i < results.size(); i++) {
+            const Bench_result& r = results[i];
+            fprintf(fout, "    {\"benchmark\": \"%s\", \"megapixels\": %.3lf, \"reps\": %d, \"median_ms\": %.4lf, "
+                "\"mean_ms\": %.4lf, \"edges_per_s\": %.1lf, \"mp_per_s\": %.3lf",
+                r.name.c_str(), r.megapixels, r.reps, r.median_ms, r.mean_ms, r.edges_per_s(), r.mp_per_s()
+            );
+            if (!std::isnan(r.expected_mtf50)) {
+                fprintf(fout, ", \"mtf50_expected\": ");
+                write_number(fout, r.expected_mtf50, "null");
+                fprintf(fout, ", \"mtf50_measured\": ");
+                write_number(fout, r.measured_mtf50, "null");
+                fprintf(fout, ", \"mtf50_rel_error\": ");
+                write_number(fout, r.mtf50_rel_error, "null");
+            }
+            fprintf(fout, "}%s\n", i + 1 < results.size() ? "," : "");
+        }
+        fprintf(fout, "  ]\n}\n");
+    }
+    
+    if (fout != stdout) {
+        fclose(fout);
+    }
+    return true;
+}
+
+static vector<double> parse_sizes(const string& s) {
+    vector<double> sizes;
+    std::stringstream ss(s);
+    string item;
+    while (std::getline(ss, item, ',')) {
+        double mp = atof(item.c_str());
+        if (mp > 0) {
+            sizes.push_back(mp);
+        }
+    }
+    return sizes;
+}
+
+int main(int argc, char** argv) {
+    
+    TCLAP::CmdLine cmd("Benchmark the MTF Mapper processing kernels on synthetic charts", ' ', "1.0");
+    TCLAP::ValueArg<string> tc_sizes("", "sizes", "Comma-separated list of chart sizes in megapixels, default 2,8,24", false, "2,8,24", "megapixels", cmd);
+    TCLAP::ValueArg<double> tc_sigma("", "sigma", "Standard deviation of the Gaussian PSF of the synthetic chart, default 0.5", false, 0.5, "pixels", cmd);
+    TCLAP::ValueArg<double> tc_min_time("", "min-time", "Minimum total time spent on each benchmark, default 1.0", false, 1.0, "seconds", cmd);
+    TCLAP::ValueArg<int> tc_min_reps("", "min-reps", "Minimum number of repetitions of each benchmark, default 3", false, 3, "count", cmd);
+    TCLAP::ValueArg<double> tc_tolerance("", "tolerance", "Maximum relative error of the mean measured MTF50, default 0.03", false, 0.03, "fraction", cmd);
+    TCLAP::ValueArg<string> tc_output("o", "output", "Output file name (default is standard out)", false, "", "filename", cmd);
+    TCLAP::SwitchArg tc_csv("", "csv", "Write CSV instead of JSON", cmd, false);
+    TCLAP::SwitchArg tc_no_kernels("", "no-kernels", "Only run the whole-image benchmarks, skipping the per-edge kernels", cmd, false);
+    cmd.parse(argc, argv);
+    
+    vector<double> sizes = parse_sizes(tc_sizes.getValue());
+    if (sizes.empty()) {
+        logger.error("%s\n", "Fatal error: no valid chart sizes specified");
+        return 1;
+    }
+    
+    const double min_time = tc_min_time.getValue();
+    const int min_reps = std::max(1, tc_min_reps.getValue());
+    
+    vector<Bench_result> results;
+    bool accuracy_ok = true;
+    
+    for (double mp: sizes) {
+        // 3:2 aspect ratio, as with most camera sensors
+        int width = int(sqrt(mp * 1e6 * 1.5)) & ~7;
+        int height = int(width / 1.5) & ~7;
+        double pixels = double(width) * height;
+        double image_mp = pixels * 1e-6;
+        
+        logger.info("Rendering %dx%d synthetic chart ...\n", width, height);
+        Synthetic_chart chart(width, height, tc_sigma.getValue());
+        const cv::Mat& img = chart.img;
+        
+        auto make_result = [&](const string& name) {
+            Bench_result r;
+            r.name = name;
+            r.megapixels = image_mp;
+            r.pixels = pixels;
+            return r;
+        };
+        
+        int brad_S = std::max(500, int(std::min(img.cols, img.rows)*0.33333));
+        cv::Mat masked;
+        {
+            Bench_result r = make_result("sauvola_adaptive_threshold");
+            time_it(r, min_time, min_reps, [&] {
+                sauvola_adaptive_threshold(img, masked, 0.85, brad_S);
+            });
+            results.push_back(r);
+        }
+        
+        {
+            Bench_result r = make_result("gradient");
+            time_it(r, min_time, min_reps, [&] {
+                Gradient gradient(img);
+            });
+            results.push_back(r);
+        }
+        
+        {
+            Bench_result r = make_result("component_labeller");
+            Component_labeller::zap_borders(masked);
+            cv::Mat work;
+            time_it(r, min_time, min_reps, 
+                [&] { work = masked.clone(); }, 
+                [&] { Component_labeller cl(work, 60, false, Detection::max_boundary_length(img)); }
+            );
+            results.push_back(r);
+        }
+        
+        {
+            Bench_result r = make_result("undistort_rectilinear_unmap");
+            Undistort_rectilinear undistort(cv::Rect(0, 0, img.cols, img.rows), vector<double>{-0.05, 0.01});
+            cv::Mat raw;
+            time_it(r, min_time, min_reps,
+                [&] { raw = img.clone(); },
+                [&] { cv::Mat unmapped = undistort.unmap(img, raw); }
+            );
+            results.push_back(r);
+        }
+        
+        // end-to-end detection and measurement, which is also the accuracy check
+        {
+            Bench_result r = make_result("detection");
+            std::unique_ptr<Detection> detection;
+            time_it(r, min_time, min_reps, 
+                [&] { detection.reset(); },
+                [&] { detection = std::unique_ptr<Detection>(new Detection(img)); }
+            );
+            r.edges = double(detection->valid_edges());
+            r.expected_mtf50 = chart.chart_mtf50();
+            r.measured_mtf50 = detection->mean_mtf50();
+            r.mtf50_rel_error = (r.measured_mtf50 - r.expected_mtf50) / r.expected_mtf50;
+            
+            // every edge of every square should have been measured
+            bool edges_ok = r.edges >= 4*chart.squares;
+            bool mtf_ok = fabs(r.mtf50_rel_error) <= tc_tolerance.getValue();
+            if (!edges_ok || !mtf_ok) {
+                logger.error("Accuracy check failed at %.1lf MP: %d of %d edges, mean MTF50 %.5lf, expected %.5lf\n",
+                    image_mp, int(r.edges), int(4*chart.squares), r.measured_mtf50, r.expected_mtf50
+                );
+                accuracy_ok = false;
+            }
+            results.push_back(r);
+        }
+        
+        if (tc_no_kernels.getValue()) {
+            continue;
+        }
+        
+        // per-edge kernels, using the edges (scansets and edge models) found by a detection pass
+        Detection detection(img, true);
+        vector<Edge_model*> models;
+        vector<map<int, scanline>> scansets;
+        for (Block& b: detection.core->get_blocks()) {
+            for (size_t k=0; k < 4; k++) {
+                if (b.get_edge_valid(k)) { // edge models are retained for valid edges
+                    models.push_back(&b.get_edge_model(k));
+                    scansets.push_back(b.get_scanset(k));
+                }
+            }
+        }
+        double n_edges = double(models.size());
+        
+        vector<std::pair<string, std::shared_ptr<Esf_sampler>>> samplers = {
+            {"esf_sampler_line", std::make_shared<Esf_sampler_line>(max_dot)},
+            {"esf_sampler_quad", std::make_shared<Esf_sampler_quad>(max_dot)},
+            {"esf_sampler_piecewise_quad", std::make_shared<Esf_sampler_piecewise_quad>(max_dot)}
+        };
+        vector<vector<Ordered_point>> ordered(models.size());
+        for (auto& s: samplers) {
+            Bench_result r = make_result(s.first);
+            r.pixels = 0;
+            r.edges = n_edges;
+            time_it(r, min_time, min_reps,
+                [&] {
+                    for (auto& o: ordered) {
+                        o.clear();
+                    }
+                },
+                [&] {
+                    for (size_t i=0; i < models.size(); i++) {
+                        double edge_length = 0;
+                        s.second->sample(*models[i], ordered[i], scansets[i], edge_length, img, img);
+                    }
+                }
+            );
+            results.push_back(r);
+        }
+        // the ESF models below are fed with the samples of the last (default) sampler
+        for (auto& o: ordered) {
+            sort(o.begin(), o.end());
+        }
+        
+        vector<std::pair<string, std::shared_ptr<Esf_model>>> esf_models = {
+            {"esf_model_kernel", std::make_shared<Esf_model_kernel>()},
+            {"esf_model_loess", std::make_shared<Esf_model_loess>()}
+        };
+        for (auto& m: esf_models) {
+            Bench_result r = make_result(m.first);
+            r.pixels = 0;
+            r.edges = n_edges;
+            vector<vector<Ordered_point>> work;
+            vector<double> sampled(FFT_SIZE*2);
+            vector<double> esf(FFT_SIZE);
+            time_it(r, min_time, min_reps,
+                [&] { work = ordered; },
+                [&] {
+                    for (auto& o: work) {
+                        Snr snr;
+                        m.second->build_esf(o, sampled.data(), FFT_SIZE, max_dot, esf, snr);
+                    }
+                }
+            );
+            results.push_back(r);
+        }
+    }
+    
+    if (!tc_no_kernels.getValue()) {
+        // one "edge" per transform, to make the throughput comparable to the other kernels
+        const int n_transforms = 10000;
+        Bench_result r;
+        r.name = "afft_realfft";
+        r.edges = n_transforms;
+        AFFT<FFT_SIZE> afft;
+        vector<double> source(FFT_SIZE);
+        std::mt19937 mt(10);
+        std::uniform_real_distribution<double> u(0.0, 1.0);
+        for (auto& v: source) {
+            v = u(mt);
+        }
+        vector<double> buffer(FFT_SIZE);
+        time_it(r, min_time, min_reps, [&] {
+            for (int i=0; i < n_transforms; i++) {
+                std::copy(source.begin(), source.end(), buffer.begin());
+                afft.realfft(buffer.data());
+            }
+        });
+        results.push_back(r);
+    }
+    
+    if (!write_results(tc_output.getValue(), tc_csv.getValue(), results, ThreadPool::instance().size())) {
+        return 1;
+    }
+    
+    return accuracy_ok ? 0 : 2;
+}
@@ -0,0 +1,234 @@
+#!/bin/bash
+#
+# Accuracy regression harness. Renders the synthetic edges listed in images.txt with
+# mtf_generate_rectangle (fixed seed), runs mtf_mapper on each of them with every
+# configuration in configs.txt (ESF samplers, ESF models, Bayer subsets), and compares
+# the per-edge MTF50 values and SFR curves against the golden results in <golden dir>.
+# A configuration whose arguments start with @<config> is compared against the golden
+# results of the (earlier) configuration <config>, and has no golden results of its own.
+# The run time of every mtf_mapper invocation is recorded alongside the results.
+#
+# usage: regression.sh [--update] [--reference <dir>] <directory with mtf_mapper binaries> <work directory> <golden dir>
+#
+#   --update      (re)write the golden results from this build, instead of comparing
+#   --reference   directory with a reference mtf_mapper binary; wherever <golden dir> has no
+#                 result, the result of the reference binary (cached in the work directory)
+#                 is used as the golden result, and its run time as the golden run time
+#
+# Tolerances can be overridden with the environment variables
+#   REGRESSION_MTF50_TOL  maximum relative MTF50 difference per edge (default 0.005)
+#   REGRESSION_SFR_TOL    maximum absolute SFR difference per edge, up to Nyquist (default 0.01)
+#
+# Exit status: 0 if all comparisons passed, 1 on any failure, 77 if no golden results exist.
+
+UPDATE=0
+REFERENCE=
+while [ $# -gt 3 ]; do
+    case "$1" in
+        --update) UPDATE=1; shift ;;
+        --reference) REFERENCE=$2; shift 2 ;;
+        *) break ;;
+    esac
+done
+
+if [ $# -ne 3 ]; then
+    echo "usage: $0 [--update] [--reference <reference bin dir>] <bin dir> <work dir> <golden dir>"
+    exit 1
+fi
+
+BIN=$1
+WORK=$2
+GOLDEN=$3
+HERE=$(cd "$(dirname "$0")" && pwd)
+MTF50_TOL=${REGRESSION_MTF50_TOL:-0.005}
+SFR_TOL=${REGRESSION_SFR_TOL:-0.01}
+SEED=42
+DIMENSION=400
+
+mkdir -p "$WORK/images" "$WORK/out" "$WORK/reference" "$GOLDEN" || exit 1
+
+RESULTS="$WORK/regression_results.csv"
+echo "image,config,edges,known_mtf50,mean_mtf50,known_rel_error,max_mtf50_rel_diff,max_sfr_abs_diff,seconds,golden_seconds,status" > "$RESULTS"
+
+if [ $UPDATE -eq 1 ]; then
+    :> "$GOLDEN/timing.txt"
+fi
+
+# renders an image, unless it already exists with the same arguments
+generate() { # name args...
+    local name=$1
+    shift
+    local args="$* -d $DIMENSION -s $SEED -l --b16"
+    if [ ! -f "$WORK/images/$name.png" ] || [ "$(cat "$WORK/images/$name.args" 2>/dev/null)" != "$args" ]; then
+        "$BIN/mtf_generate_rectangle" $args -o "$WORK/images/$name.png" > "$WORK/images/$name.txt" < /dev/null || return 1
+        echo "$args" > "$WORK/images/$name.args"
+    fi
+}
+
+# runs mtf_mapper on an image, and prints the run time in seconds
+run_mtf_mapper() { # bin dir, image, output dir, args...
+    local bin=$1 image=$2 out=$3
+    shift 3
+    rm -rf "$out"
+    mkdir -p "$out"
+    local start=$(date +%s.%N)
+    "$bin/mtf_mapper" "$image" "$out" -q -l -v 2 "$@" > "$out/log.txt" 2>&1 < /dev/null
+    local end=$(date +%s.%N)
+    echo "$start $end" | awk '{ printf "%.3f", $2 - $1 }'
+}
+
+# writes one row per edge: centroid x, centroid y, MTF50, SFR values
+extract_edges() { # output dir
+    awk '
+        FNR == 1 { file++ }
+        /^#/ { next }
+        file == 1 { n1++; x[n1] = $2; y[n1] = $3; m[n1] = $4 }
+        file == 2 { 
+            n2++; 
+            line = x[n2] " " y[n2] " " m[n2];
+            for (i=14; i <= NF; i++) line = line " " $i;
+            print line;
+        }
+    ' "$1/edge_mtf_values.txt" "$1/edge_sfr_values.txt"
+}
+
+# prints "edges max_mtf50_rel_diff max_sfr_abs_diff missing extra", matching edges by centroid
+compare_edges() { # golden current
+    awk -v mtol=$MTF50_TOL -v stol=$SFR_TOL '
+        FNR == 1 { file++ }
+        file == 1 { ng++; gx[ng] = $1; gy[ng] = $2; gline[ng] = $0 }
+        file == 2 { nc++; cx[nc] = $1; cy[nc] = $2; cline[nc] = $0 }
+        END {
+            maxm = 0; maxs = 0; missing = 0;
+            for (i=1; i <= ng; i++) {
+                best = 0; bestd = 1.0;
+                for (j=1; j <= nc; j++) {
+                    d = sqrt((gx[i] - cx[j])^2 + (gy[i] - cy[j])^2);
+                    if (!used[j] && d < bestd) { best = j; bestd = d; }
+                }
+                if (best == 0) { missing++; continue; }
+                used[best] = 1;
+                ngf = split(gline[i], g, " ");
+                ncf = split(cline[best], c, " ");
+                dm = g[3] != 0 ? (c[3] - g[3]) / g[3] : c[3] - g[3];
+                if (dm < 0) dm = -dm;
+                if (dm > maxm) maxm = dm;
+                # SFR columns start at field 4, and the first half of the curve covers 0 to Nyquist
+                last = 3 + int((ngf - 3) / 2);
+                if (ncf != ngf) { maxs = 1e9; continue; }
+                for (k=4; k <= last; k++) {
+                    ds = c[k] - g[k];
+                    if (ds < 0) ds = -ds;
+                    if (ds > maxs) maxs = ds;
+                }
+            }
+            extra = nc - (ng - missing);
+            printf "%d %.6f %.6f %d %d\n", nc, maxm, maxs, missing, extra;
+        }
+    ' "$1" "$2"
+}
+
+FAILURES=0
+COMPARED=0
+while read -r image image_args; do
+    case "$image" in ''|\#*) continue ;; esac
+    
+    if ! generate $image $image_args; then
+        echo "FAIL $image: could not generate image"
+        FAILURES=$((FAILURES + 1))
+        continue
+    fi
+    known=$(awk '$1 ~ /MTF50/ { m = $3 } END { print m + 0 }' "$WORK/images/$image.txt")
+    
+    while read -r config config_args; do
+        case "$config" in ''|\#*) continue ;; esac
+        
+        id="${image}__${config}"
+        golden_id=$id
+        case "$config_args" in
+            @*)
+                base=${config_args%% *}
+                golden_id="${image}__${base#@}"
+                config_args=${config_args#"$base"}
+                ;;
+        esac
+        out="$WORK/out/$id"
+        seconds=$(run_mtf_mapper "$BIN" "$WORK/images/$image.png" "$out" $config_args)
+        
+        if [ ! -f "$out/edge_mtf_values.txt" ] || [ ! -f "$out/edge_sfr_values.txt" ]; then
+            echo "FAIL $id: mtf_mapper produced no edge outputs (see $out/log.txt)"
+            echo "$image,$config,0,$known,,,,,$seconds,,fail" >> "$RESULTS"
+            FAILURES=$((FAILURES + 1))
+            continue
+        fi
+        extract_edges "$out" > "$out/edges.txt"
+        
+        set -- $(awk -v known=$known '{ n++; s += $3 } END { 
+            mean = n > 0 ? s/n : 0; 
+            printf "%d %.6f %.6f\n", n, mean, (known > 0 ? (mean - known)/known : 0) 
+        }' "$out/edges.txt")
+        edges=$1 mean=$2 known_err=$3
+        
+        if [ $UPDATE -eq 1 ] && [ "$golden_id" != "$id" ]; then
+            echo "$image,$config,$edges,$known,$mean,$known_err,,,$seconds,,shares golden" >> "$RESULTS"
+            continue
+        fi
+        if [ $UPDATE -eq 1 ]; then
+            cp "$out/edges.txt" "$GOLDEN/$id.txt"
+            echo "$id $seconds" >> "$GOLDEN/timing.txt"
+            echo "$image,$config,$edges,$known,$mean,$known_err,,,$seconds,,updated" >> "$RESULTS"
+            continue
+        fi
+        
+        golden="$GOLDEN/$golden_id.txt"
+        golden_seconds=$(awk -v id=$golden_id '$1 == id { print $2 }' "$GOLDEN/timing.txt" 2>/dev/null)
+        if [ ! -f "$golden" ] && [ -n "$REFERENCE" ]; then
+            golden="$WORK/reference/$golden_id.txt"
+            # the cached reference result is reused while it is newer than both the image and the reference binary
+            # (configurations that share the golden results of another one use its cached result)
+            if [ "$golden_id" = "$id" ] && { [ ! -f "$golden" ] || [ "$WORK/images/$image.png" -nt "$golden" ] || [ "$REFERENCE/mtf_mapper" -nt "$golden" ]; }; then
+                rm -f "$golden"
+                ref_out="$WORK/reference/$golden_id"
+                ref_seconds=$(run_mtf_mapper "$REFERENCE" "$WORK/images/$image.png" "$ref_out" $config_args)
+                if [ -f "$ref_out/edge_mtf_values.txt" ] && [ -f "$ref_out/edge_sfr_values.txt" ]; then
+                    extract_edges "$ref_out" > "$golden"
+                    echo "$ref_seconds" > "$WORK/reference/$golden_id.seconds"
+                else
+                    echo "FAIL $id: the reference mtf_mapper produced no edge outputs (see $ref_out/log.txt)"
+                    echo "$image,$config,$edges,$known,$mean,$known_err,,,$seconds,,fail" >> "$RESULTS"
+                    FAILURES=$((FAILURES + 1))
+                    continue
+                fi
+            fi
+            golden_seconds=$(cat "$WORK/reference/$golden_id.seconds" 2>/dev/null)
+        fi
+        if [ ! -f "$golden" ]; then
+            echo "SKIP $id: no golden result"
+            echo "$image,$config,$edges,$known,$mean,$known_err,,,$seconds,$golden_seconds,no golden" >> "$RESULTS"
+            continue
+        fi
+        
+        COMPARED=$((COMPARED + 1))
+        set -- $(compare_edges "$golden" "$out/edges.txt")
+        max_dm=$2 max_ds=$3 missing=$4 extra=$5
+        status=$(awk -v dm=$max_dm -v ds=$max_ds -v mtol=$MTF50_TOL -v stol=$SFR_TOL -v missing=$missing -v extra=$extra \
+            'BEGIN { print (dm <= mtol && ds <= stol && missing == 0 && extra == 0) ? "pass" : "fail" }')
+        if [ "$status" != "pass" ]; then
+            echo "FAIL $id: max MTF50 difference $max_dm, max SFR difference $max_ds, $missing missing and $extra extra edges"
+            FAILURES=$((FAILURES + 1))
+        fi
+        echo "$image,$config,$edges,$known,$mean,$known_err,$max_dm,$max_ds,$seconds,$golden_seconds,$status" >> "$RESULTS"
+    done < "$HERE/configs.txt"
+done < "$HERE/images.txt"
+
+echo "Results written to $RESULTS"
+if [ $UPDATE -eq 1 ]; then
+    echo "Golden results written to $GOLDEN"
+    exit 0
+fi
+if [ $COMPARED -eq 0 ] && [ $FAILURES -eq 0 ]; then
+    echo "No golden results found in $GOLDEN; run with --update on a reference build first, or use --reference"
+    exit 77
+fi
+echo "$COMPARED comparisons, $FAILURES failures"
+[ $FAILURES -eq 0 ]